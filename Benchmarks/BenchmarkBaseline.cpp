@@ -0,0 +1,442 @@
+// ----------------------------------------------------------------------------
+// BenchmarkBaseline.cpp
+// Stores EndPointBenchmarks results in a JSON file, keyed by git revision and
+// machine, and compares a new run against a stored baseline. Timings are
+// compared with a one-sided Mann-Whitney U test over the samples of each
+// benchmark, so a difference only counts when it is both larger than the
+// threshold and unlikely to be noise; allocation counts do not vary between
+// runs and are compared directly. The exit code is 1 if anything regressed,
+// and 2 if the comparison could not be made, including when a benchmark has
+// too few samples for any difference to reach --alpha.
+//
+// Usage: EndPointBenchmarks --samples 10 | BenchmarkBaseline record store.json
+//        EndPointBenchmarks --samples 10 | BenchmarkBaseline compare store.json
+//        BenchmarkBaseline list store.json
+// Options: [--revision R] [--machine M] [--baseline R] [--threshold percent]
+//          [--alpha p]
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#define BASELINE_NULL_DEVICE "NUL"
+#else
+#include <unistd.h>
+#define BASELINE_NULL_DEVICE "/dev/null"
+#endif
+#include "../include/json.hpp"
+#include "MannWhitney.h"
+
+using nlohmann::json;
+
+#define BASELINE_DEFAULT_THRESHOLD 5.0
+#define BASELINE_DEFAULT_ALPHA 0.05
+
+// Allocation counts are averages over whole samples; differences below this are rounding
+#define BASELINE_ALLOCATION_SLACK 0.5
+
+typedef struct TBaselineOptions
+{
+    const char* command;
+    const char* storePath;
+    std::string revision;
+    std::string machine;
+    std::string baseline;
+    double threshold;   // Percent
+    double alpha;
+} TBaselineOptions;
+
+typedef struct TBenchmarkSamples
+{
+    std::vector<double> iterations;
+    std::vector<double> nsPerOp;
+    std::vector<double> allocsPerOp;
+    std::vector<double> bytesPerOp;
+} TBenchmarkSamples;
+
+typedef std::map<std::string, TBenchmarkSamples> BenchmarkResults;
+
+// The first line a command prints, trailing newline removed; empty if it could not be run
+static std::string readCommand(const char* command)
+{
+    std::string result;
+    FILE* pipe = popen(command, "r");
+    if (pipe == NULL)
+    {
+        return result;
+    }
+
+    char buffer[256];
+    if (fgets(buffer, sizeof(buffer), pipe) != NULL)
+    {
+        result = buffer;
+        while (!result.empty() && (result.back() == '\n' || result.back() == '\r'))
+        {
+            result.pop_back();
+        }
+    }
+    pclose(pipe);
+    return result;
+}
+
+static std::string currentRevision()
+{
+    std::string revision = readCommand("git describe --always --dirty 2>" BASELINE_NULL_DEVICE);
+    return revision.empty() ? "unknown" : revision;
+}
+
+static std::string currentMachine()
+{
+#ifdef _WIN32
+    const char* name = getenv("COMPUTERNAME");
+    return name != NULL ? name : "unknown";
+#else
+    char name[256];
+    if (gethostname(name, sizeof(name)) != 0)
+    {
+        return "unknown";
+    }
+    name[sizeof(name) - 1] = '\0';
+    return name;
+#endif
+}
+
+// Collect the sample lines EndPointBenchmarks prints; anything else on the input is ignored
+static BenchmarkResults readResults(FILE* input)
+{
+    BenchmarkResults results;
+    char line[512];
+    while (fgets(line, sizeof(line), input) != NULL)
+    {
+        char name[256];
+        unsigned long long iterations;
+        double nsPerOp, allocsPerOp, bytesPerOp;
+        if (sscanf(line, "%255s %llu %lf ns/op %lf allocs/op %lf B/op", name, &iterations, &nsPerOp, &allocsPerOp,
+                &bytesPerOp) == 5)
+        {
+            TBenchmarkSamples& samples = results[name];
+            samples.iterations.push_back((double)iterations);
+            samples.nsPerOp.push_back(nsPerOp);
+            samples.allocsPerOp.push_back(allocsPerOp);
+            samples.bytesPerOp.push_back(bytesPerOp);
+        }
+    }
+    return results;
+}
+
+static json resultsToJson(const BenchmarkResults& results)
+{
+    json benchmarks = json::object();
+    for (const auto& result : results)
+    {
+        benchmarks[result.first] = {
+            { "iterations", result.second.iterations },
+            { "nsPerOp", result.second.nsPerOp },
+            { "allocsPerOp", result.second.allocsPerOp },
+            { "bytesPerOp", result.second.bytesPerOp }
+        };
+    }
+    return benchmarks;
+}
+
+static BenchmarkResults resultsFromJson(const json& benchmarks)
+{
+    BenchmarkResults results;
+    for (auto it = benchmarks.begin(); it != benchmarks.end(); ++it)
+    {
+        TBenchmarkSamples& samples = results[it.key()];
+        samples.iterations = it.value().at("iterations").get<std::vector<double>>();
+        samples.nsPerOp = it.value().at("nsPerOp").get<std::vector<double>>();
+        samples.allocsPerOp = it.value().at("allocsPerOp").get<std::vector<double>>();
+        samples.bytesPerOp = it.value().at("bytesPerOp").get<std::vector<double>>();
+    }
+    return results;
+}
+
+static std::string runKey(const std::string& revision, const std::string& machine)
+{
+    return revision + "@" + machine;
+}
+
+// A missing store is an empty one
+static json loadStore(const char* path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        return { { "runs", json::object() } };
+    }
+    json store = json::parse(file);
+    if (!store.contains("runs"))
+    {
+        store["runs"] = json::object();
+    }
+    return store;
+}
+
+static bool saveStore(const char* path, const json& store)
+{
+    std::ofstream file(path);
+    file << store.dump(2) << "\n";
+    return (bool)file;
+}
+
+static double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 != 0 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+static double mean(const std::vector<double>& values)
+{
+    double sum = 0;
+    for (double value : values)
+    {
+        sum += value;
+    }
+    return sum / values.size();
+}
+
+// False, after saying why, if a benchmark has too few samples on either side for any difference to reach alpha
+static bool checkSampleCounts(const BenchmarkResults& current, const BenchmarkResults& baseline, double alpha)
+{
+    for (const auto& result : current)
+    {
+        auto base = baseline.find(result.first);
+        if (base == baseline.end())
+            continue;
+
+        size_t sampleCount = result.second.nsPerOp.size();
+        size_t baselineCount = base->second.nsPerOp.size();
+        if (mannWhitneyMinimumP(sampleCount, baselineCount) >= alpha)
+        {
+            fprintf(stderr, "%s has %u samples against %u in the baseline, which cannot reach p < %.3f; "
+                "run EndPointBenchmarks with more --samples\n", result.first.c_str(), (unsigned)sampleCount,
+                (unsigned)baselineCount, alpha);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Print the comparison table; returns the number of regressions
+static int compareResults(const BenchmarkResults& current, const BenchmarkResults& baseline,
+    const TBaselineOptions& options)
+{
+    int regressions = 0;
+    printf("%-28s %14s %14s %8s %8s %10s %10s  %s\n", "benchmark", "base ns/op", "new ns/op", "change", "p",
+        "base alloc", "new alloc", "verdict");
+    for (const auto& result : current)
+    {
+        auto base = baseline.find(result.first);
+        if (base == baseline.end())
+        {
+            printf("%-28s %14s %14.1f %8s %8s %10s %10.2f  new\n", result.first.c_str(), "-",
+                median(result.second.nsPerOp), "", "", "-", mean(result.second.allocsPerOp));
+            continue;
+        }
+
+        double baseNs = median(base->second.nsPerOp);
+        double currentNs = median(result.second.nsPerOp);
+        double change = baseNs > 0 ? (currentNs / baseNs - 1) * 100 : 0;
+        double pSlower = mannWhitneyGreater(result.second.nsPerOp, base->second.nsPerOp);
+        double pFaster = mannWhitneyGreater(base->second.nsPerOp, result.second.nsPerOp);
+        double baseAllocs = mean(base->second.allocsPerOp);
+        double currentAllocs = mean(result.second.allocsPerOp);
+
+        const char* verdict = "";
+        if (currentAllocs > baseAllocs * (1 + options.threshold / 100) + BASELINE_ALLOCATION_SLACK)
+        {
+            verdict = "REGRESSION (allocations)";
+            regressions++;
+        }
+        else if (change > options.threshold && pSlower < options.alpha)
+        {
+            verdict = "REGRESSION";
+            regressions++;
+        }
+        else if (change < -options.threshold && pFaster < options.alpha)
+        {
+            verdict = "faster";
+        }
+
+        printf("%-28s %14.1f %14.1f %+7.1f%% %8.4f %10.2f %10.2f  %s\n", result.first.c_str(), baseNs, currentNs,
+            change, change >= 0 ? pSlower : pFaster, baseAllocs, currentAllocs, verdict);
+    }
+    return regressions;
+}
+
+// The most recently recorded run on the machine, other than the current revision
+static std::string latestRun(const json& store, const TBaselineOptions& options)
+{
+    std::string latest;
+    long long latestTime = -1;
+    for (auto it = store["runs"].begin(); it != store["runs"].end(); ++it)
+    {
+        const json& run = it.value();
+        if (run.value("machine", "") == options.machine && run.value("revision", "") != options.revision &&
+            run.value("recorded", 0LL) > latestTime)
+        {
+            latest = it.key();
+            latestTime = run.value("recorded", 0LL);
+        }
+    }
+    return latest;
+}
+
+static void printUsage()
+{
+    fprintf(stderr,
+        "Usage: BenchmarkBaseline record store.json [--revision R] [--machine M]\n"
+        "       BenchmarkBaseline compare store.json [--baseline R] [--machine M] [--threshold percent] [--alpha p]\n"
+        "       BenchmarkBaseline list store.json\n"
+        "record and compare read EndPointBenchmarks output from standard input.\n");
+}
+
+static bool parseArguments(TBaselineOptions* options, int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        return false;
+    }
+    options->command = argv[1];
+    options->storePath = argv[2];
+
+    for (int i = 3; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+        if (strcmp(argv[i], "--revision") == 0)
+        {
+            options->revision = argv[++i];
+        }
+        else if (strcmp(argv[i], "--machine") == 0)
+        {
+            options->machine = argv[++i];
+        }
+        else if (strcmp(argv[i], "--baseline") == 0)
+        {
+            options->baseline = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threshold") == 0)
+        {
+            options->threshold = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--alpha") == 0)
+        {
+            options->alpha = atof(argv[++i]);
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int runBaseline(const TBaselineOptions& options)
+{
+    json store = loadStore(options.storePath);
+
+    if (strcmp(options.command, "list") == 0)
+    {
+        for (auto it = store["runs"].begin(); it != store["runs"].end(); ++it)
+        {
+            time_t recorded = (time_t)it.value().value("recorded", 0LL);
+            char date[32];
+            strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&recorded));
+            printf("%-40s %s  %u benchmarks\n", it.key().c_str(), date, (unsigned)it.value()["benchmarks"].size());
+        }
+        return 0;
+    }
+
+    BenchmarkResults current = readResults(stdin);
+    if (current.empty())
+    {
+        fprintf(stderr, "No benchmark results on standard input\n");
+        return 2;
+    }
+
+    if (strcmp(options.command, "record") == 0)
+    {
+        std::string key = runKey(options.revision, options.machine);
+        store["runs"][key] = {
+            { "revision", options.revision },
+            { "machine", options.machine },
+            { "recorded", (long long)time(NULL) },
+            { "benchmarks", resultsToJson(current) }
+        };
+        if (!saveStore(options.storePath, store))
+        {
+            fprintf(stderr, "Could not write %s\n", options.storePath);
+            return 2;
+        }
+        printf("Recorded %u benchmarks as %s\n", (unsigned)current.size(), key.c_str());
+        return 0;
+    }
+
+    if (strcmp(options.command, "compare") == 0)
+    {
+        std::string key = options.baseline.empty() ? latestRun(store, options) : runKey(options.baseline, options.machine);
+        if (key.empty() || !store["runs"].contains(key))
+        {
+            fprintf(stderr, "No baseline %s in %s\n", key.empty() ? ("for " + options.machine).c_str() : key.c_str(),
+                options.storePath);
+            return 2;
+        }
+
+        BenchmarkResults baseline = resultsFromJson(store["runs"][key]["benchmarks"]);
+        if (!checkSampleCounts(current, baseline, options.alpha))
+        {
+            return 2;
+        }
+
+        printf("Comparing with %s (threshold %.1f%%, alpha %.3f)\n", key.c_str(), options.threshold, options.alpha);
+        int regressions = compareResults(current, baseline, options);
+        if (regressions > 0)
+        {
+            printf("%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+            return 1;
+        }
+        return 0;
+    }
+
+    printUsage();
+    return 2;
+}
+
+int main(int argc, char* argv[])
+{
+    TBaselineOptions options;
+    options.threshold = BASELINE_DEFAULT_THRESHOLD;
+    options.alpha = BASELINE_DEFAULT_ALPHA;
+    if (!parseArguments(&options, argc, argv))
+    {
+        printUsage();
+        return 2;
+    }
+    options.revision = options.revision.empty() ? currentRevision() : options.revision;
+    options.machine = options.machine.empty() ? currentMachine() : options.machine;
+
+    try
+    {
+        return runBaseline(options);
+    }
+    catch (const json::exception& e)
+    {
+        fprintf(stderr, "%s: %s\n", options.storePath, e.what());
+        return 2;
+    }
+}
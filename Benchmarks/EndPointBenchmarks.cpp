@@ -0,0 +1,338 @@
+// ----------------------------------------------------------------------------
+// EndPointBenchmarks.cpp
+// Microbenchmarks for the listing, cache and switching code, run against the
+// simulated backend so they need no audio hardware and run headless. Each
+// benchmark prints one line: iterations, ns/op, allocations/op and bytes/op.
+// Allocations are read from the tool's own counters (Counters.h), so they
+// cover the C++ heap; the C runtime's own buffers are not included.
+//
+// With --exe, whole invocations of the tool are timed as well (Process/*),
+// from spawning it to its exit; their allocation counts are only the
+// benchmark's own.
+//
+// With --samples N, each benchmark is timed N times at the same iteration
+// count and prints a line per sample, for BenchmarkBaseline to compare.
+//
+// Usage: EndPointBenchmarks [--filter text] [--time ms] [--samples N] [--exe path]
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <spawn.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#endif
+#include "../EndPointController/Counters.h"
+#include "../EndPointController/EndPointController.h"
+#include "../EndPointController/Output.h"
+#include "WorkDirectory.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+#define BENCH_DEFAULT_TIME_MS 500
+
+typedef struct TBenchOptions
+{
+    const char* filter;
+    long long timeNs;
+    int samples;
+    const char* exePath;
+} TBenchOptions;
+
+static TBenchOptions options = { NULL, BENCH_DEFAULT_TIME_MS * 1000000LL, 1, NULL };
+
+// Time iterations runs of op, returning the elapsed time and the events counted meanwhile
+static long long runSample(const std::function<void()>& op, unsigned long long iterations,
+    uint64_t counts[ECounter_enum_count])
+{
+    uint64_t before[ECounter_enum_count];
+    readCounters(before);
+    BenchClock::time_point start = BenchClock::now();
+    for (unsigned long long i = 0; i < iterations; i++)
+    {
+        op();
+    }
+    long long elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start).count();
+
+    readCounters(counts);
+    for (int i = 0; i < ECounter_enum_count; i++)
+    {
+        counts[i] -= before[i];
+    }
+    return elapsedNs;
+}
+
+static void printSample(const char* name, unsigned long long iterations, long long elapsedNs,
+    const uint64_t counts[ECounter_enum_count])
+{
+    printf("%-28s %10llu %14.1f ns/op %10.2f allocs/op %12.1f B/op\n", name, iterations,
+        (double)elapsedNs / iterations, (double)counts[eCounterAllocations] / iterations,
+        (double)counts[eCounterBytesAllocated] / iterations);
+    fflush(stdout);
+}
+
+// Run op until the measurement takes at least the configured time, then print the per-operation figures, once
+// per sample
+static void measure(const char* name, const std::function<void()>& op)
+{
+    if (options.filter != NULL && strstr(name, options.filter) == NULL)
+    {
+        return;
+    }
+
+    // Warm up caches, the file system and any lazily grown buffers
+    op();
+
+    uint64_t counts[ECounter_enum_count];
+    unsigned long long iterations = 1;
+    for (;;)
+    {
+        long long elapsedNs = runSample(op, iterations, counts);
+        if (elapsedNs >= options.timeNs || iterations >= 1000000000ULL)
+        {
+            printSample(name, iterations, elapsedNs, counts);
+            break;
+        }
+
+        // Aim a little past the target, growing at most 100x per round
+        unsigned long long next = elapsedNs > 0 ? (unsigned long long)(iterations * 1.2 * options.timeNs / elapsedNs)
+                                                : iterations * 100;
+        next = next > iterations * 100 ? iterations * 100 : next;
+        iterations = next > iterations ? next : iterations + 1;
+    }
+
+    // Later samples keep the iteration count, so every sample averages over the same amount of work
+    for (int sample = 1; sample < options.samples; sample++)
+    {
+        long long elapsedNs = runSample(op, iterations, counts);
+        printSample(name, iterations, elapsedNs, counts);
+    }
+}
+
+static AudioBackend* createBackend(int renderCount)
+{
+    char spec[64];
+    snprintf(spec, sizeof(spec), "render=%d,capture=2", renderCount);
+
+    AudioBackend* pBackend = NULL;
+    if (FAILED(createSimulatedBackend(spec, &pBackend)))
+    {
+        fprintf(stderr, "Could not create the simulated backend\n");
+        exit(1);
+    }
+    return pBackend;
+}
+
+// Parse a command line the way the tool does, so the benchmark runs with the same defaults
+static void parseCommand(TGlobalState* state, std::vector<LPCWSTR> arguments)
+{
+    bool isOutput = true;
+    arguments.insert(arguments.begin(), L"EndPointController");
+    *state = TGlobalState();
+    parseArguments(state, (int)arguments.size(), arguments.data(), &isOutput);
+}
+
+static void benchmarkCache(int deviceCount)
+{
+    AudioBackend* pBackend = createBackend(deviceCount);
+    refreshDeviceCache(pBackend, true);
+
+    char name[64];
+    snprintf(name, sizeof(name), "CacheWrite/%d", deviceCount);
+    measure(name, [] { cacheDeviceList(true); });
+
+    snprintf(name, sizeof(name), "CacheParse/%d", deviceCount);
+    measure(name, [] { loadDeviceCache(true); });
+
+    releaseAudioBackend(pBackend);
+}
+
+static void benchmarkFormatting()
+{
+    AudioBackend* pBackend = createBackend(4);
+    DeviceTable devices;
+    pBackend->enumerateDevices(eRender, DEVICE_STATE_ACTIVE, devices);
+    const TDeviceEntry& device = devices[0];
+
+    std::wstring output;
+    TGlobalState state;
+    parseCommand(&state, {});
+    std::wstring defaultFormat = state.deviceFormatStr;
+    std::wstring detailedFormat = portableFormatString(
+        L"Device Index: %d, Name: %ws, State: %d, Default: %d, Descriptions: %ws, Interface Name: %ws, Device ID: %ws\n");
+
+    beginOutputCapture(&output);
+    measure("PrintDeviceInfo/default", [&]
+    {
+        output.clear();
+        printDeviceInfo(device, 1, defaultFormat.c_str(), device.id.c_str());
+    });
+    measure("PrintDeviceInfo/detailed", [&]
+    {
+        output.clear();
+        printDeviceInfo(device, 1, detailedFormat.c_str(), device.id.c_str());
+    });
+    endOutputCapture();
+
+    measure("DeviceJson", [&]
+    {
+        output.clear();
+        appendDeviceJson(output, device, 1, true);
+    });
+
+    releaseAudioBackend(pBackend);
+}
+
+// A complete listing as the tool runs it: enumerate, print every device and persist the cache
+static void benchmarkListing(int deviceCount)
+{
+    AudioBackend* pBackend = createBackend(deviceCount);
+    TGlobalState state;
+    std::wstring output;
+
+    char name[64];
+    snprintf(name, sizeof(name), "List/%d", deviceCount);
+    beginOutputCapture(&output);
+    measure(name, [&]
+    {
+        output.clear();
+        parseCommand(&state, {});
+        state.pBackend = pBackend;
+        runCommand(&state, true);
+    });
+    endOutputCapture();
+
+    releaseAudioBackend(pBackend);
+}
+
+// Setting a device by index, alternating between two so every call is a real change
+static void benchmarkSwitch()
+{
+    AudioBackend* pBackend = createBackend(4);
+    refreshDeviceCache(pBackend, true);
+    TGlobalState state;
+    std::wstring output;
+    int next = 0;
+
+    // The one-shot path: load the cache from disk, then switch
+    beginOutputCapture(&output);
+    measure("Switch/cache", [&]
+    {
+        parseCommand(&state, { next++ % 2 == 0 ? L"2" : L"1" });
+        state.pBackend = pBackend;
+        runCommand(&state, true);
+    });
+
+    // The resident path: the cache is already in memory
+    measure("Switch/resident", [&]
+    {
+        switchToCachedDevice(&state, next++ % 2, true);
+    });
+    endOutputCapture();
+
+    releaseAudioBackend(pBackend);
+}
+
+#ifndef _WIN32
+extern char** environ;
+
+// Run the tool once with the simulated backend, its output discarded
+static void runProcess(const std::vector<const char*>& arguments)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+
+    std::vector<char*> argv;
+    argv.push_back((char*)options.exePath);
+    for (const char* argument : arguments)
+    {
+        argv.push_back((char*)argument);
+    }
+    argv.push_back(NULL);
+
+    pid_t pid;
+    if (posix_spawn(&pid, options.exePath, &actions, NULL, argv.data(), environ) == 0)
+    {
+        int status;
+        waitpid(pid, &status, 0);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+}
+
+// One-shot invocations, the way scripts and hotkeys run the tool: cold start included
+static void benchmarkProcess()
+{
+    setenv("EPC_SIMULATE", "render=32", 1);
+    setenv("EPC_IPC_NAME", "EndPointBenchmarks.NoDaemon", 1);
+    measure("Process/list", [] { runProcess({}); });
+
+    int next = 0;
+    measure("Process/set", [&] { runProcess({ next++ % 2 == 0 ? "2" : "1" }); });
+    unsetenv("EPC_SIMULATE");
+    unsetenv("EPC_IPC_NAME");
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            options.filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--time") == 0 && i + 1 < argc)
+        {
+            options.timeNs = atoll(argv[++i]) * 1000000LL;
+        }
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+        {
+            options.samples = atoi(argv[++i]);
+            options.samples = options.samples > 0 ? options.samples : 1;
+        }
+        else if (strcmp(argv[i], "--exe") == 0 && i + 1 < argc)
+        {
+            options.exePath = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: EndPointBenchmarks [--filter text] [--time ms] [--samples N] [--exe path]\n");
+            return 1;
+        }
+    }
+
+    // --exe is given relative to where the benchmark was started, so resolve it before changing directory
+    std::string exePath;
+    if (options.exePath != NULL)
+    {
+        exePath = std::filesystem::absolute(options.exePath).string();
+        options.exePath = exePath.c_str();
+    }
+
+    countersStart();
+    WorkDirectory workDirectory("EndPointBenchmarks");
+
+    benchmarkCache(32);
+    benchmarkCache(1024);
+    benchmarkFormatting();
+    benchmarkListing(1);
+    benchmarkListing(32);
+    benchmarkListing(1024);
+    benchmarkListing(10240);
+    benchmarkSwitch();
+#ifndef _WIN32
+    if (options.exePath != NULL)
+    {
+        benchmarkProcess();
+    }
+#endif
+    return 0;
+}
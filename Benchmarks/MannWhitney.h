@@ -0,0 +1,86 @@
+// ----------------------------------------------------------------------------
+// MannWhitney.h
+// The one-sided Mann-Whitney U test BenchmarkBaseline compares timings with,
+// using the normal approximation corrected for ties and continuity.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <math.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// The U statistic of samples against baseline, the number of pairs in which the sample is larger with ties
+// counted as half, and the tie term sum(t^3 - t) over the groups of tied values the variance is corrected by
+inline void mannWhitneyU(const std::vector<double>& samples, const std::vector<double>& baseline, double* pU,
+    double* pTieTerm)
+{
+    typedef std::pair<double, int> TRanked;    // Value, 0 for samples and 1 for the baseline
+    std::vector<TRanked> all;
+    for (double value : samples)
+    {
+        all.push_back(TRanked(value, 0));
+    }
+    for (double value : baseline)
+    {
+        all.push_back(TRanked(value, 1));
+    }
+    std::sort(all.begin(), all.end());
+
+    // Tied values share the mean of their ranks
+    double n1 = (double)samples.size();
+    double rankSum = 0;
+    double tieTerm = 0;
+    for (size_t i = 0; i < all.size();)
+    {
+        size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first)
+        {
+            j++;
+        }
+        double rank = (i + 1 + j) / 2.0;
+        double ties = (double)(j - i);
+        for (size_t k = i; k < j; k++)
+        {
+            rankSum += all[k].second == 0 ? rank : 0;
+        }
+        tieTerm += ties * ties * ties - ties;
+        i = j;
+    }
+
+    *pU = rankSum - n1 * (n1 + 1) / 2;
+    *pTieTerm = tieTerm;
+}
+
+// P of a U at least this large if both sides came from the same distribution
+inline double mannWhitneyP(double u, double tieTerm, size_t sampleCount, size_t baselineCount)
+{
+    double n1 = (double)sampleCount;
+    double n2 = (double)baselineCount;
+    double total = n1 + n2;
+    double variance = total > 1 ? n1 * n2 / 12 * ((total + 1) - tieTerm / (total * (total - 1))) : 0;
+    if (variance <= 0)
+    {
+        return 1.0;
+    }
+    double z = (u - n1 * n2 / 2 - 0.5) / sqrt(variance);
+    return 0.5 * erfc(z / sqrt(2.0));
+}
+
+// The probability of samples at least this much larger than the baseline if both came from the same distribution
+inline double mannWhitneyGreater(const std::vector<double>& samples, const std::vector<double>& baseline)
+{
+    double u;
+    double tieTerm;
+    mannWhitneyU(samples, baseline, &u, &tieTerm);
+    return mannWhitneyP(u, tieTerm, samples.size(), baseline.size());
+}
+
+// The smallest p the sample counts allow, reached when every sample is larger than every baseline value. A
+// comparison can only find a difference at a significance level above it.
+inline double mannWhitneyMinimumP(size_t sampleCount, size_t baselineCount)
+{
+    return mannWhitneyP((double)sampleCount * (double)baselineCount, 0, sampleCount, baselineCount);
+}
@@ -0,0 +1,192 @@
+// ----------------------------------------------------------------------------
+// ResidentTableStress.cpp
+// Multi-threaded stress test and read throughput benchmark for the resident
+// device table. Reader threads enumerate the table while a writer applies
+// batches of state changes; every batch flips all devices together, so a
+// reader that ever sees a mix of states has observed a torn table. The same
+// workload runs against a mutex-protected table for comparison.
+//
+// Usage: ResidentTableStress [max reader threads]
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../EndPointController/ResidentBackend.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+#define STRESS_DEVICES 32
+#define STRESS_RUN_MS 1000
+#define STRESS_DEFAULT_READERS 8
+
+typedef struct TStressResult
+{
+    unsigned long long reads;
+    unsigned long long writes;
+    unsigned long long tornReads;
+} TStressResult;
+
+// The baseline: one table behind a mutex, copied out by readers and replaced by the writer
+class LockedTable
+{
+public:
+    void replace(const DeviceTable& devices)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        table = devices;
+    }
+
+    void enumerate(DeviceTable& devices)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        devices.insert(devices.end(), table.begin(), table.end());
+    }
+
+private:
+    std::mutex lock;
+    DeviceTable table;
+};
+
+static bool isTorn(const DeviceTable& devices)
+{
+    if (devices.size() != STRESS_DEVICES)
+    {
+        return true;
+    }
+    for (const auto& device : devices)
+    {
+        if (device.state != devices[0].state)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename ReadFunction, typename WriteFunction>
+static TStressResult runStress(int readerCount, ReadFunction read, WriteFunction write)
+{
+    std::atomic<bool> stop(false);
+    std::atomic<unsigned long long> reads(0);
+    std::atomic<unsigned long long> tornReads(0);
+    TStressResult result = { 0, 0, 0 };
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < readerCount; i++)
+    {
+        readers.push_back(std::thread([&]
+        {
+            DeviceTable devices;
+            unsigned long long count = 0;
+            unsigned long long torn = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                devices.clear();
+                read(devices);
+                torn += isTorn(devices) ? 1 : 0;
+                count++;
+            }
+            reads += count;
+            tornReads += torn;
+        }));
+    }
+
+    BenchClock::time_point deadline = BenchClock::now() + std::chrono::milliseconds(STRESS_RUN_MS);
+    while (BenchClock::now() < deadline)
+    {
+        write(result.writes % 2 == 0 ? DEVICE_STATE_DISABLED : DEVICE_STATE_ACTIVE);
+        result.writes++;
+    }
+    stop = true;
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+
+    result.reads = reads;
+    result.tornReads = tornReads;
+    return result;
+}
+
+static void report(const char* name, int readerCount, const TStressResult& result)
+{
+    double elapsedNs = STRESS_RUN_MS * 1e6;
+    printf("%-8s readers=%-2d  %12.0f reads/s  %8.1f ns/read/thread  %9llu writes  %llu torn\n", name, readerCount,
+        result.reads * 1e9 / elapsedNs, result.reads > 0 ? elapsedNs * readerCount / result.reads : 0.0,
+        result.writes, result.tornReads);
+}
+
+int main(int argc, char* argv[])
+{
+    char spec[64];
+    snprintf(spec, sizeof(spec), "render=%d,capture=1", STRESS_DEVICES);
+
+    AudioBackend* pBackend = NULL;
+    if (FAILED(createSimulatedBackend(spec, &pBackend)))
+    {
+        fprintf(stderr, "Could not create the simulated backend\n");
+        return 1;
+    }
+
+    ResidentBackend* pResident = new ResidentBackend(pBackend);
+    if (FAILED(pResident->initialize()))
+    {
+        fprintf(stderr, "Could not load the device table\n");
+        return 1;
+    }
+
+    DeviceTable initial;
+    pResident->enumerateDevices(eRender, DEVICE_STATEMASK_ALL, initial);
+    LockedTable locked;
+    locked.replace(initial);
+
+    bool failed = false;
+    // Oversubscribing the cores is fine; it makes preemption inside read sections more likely
+    int maxReaders = argc > 1 ? atoi(argv[1]) : STRESS_DEFAULT_READERS;
+    for (int readerCount = 1; readerCount <= maxReaders; readerCount *= 2)
+    {
+        // Writes go through the notification path exactly as in the resident process
+        TStressResult rcu = runStress(readerCount,
+            [&](DeviceTable& devices) { pResident->enumerateDevices(eRender, DEVICE_STATEMASK_ALL, devices); },
+            [&](DWORD state)
+            {
+                for (const auto& device : initial)
+                {
+                    pResident->onDeviceStateChanged(device.id.c_str(), state);
+                }
+                std::vector<TDeviceUpdate> updates;
+                pResident->applyPendingChanges(updates);
+            });
+        report("rcu", readerCount, rcu);
+
+        DeviceTable next = initial;
+        TStressResult mutex = runStress(readerCount,
+            [&](DeviceTable& devices) { locked.enumerate(devices); },
+            [&](DWORD state)
+            {
+                for (auto& device : next)
+                {
+                    device.state = state;
+                }
+                locked.replace(next);
+            });
+        report("mutex", readerCount, mutex);
+
+        failed = failed || rcu.tornReads != 0 || mutex.tornReads != 0;
+    }
+
+    delete pResident;
+    size_t pending = rcuReclaim();
+    if (pending != 0)
+    {
+        printf("%u retired versions were never reclaimed\n", (unsigned)pending);
+        failed = true;
+    }
+    releaseAudioBackend(pBackend);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,45 @@
+// ----------------------------------------------------------------------------
+// WorkDirectory.h
+// A scratch working directory for EndPointBenchmarks and EndPointTests, so
+// the cache files the tool writes to the working directory stay out of the
+// caller's.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+// Creates a directory named after prefix and the time under the temporary directory and makes it the working
+// directory; the destructor restores the previous one and removes the directory with everything in it
+class WorkDirectory
+{
+public:
+    explicit WorkDirectory(const char* prefix)
+    {
+        std::string name = std::string(prefix) + "." +
+            std::to_string((unsigned long long)std::chrono::steady_clock::now().time_since_epoch().count());
+        path = std::filesystem::temp_directory_path() / name;
+        std::filesystem::create_directory(path);
+        previous = std::filesystem::current_path();
+        std::filesystem::current_path(path);
+    }
+
+    ~WorkDirectory()
+    {
+        std::filesystem::current_path(previous);
+        std::error_code error;
+        std::filesystem::remove_all(path, error);
+    }
+
+    const std::filesystem::path& getPath() const
+    {
+        return path;
+    }
+
+private:
+    std::filesystem::path path;
+    std::filesystem::path previous;
+};
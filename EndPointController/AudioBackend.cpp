@@ -0,0 +1,66 @@
+#include <stdlib.h>
+#include "AudioBackend.h"
+
+// Pick the backend for this process
+HRESULT createAudioBackend(AudioBackend** ppBackend)
+{
+    const char* spec = getenv("EPC_SIMULATE");
+
+#ifdef _WIN32
+    if (spec == NULL)
+    {
+        return createWasapiBackend(ppBackend);
+    }
+#endif
+
+    return createSimulatedBackend(spec != NULL ? spec : "", ppBackend);
+}
+
+// Release the backend created by createAudioBackend
+void releaseAudioBackend(AudioBackend* pBackend)
+{
+    delete pBackend;
+}
+
+bool operator==(const TAudioFormat& a, const TAudioFormat& b)
+{
+    return a.sampleRate == b.sampleRate && a.channels == b.channels && a.bitsPerSample == b.bitsPerSample &&
+           a.channelMask == b.channelMask && a.isFloat == b.isFloat;
+}
+
+bool operator==(const TProcessingPeriod& a, const TProcessingPeriod& b)
+{
+    return a.defaultPeriod == b.defaultPeriod && a.minimumPeriod == b.minimumPeriod && a.currentPeriod == b.currentPeriod;
+}
+
+// Apply one endpoint change to a table in place
+bool updateDeviceTable(DeviceTable& devices, const TDeviceEntry& device, bool remove)
+{
+    for (auto it = devices.begin(); it != devices.end(); ++it)
+    {
+        if (it->id != device.id)
+            continue;
+
+        if (remove)
+        {
+            devices.erase(it);
+            return true;
+        }
+        if (it->friendlyName == device.friendlyName && it->description == device.description &&
+            it->interfaceName == device.interfaceName && it->state == device.state &&
+            it->formFactor == device.formFactor && it->containerID == device.containerID && it->format == device.format &&
+            it->period == device.period)
+        {
+            return false;
+        }
+        *it = device;
+        return true;
+    }
+
+    if (remove)
+    {
+        return false;
+    }
+    devices.push_back(device);
+    return true;
+}
@@ -0,0 +1,231 @@
+// ----------------------------------------------------------------------------
+// AudioBackend.h
+// Abstraction over the audio endpoint API. The WASAPI backend wraps
+// IMMDeviceEnumerator and one policy-config object, IPolicyConfig where it
+// can be created and IPolicyConfigVista otherwise; the simulated backend
+// keeps an in-memory device set so the tool can be exercised without audio
+// hardware.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Platform.h"
+
+// Shared-mode stream format of an endpoint, as set in the Sound control panel. A sampleRate of 0 means the
+// format has not been read; enumeration leaves it unread, since reading it costs a call per device.
+typedef struct TAudioFormat
+{
+    DWORD sampleRate = 0;
+    UINT channels = 0;
+    UINT bitsPerSample = 0;     // Valid bits, which can be fewer than the container size
+    DWORD channelMask = 0;      // SPEAKER_* positions, 0 if the format does not give them
+    bool isFloat = false;
+} TAudioFormat;
+
+bool operator==(const TAudioFormat& a, const TAudioFormat& b);
+inline bool operator!=(const TAudioFormat& a, const TAudioFormat& b)
+{
+    return !(a == b);
+}
+
+// Audio engine processing periods of an endpoint, in 100-nanosecond units. A minimumPeriod of 0 means the
+// periods have not been read; like the format, they cost a call per device.
+typedef struct TProcessingPeriod
+{
+    INT64 defaultPeriod = 0;    // The period the engine uses when none has been set
+    INT64 minimumPeriod = 0;    // The shortest period the endpoint supports
+    INT64 currentPeriod = 0;    // The period in effect
+} TProcessingPeriod;
+
+bool operator==(const TProcessingPeriod& a, const TProcessingPeriod& b);
+inline bool operator!=(const TProcessingPeriod& a, const TProcessingPeriod& b)
+{
+    return !(a == b);
+}
+
+// Master volume and mute of an endpoint. A level below 0 means they have not been read; unlike the format,
+// they change too often to keep in a cache, so they are read live each time they are needed.
+typedef struct TEndpointVolume
+{
+    float level = -1;           // Scalar from 0 to 1, on the same audio-tapered curve as the volume slider
+    bool muted = false;
+} TEndpointVolume;
+
+// Levels closer than this are the same to the volume slider, which moves in steps of 1%
+inline bool isSameVolumeLevel(float a, float b)
+{
+    return a - b < 0.0005f && b - a < 0.0005f;
+}
+
+// A change for updateEndpointVolume; members left at -1 are kept as they are
+typedef struct TVolumeUpdate
+{
+    float level = -1;
+    int mute = -1;              // 1 to mute, 0 to unmute
+} TVolumeUpdate;
+
+// Activity of an audio session, with the values of AudioSessionState
+enum ESessionState
+{
+    eSessionInactive,
+    eSessionActive,             // A stream of the session is running
+    eSessionExpired
+};
+
+// One audio session of an endpoint: the streams of one process (or group of processes), as the volume mixer
+// shows them
+typedef struct TAudioSession
+{
+    DWORD processID = 0;
+    std::wstring displayName;   // Set by the application, often left empty
+    ESessionState state = eSessionInactive;
+    float volume = 1;           // The session's own level, from 0 to 1, scaled by the endpoint volume
+    bool muted = false;
+} TAudioSession;
+
+typedef std::vector<TAudioSession> SessionTable;
+
+// One enumerated endpoint, as shown by the listing.
+typedef struct TDeviceEntry
+{
+    std::wstring id;
+    std::wstring friendlyName;
+    std::wstring description;
+    std::wstring interfaceName;
+    DWORD state;
+    UINT formFactor;            // EndpointFormFactor value
+    std::wstring containerID;   // Groups the endpoints of one physical device
+    TAudioFormat format;        // Filled in by getDeviceFormat
+    TProcessingPeriod period;   // Filled in by getProcessingPeriod
+    TEndpointVolume volume;     // Filled in by getEndpointVolume
+    SessionTable sessions;      // Kept by a backend that watches the sessions; see getSessions
+    bool sessionsRead = false;
+} TDeviceEntry;
+
+typedef std::vector<TDeviceEntry> DeviceTable;
+
+// Per-format results of probeFormats
+#define FORMAT_SUPPORT_SHARED       0x1     // A shared-mode stream can use the format as is
+#define FORMAT_SUPPORT_EXCLUSIVE    0x2     // An exclusive-mode stream can use the format
+
+// Coarse classification of the property reported by OnPropertyValueChanged.
+enum EDeviceProperty
+{
+    eDevicePropertyName,    // Friendly name, description or interface name
+    eDevicePropertyFormat,  // The shared-mode device format
+    eDevicePropertyOther
+};
+
+// Receives endpoint change notifications. Mirrors IMMNotificationClient; callbacks arrive on a
+// backend-owned thread and must not block.
+class DeviceNotificationSink
+{
+public:
+    virtual ~DeviceNotificationSink() {}
+
+    virtual void onDeviceAdded(LPCWSTR deviceID) {}
+    virtual void onDeviceRemoved(LPCWSTR deviceID) {}
+    virtual void onDeviceStateChanged(LPCWSTR deviceID, DWORD newState) {}
+    virtual void onDefaultDeviceChanged(EDataFlow dataFlow, ERole role, LPCWSTR deviceID) {}
+    virtual void onPropertyValueChanged(LPCWSTR deviceID, EDeviceProperty property) {}
+
+    // A session of an endpoint passed to AudioBackend::watchSessions was created, changed state or volume,
+    // or went away
+    virtual void onSessionsChanged(LPCWSTR deviceID) {}
+};
+
+// The peak meter of one endpoint, opened by AudioBackend::openPeakMeter. It belongs to the thread that opened it:
+// read and delete it on that thread only.
+class PeakMeter
+{
+public:
+    virtual ~PeakMeter() {}
+
+    // The highest sample value, from 0 to 1, that the endpoint carried during the last engine period
+    virtual HRESULT getPeakValue(float* pPeak) = 0;
+};
+
+class AudioBackend
+{
+public:
+    virtual ~AudioBackend() {}
+
+    // Enumerate the endpoints of the given data flow whose state matches stateMask
+    virtual HRESULT enumerateDevices(EDataFlow dataFlow, DWORD stateMask, DeviceTable& devices) = 0;
+
+    // Read a single endpoint by ID, along with the data flow it belongs to
+    virtual HRESULT readDevice(LPCWSTR deviceID, TDeviceEntry& device, EDataFlow* pDataFlow) = 0;
+
+    // Retrieve the ID of the default endpoint for the given data flow and role
+    virtual HRESULT getDefaultDeviceID(EDataFlow dataFlow, ERole role, std::wstring& deviceID) = 0;
+
+    // Make the endpoint the default for the given role
+    virtual HRESULT setDefaultEndpoint(LPCWSTR deviceID, ERole role) = 0;
+
+    // Read the shared-mode format of an endpoint
+    virtual HRESULT getDeviceFormat(LPCWSTR deviceID, TAudioFormat& format) = 0;
+
+    // Change the shared-mode format of an endpoint. A channelMask of 0 leaves the speaker positions to the backend.
+    virtual HRESULT setDeviceFormat(LPCWSTR deviceID, const TAudioFormat& format) = 0;
+
+    // Read the audio engine's processing periods for an endpoint
+    virtual HRESULT getProcessingPeriod(LPCWSTR deviceID, TProcessingPeriod& period) = 0;
+
+    // Ask the audio engine to process the endpoint with the given period (100-ns units). The engine may round it;
+    // getProcessingPeriod reports the period it settled on.
+    virtual HRESULT setProcessingPeriod(LPCWSTR deviceID, INT64 period) = 0;
+
+    // Hide an endpoint, which disables it as the Sound control panel does, or show it again
+    virtual HRESULT setEndpointVisibility(LPCWSTR deviceID, bool visible) = 0;
+
+    // Read the version of the driver behind an endpoint, empty if it does not report one
+    virtual HRESULT getDriverVersion(LPCWSTR deviceID, std::wstring& version) = 0;
+
+    // Read the endpoint's share-mode setting, as the undocumented policy-config value
+    virtual HRESULT getShareMode(LPCWSTR deviceID, int* pShareMode) = 0;
+
+    // Test each format for shared and exclusive use, setting FORMAT_SUPPORT_* bits in support (one entry per
+    // format). Unlike the other methods, this one may be called from several threads at once.
+    virtual HRESULT probeFormats(LPCWSTR deviceID, const std::vector<TAudioFormat>& formats, std::vector<unsigned char>& support) = 0;
+
+    // Read the master volume and mute of an endpoint
+    virtual HRESULT getEndpointVolume(LPCWSTR deviceID, TEndpointVolume& volume) = 0;
+
+    // Read the volume, apply the update, and read it back, all over one activation of the endpoint's volume
+    // control. Returns S_FALSE if the endpoint already matched the update. Like probeFormats, this may be
+    // called from several threads at once.
+    virtual HRESULT updateEndpointVolume(LPCWSTR deviceID, const TVolumeUpdate& update, TEndpointVolume& before,
+        TEndpointVolume& after) = 0;
+
+    // Open the peak meter of an active endpoint for the calling thread, which may be any thread
+    virtual HRESULT openPeakMeter(LPCWSTR deviceID, PeakMeter** ppMeter) = 0;
+
+    // Enumerate the audio sessions of an endpoint. Returns S_FALSE if they came from tables that session
+    // notifications keep current rather than from the audio service. May be called from several threads at once.
+    virtual HRESULT getSessions(LPCWSTR deviceID, SessionTable& sessions) = 0;
+
+    // Deliver onSessionsChanged for the endpoint to the registered sinks from now until the backend is released.
+    // May be called from several threads at once; watching an endpoint twice has no further effect.
+    virtual HRESULT watchSessions(LPCWSTR deviceID) = 0;
+
+    // Start or stop delivering endpoint change notifications to the sink
+    virtual HRESULT registerNotificationSink(DeviceNotificationSink* pSink) = 0;
+    virtual HRESULT unregisterNotificationSink(DeviceNotificationSink* pSink) = 0;
+};
+
+// Replace the table entry with the same ID as device, append it if absent, or erase it if remove is set.
+// Returns true if the table changed.
+bool updateDeviceTable(DeviceTable& devices, const TDeviceEntry& device, bool remove);
+
+// Create the backend for this process: the simulated backend when EPC_SIMULATE is set (or on
+// platforms without WASAPI), otherwise the WASAPI backend. Initializes COM where needed.
+HRESULT createAudioBackend(AudioBackend** ppBackend);
+void releaseAudioBackend(AudioBackend* pBackend);
+
+#ifdef _WIN32
+HRESULT createWasapiBackend(AudioBackend** ppBackend);
+#endif
+HRESULT createSimulatedBackend(const char* spec, AudioBackend** ppBackend);
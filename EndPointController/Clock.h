@@ -0,0 +1,16 @@
+// ----------------------------------------------------------------------------
+// Clock.h
+// Elapsed-time helper for the reports that time their own work. The modules
+// keep their own steady_clock typedefs; readings from any of them mix.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <chrono>
+
+// Milliseconds between two steady-clock readings, with the fraction the reports print
+inline double elapsedMs(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include <new>
+#include "Counters.h"
+
+std::atomic<bool> countersEnabled(false);
+std::atomic<uint64_t> counters[ECounter_enum_count];
+
+const wchar_t* const counterNames[ECounter_enum_count] =
+{
+    L"allocs", L"frees", L"bytes", L"CoCreate", L"PropStore", L"GetValue", L"CoTaskFree"
+};
+
+void countersStart()
+{
+    countersEnabled = true;
+}
+
+void readCounters(uint64_t values[ECounter_enum_count])
+{
+    for (int i = 0; i < ECounter_enum_count; i++)
+    {
+        values[i] = counters[i].load(std::memory_order_relaxed);
+    }
+}
+
+// The replaceable global allocation functions; the array, nothrow and sized forms all end up here
+void* operator new(size_t size)
+{
+    if (countersEnabled.load(std::memory_order_relaxed))
+    {
+        counters[eCounterAllocations].fetch_add(1, std::memory_order_relaxed);
+        counters[eCounterBytesAllocated].fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void* p = malloc(size > 0 ? size : 1);
+    if (p == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    if (p != NULL)
+    {
+        countEvent(eCounterFrees);
+        free(p);
+    }
+}
+
+void operator delete[](void* p) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    operator delete(p);
+}
@@ -0,0 +1,44 @@
+// ----------------------------------------------------------------------------
+// Counters.h
+// Event counters for --stats: heap allocations, frees and bytes allocated
+// (counted by replacing the global operator new and delete), and the COM
+// calls that dominate enumeration cost. Every trace span attributes the
+// counts made while it ran to its phase. The counters are process-wide, so a
+// phase also includes what other threads did meanwhile.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+enum ECounter
+{
+    eCounterAllocations,
+    eCounterFrees,
+    eCounterBytesAllocated,
+    eCounterCoCreateInstance,
+    eCounterPropertyStoreOpens,
+    eCounterGetValue,
+    eCounterCoTaskMemFree,
+    ECounter_enum_count
+};
+
+extern std::atomic<bool> countersEnabled;
+extern std::atomic<uint64_t> counters[ECounter_enum_count];
+
+// Column headings for reports
+extern const wchar_t* const counterNames[ECounter_enum_count];
+
+// One test of a flag while counting is off
+inline void countEvent(ECounter counter, uint64_t amount = 1)
+{
+    if (countersEnabled.load(std::memory_order_relaxed))
+    {
+        counters[counter].fetch_add(amount, std::memory_order_relaxed);
+    }
+}
+
+void countersStart();
+void readCounters(uint64_t values[ECounter_enum_count]);
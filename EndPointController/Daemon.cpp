@@ -0,0 +1,333 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <wchar.h>
+#include <string>
+#include <vector>
+#include "Daemon.h"
+#include "DeviceFormat.h"
+#include "IpcChannel.h"
+#include "Output.h"
+#include "ResidentBackend.h"
+#include "SharedSnapshot.h"
+#include "SwitchScheduler.h"
+#include "Trace.h"
+
+// Wire format, in native byte order and wchar_t size (both ends are the same build):
+//   request:  uint32 argument count, then per argument a uint32 length in characters and the characters
+//   response: int32 HRESULT, uint32 length in characters, then the captured output
+#define IPC_MAX_ARGUMENTS 256
+#define IPC_MAX_ARGUMENT_LENGTH 65536
+
+static HRESULT writeString(IpcHandle connection, const std::wstring& text)
+{
+    uint32_t length = (uint32_t)text.size();
+    HRESULT hr = ipcWrite(connection, &length, sizeof(length));
+    if (SUCCEEDED(hr) && length > 0)
+    {
+        hr = ipcWrite(connection, text.c_str(), length * sizeof(wchar_t));
+    }
+    return hr;
+}
+
+static HRESULT readString(IpcHandle connection, std::wstring& text, uint32_t maxLength)
+{
+    uint32_t length = 0;
+    HRESULT hr = ipcRead(connection, &length, sizeof(length));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    if (length > maxLength)
+    {
+        return E_INVALIDARG;
+    }
+
+    text.resize(length);
+    return length > 0 ? ipcRead(connection, &text[0], length * sizeof(wchar_t)) : S_OK;
+}
+
+static HRESULT readRequest(IpcHandle connection, std::vector<std::wstring>& arguments)
+{
+    uint32_t count = 0;
+    HRESULT hr = ipcRead(connection, &count, sizeof(count));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    if (count > IPC_MAX_ARGUMENTS)
+    {
+        return E_INVALIDARG;
+    }
+
+    arguments.resize(count);
+    for (uint32_t i = 0; i < count && SUCCEEDED(hr); i++)
+    {
+        hr = readString(connection, arguments[i], IPC_MAX_ARGUMENT_LENGTH);
+    }
+    return hr;
+}
+
+// Run one client request against the resident backend, capturing its output. Switches go through the
+// scheduler, except --verify ones, which must make their call now to time the notification.
+static HRESULT serveRequest(SwitchScheduler* pScheduler, ResidentBackend* pResident, const std::vector<std::wstring>& arguments,
+    std::wstring& output, bool* pShutdown)
+{
+    std::vector<LPCWSTR> argv;
+    argv.push_back(L"EndPointController");
+    for (const auto& argument : arguments)
+    {
+        argv.push_back(argument.c_str());
+    }
+
+    TGlobalState state = {};
+    bool isOutput = true;
+
+    beginOutputCapture(&output);
+    state.hr = parseArguments(&state, (int)argv.size(), argv.data(), &isOutput);
+    if (state.hr == S_OK)
+    {
+        if (state.shutdown)
+        {
+            // Queued switches still happen
+            pScheduler->flush(true);
+            const TSwitchStats& stats = pScheduler->getStats();
+            outputf(_T("Resident process stopped: %llu switch requests, %llu calls, %llu merged, %llu dropped, %llu failed\n"),
+                stats.requests, stats.calls, stats.merged, stats.dropped, stats.failed);
+            *pShutdown = true;
+        }
+        else if (state.switchStatus)
+        {
+            // Queued switches go first, so the report covers every request made before this one; a failure is
+            // also the exit code
+            pScheduler->flush(true);
+            const TSwitchStats& stats = pScheduler->getStats();
+            outputf(_T("Switches: %llu requests, %llu calls, %llu merged, %llu dropped, %llu failed\n"),
+                stats.requests, stats.calls, stats.merged, stats.dropped, stats.failed);
+            std::wstring description;
+            state.hr = pScheduler->takeLastFailure(description);
+            if (FAILED(state.hr))
+            {
+                outputf(_T("Last failure: %ls\n"), description.c_str());
+            }
+        }
+        else if (state.daemon || state.client || state.watch || state.meter || state.whenIdleMs >= 0)
+        {
+            outputf(_T("--daemon, --client, --watch, --meter and --when-idle cannot be sent to the resident process\n"));
+            state.hr = E_INVALIDARG;
+        }
+        else if (parseDeviceFormat(state.deviceFormatStr.c_str()) < 0)
+        {
+            // The one-shot tool lets printf fail on a bad format; here it would take the daemon down
+            outputf(_T("Invalid format string\n"));
+            state.hr = E_INVALIDARG;
+        }
+        else
+        {
+            if (state.verify)
+            {
+                // Earlier queued switches go first so they cannot land after this one
+                pScheduler->flush(true);
+                state.pBackend = pResident;
+            }
+            else
+            {
+                state.pBackend = pScheduler;
+            }
+            state.resident = true;
+            runCommand(&state, isOutput);
+        }
+    }
+    endOutputCapture();
+
+    return state.hr == S_FALSE ? S_OK : state.hr;
+}
+
+static void wakeAcceptLoop(void* pContext)
+{
+    ipcWake((TIpcServer*)pContext);
+}
+
+// Fold queued endpoint changes into the resident tables and the device cache. The cache keeps the active
+// devices, as a fresh listing would; only the cache files of a data flow that actually changed are rewritten.
+static void applyDeviceChanges(ResidentBackend* pResident)
+{
+    std::vector<TDeviceUpdate> updates;
+    pResident->applyPendingChanges(updates);
+
+    bool changed[2] = { false, false };
+    for (const auto& update : updates)
+    {
+        if (update.event == eDeviceEventDefaultChanged)
+            continue;
+
+        bool isOutput = update.dataFlow == eRender;
+        bool remove = update.event == eDeviceEventRemoved || (update.device.state & DEVICE_STATE_ACTIVE) == 0;
+        if (updateDeviceTable(isOutput ? cachedOutputDevices : cachedInputDevices, update.device, remove))
+        {
+            changed[update.dataFlow] = true;
+        }
+    }
+
+    for (int flow = eRender; flow <= eCapture; flow++)
+    {
+        if (changed[flow])
+        {
+            cacheDeviceList(flow == eRender);
+        }
+    }
+}
+
+// Republish the shared snapshot if the tables changed since it was last published
+static void publishChanges(TSnapshotWriter* pSnapshot, ResidentBackend* pResident, unsigned long long* pPublishedGeneration)
+{
+    unsigned long long generation = pResident->getGeneration();
+    if (pSnapshot->pView != NULL && generation != *pPublishedGeneration)
+    {
+        publishSnapshot(pSnapshot, pResident);
+        *pPublishedGeneration = generation;
+    }
+}
+
+HRESULT runDaemon(TGlobalState* state)
+{
+    AudioBackend* pInner = NULL;
+    HRESULT hr = createAudioBackend(&pInner);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    ResidentBackend* pResident = new ResidentBackend(pInner);
+    SwitchScheduler scheduler(pResident, state->switchWindowMs, state->switchIntervalMs);
+    TIpcServer server = {};
+    server.listener = INVALID_IPC_HANDLE;
+    TSnapshotWriter snapshot = {};
+
+    // Claim the channel first: a second daemon gives up before enumerating anything
+    hr = ipcListen(&server);
+    if (FAILED(hr))
+    {
+        outputf(_T("Cannot start the resident process, is one already running? (0x%08x)\n"), (unsigned int)hr);
+    }
+    else
+    {
+        pResident->setChangeHandler(wakeAcceptLoop, &server);
+        hr = pResident->initialize();
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // Prime the device cache so "device_index" works before the first listing; from here on endpoint
+        // notifications keep it and the cache files current
+        refreshDeviceCache(pResident, true);
+        refreshDeviceCache(pResident, false);
+
+        // Listings read the published tables directly; without the segment they just enumerate as before
+        unsigned long long publishedGeneration = pResident->getGeneration();
+        if (SUCCEEDED(createSnapshotSegment(&snapshot)))
+        {
+            publishSnapshot(&snapshot, pResident);
+        }
+
+        outputf(_T("Resident process listening on %ls\n"), server.name.c_str());
+        fflush(stdout);
+
+        bool shutdown = false;
+        while (!shutdown)
+        {
+            // Wake up in time for the next queued switch
+            IpcHandle connection = INVALID_IPC_HANDLE;
+            hr = ipcAccept(&server, &connection, scheduler.getWaitMs());
+            scheduler.flush(false);
+            applyDeviceChanges(pResident);
+            publishChanges(&snapshot, pResident, &publishedGeneration);
+            if (FAILED(hr))
+            {
+                break;
+            }
+            if (hr == S_FALSE)
+            {
+                continue;
+            }
+
+            std::vector<std::wstring> arguments;
+            if (SUCCEEDED(readRequest(connection, arguments)))
+            {
+                std::wstring output;
+                int32_t result = serveRequest(&scheduler, pResident, arguments, output, &shutdown);
+                if (SUCCEEDED(ipcWrite(connection, &result, sizeof(result))))
+                {
+                    writeString(connection, output);
+                }
+            }
+            ipcCloseConnection(connection);
+
+            // A --verify switch served by the request changes the defaults
+            publishChanges(&snapshot, pResident, &publishedGeneration);
+        }
+    }
+
+    closeSnapshotSegment(&snapshot);
+
+    // Unregisters the notification sink, so nothing wakes the channel once it is closed
+    delete pResident;
+    ipcStopListening(&server);
+    releaseAudioBackend(pInner);
+    return hr;
+}
+
+HRESULT runClient(int argc, LPCWSTR argv[], bool* pServed)
+{
+    TraceSpan span("runClient");
+
+    *pServed = false;
+
+    IpcHandle connection = INVALID_IPC_HANDLE;
+    if (FAILED(ipcConnect(&connection)))
+    {
+        return S_OK;
+    }
+
+    // The resident process has its own working directory, so files named on the command line are sent as
+    // absolute paths
+    std::vector<std::wstring> arguments;
+    for (int i = 1; i < argc; i++)
+    {
+        if (wcscmp(argv[i], _T("--client")) != 0)
+        {
+            arguments.push_back(argv[i]);
+        }
+        if ((wcscmp(argv[i], _T("--rules")) == 0 || wcscmp(argv[i], _T("--meter-log")) == 0) && i + 1 < argc)
+        {
+            arguments.push_back(absolutePath(argv[++i]));
+        }
+    }
+
+    uint32_t count = (uint32_t)arguments.size();
+    HRESULT hr = ipcWrite(connection, &count, sizeof(count));
+    for (size_t i = 0; i < arguments.size() && SUCCEEDED(hr); i++)
+    {
+        hr = writeString(connection, arguments[i]);
+    }
+
+    int32_t result = E_FAIL;
+    std::wstring output;
+    if (SUCCEEDED(hr))
+    {
+        hr = ipcRead(connection, &result, sizeof(result));
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = readString(connection, output, UINT32_MAX / sizeof(wchar_t));
+    }
+    ipcCloseClient(connection);
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    *pServed = true;
+    outputf(L"%ls", output.c_str());
+    return result;
+}
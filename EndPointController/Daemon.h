@@ -0,0 +1,18 @@
+// ----------------------------------------------------------------------------
+// Daemon.h
+// Resident mode: one process keeps COM initialized and the device tables
+// warm, and serves list/switch/query requests from thin clients over the
+// local IPC channel, so each request skips process start-up and enumeration.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include "EndPointController.h"
+
+// Serve requests until a client sends --shutdown
+HRESULT runDaemon(TGlobalState* state);
+
+// Forward the command line (minus --client) to the daemon and print its reply. *pServed is false if no
+// daemon is running, in which case nothing was printed and the caller should run the request itself.
+HRESULT runClient(int argc, LPCWSTR argv[], bool* pServed);
@@ -0,0 +1,331 @@
+#include <stdio.h>
+#include <chrono>
+#include <map>
+#include "Clock.h"
+#include "DeviceCapabilities.h"
+#include "DeviceSettings.h"
+#include "Output.h"
+#include "Trace.h"
+
+typedef std::chrono::steady_clock CapabilitiesClock;
+
+// The matrix: every rate with 16-, 24- and 32-bit integer and 32-bit float samples, in the common layouts
+static const DWORD matrixRates[] = { 44100, 48000, 88200, 96000, 176400, 192000 };
+static const UINT matrixBits[] = { 16, 24, 32, 32 };
+static const bool matrixFloat[] = { false, false, false, true };
+static const UINT matrixChannels[] = { 1, 2, 6, 8 };
+
+#define MATRIX_SAMPLE_TYPES (sizeof(matrixBits) / sizeof(matrixBits[0]))
+#define MATRIX_CHANNEL_COUNTS (sizeof(matrixChannels) / sizeof(matrixChannels[0]))
+
+// What is known of one device: read on the main thread, then probed by a worker or taken from the cache
+typedef struct TDeviceCapabilities
+{
+    std::wstring driverVersion;
+    TAudioFormat format;            // The current format, which decides what shared mode takes
+    int shareMode = -1;             // -1 if it could not be read
+    std::vector<unsigned char> support;
+    bool cached = false;
+    HRESULT hr = S_OK;
+    double probeMs = 0;
+} TDeviceCapabilities;
+
+// One cache line: what a device supported, and the driver version and format it had at the time
+typedef struct TCachedCapabilities
+{
+    std::wstring driverVersion;
+    TAudioFormat format;
+    std::vector<unsigned char> support;
+} TCachedCapabilities;
+
+typedef std::map<std::wstring, TCachedCapabilities> CapabilitiesCache;
+
+void buildCapabilityMatrix(std::vector<TAudioFormat>& formats)
+{
+    formats.clear();
+    for (DWORD rate : matrixRates)
+    {
+        for (size_t type = 0; type < MATRIX_SAMPLE_TYPES; type++)
+        {
+            for (UINT channels : matrixChannels)
+            {
+                TAudioFormat format;
+                format.sampleRate = rate;
+                format.bitsPerSample = matrixBits[type];
+                format.isFloat = matrixFloat[type];
+                format.channels = channels;
+                format.channelMask = defaultChannelMask(channels);
+                formats.push_back(format);
+            }
+        }
+    }
+}
+
+// Load the cache. Each line holds "id|driverVersion|rate|channels|bits|mask|float|support" in UTF-8, support
+// being one character per matrix format: '.', 's', 'e' or 'b'. Lines written for a matrix of another size
+// are dropped.
+static void loadCapabilitiesCache(CapabilitiesCache& cache, size_t formatCount)
+{
+    TraceSpan span("loadCapabilitiesCache");
+    std::string content = readWholeFile(CAPABILITIES_CACHE_FILE);
+    std::wstring line;
+    std::vector<std::wstring> fields;
+    for (size_t lineStart = 0; lineStart < content.size();)
+    {
+        size_t lineEnd = content.find('\n', lineStart);
+        if (lineEnd == std::string::npos)
+            lineEnd = content.size();
+        line.clear();
+        appendFromUtf8(line, content.c_str() + lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 1;
+
+        fields.clear();
+        size_t start = 0;
+        for (size_t delimiterPos = line.find(L"|"); delimiterPos != std::wstring::npos; delimiterPos = line.find(L"|", start))
+        {
+            fields.push_back(line.substr(start, delimiterPos - start));
+            start = delimiterPos + 1;
+        }
+        fields.push_back(line.substr(start));
+        if (fields.size() != 8 || fields[7].size() != formatCount)
+            continue;
+
+        TCachedCapabilities& entry = cache[fields[0]];
+        entry.driverVersion = fields[1];
+        entry.format.sampleRate = (DWORD)wcstoul(fields[2].c_str(), NULL, 10);
+        entry.format.channels = (UINT)wcstoul(fields[3].c_str(), NULL, 10);
+        entry.format.bitsPerSample = (UINT)wcstoul(fields[4].c_str(), NULL, 10);
+        entry.format.channelMask = (DWORD)wcstoul(fields[5].c_str(), NULL, 10);
+        entry.format.isFloat = fields[6] == L"1";
+        entry.support.assign(formatCount, 0);
+        for (size_t i = 0; i < formatCount; i++)
+        {
+            wchar_t code = fields[7][i];
+            entry.support[i] = (code == L's' || code == L'b' ? FORMAT_SUPPORT_SHARED : 0) |
+                               (code == L'e' || code == L'b' ? FORMAT_SUPPORT_EXCLUSIVE : 0);
+        }
+    }
+}
+
+// Rewrite the cache with a single write, keeping the entries of devices this run did not look at
+static void saveCapabilitiesCache(const CapabilitiesCache& cache)
+{
+    TraceSpan span("saveCapabilitiesCache");
+    static const char codes[] = { '.', 's', 'e', 'b' };
+
+    std::string content;
+    for (const auto& entry : cache)
+    {
+        char numbers[64];
+        appendUtf8(content, entry.first);
+        content += '|';
+        appendUtf8(content, entry.second.driverVersion);
+        snprintf(numbers, sizeof(numbers), "|%lu|%u|%u|%lu|%d|", (unsigned long)entry.second.format.sampleRate,
+            entry.second.format.channels, entry.second.format.bitsPerSample, (unsigned long)entry.second.format.channelMask,
+            entry.second.format.isFloat ? 1 : 0);
+        content += numbers;
+        for (unsigned char support : entry.second.support)
+        {
+            content += codes[support & (FORMAT_SUPPORT_SHARED | FORMAT_SUPPORT_EXCLUSIVE)];
+        }
+        content += '\n';
+    }
+
+    FILE* outFile = fopen(CAPABILITIES_CACHE_FILE, "wb");
+    if (outFile != NULL)
+    {
+        fwrite(content.data(), 1, content.size(), outFile);
+        fclose(outFile);
+    }
+}
+
+// Probe the devices at the given indexes in parallel. A probe opens an audio client and asks about every format,
+// which takes from a few to hundreds of milliseconds per device; done in parallel, the whole audit takes about as
+// long as the slowest device.
+static int probeDevices(AudioBackend* pBackend, const DeviceTable& targets, const std::vector<size_t>& pending,
+    const std::vector<TAudioFormat>& formats, std::vector<TDeviceCapabilities>& results)
+{
+    return runInParallel(pending.size(), BULK_MAX_THREADS, [&](size_t slot)
+    {
+        size_t index = pending[slot];
+        TraceSpan span("AudioBackend::probeFormats");
+        CapabilitiesClock::time_point start = CapabilitiesClock::now();
+        results[index].hr = pBackend->probeFormats(targets[index].id.c_str(), formats, results[index].support);
+        results[index].probeMs = elapsedMs(start, CapabilitiesClock::now());
+    });
+}
+
+static LPCWSTR supportCode(unsigned char support)
+{
+    static LPCWSTR codes[] = { L".", L"S", L"E", L"B" };
+    return codes[support & (FORMAT_SUPPORT_SHARED | FORMAT_SUPPORT_EXCLUSIVE)];
+}
+
+// A header line, then one row per rate and sample type with a column per channel count
+static void printCapabilities(const TDeviceEntry& device, int index, const TDeviceCapabilities& capabilities)
+{
+    std::wstring text;
+    appendFormat(text, L"Device %d: %ls: driver %ls, share mode ", index, device.friendlyName.c_str(),
+        capabilities.driverVersion.empty() ? L"unknown" : capabilities.driverVersion.c_str());
+    if (capabilities.shareMode >= 0)
+        appendFormat(text, L"%d", capabilities.shareMode);
+    else
+        text += L"unknown";
+
+    if (FAILED(capabilities.hr))
+    {
+        appendFormat(text, L", probe failed (0x%08x)\n", (unsigned int)capabilities.hr);
+        outputf(_T("%ls"), text.c_str());
+        return;
+    }
+    if (capabilities.cached)
+        text += L", cached\n";
+    else
+        appendFormat(text, L", probed in %.1f ms\n", capabilities.probeMs);
+
+    text += L"            ";
+    for (UINT channels : matrixChannels)
+    {
+        appendFormat(text, L" %3uch", channels);
+    }
+    text += L"\n";
+
+    size_t format = 0;
+    for (DWORD rate : matrixRates)
+    {
+        for (size_t type = 0; type < MATRIX_SAMPLE_TYPES; type++)
+        {
+            appendFormat(text, L"  %6lu/%2u%ls", (unsigned long)rate, matrixBits[type], matrixFloat[type] ? L"f" : L" ");
+            for (size_t channel = 0; channel < MATRIX_CHANNEL_COUNTS; channel++, format++)
+            {
+                appendFormat(text, L" %5ls", supportCode(capabilities.support[format]));
+            }
+            text += L"\n";
+        }
+    }
+    outputf(_T("%ls"), text.c_str());
+}
+
+// One object per device, listing only the formats it supports in some mode
+static void printCapabilitiesJson(const TDeviceEntry& device, int index, const TDeviceCapabilities& capabilities,
+    const std::vector<TAudioFormat>& formats)
+{
+    std::wstring text;
+    appendFormat(text, L"{\"index\":%d,\"name\":", index);
+    appendJsonString(text, device.friendlyName);
+    text += L",\"id\":";
+    appendJsonString(text, device.id);
+    text += L",\"driverVersion\":";
+    appendJsonString(text, capabilities.driverVersion);
+    appendFormat(text, L",\"shareMode\":%d,\"cached\":%ls,\"probeMs\":%.1f", capabilities.shareMode,
+        capabilities.cached ? L"true" : L"false", capabilities.probeMs);
+    if (FAILED(capabilities.hr))
+    {
+        appendFormat(text, L",\"error\":%u}\n", (unsigned int)capabilities.hr);
+        outputf(_T("%ls"), text.c_str());
+        return;
+    }
+
+    text += L",\"formats\":[";
+    bool first = true;
+    for (size_t i = 0; i < formats.size(); i++)
+    {
+        if (capabilities.support[i] == 0)
+            continue;
+        appendFormat(text, L"%ls{\"sampleRate\":%lu,\"bitsPerSample\":%u,\"float\":%ls,\"channels\":%u,\"shared\":%ls,\"exclusive\":%ls}",
+            first ? L"" : L",", (unsigned long)formats[i].sampleRate, formats[i].bitsPerSample, formats[i].isFloat ? L"true" : L"false",
+            formats[i].channels, (capabilities.support[i] & FORMAT_SUPPORT_SHARED) != 0 ? L"true" : L"false",
+            (capabilities.support[i] & FORMAT_SUPPORT_EXCLUSIVE) != 0 ? L"true" : L"false");
+        first = false;
+    }
+    text += L"]}\n";
+    outputf(_T("%ls"), text.c_str());
+}
+
+// Read the cheap per-device settings in order, probe the cache misses in parallel, then report in listing order.
+// The share mode is a setting the user can change at any time, so it is read every run rather than cached.
+HRESULT runCapabilities(TGlobalState* state, bool isOutput)
+{
+    TraceSpan span("runCapabilities");
+    CapabilitiesClock::time_point start = CapabilitiesClock::now();
+
+    DeviceTable targets;
+    std::vector<int> indexes;
+    HRESULT hr = selectTargetDevices(state, isOutput, targets, indexes);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    std::vector<TAudioFormat> formats;
+    buildCapabilityMatrix(formats);
+    CapabilitiesCache cache;
+    loadCapabilitiesCache(cache, formats.size());
+
+    std::vector<TDeviceCapabilities> results(targets.size());
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+        LPCWSTR deviceID = targets[i].id.c_str();
+        TDeviceCapabilities& capabilities = results[i];
+        state->pBackend->getDriverVersion(deviceID, capabilities.driverVersion);
+        state->pBackend->getShareMode(deviceID, &capabilities.shareMode);
+        state->pBackend->getDeviceFormat(deviceID, capabilities.format);
+
+        auto it = cache.find(targets[i].id);
+        if (it != cache.end() && it->second.driverVersion == capabilities.driverVersion && it->second.format == capabilities.format)
+        {
+            capabilities.support = it->second.support;
+            capabilities.cached = true;
+        }
+        else
+        {
+            pending.push_back(i);
+        }
+    }
+
+    int threadCount = probeDevices(state->pBackend, targets, pending, formats, results);
+
+    HRESULT result = S_OK;
+    bool cacheChanged = false;
+    for (size_t index : pending)
+    {
+        const TDeviceCapabilities& capabilities = results[index];
+        if (FAILED(capabilities.hr))
+        {
+            if (SUCCEEDED(result))
+            {
+                result = capabilities.hr;
+            }
+            continue;
+        }
+        TCachedCapabilities& entry = cache[targets[index].id];
+        entry.driverVersion = capabilities.driverVersion;
+        entry.format = capabilities.format;
+        entry.support = capabilities.support;
+        cacheChanged = true;
+    }
+    if (cacheChanged)
+    {
+        saveCapabilitiesCache(cache);
+    }
+
+    if (!state->json)
+    {
+        outputf(_T("S shared, E exclusive, B both, . neither\n"));
+    }
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+        if (state->json)
+            printCapabilitiesJson(targets[i], indexes[i], results[i], formats);
+        else
+            printCapabilities(targets[i], indexes[i], results[i]);
+    }
+
+    if (!state->json)
+    {
+        outputf(_T("Probed %d devices (%d cached) on %d threads in %.1f ms\n"), (int)targets.size(),
+            (int)(targets.size() - pending.size()), threadCount, elapsedMs(start, CapabilitiesClock::now()));
+    }
+    return result;
+}
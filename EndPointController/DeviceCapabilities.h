@@ -0,0 +1,21 @@
+// ----------------------------------------------------------------------------
+// DeviceCapabilities.h
+// --capabilities: test a fixed matrix of sample rates, sample types and
+// channel counts for shared and exclusive use on each selected endpoint, and
+// report the share-mode setting and driver version next to it. Devices are
+// probed in parallel; results are cached per device ID, driver version and
+// current format, so a repeat audit only probes what changed.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include "EndPointController.h"
+
+#define CAPABILITIES_CACHE_FILE "capabilities_cache.txt"
+
+// The formats every device is tested with, rate-major, then sample type, then channel count
+void buildCapabilityMatrix(std::vector<TAudioFormat>& formats);
+
+// Probe the devices picked as for --set-format and print a table per device, or JSON lines with --json
+HRESULT runCapabilities(TGlobalState* state, bool isOutput);
@@ -0,0 +1,67 @@
+#include <wchar.h>
+#include <wctype.h>
+#include "DeviceFormat.h"
+
+// Argument kinds in the order printDeviceInfo passes them: index, friendly name, state, default flag,
+// description, interface name, device ID, sample rate, channels, bits per sample, channel mask, default, minimum
+// and current processing period, volume and mute
+static const char deviceFieldKinds[DEVICE_FORMAT_FIELD_COUNT] = { 'i', 's', 'i', 'i', 's', 's', 's', 'i', 'i', 'i', 'i', 'i', 'i', 'i', 'i', 'i' };
+
+int parseDeviceFormat(LPCWSTR format)
+{
+    int field = 0;
+    for (const wchar_t* pos = format; *pos != L'\0'; pos++)
+    {
+        if (*pos != L'%')
+            continue;
+
+        pos++;
+        if (*pos == L'%')
+            continue;
+
+        while (*pos != L'\0' && wcschr(L"-+ #0", *pos) != NULL)
+            pos++;
+        while (iswdigit(*pos))
+            pos++;
+        if (*pos == L'.')
+        {
+            pos++;
+            while (iswdigit(*pos))
+                pos++;
+        }
+
+        // Wide strings are written "%ws" or "%ls"; integers take no length modifier beyond 'h'
+        bool wide = false;
+        if (*pos == L'w' || *pos == L'l')
+        {
+            wide = true;
+            pos++;
+        }
+        else
+        {
+            while (*pos == L'h')
+                pos++;
+        }
+
+        if (*pos == L'\0' || field >= DEVICE_FORMAT_FIELD_COUNT)
+            return -1;
+
+        char kind = deviceFieldKinds[field++];
+        if (kind == 's')
+        {
+#ifdef _WIN32
+            // The Windows CRT also reads a plain "%s" as a wide string in wprintf
+            if (*pos != L's' || (!wide && pos[-1] == L'h'))
+                return -1;
+#else
+            if (*pos != L's' || !wide)
+                return -1;
+#endif
+        }
+        else if (wide || wcschr(L"diuxXoc", *pos) == NULL)
+        {
+            return -1;
+        }
+    }
+    return field;
+}
@@ -0,0 +1,27 @@
+// ----------------------------------------------------------------------------
+// DeviceFormat.h
+// Checks user supplied -f format strings against the argument list that
+// printDeviceInfo passes to printf.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include "Platform.h"
+
+// Number of printf arguments passed for each device
+#define DEVICE_FORMAT_FIELD_COUNT 16
+
+// The arguments from this position on come from the device's audio format, which takes a call per device to read
+#define DEVICE_FORMAT_AUDIO_FIELDS_START 7
+
+// The arguments from this position on are the engine processing periods, which take another call per device
+#define DEVICE_FORMAT_PERIOD_FIELDS_START 11
+
+// The arguments from this position on are the volume and mute, which take an activation per device
+#define DEVICE_FORMAT_VOLUME_FIELDS_START 14
+
+// Return the number of device fields the format consumes, or -1 if a conversion does not fit the type of
+// the argument at its position (or consumes more arguments than there are). Formats that pass can be
+// handed to printf without risking a crash, which matters for the resident daemon.
+int parseDeviceFormat(LPCWSTR format);
@@ -0,0 +1,127 @@
+#include <chrono>
+#include "Clock.h"
+#include "DeviceSessions.h"
+#include "DeviceSettings.h"
+#include "DeviceVolume.h"
+#include "Output.h"
+#include "Trace.h"
+
+typedef std::chrono::steady_clock SessionsClock;
+
+// What was found on one device, filled in by a worker
+typedef struct TSessionsResult
+{
+    HRESULT hr = S_OK;
+    SessionTable sessions;
+    double readMs = 0;
+} TSessionsResult;
+
+LPCWSTR sessionStateName(ESessionState state)
+{
+    static LPCWSTR names[] = { L"inactive", L"active", L"expired" };
+    return state >= eSessionInactive && state <= eSessionExpired ? names[state] : L"unknown";
+}
+
+// A device line, then one indented line per session
+static void printSessions(const TDeviceEntry& device, int index, const TSessionsResult& result)
+{
+    std::wstring text;
+    appendFormat(text, L"Device %d: %ls: ", index, device.friendlyName.c_str());
+    if (FAILED(result.hr))
+    {
+        appendFormat(text, L"failed (0x%08x)\n", (unsigned int)result.hr);
+        outputf(_T("%ls"), text.c_str());
+        return;
+    }
+
+    appendFormat(text, L"%d session%ls", (int)result.sessions.size(), result.sessions.size() == 1 ? L"" : L"s");
+    if (result.hr == S_FALSE)
+        text += L", cached\n";
+    else
+        appendFormat(text, L" in %.1f ms\n", result.readMs);
+
+    for (const auto& session : result.sessions)
+    {
+        appendFormat(text, L"    %ls (pid %lu): %ls, %d%%%ls\n", session.displayName.empty() ? L"(unnamed)" : session.displayName.c_str(),
+            (unsigned long)session.processID, sessionStateName(session.state), volumePercent(session.volume),
+            session.muted ? L", muted" : L"");
+    }
+    outputf(_T("%ls"), text.c_str());
+}
+
+static void printSessionsJson(const TDeviceEntry& device, int index, const TSessionsResult& result)
+{
+    std::wstring text;
+    appendFormat(text, L"{\"index\":%d,\"name\":", index);
+    appendJsonString(text, device.friendlyName);
+    text += L",\"id\":";
+    appendJsonString(text, device.id);
+    if (FAILED(result.hr))
+    {
+        appendFormat(text, L",\"error\":%u}\n", (unsigned int)result.hr);
+        outputf(_T("%ls"), text.c_str());
+        return;
+    }
+
+    appendFormat(text, L",\"cached\":%ls,\"ms\":%.1f,\"sessions\":[", result.hr == S_FALSE ? L"true" : L"false", result.readMs);
+    for (size_t i = 0; i < result.sessions.size(); i++)
+    {
+        const TAudioSession& session = result.sessions[i];
+        appendFormat(text, L"%ls{\"pid\":%lu,\"name\":", i == 0 ? L"" : L",", (unsigned long)session.processID);
+        appendJsonString(text, session.displayName);
+        appendFormat(text, L",\"state\":\"%ls\",\"volume\":%d,\"muted\":%ls}", sessionStateName(session.state),
+            volumePercent(session.volume), session.muted ? L"true" : L"false");
+    }
+    text += L"]}\n";
+    outputf(_T("%ls"), text.c_str());
+}
+
+// Each device costs a session-manager activation and a call per session, nearly all of it waiting on the audio
+// service, so the devices are read in parallel, then reported in listing order
+HRESULT runSessions(TGlobalState* state, bool isOutput)
+{
+    TraceSpan span("runSessions");
+    SessionsClock::time_point start = SessionsClock::now();
+
+    DeviceTable targets;
+    std::vector<int> indexes;
+    HRESULT hr = selectTargetDevices(state, isOutput, targets, indexes);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    std::vector<TSessionsResult> results(targets.size());
+    int threadCount = runInParallel(targets.size(), BULK_MAX_THREADS, [&](size_t i)
+    {
+        TraceSpan readSpan("AudioBackend::getSessions");
+        SessionsClock::time_point deviceStart = SessionsClock::now();
+        results[i].hr = state->pBackend->getSessions(targets[i].id.c_str(), results[i].sessions);
+        results[i].readMs = elapsedMs(deviceStart, SessionsClock::now());
+    });
+
+    HRESULT result = S_OK;
+    int sessionCount = 0;
+    int cached = 0;
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+        if (FAILED(results[i].hr) && SUCCEEDED(result))
+        {
+            result = results[i].hr;
+        }
+        sessionCount += (int)results[i].sessions.size();
+        cached += results[i].hr == S_FALSE ? 1 : 0;
+
+        if (state->json)
+            printSessionsJson(targets[i], indexes[i], results[i]);
+        else
+            printSessions(targets[i], indexes[i], results[i]);
+    }
+
+    if (!state->json)
+    {
+        outputf(_T("Found %d sessions on %d devices (%d cached) on %d threads in %.1f ms\n"), sessionCount, (int)targets.size(),
+            cached, threadCount, elapsedMs(start, SessionsClock::now()));
+    }
+    return result;
+}
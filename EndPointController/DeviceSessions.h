@@ -0,0 +1,19 @@
+// ----------------------------------------------------------------------------
+// DeviceSessions.h
+// --sessions lists the audio sessions of every endpoint a selector picks, as
+// the bulk commands of DeviceSettings.h select them: each session's process
+// ID, display name, state and volume. Endpoints are enumerated in parallel.
+// Served by the resident process, the sessions come from its tables, which
+// session notifications keep current.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include "EndPointController.h"
+
+// The name of a session state as the reports print it
+LPCWSTR sessionStateName(ESessionState state);
+
+// Enumerate the sessions of the selected devices and print them under each device, or as JSON lines with --json
+HRESULT runSessions(TGlobalState* state, bool isOutput);
@@ -0,0 +1,426 @@
+#include <stdio.h>
+#include <wchar.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "Clock.h"
+#include "DeviceSettings.h"
+#include "Output.h"
+#include "SelectionRules.h"
+#include "Trace.h"
+
+typedef std::chrono::steady_clock SettingsClock;
+
+// The usual speaker positions for a channel count, 0 for counts without one
+DWORD defaultChannelMask(UINT channels)
+{
+    switch (channels)
+    {
+    case 1: return 0x4;     // Front center
+    case 2: return 0x3;     // Front left and right
+    case 4: return 0x33;    // Quad
+    case 6: return 0x3F;    // 5.1
+    case 8: return 0x63F;   // 7.1
+    default: return 0;
+    }
+}
+
+// Parse a format given as rate/bits[/channels]
+HRESULT parseAudioFormat(LPCWSTR text, TAudioFormat& format)
+{
+    format = TAudioFormat();
+
+    wchar_t* end = NULL;
+    format.sampleRate = (DWORD)wcstoul(text, &end, 10);
+    if (end == text || *end != L'/')
+    {
+        return E_INVALIDARG;
+    }
+
+    const wchar_t* pos = end + 1;
+    format.bitsPerSample = (UINT)wcstoul(pos, &end, 10);
+    if (end == pos)
+    {
+        return E_INVALIDARG;
+    }
+    if (*end == L'f' || *end == L'F')
+    {
+        format.isFloat = true;
+        end++;
+    }
+
+    if (*end == L'/')
+    {
+        pos = end + 1;
+        format.channels = (UINT)wcstoul(pos, &end, 10);
+        if (end == pos || format.channels == 0)
+        {
+            return E_INVALIDARG;
+        }
+        format.channelMask = defaultChannelMask(format.channels);
+    }
+
+    if (*end != L'\0' || format.sampleRate == 0 || format.bitsPerSample == 0 || format.bitsPerSample > 32 ||
+        (format.isFloat && format.bitsPerSample != 32))
+    {
+        return E_INVALIDARG;
+    }
+    return S_OK;
+}
+
+// Parse a period given in milliseconds or by name
+HRESULT parseProcessingPeriod(LPCWSTR text, INT64* pPeriod)
+{
+    if (wcscmp(text, L"min") == 0)
+    {
+        *pPeriod = PERIOD_MINIMUM;
+        return S_OK;
+    }
+    if (wcscmp(text, L"default") == 0)
+    {
+        *pPeriod = PERIOD_DEFAULT;
+        return S_OK;
+    }
+
+    wchar_t* end = NULL;
+    double milliseconds = wcstod(text, &end);
+    if (end == text || *end != L'\0' || !(milliseconds > 0) || milliseconds > 1000)
+    {
+        return E_INVALIDARG;
+    }
+    *pPeriod = (INT64)(milliseconds * 10000 + 0.5);
+    return S_OK;
+}
+
+static double periodMs(INT64 period)
+{
+    return period / 10000.0;
+}
+
+void appendAudioFormat(std::wstring& buffer, const TAudioFormat& format)
+{
+    appendFormat(buffer, L"%lu Hz, %u-bit%ls", (unsigned long)format.sampleRate, format.bitsPerSample, format.isFloat ? L" float" : L"");
+    if (format.channels != 0)
+    {
+        appendFormat(buffer, L", %u channel%ls", format.channels, format.channels == 1 ? L"" : L"s");
+    }
+}
+
+// Select by listing index, by --match, or take every listed device, then drop those --except names
+HRESULT selectTargetDevices(TGlobalState* state, bool isOutput, DeviceTable& targets, std::vector<int>& indexes)
+{
+    TraceSpan span("selectTargetDevices");
+
+    TSelectionRule selector;
+    if (state->pMatch != NULL && FAILED(compileDeviceSelector(state->pMatch, selector)))
+    {
+        outputf(_T("Invalid selector: %ls\n"), state->pMatch);
+        return E_INVALIDARG;
+    }
+    TSelectionRule exclusion;
+    if (state->pExcept != NULL && FAILED(compileDeviceSelector(state->pExcept, exclusion)))
+    {
+        outputf(_T("Invalid selector: %ls\n"), state->pExcept);
+        return E_INVALIDARG;
+    }
+
+    DeviceTable devices;
+    HRESULT hr = state->pBackend->enumerateDevices(isOutput ? eRender : eCapture, state->deviceStateFilter, devices);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    for (size_t i = 0; i < devices.size(); i++)
+    {
+        if (state->option != -1 && state->option != (int)i + 1)
+            continue;
+        if (state->pMatch != NULL && !ruleMatches(selector, devices[i]))
+            continue;
+        if (state->pExcept != NULL && ruleMatches(exclusion, devices[i]))
+            continue;
+
+        targets.push_back(devices[i]);
+        indexes.push_back((int)i + 1);
+    }
+
+    if (targets.empty())
+    {
+        outputf(_T("No device matches the selector\n"));
+        return E_NOTFOUND;
+    }
+    return S_OK;
+}
+
+int runInParallel(size_t count, size_t maxThreads, const std::function<void(size_t)>& work)
+{
+    size_t threadCount = count < maxThreads ? count : maxThreads;
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        for (size_t i = next++; i < count; i = next++)
+        {
+            work(i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threadCount; i++)
+    {
+        threads.push_back(std::thread(worker));
+    }
+    if (threadCount > 0)
+    {
+        worker();
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    return (int)threadCount;
+}
+
+// Set the format device by device. The backend creates its policy-config object on the first call and the
+// rest of the batch reuses it; a device already in the target format costs one read and no write.
+HRESULT runSetFormat(TGlobalState* state, bool isOutput)
+{
+    TraceSpan span("runSetFormat");
+    SettingsClock::time_point start = SettingsClock::now();
+
+    DeviceTable targets;
+    std::vector<int> indexes;
+    HRESULT hr = selectTargetDevices(state, isOutput, targets, indexes);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    HRESULT result = S_OK;
+    int changed = 0;
+    int skipped = 0;
+    int failed = 0;
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+        SettingsClock::time_point deviceStart = SettingsClock::now();
+        const TDeviceEntry& device = targets[i];
+
+        // A format without a channel count keeps each device's own layout
+        TAudioFormat current;
+        bool known = SUCCEEDED(state->pBackend->getDeviceFormat(device.id.c_str(), current));
+        TAudioFormat target = state->targetFormat;
+        if (target.channels == 0 || (known && target.channels == current.channels))
+        {
+            target.channels = known ? current.channels : 2;
+            target.channelMask = known ? current.channelMask : defaultChannelMask(target.channels);
+        }
+
+        std::wstring outcome;
+        if (known && current == target)
+        {
+            skipped++;
+            outcome = L"already set";
+        }
+        else
+        {
+            TraceSpan setSpan("AudioBackend::setDeviceFormat");
+            hr = state->pBackend->setDeviceFormat(device.id.c_str(), target);
+            if (SUCCEEDED(hr))
+            {
+                changed++;
+                outcome = L"changed";
+                if (known)
+                {
+                    outcome += L" from ";
+                    appendAudioFormat(outcome, current);
+                }
+            }
+            else
+            {
+                failed++;
+                appendFormat(outcome, L"failed (0x%08x)", (unsigned int)hr);
+                if (SUCCEEDED(result))
+                {
+                    result = hr;
+                }
+            }
+        }
+
+        std::wstring formatText;
+        appendAudioFormat(formatText, target);
+        outputf(_T("Device %d: %ls: %ls: %ls (%.1f ms)\n"), indexes[i], device.friendlyName.c_str(), formatText.c_str(),
+            outcome.c_str(), elapsedMs(deviceStart, SettingsClock::now()));
+    }
+
+    outputf(_T("Changed %d, skipped %d, failed %d of %d devices in %.1f ms\n"), changed, skipped, failed, (int)targets.size(),
+        elapsedMs(start, SettingsClock::now()));
+    return result;
+}
+
+// Set the period device by device. The minimum and default are each device's own, so a named target is
+// resolved against the periods read before the change.
+HRESULT runSetPeriod(TGlobalState* state, bool isOutput)
+{
+    TraceSpan span("runSetPeriod");
+    SettingsClock::time_point start = SettingsClock::now();
+
+    DeviceTable targets;
+    std::vector<int> indexes;
+    HRESULT hr = selectTargetDevices(state, isOutput, targets, indexes);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    HRESULT result = S_OK;
+    int changed = 0;
+    int skipped = 0;
+    int failed = 0;
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+        SettingsClock::time_point deviceStart = SettingsClock::now();
+        const TDeviceEntry& device = targets[i];
+
+        TProcessingPeriod current;
+        hr = state->pBackend->getProcessingPeriod(device.id.c_str(), current);
+        INT64 target = state->targetPeriod == PERIOD_MINIMUM ? current.minimumPeriod
+            : state->targetPeriod == PERIOD_DEFAULT ? current.defaultPeriod : state->targetPeriod;
+
+        std::wstring outcome;
+        if (SUCCEEDED(hr) && current.currentPeriod == target)
+        {
+            skipped++;
+            outcome = L"already set";
+        }
+        else
+        {
+            if (SUCCEEDED(hr))
+            {
+                TraceSpan setSpan("AudioBackend::setProcessingPeriod");
+                hr = state->pBackend->setProcessingPeriod(device.id.c_str(), target);
+            }
+            if (SUCCEEDED(hr))
+            {
+                changed++;
+                appendFormat(outcome, L"changed from %.2f ms", periodMs(current.currentPeriod));
+
+                // The engine may round the period to whole multiples of its own
+                TProcessingPeriod effective;
+                if (state->verify && SUCCEEDED(state->pBackend->getProcessingPeriod(device.id.c_str(), effective)))
+                {
+                    appendFormat(outcome, L", effective %.2f ms (minimum %.2f ms, default %.2f ms)", periodMs(effective.currentPeriod),
+                        periodMs(effective.minimumPeriod), periodMs(effective.defaultPeriod));
+                }
+            }
+            else
+            {
+                failed++;
+                appendFormat(outcome, L"failed (0x%08x)", (unsigned int)hr);
+                if (SUCCEEDED(result))
+                {
+                    result = hr;
+                }
+            }
+        }
+
+        outputf(_T("Device %d: %ls: %.2f ms: %ls (%.1f ms)\n"), indexes[i], device.friendlyName.c_str(), periodMs(target),
+            outcome.c_str(), elapsedMs(deviceStart, SettingsClock::now()));
+    }
+
+    outputf(_T("Changed %d, skipped %d, failed %d of %d devices in %.1f ms\n"), changed, skipped, failed, (int)targets.size(),
+        elapsedMs(start, SettingsClock::now()));
+    return result;
+}
+
+// Median time of a few listings' enumeration of the data flow, in milliseconds, and the device count
+static double timeListing(TGlobalState* state, bool isOutput, size_t* pCount)
+{
+    const int runs = 5;
+    double times[runs];
+    for (int i = 0; i < runs; i++)
+    {
+        DeviceTable devices;
+        SettingsClock::time_point start = SettingsClock::now();
+        state->pBackend->enumerateDevices(isOutput ? eRender : eCapture, state->deviceStateFilter, devices);
+        times[i] = elapsedMs(start, SettingsClock::now());
+        *pCount = devices.size();
+    }
+    std::sort(times, times + runs);
+    return times[runs / 2];
+}
+
+// Hide or show device by device. Every call shares the backend's one policy-config object.
+HRESULT runSetVisibility(TGlobalState* state, bool isOutput, bool visible)
+{
+    TraceSpan span("runSetVisibility");
+    SettingsClock::time_point start = SettingsClock::now();
+
+    size_t countBefore = 0;
+    double listingBefore = state->verify ? timeListing(state, isOutput, &countBefore) : 0;
+
+    int stateFilter = state->deviceStateFilter;
+    if (visible)
+    {
+        state->deviceStateFilter = DEVICE_STATEMASK_ALL;
+    }
+    DeviceTable targets;
+    std::vector<int> indexes;
+    HRESULT hr = selectTargetDevices(state, isOutput, targets, indexes);
+    state->deviceStateFilter = stateFilter;
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    HRESULT result = S_OK;
+    int changed = 0;
+    int skipped = 0;
+    int failed = 0;
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+        SettingsClock::time_point deviceStart = SettingsClock::now();
+        const TDeviceEntry& device = targets[i];
+
+        std::wstring outcome;
+        if (((device.state & DEVICE_STATE_DISABLED) == 0) == visible)
+        {
+            skipped++;
+            outcome = visible ? L"already shown" : L"already hidden";
+        }
+        else
+        {
+            TraceSpan setSpan("AudioBackend::setEndpointVisibility");
+            hr = state->pBackend->setEndpointVisibility(device.id.c_str(), visible);
+            if (SUCCEEDED(hr))
+            {
+                changed++;
+                outcome = visible ? L"shown" : L"hidden";
+            }
+            else
+            {
+                failed++;
+                appendFormat(outcome, L"failed (0x%08x)", (unsigned int)hr);
+                if (SUCCEEDED(result))
+                {
+                    result = hr;
+                }
+            }
+        }
+
+        outputf(_T("Device %d: %ls: %ls (%.1f ms)\n"), indexes[i], device.friendlyName.c_str(), outcome.c_str(),
+            elapsedMs(deviceStart, SettingsClock::now()));
+    }
+
+    outputf(_T("Changed %d, skipped %d, failed %d of %d devices in %.1f ms\n"), changed, skipped, failed, (int)targets.size(),
+        elapsedMs(start, SettingsClock::now()));
+
+    if (state->verify)
+    {
+        size_t countAfter = 0;
+        double listingAfter = timeListing(state, isOutput, &countAfter);
+        outputf(_T("Listing: %d devices in %.2f ms before, %d devices in %.2f ms after (%+.0f%%)\n"), (int)countBefore,
+            listingBefore, (int)countAfter, listingAfter, listingBefore > 0 ? (listingAfter - listingBefore) * 100 / listingBefore : 0.0);
+    }
+    return result;
+}
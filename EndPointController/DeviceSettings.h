@@ -0,0 +1,54 @@
+// ----------------------------------------------------------------------------
+// DeviceSettings.h
+// Bulk endpoint configuration. --set-format applies one shared-mode format,
+// --set-period one engine processing period, and --hide and --unhide the
+// endpoint visibility to every endpoint of a data flow that a selector picks:
+// the device_index from the listing, the conditions given to --match (as in a
+// rules file), or else every listed device.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <functional>
+#include "EndPointController.h"
+
+// Upper bound on the threads of a parallel bulk command, whatever the device count. Their calls mostly wait on
+// the audio service, so the bound is not tied to the core count.
+#define BULK_MAX_THREADS 8
+
+// Parse "rate/bits[/channels]", e.g. "48000/24" or "48000/32f/2"; an f after the bits asks for float samples.
+// Channels left out are 0: each device keeps its own.
+HRESULT parseAudioFormat(LPCWSTR text, TAudioFormat& format);
+
+// --set-period values that stand for each device's own minimum or default period
+#define PERIOD_MINIMUM -1
+#define PERIOD_DEFAULT -2
+
+// Parse a period in milliseconds ("3", "2.5"), or "min" or "default"; the result is in 100-ns units
+HRESULT parseProcessingPeriod(LPCWSTR text, INT64* pPeriod);
+
+// The usual speaker positions for a channel count, 0 for counts without one
+DWORD defaultChannelMask(UINT channels);
+
+// Append a format in the form the reports use, e.g. "48000 Hz, 24-bit, 2 channels"
+void appendAudioFormat(std::wstring& buffer, const TAudioFormat& format);
+
+// Enumerate the devices of the data flow that the listing would show (honouring -a), keeping those the
+// selector picks and --except does not. Each device is paired with its listing index.
+HRESULT selectTargetDevices(TGlobalState* state, bool isOutput, DeviceTable& targets, std::vector<int>& indexes);
+
+// Call work(i) for every i below count from up to maxThreads threads, the calling thread among them, each taking
+// the next index until none is left. Returns the number of threads used.
+int runInParallel(size_t count, size_t maxThreads, const std::function<void(size_t)>& work);
+
+// Apply state->targetFormat to the selected devices, skipping those already in it
+HRESULT runSetFormat(TGlobalState* state, bool isOutput);
+
+// Apply state->targetPeriod to the selected devices, skipping those already at it. With state->verify, read
+// the period back and report the one the engine settled on.
+HRESULT runSetPeriod(TGlobalState* state, bool isOutput);
+
+// Hide or show the selected devices, skipping those already hidden or shown. --unhide selects from the -a
+// listing, since hidden devices are not active. With state->verify, time the listing before and after.
+HRESULT runSetVisibility(TGlobalState* state, bool isOutput, bool visible);
@@ -0,0 +1,155 @@
+#include <wchar.h>
+#include <chrono>
+#include "Clock.h"
+#include "DeviceSettings.h"
+#include "DeviceVolume.h"
+#include "Output.h"
+#include "Trace.h"
+
+typedef std::chrono::steady_clock VolumeClock;
+
+// What happened to one device, filled in by a worker
+typedef struct TVolumeResult
+{
+    HRESULT hr = S_OK;
+    TEndpointVolume before;
+    TEndpointVolume after;
+    double updateMs = 0;
+} TVolumeResult;
+
+HRESULT parseVolumeLevel(LPCWSTR text, float* pLevel)
+{
+    wchar_t* end = NULL;
+    double percent = wcstod(text, &end);
+    if (end == text || *end != L'\0' || !(percent >= 0) || percent > 100)
+    {
+        return E_INVALIDARG;
+    }
+    *pLevel = (float)(percent / 100);
+    return S_OK;
+}
+
+int volumePercent(float level)
+{
+    return (int)(level * 100 + 0.5f);
+}
+
+void appendEndpointVolume(std::wstring& buffer, const TEndpointVolume& volume)
+{
+    appendFormat(buffer, L"%d%%%ls", volumePercent(volume.level), volume.muted ? L", muted" : L"");
+}
+
+static void printVolumeJson(const TDeviceEntry& device, int index, const TVolumeResult& result, bool updating)
+{
+    std::wstring text;
+    appendFormat(text, L"{\"index\":%d,\"name\":", index);
+    appendJsonString(text, device.friendlyName);
+    text += L",\"id\":";
+    appendJsonString(text, device.id);
+    if (FAILED(result.hr))
+    {
+        appendFormat(text, L",\"error\":%u}\n", (unsigned int)result.hr);
+    }
+    else if (updating)
+    {
+        appendFormat(text, L",\"volume\":%d,\"muted\":%ls,\"previousVolume\":%d,\"previouslyMuted\":%ls,\"changed\":%ls,\"ms\":%.1f}\n",
+            volumePercent(result.after.level), result.after.muted ? L"true" : L"false", volumePercent(result.before.level),
+            result.before.muted ? L"true" : L"false", result.hr == S_OK ? L"true" : L"false", result.updateMs);
+    }
+    else
+    {
+        appendFormat(text, L",\"volume\":%d,\"muted\":%ls}\n", volumePercent(result.after.level), result.after.muted ? L"true" : L"false");
+    }
+    outputf(_T("%ls"), text.c_str());
+}
+
+// Read or update every selected device in parallel, then report in listing order. A plain report is an update that
+// changes nothing, so it too takes one activation per device.
+HRESULT runVolume(TGlobalState* state, bool isOutput)
+{
+    TraceSpan span("runVolume");
+    VolumeClock::time_point start = VolumeClock::now();
+
+    DeviceTable targets;
+    std::vector<int> indexes;
+    HRESULT hr = selectTargetDevices(state, isOutput, targets, indexes);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    const TVolumeUpdate& update = state->volumeUpdate;
+    bool updating = update.level >= 0 || update.mute >= 0;
+    std::vector<TVolumeResult> results(targets.size());
+    int threadCount = runInParallel(targets.size(), BULK_MAX_THREADS, [&](size_t i)
+    {
+        TraceSpan updateSpan("AudioBackend::updateEndpointVolume");
+        VolumeClock::time_point deviceStart = VolumeClock::now();
+        results[i].hr = state->pBackend->updateEndpointVolume(targets[i].id.c_str(), update, results[i].before, results[i].after);
+        results[i].updateMs = elapsedMs(deviceStart, VolumeClock::now());
+    });
+
+    HRESULT result = S_OK;
+    int changed = 0;
+    int skipped = 0;
+    int failed = 0;
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+        const TVolumeResult& deviceResult = results[i];
+        if (FAILED(deviceResult.hr))
+        {
+            failed++;
+            if (SUCCEEDED(result))
+            {
+                result = deviceResult.hr;
+            }
+        }
+        else if (deviceResult.hr == S_OK)
+        {
+            changed++;
+        }
+        else
+        {
+            skipped++;
+        }
+
+        if (state->json)
+        {
+            printVolumeJson(targets[i], indexes[i], deviceResult, updating);
+            continue;
+        }
+
+        std::wstring outcome;
+        if (FAILED(deviceResult.hr))
+        {
+            appendFormat(outcome, L"failed (0x%08x)", (unsigned int)deviceResult.hr);
+        }
+        else if (!updating)
+        {
+            appendEndpointVolume(outcome, deviceResult.after);
+        }
+        else if (deviceResult.hr == S_OK)
+        {
+            appendEndpointVolume(outcome, deviceResult.after);
+            outcome += L": changed from ";
+            appendEndpointVolume(outcome, deviceResult.before);
+        }
+        else
+        {
+            appendEndpointVolume(outcome, deviceResult.after);
+            outcome += L": already set";
+        }
+
+        if (updating)
+            outputf(_T("Device %d: %ls: %ls (%.1f ms)\n"), indexes[i], targets[i].friendlyName.c_str(), outcome.c_str(), deviceResult.updateMs);
+        else
+            outputf(_T("Device %d: %ls: %ls\n"), indexes[i], targets[i].friendlyName.c_str(), outcome.c_str());
+    }
+
+    if (updating && !state->json)
+    {
+        outputf(_T("Changed %d, skipped %d, failed %d of %d devices on %d threads in %.1f ms\n"), changed, skipped, failed,
+            (int)targets.size(), threadCount, elapsedMs(start, VolumeClock::now()));
+    }
+    return result;
+}
@@ -0,0 +1,24 @@
+// ----------------------------------------------------------------------------
+// DeviceVolume.h
+// --volume reports, and --set-volume, --mute and --unmute change, the master
+// volume and mute of every endpoint a selector picks, as the bulk commands of
+// DeviceSettings.h select them. Devices are updated in parallel, each over a
+// single activation of its volume control.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include "EndPointController.h"
+
+// Parse a volume in percent, 0 to 100 ("35", "12.5"), into a scalar level
+HRESULT parseVolumeLevel(LPCWSTR text, float* pLevel);
+
+// The level as the volume slider shows it, in whole percent
+int volumePercent(float level);
+
+// Append a volume in the form the reports use, e.g. "35%, muted"
+void appendEndpointVolume(std::wstring& buffer, const TEndpointVolume& volume);
+
+// Report the selected devices' volume, or apply state->volumeUpdate to them if it changes anything
+HRESULT runVolume(TGlobalState* state, bool isOutput);
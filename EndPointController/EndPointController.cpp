@@ -1,322 +1,979 @@
 #include <stdio.h>
 #include <wchar.h>
-#include <tchar.h>
 #include <string>
-#include <iostream>
-#include <fstream>
 #include <vector>
-#include "windows.h"
-#include "Mmdeviceapi.h"
-#include "PolicyConfig.h"
-#include "Propidl.h"
-#include "Functiondiscoverykeys_devpkey.h"
+#include "Platform.h"
+#include "AudioBackend.h"
+#include "EndPointController.h"
+#include "Daemon.h"
+#include "DeviceCapabilities.h"
+#include "DeviceFormat.h"
+#include "DeviceSessions.h"
+#include "DeviceSettings.h"
+#include "DeviceVolume.h"
+#include "IdleSwitch.h"
+#include "Meter.h"
+#include "Output.h"
+#include "SelectionRules.h"
+#include "SharedSnapshot.h"
+#include "Startup.h"
+#include "Stats.h"
+#include "SwitchScheduler.h"
+#include "Trace.h"
+#include "VerifySwitch.h"
+#include "Watch.h"
 
 // Format default string for outputting a device entry. The following parameters will be used in the following order:
 // Index, Device Friendly Name
 #define DEVICE_OUTPUT_FORMAT L"Audio Device %d: %ws"
 #define DEVICE_DETAILED_FORMAT L"Device Index: %d, Name: %ws, State: %d, Default: %d, Descriptions: %ws, Interface Name: %ws, Device ID: %ws\n"
 
-typedef struct TGlobalState
-{
-    HRESULT hr;
-    int option;
-    IMMDeviceEnumerator *pEnum;
-    IMMDeviceCollection *pDevices;
-    LPWSTR strDefaultDeviceID;
-    IMMDevice *pCurrentDevice;
-    LPCWSTR pDeviceFormatStr;
-    int deviceStateFilter;
-} TGlobalState;
-
-std::vector<std::pair<std::wstring, std::wstring>> cachedOutputDevices; // Stores (Device Name, Device ID) for output devices
-std::vector<std::pair<std::wstring, std::wstring>> cachedInputDevices;  // Stores (Device Name, Device ID) for input devices
+DeviceTable cachedOutputDevices; // Stores the last listed output devices
+DeviceTable cachedInputDevices;  // Stores the last listed input devices
 
 // Function declarations
+void printUsage();
 void createDeviceEnumerator(TGlobalState* state, bool isOutput);
 void enumerateDevices(TGlobalState* state, bool isOutput);
-HRESULT printDeviceInfo(IMMDevice* pDevice, int index, LPCWSTR outFormat, LPWSTR strDefaultDeviceID);
-std::wstring getDeviceProperty(IPropertyStore* pStore, const PROPERTYKEY key);
-HRESULT SetDefaultAudioPlaybackDevice(LPCWSTR devID);
-HRESULT SetDefaultAudioCaptureDevice(LPCWSTR devID);
+HRESULT printDeviceInfo(const TDeviceEntry& device, int index, LPCWSTR outFormat, LPCWSTR strDefaultDeviceID);
 void invalidParameterHandler(const wchar_t* expression, const wchar_t* function, const wchar_t* file, 
     unsigned int line, uintptr_t pReserved);
 void cacheDeviceList(bool isOutput);
-void loadDeviceCache(bool isOutput);
-HRESULT setDefaultDeviceFromCache(int deviceIndex, bool isOutput);
-LPWSTR getDefaultDeviceID(EDataFlow dataFlow);
+LPCWSTR getCachedDeviceID(int deviceIndex, bool isOutput);
+HRESULT setDefaultDeviceFromCache(AudioBackend* pBackend, int deviceIndex, bool isOutput);
+HRESULT setDefaultDeviceByRules(TGlobalState* state, bool isOutput);
+std::wstring getDefaultDeviceID(AudioBackend* pBackend, EDataFlow dataFlow);
 
 // Main function
 int _tmain(int argc, LPCWSTR argv[])
 {
-    TGlobalState state = { 0 };
+    TGlobalState state = {};
     bool isOutput = true; // Default to output devices
 
-    // Initialize COM library
-    state.hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
-    if (FAILED(state.hr))
+    // Process command line arguments
+    state.hr = parseArguments(&state, argc, argv, &isOutput);
+    if (state.hr != S_OK)
     {
-        return state.hr;
+        return SUCCEEDED(state.hr) ? 0 : state.hr;
     }
 
-    // Process command line arguments
-    state.option = -1; // Default is no option
-    state.pDeviceFormatStr = DEVICE_OUTPUT_FORMAT; // Default to simple format
-    state.deviceStateFilter = DEVICE_STATE_ACTIVE;
+    // Both report when _tmain returns, after every span below has ended
+    StartupReport startupReport(state.startupTime);
+    TraceSession traceSession(state.pTracePath);
+    if (state.stats)
+    {
+        statsStart();
+    }
+    TraceSpan span("_tmain");
+
+    if (state.daemon)
+    {
+        // Serve requests from a resident process until told to stop
+        return runDaemon(&state);
+    }
+
+    if (state.client)
+    {
+        // Forward the request to the resident process, running it here if there is none
+        bool served = false;
+        state.hr = runClient(argc, argv, &served);
+        if (served)
+        {
+            return state.hr;
+        }
+    }
+
+    if (state.shutdown || state.switchStatus)
+    {
+        outputf(_T("No resident process is running\n"));
+        return E_NOTFOUND;
+    }
+
+    // A plain listing is answered from the resident process's shared snapshot when one is published, without
+    // initializing COM; anything else, a listing that shows the volume (--json included), or no live snapshot,
+    // goes to the backend
+    bool isListing = state.option == -1 && state.pRulesPath == NULL && !state.watch && !state.setFormat &&
+        !state.setPeriod && !state.hide && !state.unhide && !state.capabilities && !state.volume && !state.meter &&
+        !state.sessions && !listingNeedsVolume(&state);
+    if (!isListing || FAILED(openSnapshotBackend(&state.pBackend)))
+    {
+        // Initialize COM library (or the simulated backend)
+        TraceSpan createSpan("createAudioBackend");
+        state.hr = createAudioBackend(&state.pBackend);
+        if (FAILED(state.hr))
+        {
+            return state.hr;
+        }
+    }
+
+    runCommand(&state, isOutput);
+    for (int i = 1; i < state.repeat && SUCCEEDED(state.hr); i++)
+    {
+        // Only the first run's output is shown
+        std::wstring discarded;
+        beginOutputCapture(&discarded);
+        state.devices.clear();
+        runCommand(&state, isOutput);
+        endOutputCapture();
+    }
+
+    // Uninitialize COM library
+    {
+        TraceSpan releaseSpan("releaseAudioBackend");
+        releaseAudioBackend(state.pBackend);
+    }
+
+    if (state.stats)
+    {
+        statsReport();
+    }
+
+    return state.hr;
+}
+
+// Print the command line help
+void printUsage()
+{
+    outputf(_T("Lists active audio end-point devices (playback or capture) or sets default audio end-point\n"));
+    outputf(_T("device.\n\n"));
+    outputf(_T("USAGE\n"));
+    outputf(_T("  EndPointController.exe [--input | --output] [-a] [-f format_str]  Lists audio end-point devices\n"));
+    outputf(_T("  EndPointController.exe device_index [--input | --output]         Sets the default device\n"));
+    outputf(_T("  EndPointController.exe device_index --when-idle ms [--timeout ms] [--input | --output]\n"));
+    outputf(_T("                                                                  Sets it once the current default is idle\n"));
+    outputf(_T("  EndPointController.exe --watch [--input | --output] [--json]     Prints device changes as they happen\n"));
+    outputf(_T("  EndPointController.exe --set-format rate/bits[/channels] [device_index | --match conditions]\n"));
+    outputf(_T("                                                                  Sets the format of the selected devices\n"));
+    outputf(_T("  EndPointController.exe --set-period ms|min|default [--verify] [device_index | --match conditions]\n"));
+    outputf(_T("                                                                  Sets the engine period of the selected devices\n"));
+    outputf(_T("  EndPointController.exe --hide | --unhide [--verify] [device_index | --match conditions]\n"));
+    outputf(_T("                                                                  Hides or shows the selected devices\n"));
+    outputf(_T("  EndPointController.exe --capabilities [--json] [device_index | --match conditions]\n"));
+    outputf(_T("                                                                  Probes the formats of the selected devices\n"));
+    outputf(_T("  EndPointController.exe --volume | [--set-volume percent] [--mute | --unmute] [--json]\n"));
+    outputf(_T("                         [device_index | --match conditions] [--except conditions]\n"));
+    outputf(_T("                                                                  Reports or sets the volume of the selected devices\n"));
+    outputf(_T("  EndPointController.exe --meter [--meter-rate hz] [--meter-log file] [--timeout ms] [--json]\n"));
+    outputf(_T("                         [device_index | --match conditions]         Samples the peak meters of the selected devices\n"));
+    outputf(_T("  EndPointController.exe --sessions [--json] [device_index | --match conditions]\n"));
+    outputf(_T("                                                                  Lists the audio sessions of the selected devices\n"));
+    outputf(_T("  EndPointController.exe --daemon                                 Serves requests from a resident process\n"));
+    outputf(_T("\n"));
+    outputf(_T("OPTIONS\n"));
+    outputf(_T("  --input         Target input devices (microphones).\n"));
+    outputf(_T("  --output        Target output devices (speakers/headphones) [Default].\n"));
+    outputf(_T("  -a              Display all devices, rather than just active devices.\n"));
+    outputf(_T("  -f format_str   Outputs the details of each device using the given format string. The\n"));
+    outputf(_T("                  printf arguments are: index, name, state, default, description,\n"));
+    outputf(_T("                  interface name, ID, sample rate, channels, bits per sample, channel mask,\n"));
+    outputf(_T("                  default, minimum and current engine period (100-ns units), volume (percent)\n"));
+    outputf(_T("                  and mute (0 or 1).\n"));
+    outputf(_T("  --default       List only the current default device.\n"));
+    outputf(_T("  --json          Print each device (or --watch event) as a JSON object per line.\n"));
+    outputf(_T("  --verify        When setting a device, wait for the default-change notification and\n"));
+    outputf(_T("                  report the propagation latency.\n"));
+    outputf(_T("  --timeout ms    How long --verify waits for the notification [Default: 5000], how long\n"));
+    outputf(_T("                  --when-idle waits [Default: %d], or how long --watch runs [Default: until\n"), WHEN_IDLE_DEFAULT_TIMEOUT_MS);
+    outputf(_T("                  interrupted].\n"));
+    outputf(_T("  --when-idle ms  Before switching, wait until the current default has had no active session\n"));
+    outputf(_T("                  and no signal on its meter for the given time. If it does not happen\n"));
+    outputf(_T("                  within the --timeout, the default is left unchanged.\n"));
+    outputf(_T("  --coalesce ms   Window over which --watch merges a burst of changes into one diff\n"));
+    outputf(_T("                  [Default: %d].\n"), WATCH_DEFAULT_COALESCE_MS);
+    outputf(_T("  --rules file    Select the device to switch to with the rules in the given file.\n"));
+    outputf(_T("  --set-format rate/bits[/channels]\n"));
+    outputf(_T("                  Set the shared-mode format (e.g. 48000/24, or 48000/32f for float) of\n"));
+    outputf(_T("                  the device given by index, the devices --match selects, or every listed\n"));
+    outputf(_T("                  device. Devices keep their channel count unless one is given.\n"));
+    outputf(_T("  --set-period ms|min|default\n"));
+    outputf(_T("                  Set the audio engine's processing period of the selected devices, in\n"));
+    outputf(_T("                  milliseconds or as each device's minimum or default. With --verify,\n"));
+    outputf(_T("                  report the period the engine settled on.\n"));
+    outputf(_T("  --hide          Hide (disable) the selected devices. With --verify, report how long a\n"));
+    outputf(_T("                  listing takes before and after.\n"));
+    outputf(_T("  --unhide        Show the selected hidden devices again, selecting from the -a listing.\n"));
+    outputf(_T("  --capabilities  Test rates, sample types and channel counts for shared and exclusive use\n"));
+    outputf(_T("                  on the selected devices, and show their share mode and driver version.\n"));
+    outputf(_T("                  Results are cached until the driver or the device format changes.\n"));
+    outputf(_T("  --volume        Report the volume and mute of the selected devices.\n"));
+    outputf(_T("  --set-volume percent\n"));
+    outputf(_T("                  Set the volume of the selected devices, 0 to 100.\n"));
+    outputf(_T("  --mute          Mute the selected devices; combines with --set-volume.\n"));
+    outputf(_T("  --unmute        Unmute the selected devices; combines with --set-volume.\n"));
+    outputf(_T("  --meter         Sample the peak meters of the selected devices until interrupted or the\n"));
+    outputf(_T("                  --timeout passes, printing a summary every second, then report the\n"));
+    outputf(_T("                  sampler's jitter and CPU cost.\n"));
+    outputf(_T("  --meter-rate hz Samples per second [Default: %d, at most %d].\n"), METER_DEFAULT_RATE_HZ, METER_MAX_RATE_HZ);
+    outputf(_T("  --meter-log file  Write every sample to the file in a compact binary form instead.\n"));
+    outputf(_T("  --sessions      List the process ID, display name, state and volume of each audio session\n"));
+    outputf(_T("                  on the selected devices.\n"));
+    outputf(_T("  --match conditions  Select devices with the conditions of a rules-file line, e.g.\n"));
+    outputf(_T("                  \"formfactor=microphone name=USB\".\n"));
+    outputf(_T("  --except conditions  Leave out the devices matching the conditions.\n"));
+    outputf(_T("  --client        Send the request to the resident process started with --daemon, or run\n"));
+    outputf(_T("                  it directly if none is running.\n"));
+    outputf(_T("  --shutdown      Stop the resident process (with --client).\n"));
+    outputf(_T("  --switch-status Send the resident process's queued switches, then report its switch counts\n"));
+    outputf(_T("                  and the last switch that failed since the previous report (with --client).\n"));
+    outputf(_T("  --trace file    Write the time spent in each phase to the file as Chrome trace-event JSON.\n"));
+    outputf(_T("  --repeat N      Run the list or switch operation N times in one process, showing the\n"));
+    outputf(_T("                  output of the first run only.\n"));
+    outputf(_T("  --stats         Report min/p50/p90/p99/max of each phase's duration at the end.\n"));
+    outputf(_T("  --startup-time  Report the time from process entry to the first output and to exit on\n"));
+    outputf(_T("                  stderr.\n"));
+    outputf(_T("  --switch-window ms    Window over which the resident process merges switch requests for\n"));
+    outputf(_T("                        the same device role into the last one [Default: %d].\n"), SWITCH_DEFAULT_WINDOW_MS);
+    outputf(_T("  --switch-interval ms  Minimum time between the resident process's switches of the same\n"));
+    outputf(_T("                        device role [Default: %d].\n"), SWITCH_DEFAULT_INTERVAL_MS);
+}
+
+// Parse the command line into state
+HRESULT parseArguments(TGlobalState* state, int argc, LPCWSTR argv[], bool* pIsOutput)
+{
+    state->option = -1; // Default is no option
+    state->deviceFormatStr = portableFormatString(DEVICE_OUTPUT_FORMAT); // Default to simple format
+    state->deviceStateFilter = DEVICE_STATE_ACTIVE;
+    state->timeoutMs = -1;
+    state->whenIdleMs = -1;
+    state->coalesceMs = WATCH_DEFAULT_COALESCE_MS;
+    state->switchWindowMs = SWITCH_DEFAULT_WINDOW_MS;
+    state->repeat = 1;
+    state->switchIntervalMs = SWITCH_DEFAULT_INTERVAL_MS;
 
     for (int i = 1; i < argc; i++) 
     {
         if (wcscmp(argv[i], _T("--help")) == 0)
         {
-            wprintf_s(_T("Lists active audio end-point devices (playback or capture) or sets default audio end-point\n"));
-            wprintf_s(_T("device.\n\n"));
-            wprintf_s(_T("USAGE\n"));
-            wprintf_s(_T("  EndPointController.exe [--input | --output] [-a] [-f format_str]  Lists audio end-point devices\n"));
-            wprintf_s(_T("  EndPointController.exe device_index [--input | --output]         Sets the default device\n"));
-            wprintf_s(_T("\n"));
-            wprintf_s(_T("OPTIONS\n"));
-            wprintf_s(_T("  --input         Target input devices (microphones).\n"));
-            wprintf_s(_T("  --output        Target output devices (speakers/headphones) [Default].\n"));
-            wprintf_s(_T("  -a              Display all devices, rather than just active devices.\n"));
-            wprintf_s(_T("  -f format_str   Outputs the details of each device using the given format string.\n"));
-            exit(0);
+            printUsage();
+            return S_FALSE;
         }
         else if (wcscmp(argv[i], _T("-a")) == 0)
         {
-            state.deviceStateFilter = DEVICE_STATEMASK_ALL;
+            state->deviceStateFilter = DEVICE_STATEMASK_ALL;
         }
         else if (wcscmp(argv[i], _T("-f")) == 0)
         {
             if ((argc - i) >= 2) {
-                state.pDeviceFormatStr = argv[++i]; // Use the provided format string
+                state->deviceFormatStr = portableFormatString(argv[++i]); // Use the provided format string
 
+#ifdef _WIN32
                 _set_invalid_parameter_handler(invalidParameterHandler);
                 _CrtSetReportMode(_CRT_ASSERT, 0);
+#endif
             }
             else
             {
-                wprintf_s(_T("Missing format string"));
-                exit(1);
+                outputf(_T("Missing format string"));
+                return E_INVALIDARG;
             }
         }
         else if (wcscmp(argv[i], _T("--input")) == 0)
         {
-            isOutput = false;
+            *pIsOutput = false;
         }
         else if (wcscmp(argv[i], _T("--output")) == 0)
         {
-            isOutput = true;
+            *pIsOutput = true;
+        }
+        else if (wcscmp(argv[i], _T("--default")) == 0)
+        {
+            state->defaultOnly = true;
+        }
+        else if (wcscmp(argv[i], _T("--verify")) == 0)
+        {
+            state->verify = true;
+        }
+        else if (wcscmp(argv[i], _T("--timeout")) == 0)
+        {
+            if ((argc - i) >= 2)
+            {
+                state->timeoutMs = _wtoi(argv[++i]);
+            }
+            else
+            {
+                outputf(_T("Missing timeout"));
+                return E_INVALIDARG;
+            }
+        }
+        else if (wcscmp(argv[i], _T("--when-idle")) == 0)
+        {
+            if ((argc - i) >= 2 && isdigit(argv[i + 1][0]))
+            {
+                state->whenIdleMs = _wtoi(argv[++i]);
+            }
+            else
+            {
+                outputf(_T("Missing or invalid idle window"));
+                return E_INVALIDARG;
+            }
+        }
+        else if (wcscmp(argv[i], _T("--watch")) == 0)
+        {
+            state->watch = true;
+        }
+        else if (wcscmp(argv[i], _T("--json")) == 0)
+        {
+            state->json = true;
+        }
+        else if (wcscmp(argv[i], _T("--coalesce")) == 0)
+        {
+            if ((argc - i) >= 2)
+            {
+                state->coalesceMs = _wtoi(argv[++i]);
+            }
+            else
+            {
+                outputf(_T("Missing coalescing window"));
+                return E_INVALIDARG;
+            }
+        }
+        else if (wcscmp(argv[i], _T("--trace")) == 0)
+        {
+            if ((argc - i) >= 2)
+            {
+                state->pTracePath = argv[++i];
+            }
+            else
+            {
+                outputf(_T("Missing trace file"));
+                return E_INVALIDARG;
+            }
+        }
+        else if (wcscmp(argv[i], _T("--repeat")) == 0)
+        {
+            if ((argc - i) >= 2 && _wtoi(argv[i + 1]) >= 1)
+            {
+                state->repeat = _wtoi(argv[++i]);
+            }
+            else
+            {
+                outputf(_T("Missing or invalid repeat count"));
+                return E_INVALIDARG;
+            }
+        }
+        else if (wcscmp(argv[i], _T("--stats")) == 0)
+        {
+            state->stats = true;
+        }
+        else if (wcscmp(argv[i], _T("--startup-time")) == 0)
+        {
+            state->startupTime = true;
+        }
+        else if (wcscmp(argv[i], _T("--switch-window")) == 0)
+        {
+            if ((argc - i) >= 2)
+            {
+                state->switchWindowMs = _wtoi(argv[++i]);
+            }
+            else
+            {
+                outputf(_T("Missing switch window"));
+                return E_INVALIDARG;
+            }
+        }
+        else if (wcscmp(argv[i], _T("--switch-interval")) == 0)
+        {
+            if ((argc - i) >= 2)
+            {
+                state->switchIntervalMs = _wtoi(argv[++i]);
+            }
+            else
+            {
+                outputf(_T("Missing switch interval"));
+                return E_INVALIDARG;
+            }
+        }
+        else if (wcscmp(argv[i], _T("--rules")) == 0)
+        {
+            if ((argc - i) >= 2)
+            {
+                state->pRulesPath = argv[++i];
+            }
+            else
+            {
+                outputf(_T("Missing rules file"));
+                return E_INVALIDARG;
+            }
+        }
+        else if (wcscmp(argv[i], _T("--set-format")) == 0)
+        {
+            if ((argc - i) >= 2 && SUCCEEDED(parseAudioFormat(argv[i + 1], state->targetFormat)))
+            {
+                state->setFormat = true;
+                i++;
+            }
+            else
+            {
+                outputf(_T("Missing or invalid format (rate/bits[/channels])"));
+                return E_INVALIDARG;
+            }
+        }
+        else if (wcscmp(argv[i], _T("--set-period")) == 0)
+        {
+            if ((argc - i) >= 2 && SUCCEEDED(parseProcessingPeriod(argv[i + 1], &state->targetPeriod)))
+            {
+                state->setPeriod = true;
+                i++;
+            }
+            else
+            {
+                outputf(_T("Missing or invalid period (ms, min or default)"));
+                return E_INVALIDARG;
+            }
+        }
+        else if (wcscmp(argv[i], _T("--hide")) == 0)
+        {
+            state->hide = true;
+        }
+        else if (wcscmp(argv[i], _T("--unhide")) == 0)
+        {
+            state->unhide = true;
+        }
+        else if (wcscmp(argv[i], _T("--capabilities")) == 0)
+        {
+            state->capabilities = true;
+        }
+        else if (wcscmp(argv[i], _T("--volume")) == 0)
+        {
+            state->volume = true;
+        }
+        else if (wcscmp(argv[i], _T("--set-volume")) == 0)
+        {
+            if ((argc - i) >= 2 && SUCCEEDED(parseVolumeLevel(argv[i + 1], &state->volumeUpdate.level)))
+            {
+                state->volume = true;
+                i++;
+            }
+            else
+            {
+                outputf(_T("Missing or invalid volume (0 to 100)"));
+                return E_INVALIDARG;
+            }
+        }
+        else if (wcscmp(argv[i], _T("--meter")) == 0)
+        {
+            state->meter = true;
+        }
+        else if (wcscmp(argv[i], _T("--meter-rate")) == 0)
+        {
+            if ((argc - i) >= 2 && _wtoi(argv[i + 1]) > 0 && _wtoi(argv[i + 1]) <= METER_MAX_RATE_HZ)
+            {
+                state->meterRateHz = _wtoi(argv[++i]);
+            }
+            else
+            {
+                outputf(_T("Missing or invalid rate (1 to %d Hz)"), METER_MAX_RATE_HZ);
+                return E_INVALIDARG;
+            }
+        }
+        else if (wcscmp(argv[i], _T("--meter-log")) == 0)
+        {
+            if ((argc - i) >= 2)
+            {
+                state->pMeterLogPath = argv[++i];
+            }
+            else
+            {
+                outputf(_T("Missing meter log path"));
+                return E_INVALIDARG;
+            }
+        }
+        else if (wcscmp(argv[i], _T("--sessions")) == 0)
+        {
+            state->sessions = true;
+        }
+        else if (wcscmp(argv[i], _T("--mute")) == 0 || wcscmp(argv[i], _T("--unmute")) == 0)
+        {
+            state->volume = true;
+            state->volumeUpdate.mute = wcscmp(argv[i], _T("--mute")) == 0 ? 1 : 0;
+        }
+        else if (wcscmp(argv[i], _T("--match")) == 0)
+        {
+            if ((argc - i) >= 2)
+            {
+                state->pMatch = argv[++i];
+            }
+            else
+            {
+                outputf(_T("Missing selector"));
+                return E_INVALIDARG;
+            }
+        }
+        else if (wcscmp(argv[i], _T("--except")) == 0)
+        {
+            if ((argc - i) >= 2)
+            {
+                state->pExcept = argv[++i];
+            }
+            else
+            {
+                outputf(_T("Missing selector"));
+                return E_INVALIDARG;
+            }
+        }
+        else if (wcscmp(argv[i], _T("--daemon")) == 0)
+        {
+            state->daemon = true;
+        }
+        else if (wcscmp(argv[i], _T("--client")) == 0)
+        {
+            state->client = true;
+        }
+        else if (wcscmp(argv[i], _T("--shutdown")) == 0)
+        {
+            state->shutdown = true;
+        }
+        else if (wcscmp(argv[i], _T("--switch-status")) == 0)
+        {
+            state->switchStatus = true;
         }
         else if (isdigit(argv[i][0]))
         {
-            state.option = _wtoi(argv[i]); // Capture the device index
+            state->option = _wtoi(argv[i]); // Capture the device index
         }
     }
+    return S_OK;
+}
 
-    // Retrieve the correct default device ID based on input or output
-    state.strDefaultDeviceID = getDefaultDeviceID(isOutput ? eRender : eCapture);
+// Run the parsed list/switch request
+HRESULT runCommand(TGlobalState* state, bool isOutput)
+{
+    TraceSpan span("runCommand");
 
-    // If setting a default device, load the cache and set it
-    if (state.option != -1) 
+    if (state->watch)
+    {
+        // Print changes until interrupted or the timeout passes
+        state->hr = runWatch(state, isOutput);
+    }
+    else if (state->setFormat)
+    {
+        // Configure every selected device in one batch
+        state->hr = runSetFormat(state, isOutput);
+    }
+    else if (state->setPeriod)
+    {
+        // Likewise for the engine period
+        state->hr = runSetPeriod(state, isOutput);
+    }
+    else if (state->hide || state->unhide)
+    {
+        // And for visibility
+        state->hr = runSetVisibility(state, isOutput, state->unhide);
+    }
+    else if (state->capabilities)
+    {
+        // Probe every selected device, in parallel
+        state->hr = runCapabilities(state, isOutput);
+    }
+    else if (state->volume)
+    {
+        // Read or update every selected device, in parallel
+        state->hr = runVolume(state, isOutput);
+    }
+    else if (state->meter)
     {
-        loadDeviceCache(isOutput);  // Load cached device list
-        state.hr = setDefaultDeviceFromCache(state.option - 1, isOutput);
+        // Sample until interrupted or the timeout passes
+        state->hr = runMeter(state, isOutput);
+    }
+    else if (state->sessions)
+    {
+        // Enumerate every selected device's sessions, in parallel
+        state->hr = runSessions(state, isOutput);
+    }
+    else if (state->pRulesPath != NULL)
+    {
+        // Let the rules pick the device to switch to
+        state->hr = setDefaultDeviceByRules(state, isOutput);
+    }
+    else if (state->option != -1) 
+    {
+        // If setting a default device, load the cache and set it
+        if (!state->resident)
+        {
+            loadDeviceCache(isOutput);  // Load cached device list
+        }
+        state->hr = switchToCachedDevice(state, state->option - 1, isOutput);
     }
     else 
     {
-        // If listing devices, enumerate them
-        createDeviceEnumerator(&state, isOutput);
+        // If listing devices, enumerate them. Only the listing marks the default device, so setting one by
+        // index never asks for it.
+        state->strDefaultDeviceID = getDefaultDeviceID(state->pBackend, isOutput ? eRender : eCapture);
+        createDeviceEnumerator(state, isOutput);
     }
+    return state->hr;
+}
 
-    // Uninitialize COM library
-    CoUninitialize();
+// Retrieve the default audio device ID for comparison
+std::wstring getDefaultDeviceID(AudioBackend* pBackend, EDataFlow dataFlow)
+{
+    TraceSpan span("getDefaultDeviceID");
 
-    return state.hr;
+    std::wstring strDefaultDeviceID;
+    pBackend->getDefaultDeviceID(dataFlow, eConsole, strDefaultDeviceID);
+    return strDefaultDeviceID;
 }
 
-// Retrieve the default audio device ID for comparison
-LPWSTR getDefaultDeviceID(EDataFlow dataFlow)
+// Read a whole file into memory, empty if it cannot be read
+std::string readWholeFile(const char* path)
 {
-    IMMDeviceEnumerator* pEnum = NULL;
-    IMMDevice* pDevice = NULL;
-    LPWSTR strDefaultDeviceID = NULL;
+    std::string content;
+    FILE* inFile = fopen(path, "rb");
+    if (inFile == NULL)
+    {
+        return content;
+    }
 
-    HRESULT hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator), (void**)&pEnum);
-    if (SUCCEEDED(hr))
+    char buffer[16384];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), inFile)) > 0)
     {
-        hr = pEnum->GetDefaultAudioEndpoint(dataFlow, eConsole, &pDevice);
-        if (SUCCEEDED(hr))
-        {
-            pDevice->GetId(&strDefaultDeviceID);
-            pDevice->Release();
-        }
-        pEnum->Release();
+        content.append(buffer, count);
     }
-    return strDefaultDeviceID;
+    fclose(inFile);
+    return content;
 }
 
-// Load the device list from a file for caching
+// Load the device list from a file for caching. Each line holds "name|id|state|formFactor|containerID" in
+// UTF-8; lines written before the extra fields existed ("name|id") load as active devices of unknown form
+// factor. The file is read with plain stdio: this is the whole of the set-by-index path, and iostreams would
+// add their static and locale initialization to every invocation's start-up.
 void loadDeviceCache(bool isOutput)
 {
-    std::wifstream inFile(isOutput ? L"output_device_cache.txt" : L"input_device_cache.txt");
+    TraceSpan span("loadDeviceCache");
+
+    auto& cache = isOutput ? cachedOutputDevices : cachedInputDevices;
+    cache.clear();
+
+    std::string content = readWholeFile(isOutput ? "output_device_cache.txt" : "input_device_cache.txt");
     std::wstring line;
-    while (std::getline(inFile, line))
+    std::vector<std::wstring> fields;
+    for (size_t lineStart = 0; lineStart < content.size();)
     {
-        size_t delimiterPos = line.find(L"|");
-        if (delimiterPos != std::wstring::npos)
+        size_t lineEnd = content.find('\n', lineStart);
+        if (lineEnd == std::string::npos)
+            lineEnd = content.size();
+        size_t next = lineEnd + 1;
+        if (lineEnd > lineStart && content[lineEnd - 1] == '\r')
+            lineEnd--;
+
+        line.clear();
+        appendFromUtf8(line, content.c_str() + lineStart, lineEnd - lineStart);
+        lineStart = next;
+
+        fields.clear();
+        size_t start = 0;
+        for (size_t delimiterPos = line.find(L"|"); delimiterPos != std::wstring::npos; delimiterPos = line.find(L"|", start))
         {
-            std::wstring name = line.substr(0, delimiterPos);
-            std::wstring id = line.substr(delimiterPos + 1);
-            if (isOutput)
-                cachedOutputDevices.push_back(std::make_pair(name, id));
-            else
-                cachedInputDevices.push_back(std::make_pair(name, id));
+            fields.push_back(line.substr(start, delimiterPos - start));
+            start = delimiterPos + 1;
         }
+        fields.push_back(line.substr(start));
+        if (fields.size() < 2)
+            continue;
+
+        // The name comes first and is the only field that may itself contain a '|'
+        size_t trailing = fields.size() >= 5 ? 4 : 1;
+        TDeviceEntry device;
+        device.friendlyName = fields[0];
+        for (size_t f = 1; f < fields.size() - trailing; f++)
+        {
+            device.friendlyName += L"|" + fields[f];
+        }
+        device.id = fields[fields.size() - trailing];
+        device.state = trailing == 4 ? (DWORD)wcstoul(fields[fields.size() - 3].c_str(), NULL, 10) : DEVICE_STATE_ACTIVE;
+        device.formFactor = trailing == 4 ? (UINT)wcstoul(fields[fields.size() - 2].c_str(), NULL, 10) : 10; // UnknownFormFactor
+        device.containerID = trailing == 4 ? fields[fields.size() - 1] : std::wstring();
+        cache.push_back(device);
+    }
+}
+
+// Replace the cached device list with a live enumeration of the active devices and persist it
+HRESULT refreshDeviceCache(AudioBackend* pBackend, bool isOutput)
+{
+    TraceSpan span("refreshDeviceCache");
+
+    DeviceTable devices;
+    HRESULT hr = pBackend->enumerateDevices(isOutput ? eRender : eCapture, DEVICE_STATE_ACTIVE, devices);
+    if (SUCCEEDED(hr))
+    {
+        (isOutput ? cachedOutputDevices : cachedInputDevices).swap(devices);
+        cacheDeviceList(isOutput);
     }
-    inFile.close();
+    return hr;
 }
 
-// Create a multimedia device enumerator (only for listing devices)
+// Enumerate the devices through the backend (only for listing devices)
 void createDeviceEnumerator(TGlobalState* state, bool isOutput)
 {
-    state->pEnum = NULL;
-    state->hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator),
-        (void**)&state->pEnum);
+    TraceSpan span("createDeviceEnumerator");
+
+    EDataFlow dataFlow = isOutput ? eRender : eCapture;
+    {
+        TraceSpan enumerateSpan("AudioBackend::enumerateDevices");
+        state->hr = state->pBackend->enumerateDevices(dataFlow, state->deviceStateFilter, state->devices);
+    }
     if (SUCCEEDED(state->hr))
     {
-        EDataFlow dataFlow = isOutput ? eRender : eCapture;
-        state->hr = state->pEnum->EnumAudioEndpoints(dataFlow, state->deviceStateFilter, &state->pDevices);
-        if (SUCCEEDED(state->hr))
-        {
-            enumerateDevices(state, isOutput);
-        }
-        state->pEnum->Release();
+        enumerateDevices(state, isOutput);
+
+        // Remember the listing so a later "device_index" invocation can switch without enumerating
+        (isOutput ? cachedOutputDevices : cachedInputDevices) = state->devices;
+        cacheDeviceList(isOutput);
     }
 }
 
 // Enumerate the devices (input or output) for listing
 void enumerateDevices(TGlobalState* state, bool isOutput)
 {
-    UINT count;
-    state->pDevices->GetCount(&count);
+    TraceSpan span("enumerateDevices");
 
-    for (UINT i = 0; i < count; i++)
+    // Device formats and periods are read only for the devices printed, and only if the output shows them
+    int fieldCount = parseDeviceFormat(state->deviceFormatStr.c_str());
+    bool needsFormat = state->json || fieldCount > DEVICE_FORMAT_AUDIO_FIELDS_START;
+    bool needsPeriod = state->json || fieldCount > DEVICE_FORMAT_PERIOD_FIELDS_START;
+    bool needsVolume = listingNeedsVolume(state);
+
+    for (size_t i = 0; i < state->devices.size(); i++)
     {
-        state->hr = state->pDevices->Item(i, &state->pCurrentDevice);
-        if (SUCCEEDED(state->hr))
+        if (state->defaultOnly && state->devices[i].id != state->strDefaultDeviceID)
+            continue;
+
+        if (needsFormat && state->devices[i].format.sampleRate == 0)
+        {
+            state->pBackend->getDeviceFormat(state->devices[i].id.c_str(), state->devices[i].format);
+        }
+        if (needsPeriod && state->devices[i].period.minimumPeriod == 0)
         {
-            printDeviceInfo(state->pCurrentDevice, i + 1, state->pDeviceFormatStr, state->strDefaultDeviceID);
-            state->pCurrentDevice->Release();
+            state->pBackend->getProcessingPeriod(state->devices[i].id.c_str(), state->devices[i].period);
+        }
+        if (needsVolume && state->devices[i].volume.level < 0)
+        {
+            state->pBackend->getEndpointVolume(state->devices[i].id.c_str(), state->devices[i].volume);
+        }
+
+        if (state->json)
+        {
+            std::wstring line;
+            appendDeviceJson(line, state->devices[i], (int)i + 1, state->devices[i].id == state->strDefaultDeviceID);
+            outputf(L"{%ls}\n", line.c_str());
+        }
+        else
+        {
+            printDeviceInfo(state->devices[i], (int)i + 1, state->deviceFormatStr.c_str(), state->strDefaultDeviceID.c_str());
         }
     }
 }
 
+// Whether the listing shows the endpoint volume, which the shared snapshot does not carry
+bool listingNeedsVolume(const TGlobalState* state)
+{
+    return state->json || parseDeviceFormat(state->deviceFormatStr.c_str()) > DEVICE_FORMAT_VOLUME_FIELDS_START;
+}
+
 // Print device info based on the format
-HRESULT printDeviceInfo(IMMDevice* pDevice, int index, LPCWSTR outFormat, LPWSTR strDefaultDeviceID)
+HRESULT printDeviceInfo(const TDeviceEntry& device, int index, LPCWSTR outFormat, LPCWSTR strDefaultDeviceID)
 {
-    LPWSTR strID = NULL;
-    HRESULT hr = pDevice->GetId(&strID);
-    if (!SUCCEEDED(hr))
-    {
-        return hr;
-    }
+    TraceSpan span("printDeviceInfo");
+
+    int deviceDefault = (strDefaultDeviceID != nullptr && wcscmp(strDefaultDeviceID, device.id.c_str()) == 0);
+
+    outputf(outFormat, index, device.friendlyName.c_str(), device.state, deviceDefault, device.description.c_str(),
+        device.interfaceName.c_str(), device.id.c_str(), device.format.sampleRate, device.format.channels,
+        device.format.bitsPerSample, device.format.channelMask, (int)device.period.defaultPeriod,
+        (int)device.period.minimumPeriod, (int)device.period.currentPeriod,
+        device.volume.level >= 0 ? volumePercent(device.volume.level) : -1, (int)device.volume.muted); // Print device info
+    outputf(L"\n");
 
-    int deviceDefault = (strDefaultDeviceID != nullptr && wcscmp(strDefaultDeviceID, strID) == 0);
+    return S_OK;
+}
 
-    DWORD dwState;
-    hr = pDevice->GetState(&dwState);
-    if (!SUCCEEDED(hr))
+// Append the fields of a device as the members of a JSON object, without the braces
+void appendDeviceJson(std::wstring& buffer, const TDeviceEntry& device, int index, bool isDefault)
+{
+    appendFormat(buffer, L"\"index\":%d,\"name\":", index);
+    appendJsonString(buffer, device.friendlyName);
+    appendFormat(buffer, L",\"state\":%u,\"default\":%ls,\"description\":", (unsigned int)device.state, isDefault ? L"true" : L"false");
+    appendJsonString(buffer, device.description);
+    buffer += L",\"interface\":";
+    appendJsonString(buffer, device.interfaceName);
+    buffer += L",\"id\":";
+    appendJsonString(buffer, device.id);
+    appendFormat(buffer, L",\"formFactor\":%u,\"container\":", device.formFactor);
+    appendJsonString(buffer, device.containerID);
+    if (device.format.sampleRate != 0)
     {
-        return hr;
+        appendFormat(buffer, L",\"sampleRate\":%lu,\"channels\":%u,\"bitsPerSample\":%u,\"channelMask\":%lu,\"float\":%ls",
+            (unsigned long)device.format.sampleRate, device.format.channels, device.format.bitsPerSample,
+            (unsigned long)device.format.channelMask, device.format.isFloat ? L"true" : L"false");
     }
-
-    IPropertyStore* pStore = NULL;
-    hr = pDevice->OpenPropertyStore(STGM_READ, &pStore);
-    if (SUCCEEDED(hr))
+    if (device.period.minimumPeriod != 0)
     {
-        std::wstring friendlyName = getDeviceProperty(pStore, PKEY_Device_FriendlyName);
-        std::wstring description = getDeviceProperty(pStore, PKEY_Device_DeviceDesc);
-        std::wstring interfaceName = getDeviceProperty(pStore, PKEY_DeviceInterface_FriendlyName);
-
-        wprintf_s(outFormat, index, friendlyName.c_str(), dwState, deviceDefault, description.c_str(), interfaceName.c_str(), strID); // Print device info
-        wprintf_s(L"\n");
-
-        pStore->Release();
+        appendFormat(buffer, L",\"defaultPeriod\":%lld,\"minimumPeriod\":%lld,\"currentPeriod\":%lld",
+            (long long)device.period.defaultPeriod, (long long)device.period.minimumPeriod, (long long)device.period.currentPeriod);
+    }
+    if (device.volume.level >= 0)
+    {
+        appendFormat(buffer, L",\"volume\":%d,\"muted\":%ls", volumePercent(device.volume.level), device.volume.muted ? L"true" : L"false");
     }
-
-    return hr;
 }
 
-// Cache the device list to a file
+// Cache the device list to a file, in UTF-8 and with a single write
 void cacheDeviceList(bool isOutput)
 {
-    std::wofstream outFile(isOutput ? L"output_device_cache.txt" : L"input_device_cache.txt");
-    const auto& cache = isOutput ? cachedOutputDevices : cachedInputDevices;
+    TraceSpan span("cacheDeviceList");
 
+    const auto& cache = isOutput ? cachedOutputDevices : cachedInputDevices;
+    std::string content;
     for (const auto& device : cache)
     {
-        outFile << device.first << L"|" << device.second << std::endl;
+        char numbers[32];
+        appendUtf8(content, device.friendlyName);
+        content += '|';
+        appendUtf8(content, device.id);
+        snprintf(numbers, sizeof(numbers), "|%lu|%u|", (unsigned long)device.state, device.formFactor);
+        content += numbers;
+        appendUtf8(content, device.containerID);
+        content += '\n';
+    }
+
+    FILE* outFile = fopen(isOutput ? "output_device_cache.txt" : "input_device_cache.txt", "wb");
+    if (outFile != NULL)
+    {
+        fwrite(content.data(), 1, content.size(), outFile);
+        fclose(outFile);
     }
-    outFile.close();
 }
 
-// Set default device from the cache
-HRESULT setDefaultDeviceFromCache(int deviceIndex, bool isOutput)
+// Look up the ID of a cached device by its zero-based index, NULL if out of range
+LPCWSTR getCachedDeviceID(int deviceIndex, bool isOutput)
 {
     const auto& cache = isOutput ? cachedOutputDevices : cachedInputDevices;
 
     if (deviceIndex < 0 || deviceIndex >= static_cast<int>(cache.size()))
+    {
+        return NULL;
+    }
+    return cache[deviceIndex].id.c_str();
+}
+
+// Set default device from the cache
+HRESULT setDefaultDeviceFromCache(AudioBackend* pBackend, int deviceIndex, bool isOutput)
+{
+    LPCWSTR deviceID = getCachedDeviceID(deviceIndex, isOutput);
+    if (deviceID == NULL)
     {
         return E_INVALIDARG;
     }
 
-    std::wstring deviceID = cache[deviceIndex].second;
-    return isOutput ? SetDefaultAudioPlaybackDevice(deviceID.c_str()) : SetDefaultAudioCaptureDevice(deviceID.c_str());
+    return isOutput ? SetDefaultAudioPlaybackDevice(pBackend, deviceID) : SetDefaultAudioCaptureDevice(pBackend, deviceID);
 }
 
-// Retrieve a property from the device's property store
-std::wstring getDeviceProperty(IPropertyStore* pStore, const PROPERTYKEY key)
+// Switch to a cached device, once the current default is idle when --when-idle was given, measuring the
+// propagation when --verify was
+HRESULT switchToCachedDevice(TGlobalState* state, int deviceIndex, bool isOutput)
 {
-    PROPVARIANT prop;
-    PropVariantInit(&prop);
-    HRESULT hr = pStore->GetValue(key, &prop);
-    if (SUCCEEDED(hr))
+    if (!state->verify && state->whenIdleMs < 0)
     {
-        std::wstring result(prop.pwszVal);
-        PropVariantClear(&prop);
-        return result;
+        return setDefaultDeviceFromCache(state->pBackend, deviceIndex, isOutput);
     }
-    return std::wstring(L"");
+
+    LPCWSTR deviceID = getCachedDeviceID(deviceIndex, isOutput);
+    if (deviceID == NULL)
+    {
+        return E_INVALIDARG;
+    }
+    if (state->whenIdleMs >= 0)
+    {
+        HRESULT hr = waitForIdleDefault(state->pBackend, deviceID, isOutput, state->whenIdleMs,
+            state->timeoutMs >= 0 ? state->timeoutMs : WHEN_IDLE_DEFAULT_TIMEOUT_MS);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+    if (!state->verify)
+    {
+        return isOutput ? SetDefaultAudioPlaybackDevice(state->pBackend, deviceID) : SetDefaultAudioCaptureDevice(state->pBackend, deviceID);
+    }
+    return verifyDefaultSwitch(state->pBackend, deviceID, isOutput,
+        state->timeoutMs >= 0 ? state->timeoutMs : VERIFY_DEFAULT_TIMEOUT_MS);
 }
 
-HRESULT SetDefaultAudioPlaybackDevice(LPCWSTR devID)
+// Evaluate the rules file over the cached devices and switch to the best match. The cache may be missing
+// or stale, so an empty cache or a failed switch falls back to a live enumeration and one retry.
+HRESULT setDefaultDeviceByRules(TGlobalState* state, bool isOutput)
 {
-    IPolicyConfigVista *pPolicyConfig;
-    ERole reserved = eConsole;
+    RuleTable rules;
+    HRESULT hr = loadSelectionRules(state->pRulesPath, rules);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
 
-    HRESULT hr = CoCreateInstance(__uuidof(CPolicyConfigVistaClient), 
-        NULL, CLSCTX_ALL, __uuidof(IPolicyConfigVista), (LPVOID *)&pPolicyConfig);
-    if (SUCCEEDED(hr))
+    if (!state->resident)
     {
-        hr = pPolicyConfig->SetDefaultEndpoint(devID, reserved);
-        pPolicyConfig->Release();
+        loadDeviceCache(isOutput);
+    }
+    bool refreshed = false;
+    if ((isOutput ? cachedOutputDevices : cachedInputDevices).empty())
+    {
+        hr = refreshDeviceCache(state->pBackend, isOutput);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        refreshed = true;
+    }
+
+    for (;;)
+    {
+        const auto& cache = isOutput ? cachedOutputDevices : cachedInputDevices;
+        int priority = 0;
+        int deviceIndex = selectDevice(rules, cache, &priority);
+        if (deviceIndex < 0)
+        {
+            hr = E_NOTFOUND;
+        }
+        else
+        {
+            outputf(_T("Selected device %d: %ls (priority %d)\n"), deviceIndex + 1, cache[deviceIndex].friendlyName.c_str(), priority);
+            hr = switchToCachedDevice(state, deviceIndex, isOutput);
+        }
+
+        // A switch that timed out or was interrupted is not retried: the cache was not the problem
+        if (SUCCEEDED(hr) || refreshed || hr == HRESULT_FROM_WIN32(ERROR_TIMEOUT) || hr == HRESULT_FROM_WIN32(ERROR_CANCELLED))
+            break;
+
+        hr = refreshDeviceCache(state->pBackend, isOutput);
+        if (FAILED(hr))
+            break;
+        refreshed = true;
+    }
+
+    if (hr == E_NOTFOUND)
+    {
+        outputf(_T("No active device matches the rules\n"));
     }
     return hr;
 }
 
-HRESULT SetDefaultAudioCaptureDevice(LPCWSTR devID)
+HRESULT SetDefaultAudioPlaybackDevice(AudioBackend* pBackend, LPCWSTR devID)
 {
-    IPolicyConfigVista *pPolicyConfig;
-    HRESULT hr = CoCreateInstance(__uuidof(CPolicyConfigVistaClient), 
-        NULL, CLSCTX_ALL, __uuidof(IPolicyConfigVista), (LPVOID *)&pPolicyConfig);
+    TraceSpan span("SetDefaultAudioPlaybackDevice");
 
-    if (SUCCEEDED(hr))
-    {
-        hr = pPolicyConfig->SetDefaultEndpoint(devID, eConsole);
-        hr = pPolicyConfig->SetDefaultEndpoint(devID, eMultimedia);
-        hr = pPolicyConfig->SetDefaultEndpoint(devID, eCommunications);
+    ERole reserved = eConsole;
 
-        pPolicyConfig->Release();
-    }
+    return pBackend->setDefaultEndpoint(devID, reserved);
+}
+
+HRESULT SetDefaultAudioCaptureDevice(AudioBackend* pBackend, LPCWSTR devID)
+{
+    TraceSpan span("SetDefaultAudioCaptureDevice");
+
+    HRESULT hr = pBackend->setDefaultEndpoint(devID, eConsole);
+    hr = pBackend->setDefaultEndpoint(devID, eMultimedia);
+    hr = pBackend->setDefaultEndpoint(devID, eCommunications);
 
     return hr;
 }
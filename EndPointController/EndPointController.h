@@ -0,0 +1,80 @@
+// ----------------------------------------------------------------------------
+// EndPointController.h
+// Declarations shared between the command-line front end and the modules
+// that build on its listing and switching functions.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include "AudioBackend.h"
+
+typedef struct TGlobalState
+{
+    HRESULT hr;
+    int option;
+    AudioBackend *pBackend;
+    DeviceTable devices;
+    std::wstring strDefaultDeviceID;
+    std::wstring deviceFormatStr;
+    int deviceStateFilter;
+    bool verify;
+    int timeoutMs;          // --timeout: -1 unless given
+    LPCWSTR pRulesPath;
+    bool defaultOnly;       // --default: list only the current default device
+    bool daemon;            // --daemon: serve requests from a resident process
+    bool client;            // --client: forward the request to the resident process
+    bool shutdown;          // --shutdown: stop the resident process
+    bool switchStatus;      // --switch-status: report the resident process's switches and the last that failed
+    bool resident;          // Served by the daemon: the device cache is kept current by notifications
+    bool watch;             // --watch: print endpoint changes as they happen
+    bool json;              // --json: print devices and events as JSON lines instead of the format string
+    int coalesceMs;         // --coalesce: window over which --watch merges a burst of changes
+    int switchWindowMs;     // --switch-window: window over which the resident process merges switch requests
+    int switchIntervalMs;   // --switch-interval: minimum time between the resident process's switches
+    LPCWSTR pTracePath;     // --trace: write the timing spans of this run to the file
+    int repeat;             // --repeat: run the list or switch operation this many times
+    bool stats;             // --stats: report per-phase latency percentiles at the end
+    bool startupTime;       // --startup-time: report the time to first output and to exit on stderr
+    LPCWSTR pMatch;         // --match: selection-rule conditions picking the devices a bulk command applies to
+    LPCWSTR pExcept;        // --except: conditions of devices a bulk command leaves out
+    bool setFormat;         // --set-format: apply targetFormat to the selected devices
+    TAudioFormat targetFormat;
+    bool setPeriod;         // --set-period: apply targetPeriod to the selected devices
+    INT64 targetPeriod;     // 100-ns units, or PERIOD_MINIMUM / PERIOD_DEFAULT
+    bool hide;              // --hide: hide the selected devices
+    bool unhide;            // --unhide: show the selected hidden devices again
+    bool capabilities;      // --capabilities: probe the selected devices' shared and exclusive formats
+    bool volume;            // --volume, --set-volume, --mute or --unmute: report or change the selected devices' volume
+    TVolumeUpdate volumeUpdate;
+    bool meter;             // --meter: sample the selected devices' peak meters
+    int meterRateHz;        // --meter-rate: samples per second, 0 for the default
+    LPCWSTR pMeterLogPath;  // --meter-log: write the samples to the file instead of summarizing them
+    bool sessions;          // --sessions: list the audio sessions of the selected devices
+    int whenIdleMs;         // --when-idle: how long the current default must be idle before a switch, -1 unless given
+} TGlobalState;
+
+extern DeviceTable cachedOutputDevices;
+extern DeviceTable cachedInputDevices;
+
+// Command-line entry point; the portable build's main (PortableMain.cpp) widens its arguments and calls it
+int _tmain(int argc, LPCWSTR argv[]);
+
+// Parse the command line into state. Returns S_FALSE if the request was fully handled (--help).
+HRESULT parseArguments(TGlobalState* state, int argc, LPCWSTR argv[], bool* pIsOutput);
+
+// Run the parsed list/switch request against state->pBackend
+HRESULT runCommand(TGlobalState* state, bool isOutput);
+
+// Whether a listing with these options shows the endpoint volume, so reads it for every device
+bool listingNeedsVolume(const TGlobalState* state);
+
+HRESULT refreshDeviceCache(AudioBackend* pBackend, bool isOutput);
+HRESULT printDeviceInfo(const TDeviceEntry& device, int index, LPCWSTR outFormat, LPCWSTR strDefaultDeviceID);
+void appendDeviceJson(std::wstring& buffer, const TDeviceEntry& device, int index, bool isDefault);
+void cacheDeviceList(bool isOutput);
+std::string readWholeFile(const char* path);
+void loadDeviceCache(bool isOutput);
+HRESULT switchToCachedDevice(TGlobalState* state, int deviceIndex, bool isOutput);
+HRESULT SetDefaultAudioPlaybackDevice(AudioBackend* pBackend, LPCWSTR devID);
+HRESULT SetDefaultAudioCaptureDevice(AudioBackend* pBackend, LPCWSTR devID);
@@ -0,0 +1,69 @@
+// ----------------------------------------------------------------------------
+// EventQueue.h
+// Unbounded lock-free multi-producer, single-consumer queue (Vyukov's
+// intrusive-stub design). Endpoint notification callbacks push into it and
+// return at once; the thread that owns the backend drains it.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+template <typename T>
+class EventQueue
+{
+public:
+    EventQueue() : head(new Node()), tail(head.load())
+    {
+    }
+
+    ~EventQueue()
+    {
+        T item;
+        while (pop(item))
+        {
+        }
+        delete tail;
+    }
+
+    // Any thread. Wait-free apart from the node allocation.
+    void push(const T& item)
+    {
+        Node* node = new Node(item);
+        Node* previous = head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    // Consumer thread only. Returns false when empty; an item whose push is still in progress is returned by
+    // a later call, so producers signal the consumer after push returns.
+    bool pop(T& item)
+    {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (next == NULL)
+        {
+            return false;
+        }
+        item = next->item;
+        delete tail;
+        tail = next;
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        Node() : next(NULL) {}
+        Node(const T& item) : next(NULL), item(item) {}
+
+        std::atomic<Node*> next;
+        T item;
+    };
+
+    EventQueue(const EventQueue&);
+    EventQueue& operator=(const EventQueue&);
+
+    std::atomic<Node*> head;    // Most recently pushed node; producers swap themselves in here
+    Node* tail;                 // Stub node whose successor is the oldest item
+};
@@ -0,0 +1,209 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "Clock.h"
+#include "IdleSwitch.h"
+#include "Interrupt.h"
+#include "Meter.h"
+#include "Output.h"
+#include "Trace.h"
+
+typedef std::chrono::steady_clock IdleClock;
+
+// Notes that some watched endpoint's sessions changed; the waiting thread re-reads them on its next pass
+class SessionChangeFlag : public DeviceNotificationSink
+{
+public:
+    SessionChangeFlag() : changed(false) {}
+
+    void onSessionsChanged(LPCWSTR deviceID)
+    {
+        changed = true;
+    }
+
+    bool consume()
+    {
+        return changed.exchange(false);
+    }
+
+private:
+    std::atomic<bool> changed;
+};
+
+// One endpoint the switch would take the default from
+typedef struct TIdleTarget
+{
+    std::wstring id;
+    std::wstring name;
+    bool watched = false;       // Its sessions follow notifications; otherwise only its meter counts
+    SessionTable sessions;
+    PeakMeter* pMeter = NULL;   // NULL if it could not be opened
+} TIdleTarget;
+
+// The defaults of the roles the switch changes, as SetDefaultAudio*Device sets them, that are not the device already
+static void findSwitchedDefaults(AudioBackend* pBackend, LPCWSTR deviceID, bool isOutput, std::vector<TIdleTarget>& targets)
+{
+    for (int role = eConsole; role < ERole_enum_count; role++)
+    {
+        if (isOutput && role != eConsole)
+            continue;
+
+        std::wstring currentID;
+        if (FAILED(pBackend->getDefaultDeviceID(isOutput ? eRender : eCapture, (ERole)role, currentID)) || currentID == deviceID)
+            continue;
+
+        bool known = false;
+        for (const auto& target : targets)
+        {
+            known |= target.id == currentID;
+        }
+        if (!known)
+        {
+            TIdleTarget target;
+            target.id = currentID;
+            targets.push_back(target);
+        }
+    }
+}
+
+// Whether the endpoint is in use, and if so, what shows it
+static bool isActive(TIdleTarget& target, std::wstring& activity)
+{
+    for (const auto& session : target.sessions)
+    {
+        if (session.state == eSessionActive)
+        {
+            activity.clear();
+            appendFormat(activity, L"%ls (pid %lu) active on %ls", session.displayName.empty() ? L"(unnamed)" : session.displayName.c_str(),
+                (unsigned long)session.processID, target.name.c_str());
+            return true;
+        }
+    }
+
+    float peak = 0;
+    if (target.pMeter != NULL && SUCCEEDED(target.pMeter->getPeakValue(&peak)) && peak > METER_SIGNAL_THRESHOLD)
+    {
+        activity.clear();
+        appendFormat(activity, L"signal on %ls (peak %.3f)", target.name.c_str(), peak);
+        return true;
+    }
+    return false;
+}
+
+// Sessions are re-read only when a notification says they changed; the meters, which have no notification, are
+// read every pass. Any activity restarts the idle window.
+HRESULT waitForIdleDefault(AudioBackend* pBackend, LPCWSTR deviceID, bool isOutput, int idleMs, int timeoutMs)
+{
+    TraceSpan span("waitForIdleDefault");
+    IdleClock::time_point start = IdleClock::now();
+
+    std::vector<TIdleTarget> targets;
+    findSwitchedDefaults(pBackend, deviceID, isOutput, targets);
+    if (targets.empty())
+    {
+        return S_OK;
+    }
+
+    SessionChangeFlag sessionChanges;
+    bool registered = SUCCEEDED(pBackend->registerNotificationSink(&sessionChanges));
+    std::wstring names;
+    for (auto& target : targets)
+    {
+        TDeviceEntry device;
+        EDataFlow dataFlow;
+        target.name = SUCCEEDED(pBackend->readDevice(target.id.c_str(), device, &dataFlow)) ? device.friendlyName : target.id;
+        names += names.empty() ? target.name : L", " + target.name;
+
+        // Watch before reading, so a change in between is not missed
+        target.watched = registered && SUCCEEDED(pBackend->watchSessions(target.id.c_str())) &&
+            SUCCEEDED(pBackend->getSessions(target.id.c_str(), target.sessions));
+        if (!target.watched)
+        {
+            target.sessions.clear();
+            outputf(_T("Cannot watch the sessions of %ls, waiting on its meter alone\n"), target.name.c_str());
+        }
+        if (FAILED(pBackend->openPeakMeter(target.id.c_str(), &target.pMeter)))
+        {
+            target.pMeter = NULL;
+        }
+    }
+    outputf(_T("Waiting for %ls to be idle for %d ms\n"), names.c_str(), idleMs);
+
+    InterruptScope interrupt;
+
+    HRESULT hr = S_OK;
+    IdleClock::time_point deadline = start + std::chrono::milliseconds(timeoutMs);
+    IdleClock::time_point quietSince = start;
+    std::wstring activity;
+    int interruptions = 0;
+    bool wasActive = false;
+    for (;;)
+    {
+        if (interrupt.isRequested())
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_CANCELLED);
+            break;
+        }
+        if (sessionChanges.consume())
+        {
+            for (auto& target : targets)
+            {
+                SessionTable sessions;
+                if (target.watched && SUCCEEDED(pBackend->getSessions(target.id.c_str(), sessions)))
+                {
+                    target.sessions.swap(sessions);
+                }
+            }
+        }
+
+        bool active = false;
+        for (auto& target : targets)
+        {
+            active |= isActive(target, activity);
+        }
+
+        IdleClock::time_point now = IdleClock::now();
+        if (active)
+        {
+            interruptions += wasActive ? 0 : 1;
+            quietSince = now;
+        }
+        else if (now - quietSince >= std::chrono::milliseconds(idleMs))
+        {
+            break;
+        }
+        wasActive = active;
+
+        if (now >= deadline)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(WHEN_IDLE_SAMPLE_MS));
+    }
+
+    for (auto& target : targets)
+    {
+        delete target.pMeter;
+    }
+    if (registered)
+    {
+        pBackend->unregisterNotificationSink(&sessionChanges);
+    }
+
+    double waitedMs = elapsedMs(start, IdleClock::now());
+    if (hr == HRESULT_FROM_WIN32(ERROR_TIMEOUT))
+    {
+        outputf(_T("Not idle within %d ms, default left unchanged; last activity: %ls\n"), timeoutMs,
+            activity.empty() ? L"none" : activity.c_str());
+    }
+    else if (FAILED(hr))
+    {
+        outputf(_T("Interrupted after %.1f ms, default left unchanged\n"), waitedMs);
+    }
+    else
+    {
+        outputf(_T("Idle after %.1f ms (activity seen %d times)\n"), waitedMs, interruptions);
+    }
+    return hr;
+}
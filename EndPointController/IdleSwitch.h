@@ -0,0 +1,25 @@
+// ----------------------------------------------------------------------------
+// IdleSwitch.h
+// --when-idle: hold a switch back until the endpoints it takes the default
+// from have been idle for a window, so a live stream is not moved mid-way.
+// An endpoint is idle while none of its sessions is active and its peak
+// meter shows no signal. Session state follows session notifications; the
+// meters are read on the waiting thread. Past the timeout the switch is
+// dropped and the default left as it was.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include "AudioBackend.h"
+
+// How long --when-idle waits when no --timeout is given
+#define WHEN_IDLE_DEFAULT_TIMEOUT_MS 60000
+
+// How often the peak meters are read while waiting
+#define WHEN_IDLE_SAMPLE_MS 20
+
+// Wait until every current default of the roles a switch to deviceID would change has been idle for idleMs.
+// Returns HRESULT_FROM_WIN32(ERROR_TIMEOUT) if that does not happen within timeoutMs, and
+// HRESULT_FROM_WIN32(ERROR_CANCELLED) if interrupted first.
+HRESULT waitForIdleDefault(AudioBackend* pBackend, LPCWSTR deviceID, bool isOutput, int idleMs, int timeoutMs);
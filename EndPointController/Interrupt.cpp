@@ -0,0 +1,26 @@
+#include <signal.h>
+#include <atomic>
+#include "Interrupt.h"
+
+static std::atomic<bool> stopRequested(false);
+
+static void onInterrupt(int)
+{
+    stopRequested = true;
+}
+
+InterruptScope::InterruptScope()
+{
+    stopRequested = false;
+    previousHandler = signal(SIGINT, onInterrupt);
+}
+
+InterruptScope::~InterruptScope()
+{
+    signal(SIGINT, previousHandler);
+}
+
+bool InterruptScope::isRequested() const
+{
+    return stopRequested;
+}
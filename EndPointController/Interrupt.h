@@ -0,0 +1,23 @@
+// ----------------------------------------------------------------------------
+// Interrupt.h
+// Ctrl+C for the commands that run until stopped or timed out (--watch,
+// --meter, --when-idle): while an InterruptScope is alive, SIGINT only sets
+// a flag the command polls, so it can stop cleanly and print its report.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+// Clears the flag and installs the handler; the destructor restores the handler it replaced
+class InterruptScope
+{
+public:
+    InterruptScope();
+    ~InterruptScope();
+
+    // Whether SIGINT arrived since the scope began
+    bool isRequested() const;
+
+private:
+    void (*previousHandler)(int);
+};
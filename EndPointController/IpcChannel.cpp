@@ -0,0 +1,468 @@
+#include <stdlib.h>
+#include <string.h>
+#include "IpcChannel.h"
+
+// A client that connects and then stalls must not wedge the daemon
+#define IPC_TRANSFER_TIMEOUT_MS 2000
+
+#ifdef _WIN32
+
+#define IPC_BUFFER_SIZE 65536
+
+// Full name of the pipe
+static std::wstring getChannelName()
+{
+    std::wstring name(L"\\\\.\\pipe\\");
+    const wchar_t* override = _wgetenv(L"EPC_IPC_NAME");
+    name += override != NULL ? override : L"EndPointController";
+    return name;
+}
+
+// Server instances are overlapped so ipcAccept can also wait for ipcWake
+static HANDLE createPipeInstance(const std::wstring& name, bool first)
+{
+    return CreateNamedPipeW(name.c_str(),
+        PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+        PIPE_UNLIMITED_INSTANCES, IPC_BUFFER_SIZE, IPC_BUFFER_SIZE, 0, NULL);
+}
+
+HRESULT ipcListen(TIpcServer* pServer)
+{
+    pServer->name = getChannelName();
+    pServer->connectPending = false;
+    ZeroMemory(&pServer->connect, sizeof(pServer->connect));
+    pServer->connect.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    pServer->wakeEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    pServer->listener = createPipeInstance(pServer->name, true);
+    if (pServer->connect.hEvent == NULL || pServer->wakeEvent == NULL || pServer->listener == INVALID_HANDLE_VALUE)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        ipcStopListening(pServer);
+        return hr;
+    }
+    return S_OK;
+}
+
+void ipcStopListening(TIpcServer* pServer)
+{
+    if (pServer->listener != INVALID_HANDLE_VALUE)
+    {
+        if (pServer->connectPending)
+        {
+            DWORD transferred;
+            CancelIo(pServer->listener);
+            GetOverlappedResult(pServer->listener, &pServer->connect, &transferred, TRUE);
+            pServer->connectPending = false;
+        }
+        CloseHandle(pServer->listener);
+        pServer->listener = INVALID_HANDLE_VALUE;
+    }
+    if (pServer->connect.hEvent != NULL)
+    {
+        CloseHandle(pServer->connect.hEvent);
+        pServer->connect.hEvent = NULL;
+    }
+    if (pServer->wakeEvent != NULL)
+    {
+        CloseHandle(pServer->wakeEvent);
+        pServer->wakeEvent = NULL;
+    }
+}
+
+HRESULT ipcAccept(TIpcServer* pServer, IpcHandle* pConnection, int timeoutMs)
+{
+    if (!pServer->connectPending)
+    {
+        ResetEvent(pServer->connect.hEvent);
+        if (!ConnectNamedPipe(pServer->listener, &pServer->connect))
+        {
+            DWORD error = GetLastError();
+            if (error == ERROR_IO_PENDING)
+            {
+                pServer->connectPending = true;
+            }
+            else if (error != ERROR_PIPE_CONNECTED)
+            {
+                return HRESULT_FROM_WIN32(error);
+            }
+        }
+    }
+
+    if (pServer->connectPending)
+    {
+        // A wake-up leaves the connect outstanding; the next call resumes waiting on it
+        HANDLE events[2] = { pServer->connect.hEvent, pServer->wakeEvent };
+        DWORD signaled = WaitForMultipleObjects(2, events, FALSE, timeoutMs < 0 ? INFINITE : (DWORD)timeoutMs);
+        if (signaled == WAIT_OBJECT_0 + 1 || signaled == WAIT_TIMEOUT)
+        {
+            return S_FALSE;
+        }
+
+        DWORD transferred;
+        pServer->connectPending = false;
+        if (signaled != WAIT_OBJECT_0 || !GetOverlappedResult(pServer->listener, &pServer->connect, &transferred, FALSE))
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    // Hand the connected instance over and immediately put up the next one, so clients arriving while this
+    // request is served queue on it instead of finding no pipe and concluding the daemon is gone
+    *pConnection = pServer->listener;
+    pServer->listener = createPipeInstance(pServer->name, false);
+    return S_OK;
+}
+
+void ipcWake(TIpcServer* pServer)
+{
+    SetEvent(pServer->wakeEvent);
+}
+
+void ipcCloseConnection(IpcHandle connection)
+{
+    FlushFileBuffers(connection);
+    DisconnectNamedPipe(connection);
+    CloseHandle(connection);
+}
+
+HRESULT ipcConnect(IpcHandle* pConnection)
+{
+    std::wstring name = getChannelName();
+    for (;;)
+    {
+        HANDLE hPipe = CreateFileW(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+        if (hPipe != INVALID_HANDLE_VALUE)
+        {
+            *pConnection = hPipe;
+            return S_OK;
+        }
+
+        DWORD error = GetLastError();
+        if (error != ERROR_PIPE_BUSY || !WaitNamedPipeW(name.c_str(), 1000))
+        {
+            return HRESULT_FROM_WIN32(error);
+        }
+    }
+}
+
+void ipcCloseClient(IpcHandle connection)
+{
+    CloseHandle(connection);
+}
+
+// One blocking ReadFile or WriteFile. Server instances are overlapped, so an OVERLAPPED is always supplied and
+// a pending transfer is given up after the same timeout the sockets use; on the client's synchronous handle
+// the call simply completes before returning.
+static HRESULT transfer(HANDLE connection, void* data, DWORD size, bool write, DWORD* pTransferred)
+{
+    OVERLAPPED overlapped = {};
+    overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (overlapped.hEvent == NULL)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    BOOL started = write ? WriteFile(connection, data, size, NULL, &overlapped) : ReadFile(connection, data, size, NULL, &overlapped);
+    HRESULT hr = S_OK;
+    if (!started && GetLastError() != ERROR_IO_PENDING)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else if (!started && WaitForSingleObject(overlapped.hEvent, IPC_TRANSFER_TIMEOUT_MS) != WAIT_OBJECT_0)
+    {
+        // The OVERLAPPED lives on this stack frame, so wait for the cancellation to land before leaving it
+        CancelIoEx(connection, &overlapped);
+        GetOverlappedResult(connection, &overlapped, pTransferred, TRUE);
+        hr = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+    }
+    else if (!GetOverlappedResult(connection, &overlapped, pTransferred, FALSE))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    CloseHandle(overlapped.hEvent);
+    return hr;
+}
+
+HRESULT ipcWrite(IpcHandle connection, const void* data, size_t size)
+{
+    const char* pos = (const char*)data;
+    while (size > 0)
+    {
+        DWORD written = 0;
+        HRESULT hr = transfer(connection, (void*)pos, (DWORD)size, true, &written);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        pos += written;
+        size -= written;
+    }
+    return S_OK;
+}
+
+HRESULT ipcRead(IpcHandle connection, void* data, size_t size)
+{
+    char* pos = (char*)data;
+    while (size > 0)
+    {
+        DWORD read = 0;
+        HRESULT hr = transfer(connection, pos, (DWORD)size, false, &read);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        if (read == 0)
+        {
+            return HRESULT_FROM_WIN32(ERROR_BROKEN_PIPE);
+        }
+        pos += read;
+        size -= read;
+    }
+    return S_OK;
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+// errno as an HRESULT; with no errno set the peer went away
+static HRESULT errnoResult()
+{
+    return hresultFromErrno(errno);
+}
+
+// Path of the socket
+static std::string getChannelPath()
+{
+    const char* override = getenv("EPC_IPC_NAME");
+    if (override != NULL && override[0] == '/')
+    {
+        return override;
+    }
+
+    std::string name = override != NULL ? override : "EndPointController";
+    const char* runtimeDir = getenv("XDG_RUNTIME_DIR");
+    if (runtimeDir != NULL && runtimeDir[0] != '\0')
+    {
+        return std::string(runtimeDir) + "/" + name + ".sock";
+    }
+    return "/tmp/" + name + "-" + std::to_string((unsigned long)getuid()) + ".sock";
+}
+
+static bool fillAddress(struct sockaddr_un* pAddress, const std::string& path)
+{
+    memset(pAddress, 0, sizeof(*pAddress));
+    pAddress->sun_family = AF_UNIX;
+    if (path.size() >= sizeof(pAddress->sun_path))
+    {
+        return false;
+    }
+    memcpy(pAddress->sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+HRESULT ipcListen(TIpcServer* pServer)
+{
+    pServer->wakePipe[0] = pServer->wakePipe[1] = -1;
+    std::string path = getChannelPath();
+    struct sockaddr_un address;
+    if (!fillAddress(&address, path))
+    {
+        return E_INVALIDARG;
+    }
+
+    // A socket file left behind by a daemon that died is removed; one that still accepts means a daemon is running
+    IpcHandle probe = INVALID_IPC_HANDLE;
+    if (SUCCEEDED(ipcConnect(&probe)))
+    {
+        ipcCloseClient(probe);
+        return HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+    }
+    unlink(path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return errnoResult();
+    }
+
+    mode_t previousMask = umask(0077);
+    int result = bind(fd, (struct sockaddr*)&address, sizeof(address));
+    umask(previousMask);
+    if (result != 0 || listen(fd, 64) != 0)
+    {
+        HRESULT hr = errnoResult();
+        close(fd);
+        return hr;
+    }
+
+    pServer->listener = fd;
+    pServer->name.assign(path.begin(), path.end());
+
+    if (pipe(pServer->wakePipe) != 0)
+    {
+        HRESULT hr = errnoResult();
+        ipcStopListening(pServer);
+        return hr;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        fcntl(pServer->wakePipe[i], F_SETFL, fcntl(pServer->wakePipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(pServer->wakePipe[i], F_SETFD, FD_CLOEXEC);
+    }
+    return S_OK;
+}
+
+void ipcStopListening(TIpcServer* pServer)
+{
+    if (pServer->listener != INVALID_IPC_HANDLE)
+    {
+        close(pServer->listener);
+        pServer->listener = INVALID_IPC_HANDLE;
+        unlink(std::string(pServer->name.begin(), pServer->name.end()).c_str());
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (pServer->wakePipe[i] >= 0)
+        {
+            close(pServer->wakePipe[i]);
+            pServer->wakePipe[i] = -1;
+        }
+    }
+}
+
+HRESULT ipcAccept(TIpcServer* pServer, IpcHandle* pConnection, int timeoutMs)
+{
+    struct pollfd fds[2] = { { pServer->listener, POLLIN, 0 }, { pServer->wakePipe[0], POLLIN, 0 } };
+    for (;;)
+    {
+        int ready = poll(fds, 2, timeoutMs);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return errnoResult();
+        }
+        if (ready == 0)
+        {
+            return S_FALSE;
+        }
+        if (fds[1].revents != 0)
+        {
+            char drain[64];
+            while (read(pServer->wakePipe[0], drain, sizeof(drain)) > 0)
+            {
+            }
+            return S_FALSE;
+        }
+        if (fds[0].revents != 0)
+            break;
+    }
+
+    int fd;
+    do
+    {
+        fd = accept(pServer->listener, NULL, NULL);
+    } while (fd < 0 && errno == EINTR);
+
+    if (fd < 0)
+    {
+        return errnoResult();
+    }
+
+    struct timeval timeout = { IPC_TRANSFER_TIMEOUT_MS / 1000, (IPC_TRANSFER_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    *pConnection = fd;
+    return S_OK;
+}
+
+void ipcWake(TIpcServer* pServer)
+{
+    // A full pipe already guarantees a wake-up, so a failed write is harmless
+    char signal = 1;
+    ssize_t written = write(pServer->wakePipe[1], &signal, 1);
+    (void)written;
+}
+
+void ipcCloseConnection(IpcHandle connection)
+{
+    close(connection);
+}
+
+HRESULT ipcConnect(IpcHandle* pConnection)
+{
+    struct sockaddr_un address;
+    if (!fillAddress(&address, getChannelPath()))
+    {
+        return E_INVALIDARG;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return errnoResult();
+    }
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        HRESULT hr = errnoResult();
+        close(fd);
+        return hr;
+    }
+
+    *pConnection = fd;
+    return S_OK;
+}
+
+void ipcCloseClient(IpcHandle connection)
+{
+    close(connection);
+}
+
+HRESULT ipcWrite(IpcHandle connection, const void* data, size_t size)
+{
+    const char* pos = (const char*)data;
+    while (size > 0)
+    {
+        ssize_t written = send(connection, pos, size, MSG_NOSIGNAL);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return errnoResult();
+        }
+        pos += written;
+        size -= (size_t)written;
+    }
+    return S_OK;
+}
+
+HRESULT ipcRead(IpcHandle connection, void* data, size_t size)
+{
+    char* pos = (char*)data;
+    while (size > 0)
+    {
+        ssize_t received = recv(connection, pos, size, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+        {
+            if (received == 0)
+                errno = 0;
+            return errnoResult();
+        }
+        pos += received;
+        size -= (size_t)received;
+    }
+    return S_OK;
+}
+
+#endif
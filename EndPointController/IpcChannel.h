@@ -0,0 +1,55 @@
+// ----------------------------------------------------------------------------
+// IpcChannel.h
+// Local request channel between the resident daemon and its clients: a
+// named pipe (\\.\pipe\EndPointController) on Windows and a Unix domain
+// socket elsewhere ($XDG_RUNTIME_DIR/EndPointController.sock, falling back
+// to /tmp/EndPointController-<uid>.sock). EPC_IPC_NAME overrides the name.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <stddef.h>
+#include "Platform.h"
+
+#ifdef _WIN32
+typedef HANDLE IpcHandle;
+#define INVALID_IPC_HANDLE INVALID_HANDLE_VALUE
+#else
+typedef int IpcHandle;
+#define INVALID_IPC_HANDLE (-1)
+#endif
+
+// Listening end of the channel owned by the daemon
+typedef struct TIpcServer
+{
+    IpcHandle listener;     // Windows: the pipe instance waiting for the next client
+    std::wstring name;
+#ifdef _WIN32
+    OVERLAPPED connect;     // Outstanding ConnectNamedPipe on listener, kept across wake-ups
+    bool connectPending;
+    HANDLE wakeEvent;
+#else
+    int wakePipe[2];        // Self-pipe that interrupts ipcAccept
+#endif
+} TIpcServer;
+
+// Claim the channel; fails if another daemon already owns it
+HRESULT ipcListen(TIpcServer* pServer);
+void ipcStopListening(TIpcServer* pServer);
+
+// Wait up to timeoutMs (-1: indefinitely) for the next client; close the connection with ipcCloseConnection.
+// Returns S_FALSE without a connection when ipcWake interrupts the wait or it times out.
+HRESULT ipcAccept(TIpcServer* pServer, IpcHandle* pConnection, int timeoutMs);
+
+// Interrupt a pending or the next ipcAccept; callable from any thread
+void ipcWake(TIpcServer* pServer);
+void ipcCloseConnection(IpcHandle connection);
+
+// Connect to a running daemon; fails quickly if there is none. Close with ipcCloseClient.
+HRESULT ipcConnect(IpcHandle* pConnection);
+void ipcCloseClient(IpcHandle connection);
+
+// Blocking transfers of exactly size bytes
+HRESULT ipcWrite(IpcHandle connection, const void* data, size_t size);
+HRESULT ipcRead(IpcHandle connection, void* data, size_t size);
@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include "DeviceSettings.h"
+#include "Interrupt.h"
+#include "Meter.h"
+#include "Output.h"
+#include "SampleRing.h"
+#include "Stats.h"
+#include "Trace.h"
+#ifdef _WIN32
+#include <mmsystem.h>
+#endif
+
+typedef std::chrono::steady_clock MeterClock;
+
+// How often the main thread drains the rings
+#define METER_DRAIN_MS 50
+
+// Each ring holds this many seconds of samples, many drain intervals' worth
+#define METER_RING_SECONDS 2
+
+typedef struct TPeakSample
+{
+    uint32_t tick;
+    float peak;
+} TPeakSample;
+
+typedef SampleRing<TPeakSample> PeakRing;
+
+// What the sampler thread found, read once it has been joined
+typedef struct TSamplerReport
+{
+    std::vector<HRESULT> openResults;   // Per device: whether its meter could be opened
+    uint64_t ticks = 0;
+    uint64_t missedTicks = 0;           // Skipped because the thread woke more than a period late
+    uint64_t readFailures = 0;
+    uint64_t cpuNs = 0;
+    double elapsedMs = 0;
+    LatencyHistogram lateness;          // How late each tick woke, in nanoseconds
+    uint64_t latenessSumNs = 0;
+} TSamplerReport;
+
+// One device's readings over the current summary interval
+typedef struct TMeterWindow
+{
+    float peak = 0;
+    double sum = 0;
+    uint64_t count = 0;
+    uint64_t signalCount = 0;
+} TMeterWindow;
+
+// CPU time the calling thread has used, in nanoseconds
+static uint64_t threadCpuNs()
+{
+#ifdef _WIN32
+    FILETIME creation, exitTime, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exitTime, &kernel, &user))
+    {
+        return 0;
+    }
+    ULARGE_INTEGER kernelTime, userTime;
+    kernelTime.LowPart = kernel.dwLowDateTime;
+    kernelTime.HighPart = kernel.dwHighDateTime;
+    userTime.LowPart = user.dwLowDateTime;
+    userTime.HighPart = user.dwHighDateTime;
+    return (kernelTime.QuadPart + userTime.QuadPart) * 100;
+#else
+    struct timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0)
+    {
+        return 0;
+    }
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#endif
+}
+
+// Open the meters, then read every one of them on each tick until told to stop. Ticks fall due at fixed offsets
+// from the start, so lateness does not accumulate; a tick that wakes more than a period late skips the ticks it
+// missed rather than catching up in a burst. Meters are opened, read and closed on this thread, which owns them.
+static void samplerThread(AudioBackend* pBackend, const DeviceTable* pTargets, std::vector<std::unique_ptr<PeakRing>>* pRings,
+    int rateHz, const std::atomic<bool>* pStop, std::promise<void>* pOpened, TSamplerReport* pReport)
+{
+    std::vector<PeakMeter*> meters(pTargets->size(), NULL);
+    pReport->openResults.resize(pTargets->size());
+    for (size_t i = 0; i < pTargets->size(); i++)
+    {
+        TraceSpan span("AudioBackend::openPeakMeter");
+        pReport->openResults[i] = pBackend->openPeakMeter((*pTargets)[i].id.c_str(), &meters[i]);
+    }
+    pOpened->set_value();
+
+#ifdef _WIN32
+    // The default 15.6 ms timer resolution cannot wake a thread 100 times a second
+    timeBeginPeriod(1);
+#endif
+    uint64_t cpuStart = threadCpuNs();
+    MeterClock::time_point start = MeterClock::now();
+    const std::chrono::nanoseconds period(1000000000LL / rateHz);
+    for (uint64_t tick = 0; !pStop->load(std::memory_order_relaxed); tick++)
+    {
+        MeterClock::time_point due = start + period * tick;
+        std::this_thread::sleep_until(due);
+        int64_t lateNs = std::chrono::duration_cast<std::chrono::nanoseconds>(MeterClock::now() - due).count();
+        if (lateNs < 0)
+        {
+            lateNs = 0;
+        }
+        pReport->lateness.record((uint64_t)lateNs);
+        pReport->latenessSumNs += (uint64_t)lateNs;
+        pReport->ticks++;
+
+        for (size_t i = 0; i < meters.size(); i++)
+        {
+            TPeakSample sample = { (uint32_t)tick, 0 };
+            if (meters[i] == NULL)
+                continue;
+            if (FAILED(meters[i]->getPeakValue(&sample.peak)))
+            {
+                pReport->readFailures++;
+                continue;
+            }
+            (*pRings)[i]->push(sample);
+        }
+
+        if (lateNs > period.count())
+        {
+            uint64_t skipped = (uint64_t)(lateNs / period.count());
+            tick += skipped;
+            pReport->missedTicks += skipped;
+        }
+    }
+    pReport->cpuNs = threadCpuNs() - cpuStart;
+    pReport->elapsedMs = std::chrono::duration<double, std::milli>(MeterClock::now() - start).count();
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+
+    for (auto pMeter : meters)
+    {
+        delete pMeter;
+    }
+}
+
+static void appendLittleEndian(std::string& buffer, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        buffer += (char)((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static void appendLogHeader(std::string& buffer, int rateHz, const DeviceTable& targets)
+{
+    buffer += "EPCM";
+    appendLittleEndian(buffer, 1, 4);
+    appendLittleEndian(buffer, (uint32_t)rateHz, 4);
+    appendLittleEndian(buffer, (uint32_t)targets.size(), 4);
+    for (const auto& device : targets)
+    {
+        std::string id;
+        appendUtf8(id, device.id);
+        appendLittleEndian(buffer, (uint32_t)id.size(), 2);
+        buffer += id;
+    }
+}
+
+static bool hasReadings(const std::vector<TMeterWindow>& windows)
+{
+    for (const auto& window : windows)
+    {
+        if (window.count > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void printWindow(TGlobalState* state, double seconds, const TDeviceEntry& device, int index, const TMeterWindow& window)
+{
+    double mean = window.count > 0 ? window.sum / window.count : 0;
+    double signal = window.count > 0 ? window.signalCount * 100.0 / window.count : 0;
+    if (state->json)
+    {
+        outputf(L"{\"time\":%.1f,\"index\":%d,\"peak\":%.4f,\"mean\":%.4f,\"signal\":%.1f,\"samples\":%llu}\n", seconds, index,
+            window.peak, mean, signal, (unsigned long long)window.count);
+    }
+    else
+    {
+        outputf(L"%7.1f s  Device %d: %ls: peak %.3f, mean %.3f, signal %3.0f%%\n", seconds, index, device.friendlyName.c_str(),
+            window.peak, mean, signal);
+    }
+}
+
+// Sample on a timer thread while this thread drains the rings, summarizing each interval or appending to the log
+HRESULT runMeter(TGlobalState* state, bool isOutput)
+{
+    TraceSpan span("runMeter");
+    int rateHz = state->meterRateHz > 0 ? state->meterRateHz : METER_DEFAULT_RATE_HZ;
+
+    DeviceTable targets;
+    std::vector<int> indexes;
+    HRESULT hr = selectTargetDevices(state, isOutput, targets, indexes);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    FILE* logFile = NULL;
+    std::string logBuffer;
+    if (state->pMeterLogPath != NULL)
+    {
+        logFile = openFile(state->pMeterLogPath, L"wb");
+        if (logFile == NULL)
+        {
+            outputf(_T("Cannot write meter log %ls\n"), state->pMeterLogPath);
+            return E_INVALIDARG;
+        }
+        appendLogHeader(logBuffer, rateHz, targets);
+    }
+
+    std::vector<std::unique_ptr<PeakRing>> rings;
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+        rings.push_back(std::unique_ptr<PeakRing>(new PeakRing((size_t)rateHz * METER_RING_SECONDS)));
+    }
+
+    TSamplerReport report;
+    std::atomic<bool> stopSampler(false);
+    std::promise<void> opened;
+    std::thread sampler(samplerThread, state->pBackend, &targets, &rings, rateHz, &stopSampler, &opened, &report);
+    opened.get_future().wait();
+
+    int meterCount = 0;
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+        if (SUCCEEDED(report.openResults[i]))
+        {
+            meterCount++;
+        }
+        else
+        {
+            outputf(_T("Device %d: %ls: no meter (0x%08x)\n"), indexes[i], targets[i].friendlyName.c_str(),
+                (unsigned int)report.openResults[i]);
+        }
+    }
+    if (logFile == NULL && !state->json)
+    {
+        outputf(_T("Sampling %d devices at %d Hz\n"), meterCount, rateHz);
+    }
+
+    InterruptScope interrupt;
+
+    MeterClock::time_point start = MeterClock::now();
+    MeterClock::time_point deadline = state->timeoutMs >= 0
+        ? start + std::chrono::milliseconds(state->timeoutMs) : MeterClock::time_point::max();
+    MeterClock::time_point nextSummary = start + std::chrono::milliseconds(METER_SUMMARY_MS);
+    std::vector<TMeterWindow> windows(targets.size());
+    uint64_t samples = 0;
+    for (bool last = false; !last;)
+    {
+        MeterClock::time_point now = MeterClock::now();
+        if (interrupt.isRequested() || now >= deadline)
+        {
+            // Drain what the sampler pushed before it stopped
+            stopSampler = true;
+            sampler.join();
+            last = true;
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(METER_DRAIN_MS));
+        }
+
+        TPeakSample sample;
+        for (size_t i = 0; i < rings.size(); i++)
+        {
+            while (rings[i]->pop(sample))
+            {
+                samples++;
+                if (logFile != NULL)
+                {
+                    appendLittleEndian(logBuffer, sample.tick, 4);
+                    appendLittleEndian(logBuffer, (uint32_t)i, 2);
+                    float peak = sample.peak < 0 ? 0 : sample.peak > 1 ? 1 : sample.peak;
+                    appendLittleEndian(logBuffer, (uint32_t)(peak * 65535 + 0.5f), 2);
+                    continue;
+                }
+
+                TMeterWindow& window = windows[i];
+                window.peak = sample.peak > window.peak ? sample.peak : window.peak;
+                window.sum += sample.peak;
+                window.count++;
+                window.signalCount += sample.peak > METER_SIGNAL_THRESHOLD ? 1 : 0;
+            }
+        }
+
+        if (logFile != NULL)
+        {
+            fwrite(logBuffer.data(), 1, logBuffer.size(), logFile);
+            logBuffer.clear();
+        }
+        else if (MeterClock::now() >= nextSummary || (last && hasReadings(windows)))
+        {
+            double seconds = std::chrono::duration<double>(MeterClock::now() - start).count();
+            for (size_t i = 0; i < targets.size(); i++)
+            {
+                if (SUCCEEDED(report.openResults[i]))
+                {
+                    printWindow(state, seconds, targets[i], indexes[i], windows[i]);
+                }
+                windows[i] = TMeterWindow();
+            }
+            nextSummary += std::chrono::milliseconds(METER_SUMMARY_MS);
+        }
+    }
+
+    uint64_t dropped = 0;
+    for (const auto& ring : rings)
+    {
+        dropped += ring->getDropped();
+    }
+    if (logFile != NULL)
+    {
+        fclose(logFile);
+        outputf(_T("Logged %llu samples to %ls\n"), (unsigned long long)samples, state->pMeterLogPath);
+    }
+
+    double seconds = report.elapsedMs / 1000;
+    outputf(_T("Sampled %d devices at %d Hz for %.1f s: %llu ticks, %llu missed, %llu failed reads, %llu dropped samples\n"),
+        meterCount, rateHz, seconds, (unsigned long long)report.ticks, (unsigned long long)report.missedTicks,
+        (unsigned long long)report.readFailures, (unsigned long long)dropped);
+    if (report.ticks > 0)
+    {
+        outputf(_T("Jitter: mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n"),
+            report.latenessSumNs / 1e6 / report.ticks, report.lateness.percentile(50) / 1e6, report.lateness.percentile(99) / 1e6,
+            report.lateness.getMax() / 1e6);
+        outputf(_T("Sampler CPU: %.1f ms (%.2f%% of one core), %.1f us per tick\n"), report.cpuNs / 1e6,
+            report.elapsedMs > 0 ? report.cpuNs / 1e4 / report.elapsedMs : 0.0, report.cpuNs / 1e3 / report.ticks);
+    }
+    return meterCount > 0 ? S_OK : report.openResults.empty() ? E_NOTFOUND : report.openResults[0];
+}
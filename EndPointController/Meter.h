@@ -0,0 +1,31 @@
+// ----------------------------------------------------------------------------
+// Meter.h
+// --meter: sample the peak meter of every selected endpoint at a fixed rate
+// on one timer thread, into a lock-free ring per device. The main thread
+// drains the rings into a live summary or a compact binary log, and the run
+// ends with the sampler's timing jitter and CPU cost.
+//
+// The binary log starts with a header: "EPCM", then the format version (1),
+// the sampling rate in Hz and the device count as 32-bit integers, then each
+// device's ID as a 16-bit byte count and UTF-8 text, in listing order. Then
+// come 8-byte records: the 32-bit tick number (time = tick / rate), the
+// 16-bit device number in header order, and the 16-bit peak scaled so
+// 65535 is full scale. All integers are little-endian.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include "EndPointController.h"
+
+#define METER_DEFAULT_RATE_HZ 100
+#define METER_MAX_RATE_HZ 1000
+
+// How often the live summary is printed
+#define METER_SUMMARY_MS 1000
+
+// Peaks above this (-60 dBFS) count as signal
+#define METER_SIGNAL_THRESHOLD 0.001f
+
+// Sample until interrupted or state->timeoutMs passes
+HRESULT runMeter(TGlobalState* state, bool isOutput);
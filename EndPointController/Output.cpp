@@ -0,0 +1,201 @@
+#include <locale.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <wchar.h>
+#include "Output.h"
+#include "Startup.h"
+
+// Per thread, so a resident process serving a request on one thread cannot take another thread's output
+static thread_local std::wstring* pCaptureBuffer = NULL;
+static bool outputStarted = false;
+static bool localeLoaded = false;
+
+void loadUserLocale()
+{
+#ifndef _WIN32
+    if (!localeLoaded)
+    {
+        setlocale(LC_ALL, "");
+        localeLoaded = true;
+    }
+#endif
+}
+
+// The first output of the process. The portable build loads the locale wprintf needs for non-ASCII text
+// here rather than at start-up, so commands that print nothing never pay for it.
+static void startOutput()
+{
+    outputStarted = true;
+    startupNoteFirstOutput();
+    loadUserLocale();
+}
+
+// Append formatted text to a string; vswprintf fails rather than truncates, so retry with a larger buffer
+static void appendFormatV(std::wstring& buffer, LPCWSTR format, va_list args)
+{
+    wchar_t stackBuffer[512];
+    va_list attempt;
+    va_copy(attempt, args);
+    int length = vswprintf(stackBuffer, 512, format, attempt);
+    va_end(attempt);
+    if (length >= 0)
+    {
+        buffer.append(stackBuffer, length);
+        return;
+    }
+
+    for (size_t size = 4096; size <= 1024 * 1024; size *= 4)
+    {
+        std::wstring heapBuffer(size, L'\0');
+        va_copy(attempt, args);
+        length = vswprintf(&heapBuffer[0], size, format, attempt);
+        va_end(attempt);
+        if (length >= 0)
+        {
+            buffer.append(heapBuffer.c_str(), length);
+            return;
+        }
+    }
+}
+
+void appendFormat(std::wstring& buffer, LPCWSTR format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    appendFormatV(buffer, format, args);
+    va_end(args);
+}
+
+void appendJsonString(std::wstring& buffer, const std::wstring& value)
+{
+    buffer += L'"';
+    for (wchar_t c : value)
+    {
+        if (c == L'"' || c == L'\\')
+        {
+            buffer += L'\\';
+            buffer += c;
+        }
+        else if (c < 0x20)
+        {
+            appendFormat(buffer, L"\\u%04x", (unsigned int)c);
+        }
+        else
+        {
+            buffer += c;
+        }
+    }
+    buffer += L'"';
+}
+
+void appendUtf8(std::string& buffer, const std::wstring& value)
+{
+    for (size_t i = 0; i < value.size(); i++)
+    {
+        unsigned long c = (unsigned long)value[i];
+
+        // UTF-16 wchar_t (Windows) carries characters beyond the BMP as surrogate pairs
+        if (c >= 0xD800 && c <= 0xDBFF && i + 1 < value.size() && value[i + 1] >= 0xDC00 && value[i + 1] <= 0xDFFF)
+        {
+            c = 0x10000 + ((c - 0xD800) << 10) + ((unsigned long)value[++i] - 0xDC00);
+        }
+
+        if (c < 0x80)
+        {
+            buffer += (char)c;
+        }
+        else if (c < 0x800)
+        {
+            buffer += (char)(0xC0 | (c >> 6));
+            buffer += (char)(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000)
+        {
+            buffer += (char)(0xE0 | (c >> 12));
+            buffer += (char)(0x80 | ((c >> 6) & 0x3F));
+            buffer += (char)(0x80 | (c & 0x3F));
+        }
+        else
+        {
+            buffer += (char)(0xF0 | (c >> 18));
+            buffer += (char)(0x80 | ((c >> 12) & 0x3F));
+            buffer += (char)(0x80 | ((c >> 6) & 0x3F));
+            buffer += (char)(0x80 | (c & 0x3F));
+        }
+    }
+}
+
+void appendFromUtf8(std::wstring& buffer, const char* text, size_t length)
+{
+    const unsigned char* p = (const unsigned char*)text;
+    size_t i = 0;
+    while (i < length)
+    {
+        unsigned long c = p[i];
+        size_t extra = c >= 0xF0 && c < 0xF5 ? 3 : c >= 0xE0 && c < 0xF0 ? 2 : c >= 0xC2 && c < 0xE0 ? 1 : 0;
+        bool valid = c < 0x80 || extra > 0;
+        if (extra > 0)
+        {
+            c &= 0x3F >> extra;
+            for (size_t k = 1; k <= extra; k++)
+            {
+                if (i + k >= length || (p[i + k] & 0xC0) != 0x80)
+                {
+                    valid = false;
+                    break;
+                }
+                c = (c << 6) | (p[i + k] & 0x3F);
+            }
+            valid = valid && c <= 0x10FFFF;
+        }
+
+        if (!valid)
+        {
+            // A stray byte from a cache written in the ANSI code page
+            buffer += (wchar_t)p[i];
+            i++;
+            continue;
+        }
+
+        i += extra + 1;
+        if (c >= 0x10000 && sizeof(wchar_t) == 2)
+        {
+            buffer += (wchar_t)(0xD800 + ((c - 0x10000) >> 10));
+            buffer += (wchar_t)(0xDC00 + ((c - 0x10000) & 0x3FF));
+        }
+        else
+        {
+            buffer += (wchar_t)c;
+        }
+    }
+}
+
+void outputf(LPCWSTR format, ...)
+{
+    if (!outputStarted)
+    {
+        startOutput();
+    }
+
+    va_list args;
+    va_start(args, format);
+    if (pCaptureBuffer == NULL)
+    {
+        vwprintf(format, args);
+    }
+    else
+    {
+        appendFormatV(*pCaptureBuffer, format, args);
+    }
+    va_end(args);
+}
+
+void beginOutputCapture(std::wstring* pBuffer)
+{
+    pCaptureBuffer = pBuffer;
+}
+
+void endOutputCapture()
+{
+    pCaptureBuffer = NULL;
+}
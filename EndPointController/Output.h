@@ -0,0 +1,33 @@
+// ----------------------------------------------------------------------------
+// Output.h
+// All user-visible text goes through outputf so the resident daemon can
+// capture the output of a request and send it back to the client.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <string>
+#include "Platform.h"
+
+// Write formatted text to stdout, or to the capture buffer if one is installed
+void outputf(LPCWSTR format, ...);
+
+// Append formatted text to a string, growing it as needed
+void appendFormat(std::wstring& buffer, LPCWSTR format, ...);
+
+// Append value as a quoted JSON string
+void appendJsonString(std::wstring& buffer, const std::wstring& value);
+
+// Load the user's locale for wide-character I/O. The portable build defers this until something needs it:
+// outputf calls it before the first output, and readers of user-written text files call it before reading.
+void loadUserLocale();
+
+// Convert between wide strings and UTF-8, the encoding of the cache files. Bytes that are not valid UTF-8
+// decode as the Latin-1 character of the same value.
+void appendUtf8(std::string& buffer, const std::wstring& value);
+void appendFromUtf8(std::wstring& buffer, const char* text, size_t length);
+
+// Redirect the calling thread's outputf into pBuffer until endOutputCapture is called
+void beginOutputCapture(std::wstring* pBuffer);
+void endOutputCapture();
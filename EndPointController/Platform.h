@@ -0,0 +1,167 @@
+// ----------------------------------------------------------------------------
+// Platform.h
+// Platform glue for the parts of EndPointController that do not talk to COM.
+// On Windows this pulls in the SDK headers; elsewhere it provides the handful
+// of Win32 types, HRESULT codes and endpoint enums the portable core uses so
+// it can be built against the simulated backend.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+
+#ifdef _WIN32
+
+#include <tchar.h>
+#include "windows.h"
+#include "Mmdeviceapi.h"
+
+#else
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <wchar.h>
+
+typedef int32_t HRESULT;
+typedef uint32_t DWORD;
+typedef uint16_t WORD;
+typedef uint32_t UINT;
+typedef int32_t INT;
+typedef int64_t INT64;
+typedef int64_t *PINT64;
+typedef wchar_t *LPWSTR;
+typedef const wchar_t *LPCWSTR;
+typedef const wchar_t *PCWSTR;
+
+#define S_OK                    ((HRESULT)0x00000000)
+#define S_FALSE                 ((HRESULT)0x00000001)
+#define E_NOTIMPL               ((HRESULT)0x80004001)
+#define E_POINTER               ((HRESULT)0x80004003)
+#define E_FAIL                  ((HRESULT)0x80004005)
+#define E_OUTOFMEMORY           ((HRESULT)0x8007000E)
+#define E_INVALIDARG            ((HRESULT)0x80070057)
+
+#define ERROR_NOT_FOUND         1168L
+#define ERROR_TIMEOUT           1460L
+#define ERROR_CANCELLED         1223L
+#define ERROR_FILE_NOT_FOUND    2L
+#define ERROR_ACCESS_DENIED     5L
+#define ERROR_BROKEN_PIPE       109L
+#define ERROR_ALREADY_EXISTS    183L
+#define HRESULT_FROM_WIN32(x)   ((HRESULT)(x) <= 0 ? ((HRESULT)(x)) : ((HRESULT)(((x) & 0x0000FFFF) | (7 << 16) | 0x80000000)))
+
+#define SUCCEEDED(hr)           (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)              (((HRESULT)(hr)) < 0)
+
+enum EDataFlow { eRender, eCapture, eAll, EDataFlow_enum_count };
+enum ERole { eConsole, eMultimedia, eCommunications, ERole_enum_count };
+
+#define DEVICE_STATE_ACTIVE     0x00000001
+#define DEVICE_STATE_DISABLED   0x00000002
+#define DEVICE_STATE_NOTPRESENT 0x00000004
+#define DEVICE_STATE_UNPLUGGED  0x00000008
+#define DEVICE_STATEMASK_ALL    0x0000000F
+
+#define _T(x)                   L ## x
+#define _wtoi(str)              ((int)wcstol((str), NULL, 10))
+
+// Errors without a Win32 counterpart keep their errno in the low word of a FACILITY_ITF code
+#define HRESULT_FROM_ERRNO_BASE 0x80040200
+
+// A POSIX errno as the HRESULT the rest of the tool reports: the Win32 error of the same meaning where there
+// is one, so the codes printed match the Windows build's. 0 (no errno set) counts as a broken connection.
+inline HRESULT hresultFromErrno(int error)
+{
+    switch (error)
+    {
+    case 0:
+    case EPIPE:
+    case ECONNRESET:
+        return HRESULT_FROM_WIN32(ERROR_BROKEN_PIPE);
+    case ENOENT:
+    case ECONNREFUSED:
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    case EACCES:
+    case EPERM:
+        return HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED);
+    case ENOMEM:
+        return E_OUTOFMEMORY;
+    case EINVAL:
+    case ENAMETOOLONG:
+        return E_INVALIDARG;
+    case EEXIST:
+    case EADDRINUSE:
+        return HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+    case EAGAIN:
+    case ETIMEDOUT:
+        return HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+    default:
+        return (HRESULT)(HRESULT_FROM_ERRNO_BASE | (error & 0xFFFF));
+    }
+}
+
+#endif
+
+#ifndef E_NOTFOUND
+#define E_NOTFOUND              HRESULT_FROM_WIN32(ERROR_NOT_FOUND)
+#endif
+
+// The CRT on Windows accepts "%ws" for wide strings in wprintf; glibc only knows "%ls". Rewrite user
+// supplied format strings once so the documented "%ws" form works in the portable build as well.
+inline std::wstring portableFormatString(LPCWSTR format)
+{
+    std::wstring result(format);
+#ifndef _WIN32
+    for (size_t pos = result.find(L"%ws"); pos != std::wstring::npos; pos = result.find(L"%ws", pos + 3))
+    {
+        result[pos + 1] = L'l';
+    }
+#endif
+    return result;
+}
+
+// Open a file named by a wide-character path, as taken from the command line.
+inline FILE* openFile(LPCWSTR path, LPCWSTR mode)
+{
+#ifdef _WIN32
+    return _wfopen(path, mode);
+#else
+    char narrowPath[4096];
+    char narrowMode[16];
+    if (wcstombs(narrowPath, path, sizeof(narrowPath)) == (size_t)-1 || wcstombs(narrowMode, mode, sizeof(narrowMode)) == (size_t)-1)
+    {
+        return NULL;
+    }
+    return fopen(narrowPath, narrowMode);
+#endif
+}
+
+// A path from the command line made absolute against the current directory, for handing to a process that
+// may run somewhere else. Left as given when it cannot be resolved.
+inline std::wstring absolutePath(LPCWSTR path)
+{
+#ifdef _WIN32
+    wchar_t* pFull = _wfullpath(NULL, path, 0);
+    std::wstring result(pFull != NULL ? pFull : path);
+    free(pFull);
+    return result;
+#else
+    char narrowDirectory[4096];
+    wchar_t directory[4096];
+    if (path[0] == L'/' || getcwd(narrowDirectory, sizeof(narrowDirectory)) == NULL ||
+        mbstowcs(directory, narrowDirectory, sizeof(directory) / sizeof(directory[0])) == (size_t)-1)
+    {
+        return path;
+    }
+    std::wstring result(directory);
+    if (result.empty() || result.back() != L'/')
+    {
+        result += L'/';
+    }
+    return result + path;
+#endif
+}
@@ -9,6 +9,14 @@
 #pragma once
 
 
+// Argument of GetShareMode and SetShareMode. Its layout is not documented; the first field holds the mode, and
+// callers should leave room for more.
+struct DeviceShareMode
+{
+    INT mode;
+};
+
+
 interface DECLSPEC_UUID("f8679f50-850a-41cf-9c72-430f290290c8")
 IPolicyConfig;
 class DECLSPEC_UUID("870af99c-171d-4f9e-af0d-e63df40c2bc9")
@@ -30,7 +38,7 @@ interface IPolicyConfig : public IUnknown
 {
 public:
 
-    virtual HRESULT GetMixFormat(
+    virtual HRESULT STDMETHODCALLTYPE GetMixFormat(
         PCWSTR,
         WAVEFORMATEX **
     );
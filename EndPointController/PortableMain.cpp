@@ -0,0 +1,41 @@
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "EndPointController.h"
+#include "Output.h"
+
+#ifndef _WIN32
+// Portable entry point: widen the arguments and hand over to _tmain. Kept apart from the rest of the tool
+// so the benchmarks can link the same code with their own main.
+int main(int argc, char* argv[])
+{
+    // Loading the user's locale is a measurable part of start-up. ASCII arguments convert the same without
+    // it, and outputf loads it before the first output.
+    for (int i = 0; i < argc; i++)
+    {
+        for (const char* p = argv[i]; *p != '\0'; p++)
+        {
+            if ((unsigned char)*p >= 0x80)
+            {
+                loadUserLocale();
+                i = argc;
+                break;
+            }
+        }
+    }
+
+    std::vector<std::wstring> arguments(argc);
+    std::vector<LPCWSTR> wideArgv(argc + 1, NULL);
+    for (int i = 0; i < argc; i++)
+    {
+        size_t length = mbstowcs(NULL, argv[i], 0);
+        if (length != (size_t)-1)
+        {
+            arguments[i].resize(length);
+            mbstowcs(&arguments[i][0], argv[i], length);
+        }
+        wideArgv[i] = arguments[i].c_str();
+    }
+    return _tmain(argc, wideArgv.data());
+}
+#endif
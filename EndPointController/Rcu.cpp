@@ -0,0 +1,124 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "Rcu.h"
+
+// A version retired at epoch E may be held by readers that entered before E; it is freed once every active
+// reader entered at E or later. Readers store the epoch they entered and then load the pointer, and writers
+// swap the pointer and then advance the epoch, all sequentially consistent: a reader that the reclaimer sees
+// as idle can only load the new version.
+typedef struct TRetired
+{
+    void* pObject;
+    void (*deleter)(void*);
+    unsigned long long epoch;
+} TRetired;
+
+static std::atomic<unsigned long long> globalEpoch(1);
+static std::atomic<unsigned long long> readerEpochs[RCU_MAX_READERS];    // 0 while the slot's thread is not reading
+static std::atomic<bool> slotClaimed[RCU_MAX_READERS];
+
+static std::mutex retiredLock;
+static std::vector<TRetired> retired;
+
+// The calling thread's reader slot, claimed on first use and returned when the thread exits
+class ReaderSlot
+{
+public:
+    ReaderSlot() : index(-1), depth(0) {}
+
+    ~ReaderSlot()
+    {
+        if (index >= 0)
+        {
+            slotClaimed[index].store(false, std::memory_order_release);
+        }
+    }
+
+    int claim()
+    {
+        for (int i = 0; index < 0 && i < RCU_MAX_READERS; i++)
+        {
+            bool expected = false;
+            if (slotClaimed[i].compare_exchange_strong(expected, true))
+            {
+                index = i;
+            }
+        }
+        if (index < 0)
+        {
+            fprintf(stderr, "More than %d concurrent RCU reader threads\n", RCU_MAX_READERS);
+            abort();
+        }
+        return index;
+    }
+
+    int index;
+    int depth;
+};
+
+static thread_local ReaderSlot readerSlot;
+
+RcuReadGuard::RcuReadGuard()
+{
+    ReaderSlot& slot = readerSlot;
+    if (slot.depth++ == 0)
+    {
+        readerEpochs[slot.claim()].store(globalEpoch.load());
+    }
+}
+
+RcuReadGuard::~RcuReadGuard()
+{
+    ReaderSlot& slot = readerSlot;
+    if (--slot.depth == 0)
+    {
+        readerEpochs[slot.index].store(0, std::memory_order_release);
+    }
+}
+
+void rcuRetire(void* pObject, void (*deleter)(void*))
+{
+    TRetired entry = { pObject, deleter, globalEpoch.fetch_add(1) + 1 };
+    {
+        std::lock_guard<std::mutex> guard(retiredLock);
+        retired.push_back(entry);
+    }
+    rcuReclaim();
+}
+
+size_t rcuReclaim()
+{
+    unsigned long long oldestReader = ULLONG_MAX;
+    for (int i = 0; i < RCU_MAX_READERS; i++)
+    {
+        unsigned long long epoch = readerEpochs[i].load();
+        if (epoch != 0 && epoch < oldestReader)
+        {
+            oldestReader = epoch;
+        }
+    }
+
+    // Run the deleters outside the lock; they may be slow
+    std::vector<TRetired> ready;
+    size_t remaining;
+    {
+        std::lock_guard<std::mutex> guard(retiredLock);
+        size_t kept = 0;
+        for (size_t i = 0; i < retired.size(); i++)
+        {
+            if (retired[i].epoch <= oldestReader)
+                ready.push_back(retired[i]);
+            else
+                retired[kept++] = retired[i];
+        }
+        retired.resize(kept);
+        remaining = kept;
+    }
+
+    for (const auto& entry : ready)
+    {
+        entry.deleter(entry.pObject);
+    }
+    return remaining;
+}
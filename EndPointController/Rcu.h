@@ -0,0 +1,85 @@
+// ----------------------------------------------------------------------------
+// Rcu.h
+// Read-copy-update for tables that many threads read and one thread at a
+// time replaces. Readers enter a read-side section (RcuReadGuard) and load
+// the current version with no lock and no reference counting; a writer
+// publishes a new immutable version with one atomic swap and retires the old
+// one, which is freed once no reader that could still hold it remains
+// (epoch-based reclamation).
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Upper bound on threads inside read-side sections at the same time
+#define RCU_MAX_READERS 256
+
+// Marks the calling thread as reading for its lifetime. Sections nest; pointers loaded inside one are valid
+// until the outermost guard is destroyed.
+class RcuReadGuard
+{
+public:
+    RcuReadGuard();
+    ~RcuReadGuard();
+
+private:
+    RcuReadGuard(const RcuReadGuard&);
+    RcuReadGuard& operator=(const RcuReadGuard&);
+};
+
+// Queue an unpublished version for deletion once every read-side section that began before now has ended.
+// Frees whatever earlier retirements have become safe.
+void rcuRetire(void* pObject, void (*deleter)(void*));
+
+// Free every retirement that has become safe; returns how many remain pending
+size_t rcuReclaim();
+
+// A pointer to the current version of T. Any number of readers; writers must be serialized by the caller.
+template <typename T>
+class RcuPointer
+{
+public:
+    RcuPointer(T* pInitial = NULL) : current(pInitial) {}
+
+    ~RcuPointer()
+    {
+        delete current.load();
+    }
+
+    // Inside an RcuReadGuard only
+    const T* read() const
+    {
+        return current.load(std::memory_order_seq_cst);
+    }
+
+    // The current version, for the writer to copy from
+    const T* writerView() const
+    {
+        return current.load(std::memory_order_relaxed);
+    }
+
+    // Make pNew the current version and retire the previous one
+    void publish(T* pNew)
+    {
+        T* pOld = current.exchange(pNew, std::memory_order_seq_cst);
+        if (pOld != NULL)
+        {
+            rcuRetire(pOld, &deleteVersion);
+        }
+    }
+
+private:
+    static void deleteVersion(void* pObject)
+    {
+        delete (T*)pObject;
+    }
+
+    RcuPointer(const RcuPointer&);
+    RcuPointer& operator=(const RcuPointer&);
+
+    std::atomic<T*> current;
+};
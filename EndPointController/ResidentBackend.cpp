@@ -0,0 +1,616 @@
+#include "ResidentBackend.h"
+
+// A version of the tables under construction. It starts out sharing everything with the current version and
+// copies the table of a data flow the first time a change needs to modify it.
+class VersionBuilder
+{
+public:
+    VersionBuilder(const TResidentTables* pCurrent) : pNext(new TResidentTables(*pCurrent)) {}
+
+    ~VersionBuilder()
+    {
+        delete pNext;
+    }
+
+    TResidentTables* tables()
+    {
+        return pNext;
+    }
+
+    DeviceTable& writable(EDataFlow dataFlow)
+    {
+        if (!copies[dataFlow])
+        {
+            copies[dataFlow] = std::make_shared<DeviceTable>(*pNext->devices[dataFlow]);
+            pNext->devices[dataFlow] = copies[dataFlow];
+        }
+        return *copies[dataFlow];
+    }
+
+    // Hand the finished version over for publishing
+    TResidentTables* release()
+    {
+        TResidentTables* pFinished = pNext;
+        pNext = NULL;
+        return pFinished;
+    }
+
+private:
+    TResidentTables* pNext;
+    std::shared_ptr<DeviceTable> copies[2];
+};
+
+// Set the sessions of a device in a version under construction. Returns false if the device is not in it.
+static bool storeSessions(VersionBuilder& next, const std::wstring& deviceID, const SessionTable& sessions)
+{
+    for (int flow = eRender; flow <= eCapture; flow++)
+    {
+        const DeviceTable& devices = *next.tables()->devices[flow];
+        for (size_t i = 0; i < devices.size(); i++)
+        {
+            if (devices[i].id == deviceID)
+            {
+                TDeviceEntry& device = next.writable((EDataFlow)flow)[i];
+                device.sessions = sessions;
+                device.sessionsRead = true;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static TResidentTables* createEmptyTables()
+{
+    TResidentTables* pTables = new TResidentTables();
+    pTables->devices[eRender] = std::make_shared<DeviceTable>();
+    pTables->devices[eCapture] = std::make_shared<DeviceTable>();
+    pTables->generation = 0;
+    return pTables;
+}
+
+ResidentBackend::ResidentBackend(AudioBackend* pInner)
+    : pInner(pInner), registered(false), tables(createEmptyTables()), changeHandler(NULL), pChangeContext(NULL)
+{
+}
+
+ResidentBackend::~ResidentBackend()
+{
+    if (registered)
+    {
+        pInner->unregisterNotificationSink(this);
+    }
+    rcuReclaim();
+}
+
+HRESULT ResidentBackend::initialize()
+{
+    // Register first so no change between the initial load and the registration is missed
+    HRESULT hr = pInner->registerNotificationSink(this);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    registered = true;
+
+    std::lock_guard<std::mutex> writer(writerLock);
+    VersionBuilder next(tables.writerView());
+    for (int flow = eRender; flow <= eCapture; flow++)
+    {
+        DeviceTable& devices = next.writable((EDataFlow)flow);
+        hr = pInner->enumerateDevices((EDataFlow)flow, DEVICE_STATEMASK_ALL, devices);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        for (auto& device : devices)
+        {
+            readAudioSettings(device);
+        }
+
+        for (int role = eConsole; role < ERole_enum_count; role++)
+        {
+            pInner->getDefaultDeviceID((EDataFlow)flow, (ERole)role, next.tables()->defaults[flow][role]);
+        }
+    }
+
+    next.tables()->generation++;
+    tables.publish(next.release());
+    return S_OK;
+}
+
+void ResidentBackend::setChangeHandler(DeviceChangeHandler handler, void* pContext)
+{
+    changeHandler = handler;
+    pChangeContext = pContext;
+}
+
+void ResidentBackend::queueChange(const TDeviceChange& change)
+{
+    changes.push(change);
+    if (changeHandler != NULL)
+    {
+        changeHandler(pChangeContext);
+    }
+}
+
+bool ResidentBackend::isSupersededRead(const std::vector<TDeviceChange>& changes, size_t index)
+{
+    // Plugging a device in raises a burst of property notifications; one re-read covers them all as long
+    // as nothing else happened to the device in between
+    for (size_t i = index + 1; i < changes.size(); i++)
+    {
+        if (changes[i].deviceID == changes[index].deviceID && changes[i].change != eDeviceChangeDefault &&
+            changes[i].change != eDeviceChangeSessions)
+        {
+            return changes[i].change == eDeviceChangeRead;
+        }
+    }
+    return false;
+}
+
+bool ResidentBackend::isSupersededSessionsRead(const std::vector<TDeviceChange>& changes, size_t index)
+{
+    // Every volume step of a fade is a notification of its own
+    for (size_t i = index + 1; i < changes.size(); i++)
+    {
+        if (changes[i].deviceID == changes[index].deviceID && changes[i].change == eDeviceChangeSessions)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ResidentBackend::readAudioSettings(TDeviceEntry& device)
+{
+    if (FAILED(pInner->getDeviceFormat(device.id.c_str(), device.format)))
+    {
+        device.format = TAudioFormat();
+    }
+    if (FAILED(pInner->getProcessingPeriod(device.id.c_str(), device.period)))
+    {
+        device.period = TProcessingPeriod();
+    }
+}
+
+void ResidentBackend::recordDevice(LPCWSTR deviceID)
+{
+    std::lock_guard<std::mutex> writer(writerLock);
+    EDataFlow dataFlow;
+    TDeviceEntry device;
+    if (findDevice(tables.writerView(), deviceID, &dataFlow) == NULL || FAILED(pInner->readDevice(deviceID, device, &dataFlow)))
+    {
+        return;
+    }
+
+    readAudioSettings(device);
+    VersionBuilder next(tables.writerView());
+    const TDeviceEntry* pKnown = findDevice(next.tables(), deviceID, &dataFlow);
+    TDeviceUpdate update;
+    update.event = pKnown->state != device.state ? eDeviceEventStateChanged : eDeviceEventPropertyChanged;
+    update.dataFlow = dataFlow;
+    update.role = eConsole;
+    device.sessions = pKnown->sessions;
+    device.sessionsRead = pKnown->sessionsRead;
+    update.device = device;
+    if (updateDeviceTable(next.writable(dataFlow), device, false))
+    {
+        next.tables()->generation++;
+        tables.publish(next.release());
+        recordedUpdates.push_back(update);
+    }
+}
+
+// A notification may have arrived while the sessions were read; the read it caused is the later one
+void ResidentBackend::recordSessions(LPCWSTR deviceID, const SessionTable& sessions)
+{
+    std::lock_guard<std::mutex> writer(writerLock);
+    EDataFlow dataFlow;
+    const TDeviceEntry* pDevice = findDevice(tables.writerView(), deviceID, &dataFlow);
+    if (pDevice == NULL || pDevice->sessionsRead)
+    {
+        return;
+    }
+
+    VersionBuilder next(tables.writerView());
+    storeSessions(next, deviceID, sessions);
+    tables.publish(next.release());
+}
+
+const TDeviceEntry* ResidentBackend::findDevice(const TResidentTables* pTables, const std::wstring& deviceID, EDataFlow* pDataFlow)
+{
+    for (int flow = eRender; flow <= eCapture; flow++)
+    {
+        for (const auto& device : *pTables->devices[flow])
+        {
+            if (device.id == deviceID)
+            {
+                *pDataFlow = (EDataFlow)flow;
+                return &device;
+            }
+        }
+    }
+    return NULL;
+}
+
+void ResidentBackend::applyPendingChanges(std::vector<TDeviceUpdate>& updates)
+{
+    {
+        std::lock_guard<std::mutex> writer(writerLock);
+        updates.insert(updates.end(), recordedUpdates.begin(), recordedUpdates.end());
+        recordedUpdates.clear();
+    }
+
+    std::vector<TDeviceChange> pending;
+    TDeviceChange change;
+    while (changes.pop(change))
+    {
+        pending.push_back(change);
+    }
+    if (pending.empty())
+    {
+        return;
+    }
+
+    // The whole batch goes into one new version
+    std::lock_guard<std::mutex> writer(writerLock);
+    VersionBuilder next(tables.writerView());
+    size_t applied = updates.size();
+    bool sessionsChanged = false;
+
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+        const TDeviceChange& change = pending[i];
+        TDeviceUpdate update;
+        update.dataFlow = change.dataFlow;
+        update.role = change.role;
+
+        if (change.change == eDeviceChangeDefault)
+        {
+            std::wstring& defaultID = next.tables()->defaults[change.dataFlow][change.role];
+            if (defaultID != change.deviceID)
+            {
+                defaultID = change.deviceID;
+                EDataFlow dataFlow;
+                const TDeviceEntry* pDevice = findDevice(next.tables(), change.deviceID, &dataFlow);
+                if (pDevice != NULL)
+                {
+                    update.device = *pDevice;
+                }
+                update.device.id = change.deviceID;
+                update.event = eDeviceEventDefaultChanged;
+                updates.push_back(update);
+            }
+            continue;
+        }
+
+        if (change.change == eDeviceChangeSessions)
+        {
+            SessionTable sessions;
+            if (!isSupersededSessionsRead(pending, i) && SUCCEEDED(pInner->getSessions(change.deviceID.c_str(), sessions)))
+            {
+                sessionsChanged |= storeSessions(next, change.deviceID, sessions);
+            }
+            continue;
+        }
+
+        if (change.change == eDeviceChangeRemoved || change.change == eDeviceChangeState)
+        {
+            // These carry everything needed; the device is not queried
+            const TDeviceEntry* pDevice = findDevice(next.tables(), change.deviceID, &update.dataFlow);
+            if (pDevice != NULL)
+            {
+                update.device = *pDevice;
+                if (change.change == eDeviceChangeRemoved)
+                {
+                    update.event = eDeviceEventRemoved;
+                    updateDeviceTable(next.writable(update.dataFlow), update.device, true);
+                    updates.push_back(update);
+                }
+                else if (update.device.state != change.state)
+                {
+                    update.event = eDeviceEventStateChanged;
+                    update.device.state = change.state;
+                    if (update.device.format.sampleRate == 0)
+                    {
+                        readAudioSettings(update.device);
+                    }
+                    updateDeviceTable(next.writable(update.dataFlow), update.device, false);
+                    updates.push_back(update);
+                }
+                continue;
+            }
+            if (change.change == eDeviceChangeRemoved)
+            {
+                continue;
+            }
+            // A state change for a device not yet in the tables is read in full
+        }
+        else if (isSupersededRead(pending, i))
+        {
+            continue;
+        }
+
+        // Readers keep using the published version while the device is queried. A device that vanished before
+        // it could be read is dropped; its removal notification follows.
+        if (SUCCEEDED(pInner->readDevice(change.deviceID.c_str(), update.device, &update.dataFlow)) &&
+            (update.dataFlow == eRender || update.dataFlow == eCapture))
+        {
+            readAudioSettings(update.device);
+            EDataFlow knownFlow;
+            const TDeviceEntry* pKnown = findDevice(next.tables(), change.deviceID, &knownFlow);
+            update.event = pKnown == NULL ? eDeviceEventAdded
+                : pKnown->state != update.device.state ? eDeviceEventStateChanged : eDeviceEventPropertyChanged;
+            if (pKnown != NULL)
+            {
+                update.device.sessions = pKnown->sessions;
+                update.device.sessionsRead = pKnown->sessionsRead;
+            }
+            if (updateDeviceTable(next.writable(update.dataFlow), update.device, false))
+            {
+                updates.push_back(update);
+            }
+        }
+    }
+
+    if (updates.size() != applied)
+    {
+        next.tables()->generation++;
+    }
+    if (updates.size() != applied || sessionsChanged)
+    {
+        tables.publish(next.release());
+    }
+}
+
+unsigned long long ResidentBackend::getGeneration() const
+{
+    RcuReadGuard guard;
+    return tables.read()->generation;
+}
+
+HRESULT ResidentBackend::enumerateDevices(EDataFlow dataFlow, DWORD stateMask, DeviceTable& devices)
+{
+    RcuReadGuard guard;
+    const TResidentTables* pTables = tables.read();
+    for (int flow = eRender; flow <= eCapture; flow++)
+    {
+        if (dataFlow != eAll && dataFlow != flow)
+            continue;
+
+        for (const auto& device : *pTables->devices[flow])
+        {
+            if ((device.state & stateMask) != 0)
+            {
+                devices.push_back(device);
+            }
+        }
+    }
+    return S_OK;
+}
+
+HRESULT ResidentBackend::readDevice(LPCWSTR deviceID, TDeviceEntry& device, EDataFlow* pDataFlow)
+{
+    RcuReadGuard guard;
+    const TDeviceEntry* pDevice = findDevice(tables.read(), deviceID, pDataFlow);
+    if (pDevice == NULL)
+    {
+        return E_NOTFOUND;
+    }
+    device = *pDevice;
+    return S_OK;
+}
+
+HRESULT ResidentBackend::getDefaultDeviceID(EDataFlow dataFlow, ERole role, std::wstring& deviceID)
+{
+    if (dataFlow != eRender && dataFlow != eCapture)
+    {
+        return E_INVALIDARG;
+    }
+
+    RcuReadGuard guard;
+    const std::wstring& defaultID = tables.read()->defaults[dataFlow][role];
+    if (defaultID.empty())
+    {
+        return E_NOTFOUND;
+    }
+    deviceID = defaultID;
+    return S_OK;
+}
+
+HRESULT ResidentBackend::setDefaultEndpoint(LPCWSTR deviceID, ERole role)
+{
+    HRESULT hr = pInner->setDefaultEndpoint(deviceID, role);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // Record the change now so a query that races the notification already sees it
+    std::lock_guard<std::mutex> writer(writerLock);
+    EDataFlow dataFlow;
+    const TResidentTables* pCurrent = tables.writerView();
+    if (findDevice(pCurrent, deviceID, &dataFlow) != NULL && pCurrent->defaults[dataFlow][role] != deviceID)
+    {
+        VersionBuilder next(pCurrent);
+        next.tables()->defaults[dataFlow][role] = deviceID;
+        next.tables()->generation++;
+        tables.publish(next.release());
+    }
+    return hr;
+}
+
+HRESULT ResidentBackend::getDeviceFormat(LPCWSTR deviceID, TAudioFormat& format)
+{
+    {
+        RcuReadGuard guard;
+        EDataFlow dataFlow;
+        const TDeviceEntry* pDevice = findDevice(tables.read(), deviceID, &dataFlow);
+        if (pDevice != NULL && pDevice->format.sampleRate != 0)
+        {
+            format = pDevice->format;
+            return S_OK;
+        }
+    }
+    return pInner->getDeviceFormat(deviceID, format);
+}
+
+HRESULT ResidentBackend::setDeviceFormat(LPCWSTR deviceID, const TAudioFormat& format)
+{
+    HRESULT hr = pInner->setDeviceFormat(deviceID, format);
+    if (SUCCEEDED(hr))
+    {
+        recordDevice(deviceID);
+    }
+    return hr;
+}
+
+HRESULT ResidentBackend::getProcessingPeriod(LPCWSTR deviceID, TProcessingPeriod& period)
+{
+    {
+        RcuReadGuard guard;
+        EDataFlow dataFlow;
+        const TDeviceEntry* pDevice = findDevice(tables.read(), deviceID, &dataFlow);
+        if (pDevice != NULL && pDevice->period.minimumPeriod != 0)
+        {
+            period = pDevice->period;
+            return S_OK;
+        }
+    }
+    return pInner->getProcessingPeriod(deviceID, period);
+}
+
+// The engine sends no notification for a period change, so the tables only learn of it here
+HRESULT ResidentBackend::setProcessingPeriod(LPCWSTR deviceID, INT64 period)
+{
+    HRESULT hr = pInner->setProcessingPeriod(deviceID, period);
+    if (SUCCEEDED(hr))
+    {
+        recordDevice(deviceID);
+    }
+    return hr;
+}
+
+// Any default change that comes with hiding a device is left to its notification
+HRESULT ResidentBackend::setEndpointVisibility(LPCWSTR deviceID, bool visible)
+{
+    HRESULT hr = pInner->setEndpointVisibility(deviceID, visible);
+    if (SUCCEEDED(hr))
+    {
+        recordDevice(deviceID);
+    }
+    return hr;
+}
+
+HRESULT ResidentBackend::getDriverVersion(LPCWSTR deviceID, std::wstring& version)
+{
+    return pInner->getDriverVersion(deviceID, version);
+}
+
+HRESULT ResidentBackend::getShareMode(LPCWSTR deviceID, int* pShareMode)
+{
+    return pInner->getShareMode(deviceID, pShareMode);
+}
+
+HRESULT ResidentBackend::probeFormats(LPCWSTR deviceID, const std::vector<TAudioFormat>& formats, std::vector<unsigned char>& support)
+{
+    return pInner->probeFormats(deviceID, formats, support);
+}
+
+HRESULT ResidentBackend::getEndpointVolume(LPCWSTR deviceID, TEndpointVolume& volume)
+{
+    return pInner->getEndpointVolume(deviceID, volume);
+}
+
+HRESULT ResidentBackend::updateEndpointVolume(LPCWSTR deviceID, const TVolumeUpdate& update, TEndpointVolume& before,
+    TEndpointVolume& after)
+{
+    return pInner->updateEndpointVolume(deviceID, update, before, after);
+}
+
+HRESULT ResidentBackend::openPeakMeter(LPCWSTR deviceID, PeakMeter** ppMeter)
+{
+    return pInner->openPeakMeter(deviceID, ppMeter);
+}
+
+// The first read of a device's sessions starts watching them; from then on they are answered from the tables
+HRESULT ResidentBackend::getSessions(LPCWSTR deviceID, SessionTable& sessions)
+{
+    {
+        RcuReadGuard guard;
+        EDataFlow dataFlow;
+        const TDeviceEntry* pDevice = findDevice(tables.read(), deviceID, &dataFlow);
+        if (pDevice != NULL && pDevice->sessionsRead)
+        {
+            sessions = pDevice->sessions;
+            return S_FALSE;
+        }
+    }
+
+    // Watch before reading, so a change in between is not missed. Sessions that cannot be watched are read live.
+    bool watched = SUCCEEDED(pInner->watchSessions(deviceID));
+    HRESULT hr = pInner->getSessions(deviceID, sessions);
+    if (SUCCEEDED(hr) && watched)
+    {
+        recordSessions(deviceID, sessions);
+    }
+    return hr;
+}
+
+HRESULT ResidentBackend::watchSessions(LPCWSTR deviceID)
+{
+    return pInner->watchSessions(deviceID);
+}
+
+HRESULT ResidentBackend::registerNotificationSink(DeviceNotificationSink* pSink)
+{
+    return pInner->registerNotificationSink(pSink);
+}
+
+HRESULT ResidentBackend::unregisterNotificationSink(DeviceNotificationSink* pSink)
+{
+    return pInner->unregisterNotificationSink(pSink);
+}
+
+void ResidentBackend::onDeviceAdded(LPCWSTR deviceID)
+{
+    TDeviceChange change = { eDeviceChangeRead, deviceID, 0, eRender, eConsole };
+    queueChange(change);
+}
+
+void ResidentBackend::onDeviceRemoved(LPCWSTR deviceID)
+{
+    TDeviceChange change = { eDeviceChangeRemoved, deviceID, 0, eRender, eConsole };
+    queueChange(change);
+}
+
+void ResidentBackend::onDeviceStateChanged(LPCWSTR deviceID, DWORD newState)
+{
+    TDeviceChange change = { eDeviceChangeState, deviceID, newState, eRender, eConsole };
+    queueChange(change);
+}
+
+void ResidentBackend::onDefaultDeviceChanged(EDataFlow dataFlow, ERole role, LPCWSTR deviceID)
+{
+    if (dataFlow == eRender || dataFlow == eCapture)
+    {
+        TDeviceChange change = { eDeviceChangeDefault, deviceID, 0, dataFlow, role };
+        queueChange(change);
+    }
+}
+
+void ResidentBackend::onPropertyValueChanged(LPCWSTR deviceID, EDeviceProperty property)
+{
+    if (property == eDevicePropertyName || property == eDevicePropertyFormat)
+    {
+        TDeviceChange change = { eDeviceChangeRead, deviceID, 0, eRender, eConsole };
+        queueChange(change);
+    }
+}
+
+void ResidentBackend::onSessionsChanged(LPCWSTR deviceID)
+{
+    TDeviceChange change = { eDeviceChangeSessions, deviceID, 0, eRender, eConsole };
+    queueChange(change);
+}
@@ -0,0 +1,162 @@
+// ----------------------------------------------------------------------------
+// ResidentBackend.h
+// Backend decorator for long-running modes. Enumeration and default-device
+// queries are answered from in-memory tables that endpoint notifications keep
+// current; switching, configuration and notification registration pass
+// through.
+//
+// Notification callbacks only push onto a lock-free queue, so they never wait
+// on a reader. applyPendingChanges folds the queue into the tables on the
+// thread that owns the inner backend, re-reading at most the devices that
+// changed, so upkeep scales with the number of changes, not of devices.
+//
+// The tables are immutable versions published through RCU: readers never
+// lock, and each batch of changes copies only the data flows it touches.
+//
+// Unlike a plain enumeration, the tables also hold each device's format and
+// engine processing periods. They are read when a device is loaded and again
+// when the audio engine reports a format change.
+//
+// A device's audio sessions join its entry the first time they are asked
+// for. From then on the inner backend watches them, and each session
+// notification re-reads that device's sessions; they are never polled.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include "AudioBackend.h"
+#include "EventQueue.h"
+#include "Rcu.h"
+
+enum EDeviceEvent
+{
+    eDeviceEventAdded,
+    eDeviceEventRemoved,
+    eDeviceEventStateChanged,
+    eDeviceEventPropertyChanged,
+    eDeviceEventDefaultChanged
+};
+
+// One change applied to the tables
+typedef struct TDeviceUpdate
+{
+    EDeviceEvent event;
+    EDataFlow dataFlow;
+    ERole role;             // eDeviceEventDefaultChanged only
+    TDeviceEntry device;    // The entry after the change; for a removal, its last known entry
+} TDeviceUpdate;
+
+// One published version of the resident tables. A new version shares the device table of every data flow
+// its changes did not touch with the version it replaces.
+typedef struct TResidentTables
+{
+    std::shared_ptr<const DeviceTable> devices[2];  // Every endpoint of each data flow, regardless of state
+    std::wstring defaults[2][ERole_enum_count];
+    unsigned long long generation;
+} TResidentTables;
+
+// Called on the notification thread after a change has been queued; must not block
+typedef void (*DeviceChangeHandler)(void* pContext);
+
+class ResidentBackend : public AudioBackend, public DeviceNotificationSink
+{
+public:
+    ResidentBackend(AudioBackend* pInner);
+    ~ResidentBackend();
+
+    // Register for notifications and load both data flows
+    HRESULT initialize();
+
+    // Ask to be woken when a change is queued, so it can be applied without waiting for the next request.
+    // Call before initialize.
+    void setChangeHandler(DeviceChangeHandler handler, void* pContext);
+
+    // Fold the queued changes into the tables, appending those that changed anything to updates, after the
+    // changes this process made itself and already recorded
+    void applyPendingChanges(std::vector<TDeviceUpdate>& updates);
+
+    // Advances whenever the tables or defaults change. Session changes do not count: the shared snapshot,
+    // which this drives, does not carry sessions.
+    unsigned long long getGeneration() const;
+
+    HRESULT enumerateDevices(EDataFlow dataFlow, DWORD stateMask, DeviceTable& devices);
+    HRESULT readDevice(LPCWSTR deviceID, TDeviceEntry& device, EDataFlow* pDataFlow);
+    HRESULT getDefaultDeviceID(EDataFlow dataFlow, ERole role, std::wstring& deviceID);
+    HRESULT setDefaultEndpoint(LPCWSTR deviceID, ERole role);
+    HRESULT getDeviceFormat(LPCWSTR deviceID, TAudioFormat& format);
+    HRESULT setDeviceFormat(LPCWSTR deviceID, const TAudioFormat& format);
+    HRESULT getProcessingPeriod(LPCWSTR deviceID, TProcessingPeriod& period);
+    HRESULT setProcessingPeriod(LPCWSTR deviceID, INT64 period);
+    HRESULT setEndpointVisibility(LPCWSTR deviceID, bool visible);
+    HRESULT getDriverVersion(LPCWSTR deviceID, std::wstring& version);
+    HRESULT getShareMode(LPCWSTR deviceID, int* pShareMode);
+    HRESULT probeFormats(LPCWSTR deviceID, const std::vector<TAudioFormat>& formats, std::vector<unsigned char>& support);
+    HRESULT getEndpointVolume(LPCWSTR deviceID, TEndpointVolume& volume);
+    HRESULT updateEndpointVolume(LPCWSTR deviceID, const TVolumeUpdate& update, TEndpointVolume& before, TEndpointVolume& after);
+    HRESULT openPeakMeter(LPCWSTR deviceID, PeakMeter** ppMeter);
+    HRESULT getSessions(LPCWSTR deviceID, SessionTable& sessions);
+    HRESULT watchSessions(LPCWSTR deviceID);
+    HRESULT registerNotificationSink(DeviceNotificationSink* pSink);
+    HRESULT unregisterNotificationSink(DeviceNotificationSink* pSink);
+
+    void onDeviceAdded(LPCWSTR deviceID);
+    void onDeviceRemoved(LPCWSTR deviceID);
+    void onDeviceStateChanged(LPCWSTR deviceID, DWORD newState);
+    void onDefaultDeviceChanged(EDataFlow dataFlow, ERole role, LPCWSTR deviceID);
+    void onPropertyValueChanged(LPCWSTR deviceID, EDeviceProperty property);
+    void onSessionsChanged(LPCWSTR deviceID);
+
+private:
+    enum EDeviceChange
+    {
+        eDeviceChangeRead,      // Added, or a name or the format changed: re-read the device
+        eDeviceChangeRemoved,
+        eDeviceChangeState,
+        eDeviceChangeDefault,
+        eDeviceChangeSessions   // Re-read the device's sessions
+    };
+
+    typedef struct TDeviceChange
+    {
+        EDeviceChange change;
+        std::wstring deviceID;
+        DWORD state;
+        EDataFlow dataFlow;
+        ERole role;
+    } TDeviceChange;
+
+    void queueChange(const TDeviceChange& change);
+
+    // A re-read made redundant by a later re-read of the same device in the batch
+    static bool isSupersededRead(const std::vector<TDeviceChange>& changes, size_t index);
+
+    // A session re-read made redundant by a later one of the same device in the batch
+    static bool isSupersededSessionsRead(const std::vector<TDeviceChange>& changes, size_t index);
+
+    // Fill in the format and processing periods of a freshly read entry; those that cannot be read stay unread
+    void readAudioSettings(TDeviceEntry& device);
+
+    // Re-read a device after this process changed it, rather than wait for a notification, and publish the
+    // entry if it differs
+    void recordDevice(LPCWSTR deviceID);
+
+    // Keep the sessions read on a reader's behalf, unless session notifications already filled them in
+    void recordSessions(LPCWSTR deviceID, const SessionTable& sessions);
+
+    // Locate a device in a version of the tables
+    static const TDeviceEntry* findDevice(const TResidentTables* pTables, const std::wstring& deviceID, EDataFlow* pDataFlow);
+
+    AudioBackend* pInner;
+    bool registered;
+
+    std::mutex writerLock;              // Serializes writers; readers never take it
+    RcuPointer<TResidentTables> tables;
+    std::vector<TDeviceUpdate> recordedUpdates;     // Published by recordDevice, not yet handed out; under writerLock
+
+    EventQueue<TDeviceChange> changes;
+    DeviceChangeHandler changeHandler;
+    void* pChangeContext;
+};
@@ -0,0 +1,73 @@
+// ----------------------------------------------------------------------------
+// SampleRing.h
+// Bounded lock-free single-producer, single-consumer ring. The --meter
+// sampler pushes each reading into its device's ring and never waits on the
+// thread that drains it; a full ring drops the new reading and counts it.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+template <typename T>
+class SampleRing
+{
+public:
+    // The capacity is rounded up to a power of two, so positions wrap with a mask
+    explicit SampleRing(size_t minimumCapacity) : head(0), tail(0), dropped(0)
+    {
+        size_t capacity = 1;
+        while (capacity < minimumCapacity)
+        {
+            capacity <<= 1;
+        }
+        items.resize(capacity);
+        mask = capacity - 1;
+    }
+
+    // Producer thread only. Returns false, counting the item as dropped, if the ring is full.
+    bool push(const T& item)
+    {
+        size_t position = head.load(std::memory_order_relaxed);
+        if (position - tail.load(std::memory_order_acquire) > mask)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        items[position & mask] = item;
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only. Returns false when empty.
+    bool pop(T& item)
+    {
+        size_t position = tail.load(std::memory_order_relaxed);
+        if (position == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = items[position & mask];
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Any thread
+    uint64_t getDropped() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<T> items;
+    size_t mask;
+
+    // Each index on its own cache line, so the producer and consumer do not share one
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+    alignas(64) std::atomic<uint64_t> dropped;
+};
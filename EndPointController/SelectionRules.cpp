@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <wchar.h>
+#include <wctype.h>
+#include <algorithm>
+#include "Output.h"
+#include "SelectionRules.h"
+
+// Names accepted by formfactor=, indexed by EndpointFormFactor value
+static const wchar_t* formFactorNames[] = { L"remote", L"speakers", L"linelevel", L"headphones", L"microphone",
+    L"headset", L"handset", L"digital", L"spdif", L"hdmi", L"unknown" };
+
+// Names accepted by state=, indexed by the bit position of the DEVICE_STATE_* value
+static const wchar_t* stateNames[] = { L"active", L"disabled", L"notpresent", L"unplugged" };
+
+static std::wstring toLower(const std::wstring& text)
+{
+    std::wstring result(text);
+    for (auto& c : result)
+    {
+        c = (wchar_t)towlower(c);
+    }
+    return result;
+}
+
+// Case-insensitive substring search against an already lower-cased needle, without allocating
+static bool containsNoCase(const std::wstring& haystack, const std::wstring& needle)
+{
+    size_t length = needle.size();
+    if (length == 0)
+        return true;
+
+    for (size_t i = 0; i + length <= haystack.size(); i++)
+    {
+        size_t j = 0;
+        while (j < length && (wchar_t)towlower(haystack[i + j]) == needle[j])
+            j++;
+        if (j == length)
+            return true;
+    }
+    return false;
+}
+
+static bool equalsNoCase(const std::wstring& value, const std::wstring& lowerValue)
+{
+    if (value.size() != lowerValue.size())
+        return false;
+
+    for (size_t i = 0; i < value.size(); i++)
+    {
+        if ((wchar_t)towlower(value[i]) != lowerValue[i])
+            return false;
+    }
+    return true;
+}
+
+// Parse a form factor given by name or number, -1 if unknown
+static int parseFormFactor(const std::wstring& value)
+{
+    if (!value.empty() && iswdigit(value[0]))
+    {
+        return (int)wcstol(value.c_str(), NULL, 10);
+    }
+    for (size_t i = 0; i < sizeof(formFactorNames) / sizeof(formFactorNames[0]); i++)
+    {
+        if (equalsNoCase(value, formFactorNames[i]))
+            return (int)i;
+    }
+    return -1;
+}
+
+// Parse a device state name into its DEVICE_STATE_* bit, 0 if unknown
+static DWORD parseDeviceState(const std::wstring& value)
+{
+    for (size_t i = 0; i < sizeof(stateNames) / sizeof(stateNames[0]); i++)
+    {
+        if (equalsNoCase(value, stateNames[i]))
+            return 1u << i;
+    }
+    return 0;
+}
+
+// Compile one rule line ("<priority> key=value ...") into its matching form
+HRESULT compileSelectionRule(const std::wstring& text, TSelectionRule& rule)
+{
+    rule.priority = 0;
+    rule.namePattern.clear();
+    rule.formFactor = -1;
+    rule.containerID.clear();
+    rule.stateMask = 0;
+
+    const wchar_t* pos = text.c_str();
+    wchar_t* end = NULL;
+    rule.priority = (int)wcstol(pos, &end, 10);
+    if (end == pos)
+    {
+        return E_INVALIDARG;
+    }
+    pos = end;
+
+    int conditions = 0;
+    while (*pos != L'\0')
+    {
+        while (iswspace(*pos))
+            pos++;
+        if (*pos == L'\0')
+            break;
+
+        const wchar_t* equals = wcschr(pos, L'=');
+        if (equals == NULL)
+        {
+            return E_INVALIDARG;
+        }
+        std::wstring key = toLower(std::wstring(pos, equals - pos));
+
+        std::wstring value;
+        pos = equals + 1;
+        if (*pos == L'"')
+        {
+            const wchar_t* close = wcschr(pos + 1, L'"');
+            if (close == NULL)
+            {
+                return E_INVALIDARG;
+            }
+            value.assign(pos + 1, close - pos - 1);
+            pos = close + 1;
+        }
+        else
+        {
+            const wchar_t* start = pos;
+            while (*pos != L'\0' && !iswspace(*pos))
+                pos++;
+            value.assign(start, pos - start);
+        }
+
+        if (key == L"name")
+        {
+            rule.namePattern = toLower(value);
+        }
+        else if (key == L"formfactor")
+        {
+            rule.formFactor = parseFormFactor(value);
+            if (rule.formFactor < 0)
+            {
+                return E_INVALIDARG;
+            }
+        }
+        else if (key == L"container")
+        {
+            rule.containerID = toLower(value);
+            if (!rule.containerID.empty() && rule.containerID[0] != L'{')
+            {
+                rule.containerID = L"{" + rule.containerID + L"}";
+            }
+        }
+        else if (key == L"state")
+        {
+            // Repeating the condition accepts any of the states
+            DWORD state = parseDeviceState(value);
+            if (state == 0)
+            {
+                return E_INVALIDARG;
+            }
+            rule.stateMask |= state;
+        }
+        else
+        {
+            return E_INVALIDARG;
+        }
+        conditions++;
+    }
+
+    return conditions > 0 ? S_OK : E_INVALIDARG;
+}
+
+// Compile a selector: a rule line whose priority is left out
+HRESULT compileDeviceSelector(const std::wstring& text, TSelectionRule& rule)
+{
+    return compileSelectionRule(L"0 " + text, rule);
+}
+
+// Load and compile a rules file; blank lines and lines starting with '#' are ignored
+HRESULT loadSelectionRules(LPCWSTR path, RuleTable& rules)
+{
+    // fgetws decodes with the user's locale
+    loadUserLocale();
+    FILE* inFile = openFile(path, L"r");
+    if (inFile == NULL)
+    {
+        outputf(_T("Cannot open rules file %ls\n"), path);
+        return E_INVALIDARG;
+    }
+
+    HRESULT hr = S_OK;
+    wchar_t line[1024];
+    int lineNumber = 0;
+    while (fgetws(line, 1024, inFile) != NULL)
+    {
+        lineNumber++;
+        // A line longer than the buffer comes back in pieces; join them so the rest is not read as another rule
+        std::wstring text(line);
+        while (text.back() != L'\n' && fgetws(line, 1024, inFile) != NULL)
+        {
+            text += line;
+        }
+        size_t first = text.find_first_not_of(L" \t\r\n");
+        if (first == std::wstring::npos || text[first] == L'#')
+            continue;
+        text.erase(text.find_last_not_of(L" \t\r\n") + 1);
+
+        TSelectionRule rule;
+        if (FAILED(compileSelectionRule(text.substr(first), rule)))
+        {
+            outputf(_T("Invalid rule on line %d: %ls\n"), lineNumber, text.c_str());
+            hr = E_INVALIDARG;
+            break;
+        }
+        // selectDevice only considers active devices, so a rule asking for another state could never match
+        if ((rule.stateMask & ~DEVICE_STATE_ACTIVE) != 0)
+        {
+            outputf(_T("Invalid rule on line %d, only state=active can match in a rules file: %ls\n"), lineNumber, text.c_str());
+            hr = E_INVALIDARG;
+            break;
+        }
+        rules.push_back(rule);
+    }
+    fclose(inFile);
+
+    std::stable_sort(rules.begin(), rules.end(),
+        [](const TSelectionRule& a, const TSelectionRule& b) { return a.priority > b.priority; });
+    return hr;
+}
+
+// Check every condition of a rule against a device
+bool ruleMatches(const TSelectionRule& rule, const TDeviceEntry& device)
+{
+    if (rule.formFactor >= 0 && (UINT)rule.formFactor != device.formFactor)
+        return false;
+    if (!rule.containerID.empty() && !equalsNoCase(device.containerID, rule.containerID))
+        return false;
+    if (rule.stateMask != 0 && (device.state & rule.stateMask) == 0)
+        return false;
+    return containsNoCase(device.friendlyName, rule.namePattern);
+}
+
+// Score every active device by its first (highest-priority) matching rule and pick the best
+int selectDevice(const RuleTable& rules, const DeviceTable& devices, int* pPriority)
+{
+    int selected = -1;
+    int bestPriority = 0;
+
+    for (size_t i = 0; i < devices.size(); i++)
+    {
+        if ((devices[i].state & DEVICE_STATE_ACTIVE) == 0)
+            continue;
+
+        for (const auto& rule : rules)
+        {
+            if (selected >= 0 && rule.priority <= bestPriority)
+                break; // Cannot beat the current pick, and ties go to the lower index
+
+            if (ruleMatches(rule, devices[i]))
+            {
+                selected = (int)i;
+                bestPriority = rule.priority;
+                break;
+            }
+        }
+    }
+
+    if (pPriority != NULL)
+    {
+        *pPriority = bestPriority;
+    }
+    return selected;
+}
@@ -0,0 +1,44 @@
+// ----------------------------------------------------------------------------
+// SelectionRules.h
+// Rule-based automatic device selection. A rules file lists one rule per
+// line: a priority followed by conditions that must all match, e.g.
+//
+//   # prefer a USB headset, else the dock speakers, else HDMI
+//   100 name=USB formfactor=headset
+//   50  name="Dock Speakers"
+//   10  formfactor=hdmi
+//
+// Conditions are name=<substring of the friendly name, case-insensitive>,
+// formfactor=<name or EndpointFormFactor value>, container=<GUID> and
+// state=<active, disabled, notpresent or unplugged>. Only active devices are
+// considered and the highest-priority match wins, so a rules file rejects
+// any state other than active; the other states are for --match.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include "AudioBackend.h"
+
+// A compiled selection rule; conditions left at their "ignore" value always match
+typedef struct TSelectionRule
+{
+    int priority;
+    std::wstring namePattern;   // Lower-case substring of the friendly name, empty to ignore
+    int formFactor;             // EndpointFormFactor value, -1 to ignore
+    std::wstring containerID;   // Lower-case braced container GUID, empty to ignore
+    DWORD stateMask;            // DEVICE_STATE_* bits any of which the device must have, 0 to ignore
+} TSelectionRule;
+
+// Compiled rules ordered by descending priority, so the first rule that matches a device is its score
+typedef std::vector<TSelectionRule> RuleTable;
+
+HRESULT loadSelectionRules(LPCWSTR path, RuleTable& rules);
+HRESULT compileSelectionRule(const std::wstring& text, TSelectionRule& rule);
+
+// Compile the conditions of a rule without its priority, as given to --match
+HRESULT compileDeviceSelector(const std::wstring& text, TSelectionRule& rule);
+bool ruleMatches(const TSelectionRule& rule, const TDeviceEntry& device);
+
+// Return the index of the best-scoring active device, or -1 if no rule matches any of them
+int selectDevice(const RuleTable& rules, const DeviceTable& devices, int* pPriority);
@@ -0,0 +1,610 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SharedSnapshot.h"
+#include "Trace.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define SNAPSHOT_MAGIC 0x53435045           // "EPCS"
+#define SNAPSHOT_LAYOUT_VERSION 3
+#define SNAPSHOT_PAYLOAD_CAPACITY (1024 * 1024)
+#define SNAPSHOT_READ_ATTEMPTS 1000
+
+// Segment header. The payload that follows holds, per data flow, a device count and the devices (state, form
+// factor, sample rate, channels, bits per sample, channel mask, a float flag and the default, minimum and current
+// processing periods, then id, friendly name, description, interface name and container ID as length-prefixed
+// wchar_t strings), then the default endpoint ID of every flow and role. Both ends are the same build, so byte
+// order matches; wcharSize and layoutVersion keep a reader from misparsing another build's segment.
+typedef struct TSnapshotHeader
+{
+    uint32_t magic;
+    uint32_t layoutVersion;
+    uint32_t wcharSize;
+    uint32_t ownerPid;                  // 0 once the daemon has withdrawn the snapshot
+    std::atomic<uint32_t> sequence;     // Odd while the payload is being rewritten
+    uint32_t payloadSize;               // Written under the sequence like the payload
+} TSnapshotHeader;
+
+#define SNAPSHOT_SEGMENT_SIZE (sizeof(TSnapshotHeader) + SNAPSHOT_PAYLOAD_CAPACITY)
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "sequence must be a plain 32-bit word in shared memory");
+
+static char* payloadOf(TSnapshotHeader* pHeader)
+{
+    return (char*)(pHeader + 1);
+}
+
+static void putUInt(std::vector<char>& payload, uint32_t value)
+{
+    payload.insert(payload.end(), (const char*)&value, (const char*)&value + sizeof(value));
+}
+
+static void putString(std::vector<char>& payload, const std::wstring& text)
+{
+    putUInt(payload, (uint32_t)text.size());
+    payload.insert(payload.end(), (const char*)text.c_str(), (const char*)(text.c_str() + text.size()));
+}
+
+// Bounds-checked cursor over a copied payload
+class PayloadReader
+{
+public:
+    PayloadReader(const std::vector<char>& payload) : pos(payload.data()), end(payload.data() + payload.size()) {}
+
+    bool getUInt(uint32_t* pValue)
+    {
+        if ((size_t)(end - pos) < sizeof(uint32_t))
+        {
+            return false;
+        }
+        memcpy(pValue, pos, sizeof(uint32_t));
+        pos += sizeof(uint32_t);
+        return true;
+    }
+
+    bool getString(std::wstring& text)
+    {
+        uint32_t length;
+        if (!getUInt(&length) || (size_t)(end - pos) / sizeof(wchar_t) < length)
+        {
+            return false;
+        }
+        text.resize(length);
+        if (length > 0)
+        {
+            memcpy(&text[0], pos, length * sizeof(wchar_t));
+        }
+        pos += length * sizeof(wchar_t);
+        return true;
+    }
+
+private:
+    const char* pos;
+    const char* end;
+};
+
+#ifdef _WIN32
+
+static std::wstring getSegmentName()
+{
+    const wchar_t* override = _wgetenv(L"EPC_IPC_NAME");
+    return std::wstring(L"Local\\") + (override != NULL ? override : L"EndPointController") + L".Snapshot";
+}
+
+static uint32_t currentProcessID()
+{
+    return GetCurrentProcessId();
+}
+
+static bool isProcessAlive(uint32_t pid)
+{
+    HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, pid);
+    if (hProcess == NULL)
+    {
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    }
+    bool alive = WaitForSingleObject(hProcess, 0) == WAIT_TIMEOUT;
+    CloseHandle(hProcess);
+    return alive;
+}
+
+static HRESULT mapSegment(TSnapshotWriter* pWriter)
+{
+    pWriter->mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)SNAPSHOT_SEGMENT_SIZE,
+        getSegmentName().c_str());
+    if (pWriter->mapping == NULL)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    pWriter->pView = MapViewOfFile(pWriter->mapping, FILE_MAP_ALL_ACCESS, 0, 0, SNAPSHOT_SEGMENT_SIZE);
+    if (pWriter->pView == NULL)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        CloseHandle(pWriter->mapping);
+        pWriter->mapping = NULL;
+        return hr;
+    }
+    return S_OK;
+}
+
+static void unmapSegment(TSnapshotWriter* pWriter)
+{
+    UnmapViewOfFile(pWriter->pView);
+    CloseHandle(pWriter->mapping);
+    pWriter->pView = NULL;
+    pWriter->mapping = NULL;
+}
+
+static const TSnapshotHeader* openReadView(void** ppContext)
+{
+    HANDLE mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, getSegmentName().c_str());
+    if (mapping == NULL)
+    {
+        return NULL;
+    }
+    void* pView = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, SNAPSHOT_SEGMENT_SIZE);
+    CloseHandle(mapping);
+    *ppContext = pView;
+    return (const TSnapshotHeader*)pView;
+}
+
+static void closeReadView(const TSnapshotHeader* pHeader, void* pContext)
+{
+    UnmapViewOfFile(pContext);
+}
+
+#else
+
+static std::string getSegmentName()
+{
+    const char* override = getenv("EPC_IPC_NAME");
+    std::string name = override != NULL && strchr(override, '/') == NULL ? override : "EndPointController";
+    return "/" + name + ".snapshot." + std::to_string((unsigned long)getuid());
+}
+
+static uint32_t currentProcessID()
+{
+    return (uint32_t)getpid();
+}
+
+static bool isProcessAlive(uint32_t pid)
+{
+    return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+}
+
+// Only trust a segment this user created; the name is predictable
+static bool isOwnSegment(int fd)
+{
+    struct stat status;
+    return fstat(fd, &status) == 0 && status.st_uid == getuid() && (size_t)status.st_size >= SNAPSHOT_SEGMENT_SIZE;
+}
+
+static HRESULT mapSegment(TSnapshotWriter* pWriter)
+{
+    pWriter->name = getSegmentName();
+    int fd = shm_open(pWriter->name.c_str(), O_CREAT | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        return hresultFromErrno(errno);
+    }
+
+    HRESULT hr = S_OK;
+    errno = 0;
+    if (ftruncate(fd, SNAPSHOT_SEGMENT_SIZE) != 0 || !isOwnSegment(fd))
+    {
+        hr = hresultFromErrno(errno != 0 ? errno : EACCES);
+    }
+    else
+    {
+        void* pView = mmap(NULL, SNAPSHOT_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (pView == MAP_FAILED)
+        {
+            hr = hresultFromErrno(errno);
+        }
+        else
+        {
+            pWriter->pView = pView;
+        }
+    }
+    close(fd);
+    return hr;
+}
+
+static void unmapSegment(TSnapshotWriter* pWriter)
+{
+    munmap(pWriter->pView, SNAPSHOT_SEGMENT_SIZE);
+    shm_unlink(pWriter->name.c_str());
+    pWriter->pView = NULL;
+}
+
+static const TSnapshotHeader* openReadView(void** ppContext)
+{
+    int fd = shm_open(getSegmentName().c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    void* pView = isOwnSegment(fd) ? mmap(NULL, SNAPSHOT_SEGMENT_SIZE, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    *ppContext = NULL;
+    return pView != MAP_FAILED ? (const TSnapshotHeader*)pView : NULL;
+}
+
+static void closeReadView(const TSnapshotHeader* pHeader, void* pContext)
+{
+    munmap((void*)pHeader, SNAPSHOT_SEGMENT_SIZE);
+}
+
+#endif
+
+HRESULT createSnapshotSegment(TSnapshotWriter* pWriter)
+{
+    pWriter->pView = NULL;
+    HRESULT hr = mapSegment(pWriter);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // Readers ignore the segment until the first publish: an empty payload does not parse
+    TSnapshotHeader* pHeader = (TSnapshotHeader*)pWriter->pView;
+    pHeader->ownerPid = 0;
+    // A daemon that died mid-publish leaves the sequence odd, which would keep every reader retrying
+    pHeader->sequence.store(0, std::memory_order_relaxed);
+    pHeader->payloadSize = 0;
+    pHeader->layoutVersion = SNAPSHOT_LAYOUT_VERSION;
+    pHeader->wcharSize = sizeof(wchar_t);
+    pHeader->magic = SNAPSHOT_MAGIC;
+    pHeader->ownerPid = currentProcessID();
+    return S_OK;
+}
+
+HRESULT publishSnapshot(TSnapshotWriter* pWriter, AudioBackend* pSource)
+{
+    if (pWriter->pView == NULL)
+    {
+        return E_POINTER;
+    }
+
+    std::vector<char> payload;
+    HRESULT hr = S_OK;
+    for (int flow = eRender; flow <= eCapture && SUCCEEDED(hr); flow++)
+    {
+        DeviceTable devices;
+        hr = pSource->enumerateDevices((EDataFlow)flow, DEVICE_STATEMASK_ALL, devices);
+        putUInt(payload, (uint32_t)devices.size());
+        for (const auto& device : devices)
+        {
+            putUInt(payload, device.state);
+            putUInt(payload, device.formFactor);
+            putUInt(payload, device.format.sampleRate);
+            putUInt(payload, device.format.channels);
+            putUInt(payload, device.format.bitsPerSample);
+            putUInt(payload, device.format.channelMask);
+            putUInt(payload, device.format.isFloat ? 1 : 0);
+            putUInt(payload, (uint32_t)device.period.defaultPeriod);
+            putUInt(payload, (uint32_t)device.period.minimumPeriod);
+            putUInt(payload, (uint32_t)device.period.currentPeriod);
+            putString(payload, device.id);
+            putString(payload, device.friendlyName);
+            putString(payload, device.description);
+            putString(payload, device.interfaceName);
+            putString(payload, device.containerID);
+        }
+    }
+    for (int flow = eRender; flow <= eCapture; flow++)
+    {
+        for (int role = eConsole; role < ERole_enum_count; role++)
+        {
+            std::wstring deviceID;
+            pSource->getDefaultDeviceID((EDataFlow)flow, (ERole)role, deviceID);
+            putString(payload, deviceID);
+        }
+    }
+
+    // A payload that does not fit is withdrawn (published empty) so readers enumerate instead
+    if (FAILED(hr) || payload.size() > SNAPSHOT_PAYLOAD_CAPACITY)
+    {
+        payload.clear();
+        hr = FAILED(hr) ? hr : E_OUTOFMEMORY;
+    }
+
+    TSnapshotHeader* pHeader = (TSnapshotHeader*)pWriter->pView;
+    uint32_t sequence = pHeader->sequence.load(std::memory_order_relaxed);
+    pHeader->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    if (!payload.empty())
+    {
+        memcpy(payloadOf(pHeader), payload.data(), payload.size());
+    }
+    pHeader->payloadSize = (uint32_t)payload.size();
+    pHeader->sequence.store(sequence + 2, std::memory_order_release);
+    return hr;
+}
+
+void closeSnapshotSegment(TSnapshotWriter* pWriter)
+{
+    if (pWriter->pView != NULL)
+    {
+        ((TSnapshotHeader*)pWriter->pView)->ownerPid = 0;
+        unmapSegment(pWriter);
+    }
+}
+
+// Copy a consistent payload out of the segment: retry while the sequence is odd or moved during the copy
+static HRESULT copySnapshot(std::vector<char>& payload)
+{
+    void* pContext = NULL;
+    const TSnapshotHeader* pHeader = openReadView(&pContext);
+    if (pHeader == NULL)
+    {
+        return E_NOTFOUND;
+    }
+
+    HRESULT hr = E_NOTFOUND;
+    if (pHeader->magic == SNAPSHOT_MAGIC && pHeader->layoutVersion == SNAPSHOT_LAYOUT_VERSION &&
+        pHeader->wcharSize == sizeof(wchar_t) && pHeader->ownerPid != 0 && isProcessAlive(pHeader->ownerPid))
+    {
+        const char* pPayload = (const char*)(pHeader + 1);
+        for (int attempt = 0; attempt < SNAPSHOT_READ_ATTEMPTS; attempt++)
+        {
+            uint32_t sequence = pHeader->sequence.load(std::memory_order_acquire);
+            if ((sequence & 1) != 0)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            uint32_t size = pHeader->payloadSize;
+            payload.assign(pPayload, pPayload + (size <= SNAPSHOT_PAYLOAD_CAPACITY ? size : 0));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (pHeader->sequence.load(std::memory_order_relaxed) == sequence)
+            {
+                hr = S_OK;
+                break;
+            }
+        }
+    }
+
+    closeReadView(pHeader, pContext);
+    return hr;
+}
+
+// Read-only backend over a copied snapshot
+class SnapshotBackend : public AudioBackend
+{
+public:
+    HRESULT load(const std::vector<char>& payload)
+    {
+        PayloadReader reader(payload);
+        for (int flow = eRender; flow <= eCapture; flow++)
+        {
+            uint32_t count;
+            if (!reader.getUInt(&count))
+            {
+                return E_NOTFOUND;
+            }
+            for (uint32_t i = 0; i < count; i++)
+            {
+                TDeviceEntry device;
+                uint32_t state, formFactor, sampleRate, channels, bitsPerSample, channelMask, isFloat;
+                uint32_t defaultPeriod, minimumPeriod, currentPeriod;
+                if (!reader.getUInt(&state) || !reader.getUInt(&formFactor) || !reader.getUInt(&sampleRate) ||
+                    !reader.getUInt(&channels) || !reader.getUInt(&bitsPerSample) || !reader.getUInt(&channelMask) ||
+                    !reader.getUInt(&isFloat) || !reader.getUInt(&defaultPeriod) || !reader.getUInt(&minimumPeriod) ||
+                    !reader.getUInt(&currentPeriod) || !reader.getString(device.id) ||
+                    !reader.getString(device.friendlyName) || !reader.getString(device.description) ||
+                    !reader.getString(device.interfaceName) || !reader.getString(device.containerID))
+                {
+                    return E_NOTFOUND;
+                }
+                device.state = state;
+                device.formFactor = formFactor;
+                device.format.sampleRate = sampleRate;
+                device.format.channels = channels;
+                device.format.bitsPerSample = bitsPerSample;
+                device.format.channelMask = channelMask;
+                device.format.isFloat = isFloat != 0;
+                device.period.defaultPeriod = defaultPeriod;
+                device.period.minimumPeriod = minimumPeriod;
+                device.period.currentPeriod = currentPeriod;
+                tables[flow].push_back(device);
+            }
+        }
+        for (int flow = eRender; flow <= eCapture; flow++)
+        {
+            for (int role = eConsole; role < ERole_enum_count; role++)
+            {
+                if (!reader.getString(defaults[flow][role]))
+                {
+                    return E_NOTFOUND;
+                }
+            }
+        }
+        return S_OK;
+    }
+
+    HRESULT enumerateDevices(EDataFlow dataFlow, DWORD stateMask, DeviceTable& devices)
+    {
+        for (int flow = eRender; flow <= eCapture; flow++)
+        {
+            if (dataFlow != eAll && dataFlow != flow)
+                continue;
+
+            for (const auto& device : tables[flow])
+            {
+                if ((device.state & stateMask) != 0)
+                {
+                    devices.push_back(device);
+                }
+            }
+        }
+        return S_OK;
+    }
+
+    HRESULT readDevice(LPCWSTR deviceID, TDeviceEntry& device, EDataFlow* pDataFlow)
+    {
+        for (int flow = eRender; flow <= eCapture; flow++)
+        {
+            for (const auto& entry : tables[flow])
+            {
+                if (entry.id == deviceID)
+                {
+                    device = entry;
+                    *pDataFlow = (EDataFlow)flow;
+                    return S_OK;
+                }
+            }
+        }
+        return E_NOTFOUND;
+    }
+
+    HRESULT getDefaultDeviceID(EDataFlow dataFlow, ERole role, std::wstring& deviceID)
+    {
+        if (dataFlow != eRender && dataFlow != eCapture)
+        {
+            return E_INVALIDARG;
+        }
+        if (defaults[dataFlow][role].empty())
+        {
+            return E_NOTFOUND;
+        }
+        deviceID = defaults[dataFlow][role];
+        return S_OK;
+    }
+
+    HRESULT setDefaultEndpoint(LPCWSTR deviceID, ERole role)
+    {
+        return E_NOTIMPL;
+    }
+
+    // Only the formats the daemon had read are known
+    HRESULT getDeviceFormat(LPCWSTR deviceID, TAudioFormat& format)
+    {
+        TDeviceEntry device;
+        EDataFlow dataFlow;
+        if (FAILED(readDevice(deviceID, device, &dataFlow)) || device.format.sampleRate == 0)
+        {
+            return E_NOTFOUND;
+        }
+        format = device.format;
+        return S_OK;
+    }
+
+    HRESULT setDeviceFormat(LPCWSTR deviceID, const TAudioFormat& format)
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT getProcessingPeriod(LPCWSTR deviceID, TProcessingPeriod& period)
+    {
+        TDeviceEntry device;
+        EDataFlow dataFlow;
+        if (FAILED(readDevice(deviceID, device, &dataFlow)) || device.period.minimumPeriod == 0)
+        {
+            return E_NOTFOUND;
+        }
+        period = device.period;
+        return S_OK;
+    }
+
+    HRESULT setProcessingPeriod(LPCWSTR deviceID, INT64 period)
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT setEndpointVisibility(LPCWSTR deviceID, bool visible)
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT getDriverVersion(LPCWSTR deviceID, std::wstring& version)
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT getShareMode(LPCWSTR deviceID, int* pShareMode)
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT probeFormats(LPCWSTR deviceID, const std::vector<TAudioFormat>& formats, std::vector<unsigned char>& support)
+    {
+        return E_NOTIMPL;
+    }
+
+    // The snapshot does not carry volumes, which change too often to publish
+    HRESULT getEndpointVolume(LPCWSTR deviceID, TEndpointVolume& volume)
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT updateEndpointVolume(LPCWSTR deviceID, const TVolumeUpdate& update, TEndpointVolume& before, TEndpointVolume& after)
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT openPeakMeter(LPCWSTR deviceID, PeakMeter** ppMeter)
+    {
+        return E_NOTIMPL;
+    }
+
+    // Nor sessions, which only the daemon's own requests read from its tables
+    HRESULT getSessions(LPCWSTR deviceID, SessionTable& sessions)
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT watchSessions(LPCWSTR deviceID)
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT registerNotificationSink(DeviceNotificationSink* pSink)
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT unregisterNotificationSink(DeviceNotificationSink* pSink)
+    {
+        return E_NOTIMPL;
+    }
+
+private:
+    DeviceTable tables[2];
+    std::wstring defaults[2][ERole_enum_count];
+};
+
+HRESULT openSnapshotBackend(AudioBackend** ppBackend)
+{
+    TraceSpan span("openSnapshotBackend");
+
+    std::vector<char> payload;
+    HRESULT hr = copySnapshot(payload);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    SnapshotBackend* pBackend = new SnapshotBackend();
+    hr = pBackend->load(payload);
+    if (FAILED(hr))
+    {
+        delete pBackend;
+        return hr;
+    }
+    *ppBackend = pBackend;
+    return S_OK;
+}
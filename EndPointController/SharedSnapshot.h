@@ -0,0 +1,38 @@
+// ----------------------------------------------------------------------------
+// SharedSnapshot.h
+// The resident daemon publishes its device tables and default endpoints into
+// a named shared-memory segment (Local\EndPointController.Snapshot on
+// Windows, POSIX shm /EndPointController.snapshot.<uid> elsewhere; the
+// EPC_IPC_NAME override applies). A sequence counter used as a seqlock lets
+// a listing read a consistent copy with no COM, no IPC round trip and no
+// lock, falling back to live enumeration when no live daemon publishes one.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include "AudioBackend.h"
+
+// Writer side, owned by the daemon
+typedef struct TSnapshotWriter
+{
+    void* pView;            // Mapped segment, NULL when not published
+#ifdef _WIN32
+    HANDLE mapping;
+#else
+    std::string name;
+#endif
+} TSnapshotWriter;
+
+// Create the segment; fails if it cannot be created or mapped
+HRESULT createSnapshotSegment(TSnapshotWriter* pWriter);
+
+// Copy the tables and defaults of pSource (both data flows, every state) into the segment
+HRESULT publishSnapshot(TSnapshotWriter* pWriter, AudioBackend* pSource);
+
+// Withdraw the snapshot so readers fall back, and release the segment
+void closeSnapshotSegment(TSnapshotWriter* pWriter);
+
+// Open a read-only backend over a consistent copy of the published snapshot. Fails with E_NOTFOUND if there
+// is no segment or its publisher has exited; setDefaultEndpoint and notifications are not supported.
+HRESULT openSnapshotBackend(AudioBackend** ppBackend);
@@ -0,0 +1,886 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include "AudioBackend.h"
+
+// Simulated endpoint backend. The device set is generated from a spec string taken from the
+// EPC_SIMULATE environment variable, a comma separated list of key=value pairs:
+//   render=N            number of playback endpoints (default 4)
+//   capture=N           number of capture endpoints (default 2)
+//   notify_delay_ms=N   delay between a default change and its OnDefaultDeviceChanged callback,
+//                       to emulate the audio engine's propagation latency (default 0)
+//   hotplug_ms=N        every N ms, unplug or replug the last playback endpoint, delivering
+//                       OnDeviceStateChanged (and OnDefaultDeviceChanged if it was the default)
+//   probe_ms=N          time each probeFormats call takes, as activating an audio client does (default 0)
+//   volume_ms=N         time each updateEndpointVolume call takes, as activating a volume control does (default 0)
+//   sessions_ms=N       time each getSessions call takes, as activating a session manager does (default 0)
+//   session_toggle_ms=N every N ms, start or stop the application session of each default endpoint, delivering
+//                       onSessionsChanged if its sessions are watched
+typedef struct TSimulationSpec
+{
+    int renderCount;
+    int captureCount;
+    int notifyDelayMs;
+    int hotplugMs;
+    int probeMs;
+    int volumeMs;
+    int sessionsMs;
+    int sessionToggleMs;
+} TSimulationSpec;
+
+enum ESimulatedEvent
+{
+    eSimulatedDefaultChanged,
+    eSimulatedStateChanged,
+    eSimulatedFormatChanged,
+    eSimulatedSessionsChanged,
+    eSimulatedHotplug,          // Timer tick that toggles the hot-plugged endpoint
+    eSimulatedSessionToggle     // Timer tick that starts or stops the default endpoints' application sessions
+};
+
+// A notification waiting for its due time on the notifier thread
+typedef struct TPendingNotification
+{
+    ESimulatedEvent event;
+    EDataFlow dataFlow;
+    ERole role;
+    std::wstring deviceID;
+    DWORD state;
+} TPendingNotification;
+
+typedef std::chrono::steady_clock SimClock;
+
+// Generated device descriptions and their EndpointFormFactor values
+static const wchar_t* renderDescriptions[] = { L"Speakers", L"Headphones", L"HDMI Output", L"Headset Earphone" };
+static const UINT renderFormFactors[] = { 1, 3, 9, 5 };
+static const wchar_t* captureDescriptions[] = { L"Microphone", L"Line In", L"Headset Microphone" };
+static const UINT captureFormFactors[] = { 4, 2, 5 };
+
+// The device format of each description: sample rate, channels, bits, channel mask
+static const DWORD renderFormats[][4] = { { 48000, 2, 24, 0x3 }, { 44100, 2, 16, 0x3 }, { 48000, 8, 24, 0x63F }, { 48000, 2, 16, 0x3 } };
+static const DWORD captureFormats[][4] = { { 48000, 2, 16, 0x3 }, { 44100, 2, 24, 0x3 }, { 16000, 1, 16, 0x4 } };
+
+// The minimum processing period of each description in 100-ns units: 3 ms for endpoints with low-latency
+// drivers, the 10 ms default for HDMI and headsets
+static const INT64 renderMinimumPeriods[] = { 30000, 30000, 100000, 100000 };
+static const INT64 captureMinimumPeriods[] = { 30000, 30000, 100000 };
+#define SIMULATED_DEFAULT_PERIOD 100000
+
+// Like the engine, periods are whole multiples of this many frames at the device's sample rate
+#define SIMULATED_PERIOD_GRANULARITY_FRAMES 16
+
+// Sample rates every simulated endpoint accepts in setDeviceFormat, besides the one it starts out with
+static const DWORD supportedSampleRates[] = { 44100, 48000, 88200, 96000, 176400, 192000 };
+
+// The share-mode setting of each description: HDMI endpoints are left shared only
+static const int renderShareModes[] = { 1, 1, 0, 1 };
+static const int captureShareModes[] = { 1, 1, 1 };
+
+// The application session each description hosts, and its process ID before the endpoint number is added. An
+// empty name stands for an application that did not set one. Playback endpoints also carry the system sounds.
+static const wchar_t* renderSessionNames[] = { L"Media Player", L"Voice Chat", L"", L"Browser" };
+static const DWORD renderSessionProcesses[] = { 4100, 4200, 4300, 4400 };
+static const wchar_t* captureSessionNames[] = { L"Voice Chat", L"Recorder", L"" };
+static const DWORD captureSessionProcesses[] = { 4200, 4500, 4600 };
+
+// Parse the EPC_SIMULATE spec, leaving defaults in place for missing or unknown keys
+static void parseSimulationSpec(const char* spec, TSimulationSpec* pSpec)
+{
+    pSpec->renderCount = 4;
+    pSpec->captureCount = 2;
+    pSpec->notifyDelayMs = 0;
+    pSpec->hotplugMs = 0;
+    pSpec->probeMs = 0;
+    pSpec->volumeMs = 0;
+    pSpec->sessionsMs = 0;
+    pSpec->sessionToggleMs = 0;
+
+    const char* pos = spec;
+    while (*pos != '\0')
+    {
+        const char* end = strchr(pos, ',');
+        size_t length = end != NULL ? (size_t)(end - pos) : strlen(pos);
+        std::string item(pos, length);
+
+        size_t equals = item.find('=');
+        if (equals != std::string::npos)
+        {
+            std::string key = item.substr(0, equals);
+            int value = atoi(item.c_str() + equals + 1);
+            if (key == "render")
+                pSpec->renderCount = value;
+            else if (key == "capture")
+                pSpec->captureCount = value;
+            else if (key == "notify_delay_ms")
+                pSpec->notifyDelayMs = value;
+            else if (key == "hotplug_ms")
+                pSpec->hotplugMs = value;
+            else if (key == "probe_ms")
+                pSpec->probeMs = value;
+            else if (key == "volume_ms")
+                pSpec->volumeMs = value;
+            else if (key == "sessions_ms")
+                pSpec->sessionsMs = value;
+            else if (key == "session_toggle_ms")
+                pSpec->sessionToggleMs = value;
+        }
+
+        pos += length;
+        if (*pos == ',')
+            pos++;
+    }
+}
+
+// Synthetic levels: each endpoint carries a tone whose level wavers around -12 dBFS for the first 70% of a cycle
+// and is silent for the rest. Cycles are 2 s plus 1 s per endpoint number, so endpoints go quiet at different times.
+class SimulatedPeakMeter : public PeakMeter
+{
+public:
+    SimulatedPeakMeter(int number, SimClock::time_point start) : number(number), start(start) {}
+
+    HRESULT getPeakValue(float* pPeak)
+    {
+        double seconds = std::chrono::duration<double>(SimClock::now() - start).count();
+        double cycle = 2.0 + number;
+        double phase = fmod(seconds, cycle) / cycle;
+        *pPeak = phase < 0.7 ? (float)(0.25 + 0.15 * sin(seconds * 6.283185307 * 3 + number)) : 0.0f;
+        return S_OK;
+    }
+
+private:
+    int number;
+    SimClock::time_point start;
+};
+
+class SimulatedBackend : public AudioBackend
+{
+public:
+    SimulatedBackend(const TSimulationSpec& spec)
+        : notifyDelayMs(spec.notifyDelayMs), hotplugMs(spec.hotplugMs), probeMs(spec.probeMs), volumeMs(spec.volumeMs),
+          sessionsMs(spec.sessionsMs), sessionToggleMs(spec.sessionToggleMs), stopping(false)
+    {
+        created = SimClock::now();
+        generateDevices(eRender, spec.renderCount);
+        generateDevices(eCapture, spec.captureCount);
+
+        if (hotplugMs > 0 && spec.renderCount >= 2)
+        {
+            TPendingNotification tick = { eSimulatedHotplug, eRender, eConsole, std::wstring(), 0 };
+            postNotification(tick, hotplugMs);
+        }
+        if (sessionToggleMs > 0)
+        {
+            TPendingNotification tick = { eSimulatedSessionToggle, eRender, eConsole, std::wstring(), 0 };
+            postNotification(tick, sessionToggleMs);
+        }
+    }
+
+    ~SimulatedBackend()
+    {
+        {
+            std::lock_guard<std::mutex> guard(queueLock);
+            stopping = true;
+        }
+        queueSignal.notify_all();
+        if (notifier.joinable())
+        {
+            notifier.join();
+        }
+    }
+
+    HRESULT enumerateDevices(EDataFlow dataFlow, DWORD stateMask, DeviceTable& devices)
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        for (int flow = eRender; flow <= eCapture; flow++)
+        {
+            if (dataFlow != eAll && dataFlow != flow)
+                continue;
+
+            for (const auto& device : flowDevices[flow])
+            {
+                if ((device.state & stateMask) != 0)
+                {
+                    devices.push_back(device);
+                }
+            }
+        }
+        return S_OK;
+    }
+
+    HRESULT readDevice(LPCWSTR deviceID, TDeviceEntry& device, EDataFlow* pDataFlow)
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        const TDeviceEntry* pDevice = findDevice(deviceID, pDataFlow);
+        if (pDevice == NULL)
+        {
+            return E_NOTFOUND;
+        }
+        device = *pDevice;
+        return S_OK;
+    }
+
+    HRESULT getDefaultDeviceID(EDataFlow dataFlow, ERole role, std::wstring& deviceID)
+    {
+        if (dataFlow != eRender && dataFlow != eCapture)
+        {
+            return E_INVALIDARG;
+        }
+
+        std::lock_guard<std::mutex> guard(stateLock);
+        if (defaults[dataFlow][role].empty())
+        {
+            return E_NOTFOUND;
+        }
+        deviceID = defaults[dataFlow][role];
+        return S_OK;
+    }
+
+    HRESULT setDefaultEndpoint(LPCWSTR deviceID, ERole role)
+    {
+        EDataFlow dataFlow;
+        {
+            std::lock_guard<std::mutex> guard(stateLock);
+            const TDeviceEntry* pDevice = findDevice(deviceID, &dataFlow);
+            if (pDevice == NULL)
+            {
+                return E_NOTFOUND;
+            }
+            if ((pDevice->state & DEVICE_STATE_ACTIVE) == 0)
+            {
+                return E_INVALIDARG;
+            }
+            if (defaults[dataFlow][role] == deviceID)
+            {
+                return S_OK;
+            }
+            defaults[dataFlow][role] = deviceID;
+        }
+
+        TPendingNotification notification = { eSimulatedDefaultChanged, dataFlow, role, deviceID, 0 };
+        postNotification(notification, notifyDelayMs);
+        return S_OK;
+    }
+
+    HRESULT getDeviceFormat(LPCWSTR deviceID, TAudioFormat& format)
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        auto it = formats.find(deviceID);
+        if (it == formats.end())
+        {
+            return E_NOTFOUND;
+        }
+        format = it->second;
+        return S_OK;
+    }
+
+    // Like a driver, accept only the supported rates, 16/24/32-bit integer or 32-bit float samples, and the
+    // channel count the endpoint already has
+    HRESULT setDeviceFormat(LPCWSTR deviceID, const TAudioFormat& format)
+    {
+        EDataFlow dataFlow;
+        {
+            std::lock_guard<std::mutex> guard(stateLock);
+            auto it = formats.find(deviceID);
+            if (it == formats.end() || findDevice(deviceID, &dataFlow) == NULL)
+            {
+                return E_NOTFOUND;
+            }
+
+            bool rateSupported = format.sampleRate == it->second.sampleRate;
+            for (DWORD rate : supportedSampleRates)
+            {
+                rateSupported |= format.sampleRate == rate;
+            }
+            bool bitsSupported = format.isFloat ? format.bitsPerSample == 32
+                : format.bitsPerSample == 16 || format.bitsPerSample == 24 || format.bitsPerSample == 32;
+            if (!rateSupported || !bitsSupported || format.channels != it->second.channels)
+            {
+                return E_INVALIDARG;
+            }
+
+            TAudioFormat applied = format;
+            if (applied.channelMask == 0)
+            {
+                applied.channelMask = it->second.channelMask;
+            }
+            if (applied == it->second)
+            {
+                return S_OK;
+            }
+            it->second = applied;
+        }
+
+        TPendingNotification notification = { eSimulatedFormatChanged, dataFlow, eConsole, deviceID, 0 };
+        postNotification(notification, notifyDelayMs);
+        return S_OK;
+    }
+
+    HRESULT getProcessingPeriod(LPCWSTR deviceID, TProcessingPeriod& period)
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        auto it = periods.find(deviceID);
+        if (it == periods.end())
+        {
+            return E_NOTFOUND;
+        }
+        period = it->second;
+        return S_OK;
+    }
+
+    // Periods between the minimum and the default are accepted; any but the default is rounded up to the granularity
+    HRESULT setProcessingPeriod(LPCWSTR deviceID, INT64 period)
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        auto it = periods.find(deviceID);
+        if (it == periods.end())
+        {
+            return E_NOTFOUND;
+        }
+        if (period < it->second.minimumPeriod || period > it->second.defaultPeriod)
+        {
+            return E_INVALIDARG;
+        }
+
+        if (period == it->second.defaultPeriod)
+        {
+            it->second.currentPeriod = period;
+            return S_OK;
+        }
+        INT64 rate = formats[deviceID].sampleRate;
+        INT64 granules = (period * rate + 10000000LL * SIMULATED_PERIOD_GRANULARITY_FRAMES - 1) /
+            (10000000LL * SIMULATED_PERIOD_GRANULARITY_FRAMES);
+        it->second.currentPeriod = granules * SIMULATED_PERIOD_GRANULARITY_FRAMES * 10000000LL / rate;
+        return S_OK;
+    }
+
+    // Hiding disables the endpoint; showing it again makes it active. Hiding the default moves the default to the
+    // first active endpoint of the data flow, as the audio engine does.
+    HRESULT setEndpointVisibility(LPCWSTR deviceID, bool visible)
+    {
+        std::vector<TPendingNotification> notifications;
+        {
+            std::lock_guard<std::mutex> guard(stateLock);
+            EDataFlow dataFlow;
+            TDeviceEntry* pDevice = findDevice(deviceID, &dataFlow);
+            if (pDevice == NULL)
+            {
+                return E_NOTFOUND;
+            }
+            DWORD state = visible ? DEVICE_STATE_ACTIVE : DEVICE_STATE_DISABLED;
+            if (pDevice->state == state)
+            {
+                return S_OK;
+            }
+            pDevice->state = state;
+
+            TPendingNotification stateChange = { eSimulatedStateChanged, dataFlow, eConsole, deviceID, state };
+            notifications.push_back(stateChange);
+            if (!visible)
+            {
+                moveDefaultsFrom(dataFlow, deviceID, notifications);
+            }
+        }
+
+        for (const auto& notification : notifications)
+        {
+            postNotification(notification, notifyDelayMs);
+        }
+        return S_OK;
+    }
+
+    HRESULT getDriverVersion(LPCWSTR deviceID, std::wstring& version)
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        auto it = driverVersions.find(deviceID);
+        if (it == driverVersions.end())
+        {
+            return E_NOTFOUND;
+        }
+        version = it->second;
+        return S_OK;
+    }
+
+    HRESULT getShareMode(LPCWSTR deviceID, int* pShareMode)
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        auto it = shareModes.find(deviceID);
+        if (it == shareModes.end())
+        {
+            return E_NOTFOUND;
+        }
+        *pShareMode = it->second;
+        return S_OK;
+    }
+
+    // The engine takes the endpoint's own format, or float samples in its layout, from shared streams; exclusive
+    // streams get what setDeviceFormat accepts, minus 32-bit samples, which the simulated drivers do not stream
+    HRESULT probeFormats(LPCWSTR deviceID, const std::vector<TAudioFormat>& formats, std::vector<unsigned char>& support)
+    {
+        TAudioFormat current;
+        {
+            std::lock_guard<std::mutex> guard(stateLock);
+            EDataFlow dataFlow;
+            const TDeviceEntry* pDevice = findDevice(deviceID, &dataFlow);
+            if (pDevice == NULL)
+            {
+                return E_NOTFOUND;
+            }
+            if ((pDevice->state & DEVICE_STATE_ACTIVE) == 0)
+            {
+                return E_INVALIDARG;
+            }
+            current = this->formats[deviceID];
+        }
+        if (probeMs > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(probeMs));
+        }
+
+        support.assign(formats.size(), 0);
+        for (size_t i = 0; i < formats.size(); i++)
+        {
+            const TAudioFormat& format = formats[i];
+            if (format.channels != current.channels)
+            {
+                continue;
+            }
+            bool isMixFormat = format.isFloat && format.bitsPerSample == 32;
+            bool isCurrent = format.isFloat == current.isFloat && format.bitsPerSample == current.bitsPerSample;
+            if (format.sampleRate == current.sampleRate && (isMixFormat || isCurrent))
+            {
+                support[i] |= FORMAT_SUPPORT_SHARED;
+            }
+
+            bool rateSupported = format.sampleRate == current.sampleRate;
+            for (DWORD rate : supportedSampleRates)
+            {
+                rateSupported |= format.sampleRate == rate;
+            }
+            if (rateSupported && !format.isFloat && (format.bitsPerSample == 16 || format.bitsPerSample == 24))
+            {
+                support[i] |= FORMAT_SUPPORT_EXCLUSIVE;
+            }
+        }
+        return S_OK;
+    }
+
+    HRESULT getEndpointVolume(LPCWSTR deviceID, TEndpointVolume& volume)
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        auto it = volumes.find(deviceID);
+        if (it == volumes.end())
+        {
+            return E_NOTFOUND;
+        }
+        volume = it->second;
+        return S_OK;
+    }
+
+    // Levels outside 0 to 1 are rejected, as IAudioEndpointVolume does
+    HRESULT updateEndpointVolume(LPCWSTR deviceID, const TVolumeUpdate& update, TEndpointVolume& before, TEndpointVolume& after)
+    {
+        if (update.level > 1)
+        {
+            return E_INVALIDARG;
+        }
+        if (volumeMs > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(volumeMs));
+        }
+
+        std::lock_guard<std::mutex> guard(stateLock);
+        auto it = volumes.find(deviceID);
+        if (it == volumes.end())
+        {
+            return E_NOTFOUND;
+        }
+        before = it->second;
+        bool changeLevel = update.level >= 0 && !isSameVolumeLevel(update.level, before.level);
+        bool changeMute = update.mute >= 0 && (update.mute != 0) != before.muted;
+        if (changeLevel)
+        {
+            it->second.level = update.level;
+        }
+        if (changeMute)
+        {
+            it->second.muted = update.mute != 0;
+        }
+        after = it->second;
+        return changeLevel || changeMute ? S_OK : S_FALSE;
+    }
+
+    // Endpoints are numbered across both data flows, so no two share a level pattern
+    HRESULT openPeakMeter(LPCWSTR deviceID, PeakMeter** ppMeter)
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        EDataFlow dataFlow;
+        const TDeviceEntry* pDevice = findDevice(deviceID, &dataFlow);
+        if (pDevice == NULL)
+        {
+            return E_NOTFOUND;
+        }
+        if ((pDevice->state & DEVICE_STATE_ACTIVE) == 0)
+        {
+            return E_INVALIDARG;
+        }
+
+        int number = (int)(pDevice - flowDevices[dataFlow].data());
+        if (dataFlow == eCapture)
+        {
+            number += (int)flowDevices[eRender].size();
+        }
+        *ppMeter = new SimulatedPeakMeter(number, created);
+        return S_OK;
+    }
+
+    // Like the audio service, only an active endpoint has a session manager
+    HRESULT getSessions(LPCWSTR deviceID, SessionTable& sessions)
+    {
+        if (sessionsMs > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(sessionsMs));
+        }
+
+        std::lock_guard<std::mutex> guard(stateLock);
+        EDataFlow dataFlow;
+        const TDeviceEntry* pDevice = findDevice(deviceID, &dataFlow);
+        if (pDevice == NULL)
+        {
+            return E_NOTFOUND;
+        }
+        if ((pDevice->state & DEVICE_STATE_ACTIVE) == 0)
+        {
+            return E_INVALIDARG;
+        }
+        sessions = this->sessions[deviceID];
+        return S_OK;
+    }
+
+    HRESULT watchSessions(LPCWSTR deviceID)
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        EDataFlow dataFlow;
+        if (findDevice(deviceID, &dataFlow) == NULL)
+        {
+            return E_NOTFOUND;
+        }
+        watchedSessions.insert(deviceID);
+        return S_OK;
+    }
+
+    HRESULT registerNotificationSink(DeviceNotificationSink* pSink)
+    {
+        std::lock_guard<std::mutex> guard(sinksLock);
+        sinks.push_back(pSink);
+        return S_OK;
+    }
+
+    HRESULT unregisterNotificationSink(DeviceNotificationSink* pSink)
+    {
+        // Delivery holds sinksLock, so no callback reaches the sink once this returns
+        std::lock_guard<std::mutex> guard(sinksLock);
+        for (auto it = sinks.begin(); it != sinks.end(); ++it)
+        {
+            if (*it == pSink)
+            {
+                sinks.erase(it);
+                return S_OK;
+            }
+        }
+        return E_INVALIDARG;
+    }
+
+private:
+    // Populate one data flow with generated endpoints; the first becomes the default for every role
+    void generateDevices(EDataFlow dataFlow, int count)
+    {
+        const wchar_t** descriptions = dataFlow == eRender ? renderDescriptions : captureDescriptions;
+        const UINT* formFactors = dataFlow == eRender ? renderFormFactors : captureFormFactors;
+        const DWORD (*deviceFormats)[4] = dataFlow == eRender ? renderFormats : captureFormats;
+        const INT64* minimumPeriods = dataFlow == eRender ? renderMinimumPeriods : captureMinimumPeriods;
+        const int* deviceShareModes = dataFlow == eRender ? renderShareModes : captureShareModes;
+        const wchar_t** sessionNames = dataFlow == eRender ? renderSessionNames : captureSessionNames;
+        const DWORD* sessionProcesses = dataFlow == eRender ? renderSessionProcesses : captureSessionProcesses;
+        size_t descriptionCount = dataFlow == eRender ? sizeof(renderDescriptions) / sizeof(renderDescriptions[0])
+                                                      : sizeof(captureDescriptions) / sizeof(captureDescriptions[0]);
+
+        for (int i = 0; i < count; i++)
+        {
+            wchar_t buffer[128];
+            TDeviceEntry device;
+
+            swprintf(buffer, 128, L"{0.0.%d.00000000}.{%08x-0000-4000-8000-%012x}", (int)dataFlow, i + 1, i + 1);
+            device.id = buffer;
+            device.description = descriptions[i % descriptionCount];
+            swprintf(buffer, 128, L"Simulated Audio Device %d", i + 1);
+            device.interfaceName = buffer;
+            device.friendlyName = device.description + L" (" + device.interfaceName + L")";
+            device.state = DEVICE_STATE_ACTIVE;
+            device.formFactor = formFactors[i % descriptionCount];
+            // Render and capture endpoints with the same number belong to the same simulated device
+            swprintf(buffer, 128, L"{%08X-0000-4000-8000-00000000C0DE}", i + 1);
+            device.containerID = buffer;
+            flowDevices[dataFlow].push_back(device);
+
+            // Kept apart from the entries: like WASAPI, enumeration does not report the format
+            TAudioFormat& format = formats[device.id];
+            format.sampleRate = deviceFormats[i % descriptionCount][0];
+            format.channels = deviceFormats[i % descriptionCount][1];
+            format.bitsPerSample = deviceFormats[i % descriptionCount][2];
+            format.channelMask = deviceFormats[i % descriptionCount][3];
+
+            TProcessingPeriod& period = periods[device.id];
+            period.defaultPeriod = SIMULATED_DEFAULT_PERIOD;
+            period.minimumPeriod = minimumPeriods[i % descriptionCount];
+            period.currentPeriod = SIMULATED_DEFAULT_PERIOD;
+
+            swprintf(buffer, 128, L"10.0.%d.%d", (int)dataFlow + 1, i + 1);
+            driverVersions[device.id] = buffer;
+            shareModes[device.id] = deviceShareModes[i % descriptionCount];
+
+            TEndpointVolume& volume = volumes[device.id];
+            volume.level = dataFlow == eRender ? 0.8f : 0.6f;
+            volume.muted = false;
+
+            // The application session comes last, where toggleSessions looks for it; only the default's plays
+            SessionTable& deviceSessions = sessions[device.id];
+            if (dataFlow == eRender)
+            {
+                TAudioSession systemSounds;
+                systemSounds.displayName = L"System Sounds";
+                deviceSessions.push_back(systemSounds);
+            }
+            TAudioSession application;
+            application.processID = sessionProcesses[i % descriptionCount] + (DWORD)(i / descriptionCount);
+            application.displayName = sessionNames[i % descriptionCount];
+            application.state = i == 0 ? eSessionActive : eSessionInactive;
+            application.volume = application.displayName == L"Voice Chat" ? 0.5f : 1.0f;
+            deviceSessions.push_back(application);
+        }
+
+        for (int role = eConsole; role < ERole_enum_count; role++)
+        {
+            defaults[dataFlow][role] = count > 0 ? flowDevices[dataFlow][0].id : std::wstring();
+        }
+    }
+
+    // Look a device up by ID across both data flows; caller holds stateLock
+    TDeviceEntry* findDevice(LPCWSTR deviceID, EDataFlow* pDataFlow)
+    {
+        for (int flow = eRender; flow <= eCapture; flow++)
+        {
+            for (auto& device : flowDevices[flow])
+            {
+                if (device.id == deviceID)
+                {
+                    *pDataFlow = (EDataFlow)flow;
+                    return &device;
+                }
+            }
+        }
+        return NULL;
+    }
+
+    // Give every role whose default is the device to the first active endpoint of the data flow, collecting the
+    // notifications to send; caller holds stateLock
+    void moveDefaultsFrom(EDataFlow dataFlow, const std::wstring& deviceID, std::vector<TPendingNotification>& notifications)
+    {
+        std::wstring replacement;
+        for (const auto& device : flowDevices[dataFlow])
+        {
+            if (device.state == DEVICE_STATE_ACTIVE)
+            {
+                replacement = device.id;
+                break;
+            }
+        }
+
+        for (int role = eConsole; role < ERole_enum_count; role++)
+        {
+            if (defaults[dataFlow][role] == deviceID)
+            {
+                defaults[dataFlow][role] = replacement;
+                TPendingNotification defaultChange = { eSimulatedDefaultChanged, dataFlow, (ERole)role, replacement, 0 };
+                notifications.push_back(defaultChange);
+            }
+        }
+    }
+
+    // Queue a notification for delivery after delayMs
+    void postNotification(const TPendingNotification& notification, int delayMs)
+    {
+        {
+            std::lock_guard<std::mutex> guard(queueLock);
+            pending.insert(std::make_pair(SimClock::now() + std::chrono::milliseconds(delayMs), notification));
+            if (!notifier.joinable())
+            {
+                notifier = std::thread(&SimulatedBackend::notifierThread, this);
+            }
+        }
+        queueSignal.notify_all();
+    }
+
+    // Deliver queued notifications to the registered sinks once they fall due
+    void notifierThread()
+    {
+        std::unique_lock<std::mutex> queueGuard(queueLock);
+        while (!stopping)
+        {
+            if (pending.empty())
+            {
+                queueSignal.wait(queueGuard);
+                continue;
+            }
+
+            auto due = pending.begin()->first;
+            if (SimClock::now() < due)
+            {
+                queueSignal.wait_until(queueGuard, due);
+                continue;
+            }
+
+            TPendingNotification notification = pending.begin()->second;
+            pending.erase(pending.begin());
+            queueGuard.unlock();
+            if (notification.event == eSimulatedHotplug)
+            {
+                hotplug();
+            }
+            else if (notification.event == eSimulatedSessionToggle)
+            {
+                toggleSessions();
+            }
+            else
+            {
+                deliverNotification(notification);
+            }
+            queueGuard.lock();
+        }
+    }
+
+    void deliverNotification(const TPendingNotification& notification)
+    {
+        std::lock_guard<std::mutex> guard(sinksLock);
+        for (auto pSink : sinks)
+        {
+            if (notification.event == eSimulatedStateChanged)
+            {
+                pSink->onDeviceStateChanged(notification.deviceID.c_str(), notification.state);
+            }
+            else if (notification.event == eSimulatedFormatChanged)
+            {
+                pSink->onPropertyValueChanged(notification.deviceID.c_str(), eDevicePropertyFormat);
+            }
+            else if (notification.event == eSimulatedSessionsChanged)
+            {
+                pSink->onSessionsChanged(notification.deviceID.c_str());
+            }
+            else
+            {
+                pSink->onDefaultDeviceChanged(notification.dataFlow, notification.role, notification.deviceID.c_str());
+            }
+        }
+    }
+
+    // Unplug or replug the last playback endpoint. Like the audio engine, unplugging the default moves the
+    // default to the first active playback endpoint.
+    void hotplug()
+    {
+        std::vector<TPendingNotification> notifications;
+        {
+            std::lock_guard<std::mutex> guard(stateLock);
+            TDeviceEntry& device = flowDevices[eRender].back();
+            device.state = device.state == DEVICE_STATE_ACTIVE ? DEVICE_STATE_UNPLUGGED : DEVICE_STATE_ACTIVE;
+
+            TPendingNotification stateChange = { eSimulatedStateChanged, eRender, eConsole, device.id, device.state };
+            notifications.push_back(stateChange);
+            if (device.state != DEVICE_STATE_ACTIVE)
+            {
+                moveDefaultsFrom(eRender, device.id, notifications);
+            }
+        }
+
+        for (const auto& notification : notifications)
+        {
+            deliverNotification(notification);
+        }
+
+        TPendingNotification tick = { eSimulatedHotplug, eRender, eConsole, std::wstring(), 0 };
+        postNotification(tick, hotplugMs);
+    }
+
+    // Start the application session of each data flow's console default if it is stopped, or stop it
+    void toggleSessions()
+    {
+        std::vector<TPendingNotification> notifications;
+        {
+            std::lock_guard<std::mutex> guard(stateLock);
+            for (int flow = eRender; flow <= eCapture; flow++)
+            {
+                const std::wstring& deviceID = defaults[flow][eConsole];
+                auto it = sessions.find(deviceID);
+                if (it == sessions.end() || it->second.empty())
+                    continue;
+
+                TAudioSession& application = it->second.back();
+                application.state = application.state == eSessionActive ? eSessionInactive : eSessionActive;
+                if (watchedSessions.count(deviceID) != 0)
+                {
+                    TPendingNotification sessionsChange = { eSimulatedSessionsChanged, (EDataFlow)flow, eConsole, deviceID, 0 };
+                    notifications.push_back(sessionsChange);
+                }
+            }
+        }
+
+        for (const auto& notification : notifications)
+        {
+            deliverNotification(notification);
+        }
+
+        TPendingNotification tick = { eSimulatedSessionToggle, eRender, eConsole, std::wstring(), 0 };
+        postNotification(tick, sessionToggleMs);
+    }
+
+    int notifyDelayMs;
+    int hotplugMs;
+    int probeMs;
+    int volumeMs;
+    int sessionsMs;
+    int sessionToggleMs;
+    SimClock::time_point created;       // Time zero of the synthetic meter levels
+
+    std::mutex stateLock;
+    DeviceTable flowDevices[2];
+    std::wstring defaults[2][ERole_enum_count];
+    std::map<std::wstring, TAudioFormat> formats;
+    std::map<std::wstring, TProcessingPeriod> periods;
+    std::map<std::wstring, std::wstring> driverVersions;
+    std::map<std::wstring, int> shareModes;
+    std::map<std::wstring, TEndpointVolume> volumes;
+    std::map<std::wstring, SessionTable> sessions;
+    std::set<std::wstring> watchedSessions;
+
+    std::mutex sinksLock;
+    std::vector<DeviceNotificationSink*> sinks;
+
+    std::mutex queueLock;
+    std::condition_variable queueSignal;
+    std::multimap<SimClock::time_point, TPendingNotification> pending;
+    std::thread notifier;
+    bool stopping;
+};
+
+// Create the simulated backend described by spec
+HRESULT createSimulatedBackend(const char* spec, AudioBackend** ppBackend)
+{
+    TSimulationSpec simulationSpec;
+    parseSimulationSpec(spec, &simulationSpec);
+    *ppBackend = new SimulatedBackend(simulationSpec);
+    return S_OK;
+}
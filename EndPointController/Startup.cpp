@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <chrono>
+#include "Platform.h"
+#include "Startup.h"
+
+typedef std::chrono::steady_clock StartupClock;
+
+#ifdef _WIN32
+// Process creation as the system recorded it, against the wall clock at entry
+static double measureCreationToEntryUs()
+{
+    FILETIME creation, exitTime, kernel, user, now;
+    GetSystemTimePreciseAsFileTime(&now);
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exitTime, &kernel, &user))
+    {
+        return -1;
+    }
+
+    ULARGE_INTEGER start, entry;
+    start.LowPart = creation.dwLowDateTime;
+    start.HighPart = creation.dwHighDateTime;
+    entry.LowPart = now.dwLowDateTime;
+    entry.HighPart = now.dwHighDateTime;
+    return (entry.QuadPart - start.QuadPart) / 10.0;
+}
+#endif
+
+// Initialized with the other statics, before main runs
+static const StartupClock::time_point entryTime = StartupClock::now();
+#ifdef _WIN32
+static const double creationToEntryUs = measureCreationToEntryUs();
+#endif
+static StartupClock::time_point firstOutputTime;
+static bool sawOutput = false;
+
+void startupNoteFirstOutput()
+{
+    if (!sawOutput)
+    {
+        firstOutputTime = StartupClock::now();
+        sawOutput = true;
+    }
+}
+
+static double sinceEntryUs(StartupClock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - entryTime).count() / 1000.0;
+}
+
+StartupReport::~StartupReport()
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    double exitUs = sinceEntryUs(StartupClock::now());
+#ifdef _WIN32
+    if (creationToEntryUs >= 0)
+    {
+        fprintf(stderr, "Process creation to entry: %.1f us\n", creationToEntryUs);
+    }
+#endif
+    if (sawOutput)
+    {
+        fprintf(stderr, "Entry to first output: %.1f us\n", sinceEntryUs(firstOutputTime));
+    }
+    else
+    {
+        fprintf(stderr, "Entry to first output: no output\n");
+    }
+    fprintf(stderr, "Entry to exit: %.1f us\n", exitUs);
+}
@@ -0,0 +1,27 @@
+// ----------------------------------------------------------------------------
+// Startup.h
+// Cold-start measurement for --startup-time: the time from process entry
+// (static initialization, before main) to the first byte of output and to
+// exit, and on Windows also from process creation to entry, which covers
+// the loader and the DLLs it maps before any of our code runs.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+// Called by outputf the first time anything is printed
+void startupNoteFirstOutput();
+
+// Prints the measurements to stderr when it goes out of scope, if enabled
+class StartupReport
+{
+public:
+    explicit StartupReport(bool enabled) : enabled(enabled) {}
+    ~StartupReport();
+
+private:
+    StartupReport(const StartupReport&);
+    StartupReport& operator=(const StartupReport&);
+
+    bool enabled;
+};
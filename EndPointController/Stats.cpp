@@ -0,0 +1,175 @@
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include "Output.h"
+#include "Stats.h"
+#include "Trace.h"
+
+#define SUB_BUCKET_COUNT (1 << HISTOGRAM_SUB_BUCKET_BITS)
+
+typedef struct TPhaseStats
+{
+    const char* name;
+    LatencyHistogram histogram;
+    uint64_t counts[ECounter_enum_count];   // Summed over every call
+} TPhaseStats;
+
+static std::atomic<bool> statsEnabled(false);
+static std::mutex statsLock;
+static std::vector<TPhaseStats> phases;
+
+// Values below SUB_BUCKET_COUNT map to themselves. Above that, the shift is the number of bits beyond the
+// sub-bucket precision, and the top HISTOGRAM_SUB_BUCKET_BITS + 1 bits select the bucket within that range.
+static size_t bucketIndex(uint64_t value)
+{
+    if (value < SUB_BUCKET_COUNT)
+    {
+        return (size_t)value;
+    }
+
+    int shift = 0;
+    while ((value >> shift) >= 2 * SUB_BUCKET_COUNT)
+    {
+        shift++;
+    }
+    return ((size_t)(shift + 1) << HISTOGRAM_SUB_BUCKET_BITS) + (size_t)((value >> shift) - SUB_BUCKET_COUNT);
+}
+
+// The largest value that maps to the bucket
+static uint64_t bucketLimit(size_t index)
+{
+    if (index < 2 * SUB_BUCKET_COUNT)
+    {
+        return index;
+    }
+    int shift = (int)(index >> HISTOGRAM_SUB_BUCKET_BITS) - 1;
+    uint64_t lowest = (uint64_t)((index & (SUB_BUCKET_COUNT - 1)) + SUB_BUCKET_COUNT) << shift;
+    return lowest + ((uint64_t)1 << shift) - 1;
+}
+
+LatencyHistogram::LatencyHistogram() : buckets(HISTOGRAM_BUCKET_COUNT, 0), count(0), minValue(UINT64_MAX), maxValue(0)
+{
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+    buckets[bucketIndex(value)]++;
+    count++;
+    minValue = value < minValue ? value : minValue;
+    maxValue = value > maxValue ? value : maxValue;
+}
+
+uint64_t LatencyHistogram::percentile(double percent) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(percent / 100.0 * count + 0.5);
+    rank = rank < 1 ? 1 : rank > count ? count : rank;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            // Never report beyond what was actually recorded
+            uint64_t limit = bucketLimit(i);
+            return limit < maxValue ? limit : maxValue;
+        }
+    }
+    return maxValue;
+}
+
+static uint64_t startCounts[ECounter_enum_count];
+
+void statsStart()
+{
+    countersStart();
+    readCounters(startCounts);
+    statsEnabled = true;
+    spansEnabled = true;
+}
+
+void statsRecordSpan(const char* name, uint64_t durationNs, const uint64_t counts[ECounter_enum_count])
+{
+    if (!statsEnabled.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    // Few phases, so a linear search beats hashing
+    std::lock_guard<std::mutex> guard(statsLock);
+    TPhaseStats* pPhase = NULL;
+    for (auto& phase : phases)
+    {
+        if (phase.name == name || strcmp(phase.name, name) == 0)
+        {
+            pPhase = &phase;
+            break;
+        }
+    }
+    if (pPhase == NULL)
+    {
+        phases.push_back(TPhaseStats());
+        pPhase = &phases.back();
+        pPhase->name = name;
+        for (int i = 0; i < ECounter_enum_count; i++)
+        {
+            pPhase->counts[i] = 0;
+        }
+    }
+
+    pPhase->histogram.record(durationNs);
+    for (int i = 0; i < ECounter_enum_count; i++)
+    {
+        pPhase->counts[i] += counts[i];
+    }
+}
+
+static void printCounts(const std::wstring& name, const uint64_t counts[ECounter_enum_count], uint64_t calls)
+{
+    outputf(_T("%-36ls %8llu"), name.c_str(), (unsigned long long)calls);
+    for (int i = 0; i < ECounter_enum_count; i++)
+    {
+        outputf(_T(" %10.1f"), (double)counts[i] / calls);
+    }
+    outputf(_T("\n"));
+}
+
+void statsReport()
+{
+    std::lock_guard<std::mutex> guard(statsLock);
+    outputf(_T("%-36ls %8ls %10ls %10ls %10ls %10ls %10ls\n"), L"phase (us)", L"count", L"min", L"p50", L"p90", L"p99", L"max");
+    for (const auto& phase : phases)
+    {
+        // Phase names are ASCII literals
+        std::wstring name(phase.name, phase.name + strlen(phase.name));
+        const LatencyHistogram& histogram = phase.histogram;
+        outputf(_T("%-36ls %8llu %10.1f %10.1f %10.1f %10.1f %10.1f\n"), name.c_str(), (unsigned long long)histogram.getCount(),
+            histogram.getMin() / 1000.0, histogram.percentile(50) / 1000.0, histogram.percentile(90) / 1000.0,
+            histogram.percentile(99) / 1000.0, histogram.getMax() / 1000.0);
+    }
+
+    outputf(_T("\n%-36ls %8ls"), L"phase (per call)", L"count");
+    for (int i = 0; i < ECounter_enum_count; i++)
+    {
+        outputf(_T(" %10ls"), counterNames[i]);
+    }
+    outputf(_T("\n"));
+    for (const auto& phase : phases)
+    {
+        printCounts(std::wstring(phase.name, phase.name + strlen(phase.name)), phase.counts, phase.histogram.getCount());
+    }
+
+    // Everything since collection started, including work outside any span
+    uint64_t totals[ECounter_enum_count];
+    readCounters(totals);
+    for (int i = 0; i < ECounter_enum_count; i++)
+    {
+        totals[i] -= startCounts[i];
+    }
+    printCounts(L"total", totals, 1);
+}
@@ -0,0 +1,51 @@
+// ----------------------------------------------------------------------------
+// Stats.h
+// Latency statistics for --stats. Every trace span that ends while
+// collection is on is recorded in a histogram for its phase, and the report
+// gives min/p50/p90/p99/max per phase, followed by the event counters
+// (Counters.h) per call of each phase. Histograms are log-linear (HDR
+// style): 64 linear sub-buckets per power of two keep every recorded value
+// within 1.6% at any magnitude, in a fixed 30 KB per phase.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "Counters.h"
+
+#define HISTOGRAM_SUB_BUCKET_BITS 6
+#define HISTOGRAM_BUCKET_COUNT ((64 - HISTOGRAM_SUB_BUCKET_BITS + 1) << HISTOGRAM_SUB_BUCKET_BITS)
+
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(uint64_t value);
+
+    // The value at or below which the given percentage of the recorded values fall, to the histogram's precision
+    uint64_t percentile(double percent) const;
+
+    uint64_t getCount() const { return count; }
+    uint64_t getMin() const { return count > 0 ? minValue : 0; }
+    uint64_t getMax() const { return maxValue; }
+
+private:
+    std::vector<uint64_t> buckets;
+    uint64_t count;
+    uint64_t minValue;
+    uint64_t maxValue;
+};
+
+// Start collecting span durations and counting events; spans already running when this is called are not
+// counted
+void statsStart();
+
+// Called by every ending span with its duration and the events counted while it ran; does nothing unless
+// collection is on
+void statsRecordSpan(const char* name, uint64_t durationNs, const uint64_t counts[ECounter_enum_count]);
+
+// Print the per-phase tables through outputf, in the order the phases first ended
+void statsReport();
@@ -0,0 +1,223 @@
+#include "Output.h"
+#include "SwitchScheduler.h"
+
+static const wchar_t* roleNames[] = { L"console", L"multimedia", L"communications" };
+
+SwitchScheduler::SwitchScheduler(AudioBackend* pInner, int windowMs, int intervalMs)
+    : pInner(pInner), window(windowMs > 0 ? windowMs : 0), interval(intervalMs > 0 ? intervalMs : 0)
+{
+    for (int flow = eRender; flow <= eCapture; flow++)
+    {
+        for (int role = eConsole; role < ERole_enum_count; role++)
+        {
+            slots[flow][role].queued = false;
+            slots[flow][role].called = false;
+        }
+    }
+    stats = TSwitchStats();
+    lastFailure = S_OK;
+}
+
+// The end of the slot's window, pushed back until the minimum interval since its last call has passed
+SwitchScheduler::Clock::time_point SwitchScheduler::dueTime(const TSwitchSlot& slot) const
+{
+    Clock::time_point due = slot.firstQueued + window;
+    if (slot.called && slot.lastCall + interval > due)
+    {
+        due = slot.lastCall + interval;
+    }
+    return due;
+}
+
+int SwitchScheduler::getWaitMs() const
+{
+    bool any = false;
+    Clock::time_point next = Clock::time_point::max();
+    for (int flow = eRender; flow <= eCapture; flow++)
+    {
+        for (int role = eConsole; role < ERole_enum_count; role++)
+        {
+            if (slots[flow][role].queued)
+            {
+                Clock::time_point due = dueTime(slots[flow][role]);
+                next = due < next ? due : next;
+                any = true;
+            }
+        }
+    }
+    if (!any)
+    {
+        return -1;
+    }
+
+    // Round up so the caller does not wake a fraction of a millisecond early and spin
+    auto wait = std::chrono::duration_cast<std::chrono::microseconds>(next - Clock::now()).count();
+    return wait <= 0 ? 0 : (int)((wait + 999) / 1000);
+}
+
+void SwitchScheduler::flush(bool force)
+{
+    Clock::time_point now = Clock::now();
+    for (int flow = eRender; flow <= eCapture; flow++)
+    {
+        for (int role = eConsole; role < ERole_enum_count; role++)
+        {
+            TSwitchSlot& slot = slots[flow][role];
+            if (!slot.queued || (!force && now < dueTime(slot)))
+                continue;
+
+            slot.queued = false;
+            std::wstring currentID;
+            if (SUCCEEDED(pInner->getDefaultDeviceID((EDataFlow)flow, (ERole)role, currentID)) && currentID == slot.deviceID)
+            {
+                stats.dropped++;
+                continue;
+            }
+
+            HRESULT hr = pInner->setDefaultEndpoint(slot.deviceID.c_str(), (ERole)role);
+            slot.lastCall = Clock::now();
+            slot.called = true;
+            stats.calls++;
+            if (FAILED(hr))
+            {
+                stats.failed++;
+                lastFailure = hr;
+                lastFailureDescription.clear();
+                appendFormat(lastFailureDescription, L"Switching the %ls %ls device to %ls failed (0x%08x)",
+                    flow == eRender ? L"render" : L"capture", roleNames[role], slot.deviceID.c_str(), (unsigned int)hr);
+                outputf(_T("%ls\n"), lastFailureDescription.c_str());
+            }
+        }
+    }
+}
+
+HRESULT SwitchScheduler::takeLastFailure(std::wstring& description)
+{
+    HRESULT hr = lastFailure;
+    description = lastFailureDescription;
+    lastFailure = S_OK;
+    lastFailureDescription.clear();
+    return hr;
+}
+
+HRESULT SwitchScheduler::enumerateDevices(EDataFlow dataFlow, DWORD stateMask, DeviceTable& devices)
+{
+    return pInner->enumerateDevices(dataFlow, stateMask, devices);
+}
+
+HRESULT SwitchScheduler::readDevice(LPCWSTR deviceID, TDeviceEntry& device, EDataFlow* pDataFlow)
+{
+    return pInner->readDevice(deviceID, device, pDataFlow);
+}
+
+// A queued switch is reported as the default already, so a client sees the effect of its own request
+HRESULT SwitchScheduler::getDefaultDeviceID(EDataFlow dataFlow, ERole role, std::wstring& deviceID)
+{
+    if ((dataFlow == eRender || dataFlow == eCapture) && slots[dataFlow][role].queued)
+    {
+        deviceID = slots[dataFlow][role].deviceID;
+        return S_OK;
+    }
+    return pInner->getDefaultDeviceID(dataFlow, role, deviceID);
+}
+
+HRESULT SwitchScheduler::setDefaultEndpoint(LPCWSTR deviceID, ERole role)
+{
+    TDeviceEntry device;
+    EDataFlow dataFlow;
+    HRESULT hr = pInner->readDevice(deviceID, device, &dataFlow);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    stats.requests++;
+    TSwitchSlot& slot = slots[dataFlow][role];
+    if (slot.queued)
+    {
+        stats.merged++;
+    }
+    else
+    {
+        slot.queued = true;
+        slot.firstQueued = Clock::now();
+    }
+    slot.deviceID = deviceID;
+    return S_OK;
+}
+
+HRESULT SwitchScheduler::getDeviceFormat(LPCWSTR deviceID, TAudioFormat& format)
+{
+    return pInner->getDeviceFormat(deviceID, format);
+}
+
+HRESULT SwitchScheduler::setDeviceFormat(LPCWSTR deviceID, const TAudioFormat& format)
+{
+    return pInner->setDeviceFormat(deviceID, format);
+}
+
+HRESULT SwitchScheduler::getProcessingPeriod(LPCWSTR deviceID, TProcessingPeriod& period)
+{
+    return pInner->getProcessingPeriod(deviceID, period);
+}
+
+HRESULT SwitchScheduler::setProcessingPeriod(LPCWSTR deviceID, INT64 period)
+{
+    return pInner->setProcessingPeriod(deviceID, period);
+}
+
+HRESULT SwitchScheduler::setEndpointVisibility(LPCWSTR deviceID, bool visible)
+{
+    return pInner->setEndpointVisibility(deviceID, visible);
+}
+
+HRESULT SwitchScheduler::getDriverVersion(LPCWSTR deviceID, std::wstring& version)
+{
+    return pInner->getDriverVersion(deviceID, version);
+}
+
+HRESULT SwitchScheduler::getShareMode(LPCWSTR deviceID, int* pShareMode)
+{
+    return pInner->getShareMode(deviceID, pShareMode);
+}
+
+HRESULT SwitchScheduler::probeFormats(LPCWSTR deviceID, const std::vector<TAudioFormat>& formats, std::vector<unsigned char>& support)
+{
+    return pInner->probeFormats(deviceID, formats, support);
+}
+
+HRESULT SwitchScheduler::getEndpointVolume(LPCWSTR deviceID, TEndpointVolume& volume)
+{
+    return pInner->getEndpointVolume(deviceID, volume);
+}
+
+HRESULT SwitchScheduler::updateEndpointVolume(LPCWSTR deviceID, const TVolumeUpdate& update, TEndpointVolume& before,
+    TEndpointVolume& after)
+{
+    return pInner->updateEndpointVolume(deviceID, update, before, after);
+}
+
+HRESULT SwitchScheduler::openPeakMeter(LPCWSTR deviceID, PeakMeter** ppMeter)
+{
+    return pInner->openPeakMeter(deviceID, ppMeter);
+}
+
+HRESULT SwitchScheduler::getSessions(LPCWSTR deviceID, SessionTable& sessions)
+{
+    return pInner->getSessions(deviceID, sessions);
+}
+
+HRESULT SwitchScheduler::watchSessions(LPCWSTR deviceID)
+{
+    return pInner->watchSessions(deviceID);
+}
+
+HRESULT SwitchScheduler::registerNotificationSink(DeviceNotificationSink* pSink)
+{
+    return pInner->registerNotificationSink(pSink);
+}
+
+HRESULT SwitchScheduler::unregisterNotificationSink(DeviceNotificationSink* pSink)
+{
+    return pInner->unregisterNotificationSink(pSink);
+}
@@ -0,0 +1,90 @@
+// ----------------------------------------------------------------------------
+// SwitchScheduler.h
+// Rate limiting for default-device switches in the resident process. Each
+// switch is queued per data flow and role; a burst of requests inside the
+// coalescing window collapses into the last one, and the real
+// SetDefaultEndpoint calls for a flow and role are spaced at least the
+// minimum interval apart, so hotkey spam costs one system-wide broadcast.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <chrono>
+#include "AudioBackend.h"
+
+#define SWITCH_DEFAULT_WINDOW_MS 25
+#define SWITCH_DEFAULT_INTERVAL_MS 100
+
+typedef struct TSwitchStats
+{
+    unsigned long long requests;    // Switches asked for
+    unsigned long long calls;       // SetDefaultEndpoint calls actually made
+    unsigned long long merged;      // Replaced by a later request for the same flow and role before being sent
+    unsigned long long dropped;     // The device was already the default when the switch came due
+    unsigned long long failed;      // Calls that returned an error
+} TSwitchStats;
+
+// Wraps the resident backend. setDefaultEndpoint only queues the switch; flush() sends the ones that are due,
+// and takeLastFailure() hands the last one that failed to whoever asks after the reply has gone.
+class SwitchScheduler : public AudioBackend
+{
+public:
+    SwitchScheduler(AudioBackend* pInner, int windowMs, int intervalMs);
+
+    // Milliseconds until the next queued switch is due, -1 if none is queued
+    int getWaitMs() const;
+
+    // Send the switches that are due; with force, every queued switch regardless of window and interval
+    void flush(bool force);
+
+    const TSwitchStats& getStats() const
+    {
+        return stats;
+    }
+
+    // The result of the last switch that failed since the previous call, S_OK if none did, with what it was
+    HRESULT takeLastFailure(std::wstring& description);
+
+    HRESULT enumerateDevices(EDataFlow dataFlow, DWORD stateMask, DeviceTable& devices);
+    HRESULT readDevice(LPCWSTR deviceID, TDeviceEntry& device, EDataFlow* pDataFlow);
+    HRESULT getDefaultDeviceID(EDataFlow dataFlow, ERole role, std::wstring& deviceID);
+    HRESULT setDefaultEndpoint(LPCWSTR deviceID, ERole role);
+    HRESULT getDeviceFormat(LPCWSTR deviceID, TAudioFormat& format);
+    HRESULT setDeviceFormat(LPCWSTR deviceID, const TAudioFormat& format);
+    HRESULT getProcessingPeriod(LPCWSTR deviceID, TProcessingPeriod& period);
+    HRESULT setProcessingPeriod(LPCWSTR deviceID, INT64 period);
+    HRESULT setEndpointVisibility(LPCWSTR deviceID, bool visible);
+    HRESULT getDriverVersion(LPCWSTR deviceID, std::wstring& version);
+    HRESULT getShareMode(LPCWSTR deviceID, int* pShareMode);
+    HRESULT probeFormats(LPCWSTR deviceID, const std::vector<TAudioFormat>& formats, std::vector<unsigned char>& support);
+    HRESULT getEndpointVolume(LPCWSTR deviceID, TEndpointVolume& volume);
+    HRESULT updateEndpointVolume(LPCWSTR deviceID, const TVolumeUpdate& update, TEndpointVolume& before, TEndpointVolume& after);
+    HRESULT openPeakMeter(LPCWSTR deviceID, PeakMeter** ppMeter);
+    HRESULT getSessions(LPCWSTR deviceID, SessionTable& sessions);
+    HRESULT watchSessions(LPCWSTR deviceID);
+    HRESULT registerNotificationSink(DeviceNotificationSink* pSink);
+    HRESULT unregisterNotificationSink(DeviceNotificationSink* pSink);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    typedef struct TSwitchSlot
+    {
+        bool queued;
+        std::wstring deviceID;          // The latest request
+        Clock::time_point firstQueued;  // When the burst began; the window runs from here
+        Clock::time_point lastCall;     // Last SetDefaultEndpoint for this flow and role
+        bool called;
+    } TSwitchSlot;
+
+    Clock::time_point dueTime(const TSwitchSlot& slot) const;
+
+    AudioBackend* pInner;
+    std::chrono::milliseconds window;
+    std::chrono::milliseconds interval;
+    TSwitchSlot slots[2][ERole_enum_count];
+    TSwitchStats stats;
+    HRESULT lastFailure;
+    std::wstring lastFailureDescription;
+};
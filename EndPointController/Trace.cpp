@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include "Output.h"
+#include "Stats.h"
+#include "Trace.h"
+
+#ifdef _WIN32
+#define TRACE_PID() ((unsigned long)GetCurrentProcessId())
+#else
+#include <unistd.h>
+#define TRACE_PID() ((unsigned long)getpid())
+#endif
+
+// Spans are buffered in memory and written in one go, so recording never touches the file system
+#define TRACE_INITIAL_CAPACITY 4096
+
+typedef std::chrono::steady_clock TraceClock;
+
+typedef struct TTraceEvent
+{
+    const char* name;
+    unsigned long long startNs;
+    unsigned long long durationNs;
+    int thread;
+} TTraceEvent;
+
+std::atomic<bool> spansEnabled(false);
+static bool traceRecording = false;
+
+static TraceClock::time_point traceOrigin;
+static std::mutex traceLock;
+static std::vector<TTraceEvent> traceEvents;
+static std::atomic<int> nextTraceThread(1);
+
+// Small sequential thread numbers read better in the viewer than native thread IDs
+static int traceThread()
+{
+    static thread_local int thread = 0;
+    if (thread == 0)
+    {
+        thread = nextTraceThread++;
+    }
+    return thread;
+}
+
+static unsigned long long traceNow()
+{
+    return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(TraceClock::now() - traceOrigin).count();
+}
+
+void traceStart()
+{
+    std::lock_guard<std::mutex> guard(traceLock);
+    traceEvents.reserve(TRACE_INITIAL_CAPACITY);
+    traceOrigin = TraceClock::now();
+    traceRecording = true;
+    spansEnabled = true;
+}
+
+void TraceSpan::begin(const char* name)
+{
+    pName = name;
+    readCounters(startCounts);
+    startNs = traceNow();
+}
+
+void TraceSpan::end()
+{
+    unsigned long long durationNs = traceNow() - startNs;
+    uint64_t counts[ECounter_enum_count];
+    readCounters(counts);
+    for (int i = 0; i < ECounter_enum_count; i++)
+    {
+        counts[i] -= startCounts[i];
+    }
+    statsRecordSpan(pName, durationNs, counts);
+
+    TTraceEvent event = { pName, startNs, durationNs, traceThread() };
+    std::lock_guard<std::mutex> guard(traceLock);
+    if (traceRecording)
+    {
+        traceEvents.push_back(event);
+    }
+}
+
+// Write the recorded spans as complete ("X") events, timestamps in microseconds
+HRESULT traceWrite(LPCWSTR path)
+{
+    std::lock_guard<std::mutex> guard(traceLock);
+    traceRecording = false;
+
+    FILE* outFile = openFile(path, L"w");
+    if (outFile == NULL)
+    {
+        outputf(_T("Cannot write trace file %ls\n"), path);
+        return E_FAIL;
+    }
+
+    unsigned long pid = TRACE_PID();
+    fprintf(outFile, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(outFile, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":1,\"args\":{\"name\":\"EndPointController\"}}", pid);
+    for (const auto& event : traceEvents)
+    {
+        fprintf(outFile, ",\n{\"name\":\"%s\",\"cat\":\"epc\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lu,\"tid\":%d}",
+            event.name, event.startNs / 1000.0, event.durationNs / 1000.0, pid, event.thread);
+    }
+    fprintf(outFile, "\n]}\n");
+
+    bool failed = ferror(outFile) != 0;
+    failed = fclose(outFile) != 0 || failed;
+    traceEvents.clear();
+    return failed ? E_FAIL : S_OK;
+}
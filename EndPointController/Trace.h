@@ -0,0 +1,81 @@
+// ----------------------------------------------------------------------------
+// Trace.h
+// Scoped timing spans written as Chrome trace-event JSON (--trace file),
+// which chrome://tracing and Perfetto open directly. The same spans feed the
+// --stats histograms. While neither is on a span costs one test of a global
+// flag when it begins and one when it ends.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <atomic>
+#include "Counters.h"
+#include "Platform.h"
+
+// Set while tracing or --stats needs span timings
+extern std::atomic<bool> spansEnabled;
+
+// Start and stop recording; spans on any thread are collected until traceWrite
+void traceStart();
+HRESULT traceWrite(LPCWSTR path);
+
+// Times its own lifetime under the given name, which must be a string literal
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char* name) : active(spansEnabled.load(std::memory_order_relaxed))
+    {
+        if (active)
+        {
+            begin(name);
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if (active)
+        {
+            end();
+        }
+    }
+
+private:
+    void begin(const char* name);
+    void end();
+
+    TraceSpan(const TraceSpan&);
+    TraceSpan& operator=(const TraceSpan&);
+
+    bool active;
+    const char* pName;
+    unsigned long long startNs;
+    uint64_t startCounts[ECounter_enum_count];
+};
+
+// Records the whole run: starts tracing if a path was given and writes the file when it goes out of scope
+class TraceSession
+{
+public:
+    explicit TraceSession(LPCWSTR path) : pPath(path)
+    {
+        if (pPath != NULL)
+        {
+            traceStart();
+        }
+    }
+
+    ~TraceSession()
+    {
+        if (pPath != NULL)
+        {
+            traceWrite(pPath);
+        }
+    }
+
+private:
+    TraceSession(const TraceSession&);
+    TraceSession& operator=(const TraceSession&);
+
+    LPCWSTR pPath;
+};
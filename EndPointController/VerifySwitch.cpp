@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <wchar.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include "Clock.h"
+#include "EndPointController.h"
+#include "Output.h"
+#include "VerifySwitch.h"
+
+typedef std::chrono::steady_clock VerifyClock;
+
+static const wchar_t* roleNames[] = { L"console", L"multimedia", L"communications" };
+
+// Records when the audio engine reports the expected device as default for each awaited role
+class DefaultChangeWaiter : public DeviceNotificationSink
+{
+public:
+    DefaultChangeWaiter(EDataFlow dataFlow, LPCWSTR deviceID, unsigned int roleMask)
+        : dataFlow(dataFlow), deviceID(deviceID), pendingRoles(roleMask)
+    {
+    }
+
+    void onDefaultDeviceChanged(EDataFlow flow, ERole role, LPCWSTR id)
+    {
+        VerifyClock::time_point now = VerifyClock::now();
+        if (flow != dataFlow || wcscmp(id, deviceID.c_str()) != 0)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        if ((pendingRoles & (1u << role)) != 0)
+        {
+            pendingRoles &= ~(1u << role);
+            reportedAt[role] = now;
+            signal.notify_all();
+        }
+    }
+
+    // Wait until every awaited role has been reported; false on timeout
+    bool wait(int timeoutMs)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        return signal.wait_for(guard, std::chrono::milliseconds(timeoutMs), [this] { return pendingRoles == 0; });
+    }
+
+    bool isPending(ERole role)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return (pendingRoles & (1u << role)) != 0;
+    }
+
+    VerifyClock::time_point reportedAt[ERole_enum_count];
+
+private:
+    EDataFlow dataFlow;
+    std::wstring deviceID;
+    unsigned int pendingRoles;
+    std::mutex lock;
+    std::condition_variable signal;
+};
+
+// Switch the default device and report the propagation latency of the change
+HRESULT verifyDefaultSwitch(AudioBackend* pBackend, LPCWSTR deviceID, bool isOutput, int timeoutMs)
+{
+    EDataFlow dataFlow = isOutput ? eRender : eCapture;
+
+    // Playback switches only the console role, capture switches all three (see SetDefaultAudio*Device).
+    // Roles that already point at the device produce no notification, so they are not awaited.
+    unsigned int roleMask = 0;
+    for (int role = eConsole; role < ERole_enum_count; role++)
+    {
+        if (isOutput && role != eConsole)
+            continue;
+
+        std::wstring currentID;
+        if (FAILED(pBackend->getDefaultDeviceID(dataFlow, (ERole)role, currentID)) || currentID != deviceID)
+        {
+            roleMask |= 1u << role;
+        }
+    }
+
+    if (roleMask == 0)
+    {
+        outputf(_T("Device is already the default, no change to verify\n"));
+        return S_OK;
+    }
+
+    DefaultChangeWaiter waiter(dataFlow, deviceID, roleMask);
+    HRESULT hr = pBackend->registerNotificationSink(&waiter);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    VerifyClock::time_point start = VerifyClock::now();
+    hr = isOutput ? SetDefaultAudioPlaybackDevice(pBackend, deviceID) : SetDefaultAudioCaptureDevice(pBackend, deviceID);
+    VerifyClock::time_point returned = VerifyClock::now();
+
+    bool reported = SUCCEEDED(hr) && waiter.wait(timeoutMs);
+    pBackend->unregisterNotificationSink(&waiter);
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    outputf(_T("Switch call returned after %.3f ms\n"), elapsedMs(start, returned));
+
+    VerifyClock::time_point lastReport = returned;
+    for (int role = eConsole; role < ERole_enum_count; role++)
+    {
+        if ((roleMask & (1u << role)) == 0)
+            continue;
+
+        if (waiter.isPending((ERole)role))
+        {
+            outputf(_T("Default change (%ls) not reported within %d ms\n"), roleNames[role], timeoutMs);
+        }
+        else
+        {
+            outputf(_T("Default change (%ls) reported after %.3f ms\n"), roleNames[role], elapsedMs(start, waiter.reportedAt[role]));
+            if (waiter.reportedAt[role] > lastReport)
+                lastReport = waiter.reportedAt[role];
+        }
+    }
+
+    if (!reported)
+    {
+        return HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+    }
+
+    outputf(_T("Propagation latency: %.3f ms\n"), elapsedMs(returned, lastReport));
+    return S_OK;
+}
@@ -0,0 +1,16 @@
+// ----------------------------------------------------------------------------
+// VerifySwitch.h
+// Measures how long the audio engine takes to report a new default endpoint
+// after SetDefaultEndpoint returns.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include "AudioBackend.h"
+
+#define VERIFY_DEFAULT_TIMEOUT_MS 5000
+
+// Switch the default device and wait up to timeoutMs for OnDefaultDeviceChanged on every role the
+// switch touches. Returns HRESULT_FROM_WIN32(ERROR_TIMEOUT) if the change is never reported.
+HRESULT verifyDefaultSwitch(AudioBackend* pBackend, LPCWSTR deviceID, bool isOutput, int timeoutMs);
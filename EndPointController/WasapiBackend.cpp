@@ -0,0 +1,1373 @@
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <string.h>
+#include <mmreg.h>
+#include <audioclient.h>
+#include <audiopolicy.h>
+#include <endpointvolume.h>
+#include "AudioBackend.h"
+#include "PolicyConfig.h"
+#include "Trace.h"
+#include "Propidl.h"
+#include "Functiondiscoverykeys_devpkey.h"
+
+std::wstring getDeviceProperty(IPropertyStore* pStore, const PROPERTYKEY key);
+UINT getDeviceUIntProperty(IPropertyStore* pStore, const PROPERTYKEY key, UINT defaultValue);
+std::wstring getDeviceGuidProperty(IPropertyStore* pStore, const PROPERTYKEY key);
+
+// The policy-config interfaces, in the order they are tried when nothing is cached
+enum EPolicyConfigInterface
+{
+    ePolicyConfigUnknown,
+    ePolicyConfigWin7,      // IPolicyConfig
+    ePolicyConfigVista      // IPolicyConfigVista
+};
+
+#define POLICY_CONFIG_CACHE_FILE "policy_config_cache.txt"
+
+// DEVPKEY_Device_DriverVersion, which endpoint property stores pass through from the device node
+static const PROPERTYKEY PKEY_EndpointDriverVersion = { { 0xa8b865dd, 0x2e3d, 0x4094, { 0xad, 0x97, 0xe5, 0x93, 0xa7, 0x0c, 0x75, 0xd6 } }, 3 };
+
+// Event context of the volume changes this tool makes, so volume notifications can tell them apart
+static const GUID volumeEventContext = { 0x5c4b1f0e, 0x8d2a, 0x4e6b, { 0x9f, 0x3c, 0x1a, 0x7e, 0x2d, 0x40, 0xb8, 0x61 } };
+
+// Read which policy-config interface worked last time, kept next to the device caches
+static EPolicyConfigInterface loadPolicyConfigInterface()
+{
+    char line[32] = "";
+    FILE* inFile = fopen(POLICY_CONFIG_CACHE_FILE, "rb");
+    if (inFile == NULL)
+    {
+        return ePolicyConfigUnknown;
+    }
+    size_t count = fread(line, 1, sizeof(line) - 1, inFile);
+    fclose(inFile);
+    line[count] = '\0';
+
+    if (strncmp(line, "IPolicyConfigVista", 18) == 0)
+        return ePolicyConfigVista;
+    if (strncmp(line, "IPolicyConfig", 13) == 0)
+        return ePolicyConfigWin7;
+    return ePolicyConfigUnknown;
+}
+
+static void savePolicyConfigInterface(EPolicyConfigInterface found)
+{
+    FILE* outFile = fopen(POLICY_CONFIG_CACHE_FILE, "wb");
+    if (outFile != NULL)
+    {
+        fputs(found == ePolicyConfigVista ? "IPolicyConfigVista\n" : "IPolicyConfig\n", outFile);
+        fclose(outFile);
+    }
+}
+
+// A peak meter over IAudioMeterInformation. It holds a reference on the apartment its thread joined when it was
+// opened, and leaves it when deleted.
+class CPeakMeter : public PeakMeter
+{
+public:
+    CPeakMeter(IAudioMeterInformation* pMeter, bool uninitialize) : pMeter(pMeter), uninitialize(uninitialize) {}
+
+    ~CPeakMeter()
+    {
+        pMeter->Release();
+        if (uninitialize)
+        {
+            CoUninitialize();
+        }
+    }
+
+    HRESULT getPeakValue(float* pPeak)
+    {
+        return pMeter->GetPeakValue(pPeak);
+    }
+
+private:
+    IAudioMeterInformation* pMeter;
+    bool uninitialize;
+};
+
+// Called on an audio service thread when a watched endpoint's sessions change
+typedef void (*SessionChangeHandler)(void* pContext, LPCWSTR deviceID);
+
+// Watches the sessions of one endpoint. Registered with the session manager, it hears of new sessions; registered
+// with every session, it hears of their state, volume and name changes and of their disconnection. Each of these
+// reaches the handler as a change of the endpoint's sessions.
+class CSessionWatcher : public IAudioSessionNotification, public IAudioSessionEvents
+{
+public:
+    CSessionWatcher(LPCWSTR deviceID, SessionChangeHandler handler, void* pContext)
+        : refCount(1), deviceID(deviceID), handler(handler), pContext(pContext), pManager(NULL), closed(false) {}
+
+    // Start watching. Notifications only flow once the manager has enumerated its sessions, which also gives the
+    // existing sessions to register with.
+    HRESULT attach(IAudioSessionManager2* pSessionManager)
+    {
+        pManager = pSessionManager;
+        pManager->AddRef();
+        HRESULT hr = pManager->RegisterSessionNotification(this);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        IAudioSessionEnumerator* pSessions = NULL;
+        hr = pManager->GetSessionEnumerator(&pSessions);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        int count = 0;
+        pSessions->GetCount(&count);
+        for (int i = 0; i < count; i++)
+        {
+            IAudioSessionControl* pControl = NULL;
+            if (SUCCEEDED(pSessions->GetSession(i, &pControl)))
+            {
+                track(pControl);
+                pControl->Release();
+            }
+        }
+        pSessions->Release();
+        return S_OK;
+    }
+
+    // Stop watching; no callback reaches the handler once this returns
+    void detach()
+    {
+        std::vector<IAudioSessionControl*> closing;
+        {
+            std::lock_guard<std::mutex> guard(controlsLock);
+            closed = true;
+            closing.swap(controls);
+        }
+        for (auto pControl : closing)
+        {
+            pControl->UnregisterAudioSessionNotification(this);
+            pControl->Release();
+        }
+        if (pManager != NULL)
+        {
+            pManager->UnregisterSessionNotification(this);
+            pManager->Release();
+            pManager = NULL;
+        }
+    }
+
+    ULONG STDMETHODCALLTYPE AddRef()
+    {
+        return InterlockedIncrement(&refCount);
+    }
+
+    ULONG STDMETHODCALLTYPE Release()
+    {
+        ULONG count = InterlockedDecrement(&refCount);
+        if (count == 0)
+        {
+            delete this;
+        }
+        return count;
+    }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, VOID** ppvInterface)
+    {
+        if (riid == IID_IUnknown || riid == __uuidof(IAudioSessionNotification))
+        {
+            AddRef();
+            *ppvInterface = (IAudioSessionNotification*)this;
+            return S_OK;
+        }
+        if (riid == __uuidof(IAudioSessionEvents))
+        {
+            AddRef();
+            *ppvInterface = (IAudioSessionEvents*)this;
+            return S_OK;
+        }
+        *ppvInterface = NULL;
+        return E_NOINTERFACE;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnSessionCreated(IAudioSessionControl* pNewSession)
+    {
+        track(pNewSession);
+        notify();
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnDisplayNameChanged(LPCWSTR NewDisplayName, LPCGUID EventContext)
+    {
+        notify();
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnIconPathChanged(LPCWSTR NewIconPath, LPCGUID EventContext)
+    {
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnSimpleVolumeChanged(float NewVolume, BOOL NewMute, LPCGUID EventContext)
+    {
+        notify();
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnChannelVolumeChanged(DWORD ChannelCount, float NewChannelVolumeArray[], DWORD ChangedChannel,
+        LPCGUID EventContext)
+    {
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnGroupingParamChanged(LPCGUID NewGroupingParam, LPCGUID EventContext)
+    {
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnStateChanged(AudioSessionState NewState)
+    {
+        notify();
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnSessionDisconnected(AudioSessionDisconnectReason DisconnectReason)
+    {
+        notify();
+        return S_OK;
+    }
+
+private:
+    // Register for a session's events, keeping its control until detach. A session enumerated just as it was
+    // created may be tracked twice, which only doubles its notifications.
+    void track(IAudioSessionControl* pControl)
+    {
+        if (FAILED(pControl->RegisterAudioSessionNotification(this)))
+        {
+            return;
+        }
+
+        bool keep;
+        {
+            std::lock_guard<std::mutex> guard(controlsLock);
+            keep = !closed;
+            if (keep)
+            {
+                pControl->AddRef();
+                controls.push_back(pControl);
+            }
+        }
+        if (!keep)
+        {
+            pControl->UnregisterAudioSessionNotification(this);
+        }
+    }
+
+    void notify()
+    {
+        std::lock_guard<std::mutex> guard(controlsLock);
+        if (!closed)
+        {
+            handler(pContext, deviceID.c_str());
+        }
+    }
+
+    LONG refCount;
+    std::wstring deviceID;
+    SessionChangeHandler handler;
+    void* pContext;
+    IAudioSessionManager2* pManager;
+    std::mutex controlsLock;
+    std::vector<IAudioSessionControl*> controls;
+    bool closed;
+};
+
+// A watchSessions call waiting for the session thread
+typedef struct TSessionWatchRequest
+{
+    std::wstring deviceID;
+    std::promise<HRESULT> result;
+} TSessionWatchRequest;
+
+// Forwards IMMNotificationClient callbacks to a DeviceNotificationSink
+class CNotificationClient : public IMMNotificationClient
+{
+public:
+    CNotificationClient(DeviceNotificationSink* pSink) : refCount(1), pSink(pSink) {}
+
+    ULONG STDMETHODCALLTYPE AddRef()
+    {
+        return InterlockedIncrement(&refCount);
+    }
+
+    ULONG STDMETHODCALLTYPE Release()
+    {
+        ULONG count = InterlockedDecrement(&refCount);
+        if (count == 0)
+        {
+            delete this;
+        }
+        return count;
+    }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, VOID** ppvInterface)
+    {
+        if (riid == IID_IUnknown || riid == __uuidof(IMMNotificationClient))
+        {
+            AddRef();
+            *ppvInterface = (IMMNotificationClient*)this;
+            return S_OK;
+        }
+        *ppvInterface = NULL;
+        return E_NOINTERFACE;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnDefaultDeviceChanged(EDataFlow flow, ERole role, LPCWSTR pwstrDeviceId)
+    {
+        pSink->onDefaultDeviceChanged(flow, role, pwstrDeviceId != NULL ? pwstrDeviceId : L"");
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnDeviceAdded(LPCWSTR pwstrDeviceId)
+    {
+        pSink->onDeviceAdded(pwstrDeviceId);
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnDeviceRemoved(LPCWSTR pwstrDeviceId)
+    {
+        pSink->onDeviceRemoved(pwstrDeviceId);
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnDeviceStateChanged(LPCWSTR pwstrDeviceId, DWORD dwNewState)
+    {
+        pSink->onDeviceStateChanged(pwstrDeviceId, dwNewState);
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnPropertyValueChanged(LPCWSTR pwstrDeviceId, const PROPERTYKEY key)
+    {
+        pSink->onPropertyValueChanged(pwstrDeviceId, classifyProperty(key));
+        return S_OK;
+    }
+
+private:
+    static bool isSameKey(const PROPERTYKEY& a, const PROPERTYKEY& b)
+    {
+        return a.fmtid == b.fmtid && a.pid == b.pid;
+    }
+
+    static EDeviceProperty classifyProperty(const PROPERTYKEY& key)
+    {
+        if (isSameKey(key, PKEY_Device_FriendlyName) || isSameKey(key, PKEY_Device_DeviceDesc) ||
+            isSameKey(key, PKEY_DeviceInterface_FriendlyName))
+        {
+            return eDevicePropertyName;
+        }
+        if (isSameKey(key, PKEY_AudioEngine_DeviceFormat))
+        {
+            return eDevicePropertyFormat;
+        }
+        return eDevicePropertyOther;
+    }
+
+    LONG refCount;
+    DeviceNotificationSink* pSink;
+};
+
+class WasapiBackend : public AudioBackend
+{
+public:
+    WasapiBackend() : comInitialized(false), pEnum(NULL), pPolicyConfig(NULL), pPolicyConfigVista(NULL), sessionStopping(false) {}
+
+    ~WasapiBackend()
+    {
+        if (sessionThread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> guard(sessionLock);
+                sessionStopping = true;
+            }
+            sessionSignal.notify_all();
+            sessionThread.join();
+        }
+        for (auto& client : clients)
+        {
+            pEnum->UnregisterEndpointNotificationCallback(client.second);
+            client.second->Release();
+        }
+        if (pPolicyConfig != NULL)
+        {
+            pPolicyConfig->Release();
+        }
+        if (pPolicyConfigVista != NULL)
+        {
+            pPolicyConfigVista->Release();
+        }
+        if (pEnum != NULL)
+        {
+            pEnum->Release();
+        }
+        if (comInitialized)
+        {
+            CoUninitialize();
+        }
+    }
+
+    // Initialize COM and create the one device enumerator shared by every operation
+    HRESULT initialize()
+    {
+        HRESULT hr;
+        {
+            TraceSpan span("CoInitializeEx");
+            hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+        }
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        comInitialized = true;
+
+        TraceSpan span("CoCreateInstance(MMDeviceEnumerator)");
+        countEvent(eCounterCoCreateInstance);
+        return CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator),
+            (void**)&pEnum);
+    }
+
+    HRESULT enumerateDevices(EDataFlow dataFlow, DWORD stateMask, DeviceTable& devices)
+    {
+        IMMDeviceCollection* pDevices = NULL;
+        HRESULT hr;
+        {
+            TraceSpan span("EnumAudioEndpoints");
+            hr = pEnum->EnumAudioEndpoints(dataFlow, stateMask, &pDevices);
+        }
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        UINT count = 0;
+        pDevices->GetCount(&count);
+        devices.reserve(devices.size() + count);
+
+        for (UINT i = 0; i < count; i++)
+        {
+            IMMDevice* pDevice = NULL;
+            if (SUCCEEDED(pDevices->Item(i, &pDevice)))
+            {
+                TDeviceEntry entry;
+                if (SUCCEEDED(readDeviceEntry(pDevice, entry)))
+                {
+                    devices.push_back(entry);
+                }
+                pDevice->Release();
+            }
+        }
+
+        pDevices->Release();
+        return S_OK;
+    }
+
+    HRESULT readDevice(LPCWSTR deviceID, TDeviceEntry& device, EDataFlow* pDataFlow)
+    {
+        IMMDevice* pDevice = NULL;
+        HRESULT hr = pEnum->GetDevice(deviceID, &pDevice);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        IMMEndpoint* pEndpoint = NULL;
+        hr = pDevice->QueryInterface(__uuidof(IMMEndpoint), (void**)&pEndpoint);
+        if (SUCCEEDED(hr))
+        {
+            hr = pEndpoint->GetDataFlow(pDataFlow);
+            pEndpoint->Release();
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = readDeviceEntry(pDevice, device);
+        }
+        pDevice->Release();
+        return hr;
+    }
+
+    HRESULT getDefaultDeviceID(EDataFlow dataFlow, ERole role, std::wstring& deviceID)
+    {
+        TraceSpan span("GetDefaultAudioEndpoint");
+        IMMDevice* pDevice = NULL;
+        HRESULT hr = pEnum->GetDefaultAudioEndpoint(dataFlow, role, &pDevice);
+        if (SUCCEEDED(hr))
+        {
+            LPWSTR strID = NULL;
+            hr = pDevice->GetId(&strID);
+            if (SUCCEEDED(hr))
+            {
+                deviceID = strID;
+                CoTaskMemFree(strID);
+                countEvent(eCounterCoTaskMemFree);
+            }
+            pDevice->Release();
+        }
+        return hr;
+    }
+
+    HRESULT setDefaultEndpoint(LPCWSTR deviceID, ERole role)
+    {
+        HRESULT hr = createPolicyConfig();
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        TraceSpan span("SetDefaultEndpoint");
+        return pPolicyConfig != NULL ? pPolicyConfig->SetDefaultEndpoint(deviceID, role)
+                                     : pPolicyConfigVista->SetDefaultEndpoint(deviceID, role);
+    }
+
+    // The current (not the default) device format. An endpoint whose driver does not report one still has the
+    // engine's mix format, which only IPolicyConfig can read: IPolicyConfigVista's GetMixFormat is not usable on
+    // Windows 7 and later.
+    HRESULT getDeviceFormat(LPCWSTR deviceID, TAudioFormat& format)
+    {
+        HRESULT hr = createPolicyConfig();
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        TraceSpan span("GetDeviceFormat");
+        WAVEFORMATEX* pFormat = NULL;
+        hr = pPolicyConfig != NULL ? pPolicyConfig->GetDeviceFormat(deviceID, FALSE, &pFormat)
+                                   : pPolicyConfigVista->GetDeviceFormat(deviceID, FALSE, &pFormat);
+        if ((FAILED(hr) || pFormat == NULL) && pPolicyConfig != NULL)
+        {
+            TraceSpan mixSpan("GetMixFormat");
+            hr = pPolicyConfig->GetMixFormat(deviceID, &pFormat);
+        }
+        if (FAILED(hr) || pFormat == NULL)
+        {
+            return FAILED(hr) ? hr : E_POINTER;
+        }
+
+        format.sampleRate = pFormat->nSamplesPerSec;
+        format.channels = pFormat->nChannels;
+        format.bitsPerSample = pFormat->wBitsPerSample;
+        format.channelMask = 0;
+        format.isFloat = pFormat->wFormatTag == WAVE_FORMAT_IEEE_FLOAT;
+        if (pFormat->wFormatTag == WAVE_FORMAT_EXTENSIBLE && pFormat->cbSize >= sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX))
+        {
+            // Sub-format GUIDs carry the plain format tag in their first field
+            const WAVEFORMATEXTENSIBLE* pExtensible = (const WAVEFORMATEXTENSIBLE*)pFormat;
+            if (pExtensible->Samples.wValidBitsPerSample != 0)
+            {
+                format.bitsPerSample = pExtensible->Samples.wValidBitsPerSample;
+            }
+            format.channelMask = pExtensible->dwChannelMask;
+            format.isFloat = pExtensible->SubFormat.Data1 == WAVE_FORMAT_IEEE_FLOAT;
+        }
+        CoTaskMemFree(pFormat);
+        countEvent(eCounterCoTaskMemFree);
+        return S_OK;
+    }
+
+    // The endpoint format is integer PCM or float as requested; the engine mixes in 32-bit float at the same
+    // rate and channel layout, as the Sound control panel sets it
+    HRESULT setDeviceFormat(LPCWSTR deviceID, const TAudioFormat& format)
+    {
+        if (format.sampleRate == 0 || format.channels == 0 || format.bitsPerSample == 0)
+        {
+            return E_INVALIDARG;
+        }
+        HRESULT hr = createPolicyConfig();
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        WAVEFORMATEXTENSIBLE endpointFormat;
+        WAVEFORMATEXTENSIBLE mixFormat;
+        TAudioFormat mix = format;
+        mix.bitsPerSample = 32;
+        mix.isFloat = true;
+        buildWaveFormat(format, endpointFormat);
+        buildWaveFormat(mix, mixFormat);
+
+        TraceSpan span("SetDeviceFormat");
+        return pPolicyConfig != NULL ? pPolicyConfig->SetDeviceFormat(deviceID, &endpointFormat.Format, &mixFormat.Format)
+                                     : pPolicyConfigVista->SetDeviceFormat(deviceID, &endpointFormat.Format, &mixFormat.Format);
+    }
+
+    // GetProcessingPeriod's flag selects the engine's defaults (TRUE) or the settings in effect (FALSE); both
+    // report the minimum
+    HRESULT getProcessingPeriod(LPCWSTR deviceID, TProcessingPeriod& period)
+    {
+        HRESULT hr = createPolicyConfig();
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        TraceSpan span("GetProcessingPeriod");
+        INT64 minimumPeriod = 0;
+        if (pPolicyConfig != NULL)
+        {
+            hr = pPolicyConfig->GetProcessingPeriod(deviceID, TRUE, &period.defaultPeriod, &minimumPeriod);
+            if (SUCCEEDED(hr))
+            {
+                hr = pPolicyConfig->GetProcessingPeriod(deviceID, FALSE, &period.currentPeriod, &period.minimumPeriod);
+            }
+        }
+        else
+        {
+            hr = pPolicyConfigVista->GetProcessingPeriod(deviceID, TRUE, &period.defaultPeriod, &minimumPeriod);
+            if (SUCCEEDED(hr))
+            {
+                hr = pPolicyConfigVista->GetProcessingPeriod(deviceID, FALSE, &period.currentPeriod, &period.minimumPeriod);
+            }
+        }
+        return hr;
+    }
+
+    HRESULT setProcessingPeriod(LPCWSTR deviceID, INT64 period)
+    {
+        HRESULT hr = createPolicyConfig();
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        TraceSpan span("SetProcessingPeriod");
+        return pPolicyConfig != NULL ? pPolicyConfig->SetProcessingPeriod(deviceID, &period)
+                                     : pPolicyConfigVista->SetProcessingPeriod(deviceID, &period);
+    }
+
+    HRESULT setEndpointVisibility(LPCWSTR deviceID, bool visible)
+    {
+        HRESULT hr = createPolicyConfig();
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        TraceSpan span("SetEndpointVisibility");
+        return pPolicyConfig != NULL ? pPolicyConfig->SetEndpointVisibility(deviceID, visible ? TRUE : FALSE)
+                                     : pPolicyConfigVista->SetEndpointVisibility(deviceID, visible ? TRUE : FALSE);
+    }
+
+    HRESULT getDriverVersion(LPCWSTR deviceID, std::wstring& version)
+    {
+        IMMDevice* pDevice = NULL;
+        HRESULT hr = pEnum->GetDevice(deviceID, &pDevice);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        IPropertyStore* pStore = NULL;
+        {
+            TraceSpan storeSpan("OpenPropertyStore");
+            countEvent(eCounterPropertyStoreOpens);
+            hr = pDevice->OpenPropertyStore(STGM_READ, &pStore);
+        }
+        if (SUCCEEDED(hr))
+        {
+            version = getDeviceProperty(pStore, PKEY_EndpointDriverVersion);
+            pStore->Release();
+        }
+        pDevice->Release();
+        return hr;
+    }
+
+    HRESULT getShareMode(LPCWSTR deviceID, int* pShareMode)
+    {
+        HRESULT hr = createPolicyConfig();
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        // Room to spare, in case the structure is larger than the one field known
+        DeviceShareMode shareMode[4];
+        ZeroMemory(shareMode, sizeof(shareMode));
+        TraceSpan span("GetShareMode");
+        hr = pPolicyConfig != NULL ? pPolicyConfig->GetShareMode(deviceID, shareMode)
+                                   : pPolicyConfigVista->GetShareMode(deviceID, shareMode);
+        if (SUCCEEDED(hr))
+        {
+            *pShareMode = shareMode[0].mode;
+        }
+        return hr;
+    }
+
+    // Runs on the caller's thread with an apartment, enumerator and client of its own, so probes of different
+    // devices proceed in parallel rather than queue behind the main thread's apartment. IsFormatSupported
+    // answers S_FALSE with a closest match in shared mode; only S_OK counts as support.
+    HRESULT probeFormats(LPCWSTR deviceID, const std::vector<TAudioFormat>& formats, std::vector<unsigned char>& support)
+    {
+        support.assign(formats.size(), 0);
+        // A thread that already has an apartment keeps it
+        HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+        bool uninitialize = SUCCEEDED(hr);
+        if (FAILED(hr) && hr != RPC_E_CHANGED_MODE)
+        {
+            return hr;
+        }
+
+        IMMDeviceEnumerator* pProbeEnum = NULL;
+        IMMDevice* pDevice = NULL;
+        IAudioClient* pClient = NULL;
+        {
+            TraceSpan span("CoCreateInstance(MMDeviceEnumerator)");
+            countEvent(eCounterCoCreateInstance);
+            hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator),
+                (void**)&pProbeEnum);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = pProbeEnum->GetDevice(deviceID, &pDevice);
+        }
+        if (SUCCEEDED(hr))
+        {
+            TraceSpan span("Activate(IAudioClient)");
+            hr = pDevice->Activate(__uuidof(IAudioClient), CLSCTX_ALL, NULL, (void**)&pClient);
+        }
+
+        for (size_t i = 0; SUCCEEDED(hr) && i < formats.size(); i++)
+        {
+            TraceSpan span("IsFormatSupported");
+            WAVEFORMATEXTENSIBLE wave;
+            buildWaveFormat(formats[i], wave);
+
+            WAVEFORMATEX* pClosest = NULL;
+            if (pClient->IsFormatSupported(AUDCLNT_SHAREMODE_SHARED, &wave.Format, &pClosest) == S_OK)
+            {
+                support[i] |= FORMAT_SUPPORT_SHARED;
+            }
+            if (pClosest != NULL)
+            {
+                CoTaskMemFree(pClosest);
+                countEvent(eCounterCoTaskMemFree);
+            }
+            if (pClient->IsFormatSupported(AUDCLNT_SHAREMODE_EXCLUSIVE, &wave.Format, NULL) == S_OK)
+            {
+                support[i] |= FORMAT_SUPPORT_EXCLUSIVE;
+            }
+        }
+
+        if (pClient != NULL)
+        {
+            pClient->Release();
+        }
+        if (pDevice != NULL)
+        {
+            pDevice->Release();
+        }
+        if (pProbeEnum != NULL)
+        {
+            pProbeEnum->Release();
+        }
+        if (uninitialize)
+        {
+            CoUninitialize();
+        }
+        return hr;
+    }
+
+    HRESULT getEndpointVolume(LPCWSTR deviceID, TEndpointVolume& volume)
+    {
+        IAudioEndpointVolume* pVolume = NULL;
+        HRESULT hr = activateEndpointVolume(pEnum, deviceID, &pVolume);
+        if (SUCCEEDED(hr))
+        {
+            hr = readEndpointVolume(pVolume, volume);
+            pVolume->Release();
+        }
+        return hr;
+    }
+
+    // Runs in an apartment and with an enumerator of its own, as probeFormats does
+    HRESULT updateEndpointVolume(LPCWSTR deviceID, const TVolumeUpdate& update, TEndpointVolume& before, TEndpointVolume& after)
+    {
+        HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+        bool uninitialize = SUCCEEDED(hr);
+        if (FAILED(hr) && hr != RPC_E_CHANGED_MODE)
+        {
+            return hr;
+        }
+
+        IMMDeviceEnumerator* pUpdateEnum = NULL;
+        IAudioEndpointVolume* pVolume = NULL;
+        {
+            TraceSpan span("CoCreateInstance(MMDeviceEnumerator)");
+            countEvent(eCounterCoCreateInstance);
+            hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator),
+                (void**)&pUpdateEnum);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = activateEndpointVolume(pUpdateEnum, deviceID, &pVolume);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = readEndpointVolume(pVolume, before);
+        }
+
+        bool changeLevel = update.level >= 0 && !isSameVolumeLevel(update.level, before.level);
+        bool changeMute = update.mute >= 0 && (update.mute != 0) != before.muted;
+        if (SUCCEEDED(hr) && changeLevel)
+        {
+            TraceSpan span("SetMasterVolumeLevelScalar");
+            hr = pVolume->SetMasterVolumeLevelScalar(update.level, &volumeEventContext);
+        }
+        if (SUCCEEDED(hr) && changeMute)
+        {
+            TraceSpan span("SetMute");
+            hr = pVolume->SetMute(update.mute != 0 ? TRUE : FALSE, &volumeEventContext);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = readEndpointVolume(pVolume, after);
+        }
+        if (SUCCEEDED(hr) && !changeLevel && !changeMute)
+        {
+            hr = S_FALSE;
+        }
+
+        if (pVolume != NULL)
+        {
+            pVolume->Release();
+        }
+        if (pUpdateEnum != NULL)
+        {
+            pUpdateEnum->Release();
+        }
+        if (uninitialize)
+        {
+            CoUninitialize();
+        }
+        return hr;
+    }
+
+    // Activated through an enumerator of the calling thread's apartment, so the meter can be read without marshaling
+    HRESULT openPeakMeter(LPCWSTR deviceID, PeakMeter** ppMeter)
+    {
+        HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+        bool uninitialize = SUCCEEDED(hr);
+        if (FAILED(hr) && hr != RPC_E_CHANGED_MODE)
+        {
+            return hr;
+        }
+
+        IMMDeviceEnumerator* pMeterEnum = NULL;
+        IMMDevice* pDevice = NULL;
+        IAudioMeterInformation* pMeter = NULL;
+        {
+            TraceSpan span("CoCreateInstance(MMDeviceEnumerator)");
+            countEvent(eCounterCoCreateInstance);
+            hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator),
+                (void**)&pMeterEnum);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = pMeterEnum->GetDevice(deviceID, &pDevice);
+        }
+        if (SUCCEEDED(hr))
+        {
+            TraceSpan span("Activate(IAudioMeterInformation)");
+            hr = pDevice->Activate(__uuidof(IAudioMeterInformation), CLSCTX_ALL, NULL, (void**)&pMeter);
+        }
+
+        if (pDevice != NULL)
+        {
+            pDevice->Release();
+        }
+        if (pMeterEnum != NULL)
+        {
+            pMeterEnum->Release();
+        }
+        if (FAILED(hr))
+        {
+            if (uninitialize)
+            {
+                CoUninitialize();
+            }
+            return hr;
+        }
+        *ppMeter = new CPeakMeter(pMeter, uninitialize);
+        return S_OK;
+    }
+
+    // Runs in an apartment and with an enumerator of its own, as probeFormats does
+    HRESULT getSessions(LPCWSTR deviceID, SessionTable& sessions)
+    {
+        HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+        bool uninitialize = SUCCEEDED(hr);
+        if (FAILED(hr) && hr != RPC_E_CHANGED_MODE)
+        {
+            return hr;
+        }
+
+        IMMDeviceEnumerator* pSessionEnum = NULL;
+        IAudioSessionManager2* pManager = NULL;
+        IAudioSessionEnumerator* pSessions = NULL;
+        {
+            TraceSpan span("CoCreateInstance(MMDeviceEnumerator)");
+            countEvent(eCounterCoCreateInstance);
+            hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator),
+                (void**)&pSessionEnum);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = activateSessionManager(pSessionEnum, deviceID, &pManager);
+        }
+        if (SUCCEEDED(hr))
+        {
+            TraceSpan span("GetSessionEnumerator");
+            hr = pManager->GetSessionEnumerator(&pSessions);
+        }
+
+        int count = 0;
+        if (SUCCEEDED(hr))
+        {
+            hr = pSessions->GetCount(&count);
+        }
+        for (int i = 0; SUCCEEDED(hr) && i < count; i++)
+        {
+            IAudioSessionControl* pControl = NULL;
+            TAudioSession session;
+            hr = pSessions->GetSession(i, &pControl);
+            if (SUCCEEDED(hr))
+            {
+                hr = readSession(pControl, session);
+                pControl->Release();
+            }
+            if (SUCCEEDED(hr))
+            {
+                sessions.push_back(session);
+            }
+        }
+
+        if (pSessions != NULL)
+        {
+            pSessions->Release();
+        }
+        if (pManager != NULL)
+        {
+            pManager->Release();
+        }
+        if (pSessionEnum != NULL)
+        {
+            pSessionEnum->Release();
+        }
+        if (uninitialize)
+        {
+            CoUninitialize();
+        }
+        return hr;
+    }
+
+    // The watcher is set up on the session thread, whatever the caller's apartment
+    HRESULT watchSessions(LPCWSTR deviceID)
+    {
+        TSessionWatchRequest request;
+        request.deviceID = deviceID;
+        std::future<HRESULT> result = request.result.get_future();
+        {
+            std::lock_guard<std::mutex> guard(sessionLock);
+            if (!sessionThread.joinable())
+            {
+                sessionThread = std::thread(&WasapiBackend::sessionThreadMain, this);
+            }
+            sessionRequests.push_back(&request);
+        }
+        sessionSignal.notify_all();
+        return result.get();
+    }
+
+    HRESULT registerNotificationSink(DeviceNotificationSink* pSink)
+    {
+        std::lock_guard<std::mutex> guard(clientsLock);
+        CNotificationClient* pClient = new CNotificationClient(pSink);
+        HRESULT hr = pEnum->RegisterEndpointNotificationCallback(pClient);
+        if (FAILED(hr))
+        {
+            pClient->Release();
+            return hr;
+        }
+        clients[pSink] = pClient;
+        return S_OK;
+    }
+
+    HRESULT unregisterNotificationSink(DeviceNotificationSink* pSink)
+    {
+        std::lock_guard<std::mutex> guard(clientsLock);
+        auto it = clients.find(pSink);
+        if (it == clients.end())
+        {
+            return E_INVALIDARG;
+        }
+        HRESULT hr = pEnum->UnregisterEndpointNotificationCallback(it->second);
+        it->second->Release();
+        clients.erase(it);
+        return hr;
+    }
+
+private:
+    // Create the policy-config object on first use; every later call shares it. IPolicyConfig (Windows 7 and
+    // later) is preferred, since IPolicyConfigVista's format, period and visibility methods do not work on those
+    // systems; Vista only has the latter. The interface that worked is remembered across runs, so a Vista
+    // machine does not pay for a failed CoCreateInstance every time, and the other is only tried if it fails.
+    HRESULT createPolicyConfig()
+    {
+        if (pPolicyConfig != NULL || pPolicyConfigVista != NULL)
+        {
+            return S_OK;
+        }
+
+        EPolicyConfigInterface cached = loadPolicyConfigInterface();
+        EPolicyConfigInterface order[2] = { ePolicyConfigWin7, ePolicyConfigVista };
+        if (cached == ePolicyConfigVista)
+        {
+            order[0] = ePolicyConfigVista;
+            order[1] = ePolicyConfigWin7;
+        }
+
+        HRESULT hr = E_NOINTERFACE;
+        for (EPolicyConfigInterface candidate : order)
+        {
+            TraceSpan span(candidate == ePolicyConfigWin7 ? "CoCreateInstance(PolicyConfig)" : "CoCreateInstance(PolicyConfigVista)");
+            countEvent(eCounterCoCreateInstance);
+            hr = candidate == ePolicyConfigWin7
+                ? CoCreateInstance(__uuidof(CPolicyConfigClient), NULL, CLSCTX_ALL, __uuidof(IPolicyConfig), (LPVOID *)&pPolicyConfig)
+                : CoCreateInstance(__uuidof(CPolicyConfigVistaClient), NULL, CLSCTX_ALL, __uuidof(IPolicyConfigVista),
+                    (LPVOID *)&pPolicyConfigVista);
+            if (SUCCEEDED(hr))
+            {
+                if (candidate != cached)
+                {
+                    savePolicyConfigInterface(candidate);
+                }
+                break;
+            }
+        }
+        return hr;
+    }
+
+    // Describe a format as WAVEFORMATEXTENSIBLE, the only form that carries valid bits and speaker positions.
+    // Samples are stored in whole bytes, so 20-bit audio travels in a 24-bit container.
+    static void buildWaveFormat(const TAudioFormat& format, WAVEFORMATEXTENSIBLE& wave)
+    {
+        WORD containerBits = (WORD)((format.bitsPerSample + 7) / 8 * 8);
+        ZeroMemory(&wave, sizeof(wave));
+        wave.Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+        wave.Format.nChannels = (WORD)format.channels;
+        wave.Format.nSamplesPerSec = format.sampleRate;
+        wave.Format.wBitsPerSample = containerBits;
+        wave.Format.nBlockAlign = (WORD)(format.channels * containerBits / 8);
+        wave.Format.nAvgBytesPerSec = format.sampleRate * wave.Format.nBlockAlign;
+        wave.Format.cbSize = sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX);
+        wave.Samples.wValidBitsPerSample = (WORD)format.bitsPerSample;
+        wave.dwChannelMask = format.channelMask;
+
+        // KSDATAFORMAT_SUBTYPE_PCM or _IEEE_FLOAT: the plain format tag followed by a fixed suffix
+        static const GUID subFormatBase = { 0x00000000, 0x0000, 0x0010, { 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 } };
+        wave.SubFormat = subFormatBase;
+        wave.SubFormat.Data1 = format.isFloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+    }
+
+    // Activate the volume control of an endpoint through the given enumerator
+    static HRESULT activateEndpointVolume(IMMDeviceEnumerator* pEnumerator, LPCWSTR deviceID, IAudioEndpointVolume** ppVolume)
+    {
+        IMMDevice* pDevice = NULL;
+        HRESULT hr = pEnumerator->GetDevice(deviceID, &pDevice);
+        if (SUCCEEDED(hr))
+        {
+            TraceSpan span("Activate(IAudioEndpointVolume)");
+            hr = pDevice->Activate(__uuidof(IAudioEndpointVolume), CLSCTX_ALL, NULL, (void**)ppVolume);
+            pDevice->Release();
+        }
+        return hr;
+    }
+
+    static HRESULT activateSessionManager(IMMDeviceEnumerator* pEnumerator, LPCWSTR deviceID, IAudioSessionManager2** ppManager)
+    {
+        IMMDevice* pDevice = NULL;
+        HRESULT hr = pEnumerator->GetDevice(deviceID, &pDevice);
+        if (SUCCEEDED(hr))
+        {
+            TraceSpan span("Activate(IAudioSessionManager2)");
+            hr = pDevice->Activate(__uuidof(IAudioSessionManager2), CLSCTX_ALL, NULL, (void**)ppManager);
+            pDevice->Release();
+        }
+        return hr;
+    }
+
+    // A session shared by several processes reports AUDCLNT_S_NO_SINGLE_PROCESS along with one of their IDs
+    static HRESULT readSession(IAudioSessionControl* pControl, TAudioSession& session)
+    {
+        TraceSpan span("readSession");
+        AudioSessionState state = AudioSessionStateInactive;
+        HRESULT hr = pControl->GetState(&state);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        session.state = (ESessionState)state;
+
+        LPWSTR strName = NULL;
+        if (SUCCEEDED(pControl->GetDisplayName(&strName)))
+        {
+            session.displayName = strName;
+            CoTaskMemFree(strName);
+            countEvent(eCounterCoTaskMemFree);
+        }
+
+        IAudioSessionControl2* pControl2 = NULL;
+        if (SUCCEEDED(pControl->QueryInterface(__uuidof(IAudioSessionControl2), (void**)&pControl2)))
+        {
+            pControl2->GetProcessId(&session.processID);
+            pControl2->Release();
+        }
+
+        ISimpleAudioVolume* pVolume = NULL;
+        if (SUCCEEDED(pControl->QueryInterface(__uuidof(ISimpleAudioVolume), (void**)&pVolume)))
+        {
+            BOOL muted = FALSE;
+            pVolume->GetMasterVolume(&session.volume);
+            pVolume->GetMute(&muted);
+            session.muted = muted != FALSE;
+            pVolume->Release();
+        }
+        return S_OK;
+    }
+
+    // Session watchers must live in the multithreaded apartment, where the audio service can call them on its own
+    // threads. This thread keeps that apartment alive for as long as the backend lives, sets up every watcher,
+    // and takes them down at the end.
+    void sessionThreadMain()
+    {
+        HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+        bool uninitialize = SUCCEEDED(hr);
+        IMMDeviceEnumerator* pWatchEnum = NULL;
+        if (SUCCEEDED(hr))
+        {
+            countEvent(eCounterCoCreateInstance);
+            hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator),
+                (void**)&pWatchEnum);
+        }
+
+        std::map<std::wstring, CSessionWatcher*> watchers;
+        std::unique_lock<std::mutex> guard(sessionLock);
+        while (true)
+        {
+            if (sessionRequests.empty())
+            {
+                if (sessionStopping)
+                {
+                    break;
+                }
+                sessionSignal.wait(guard);
+                continue;
+            }
+
+            TSessionWatchRequest* pRequest = sessionRequests.front();
+            sessionRequests.pop_front();
+            guard.unlock();
+            HRESULT watchResult = hr;
+            if (SUCCEEDED(watchResult) && watchers.count(pRequest->deviceID) == 0)
+            {
+                watchResult = startSessionWatch(pWatchEnum, pRequest->deviceID.c_str(), watchers);
+            }
+            pRequest->result.set_value(watchResult);
+            guard.lock();
+        }
+        guard.unlock();
+
+        for (auto& watcher : watchers)
+        {
+            watcher.second->detach();
+            watcher.second->Release();
+        }
+        if (pWatchEnum != NULL)
+        {
+            pWatchEnum->Release();
+        }
+        if (uninitialize)
+        {
+            CoUninitialize();
+        }
+    }
+
+    HRESULT startSessionWatch(IMMDeviceEnumerator* pWatchEnum, LPCWSTR deviceID, std::map<std::wstring, CSessionWatcher*>& watchers)
+    {
+        IAudioSessionManager2* pManager = NULL;
+        HRESULT hr = activateSessionManager(pWatchEnum, deviceID, &pManager);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        CSessionWatcher* pWatcher = new CSessionWatcher(deviceID, deliverSessionsChanged, this);
+        hr = pWatcher->attach(pManager);
+        pManager->Release();
+        if (FAILED(hr))
+        {
+            pWatcher->detach();
+            pWatcher->Release();
+            return hr;
+        }
+        watchers[deviceID] = pWatcher;
+        return S_OK;
+    }
+
+    // Session changes go to the same sinks as endpoint changes
+    static void deliverSessionsChanged(void* pContext, LPCWSTR deviceID)
+    {
+        WasapiBackend* pBackend = (WasapiBackend*)pContext;
+        std::lock_guard<std::mutex> guard(pBackend->clientsLock);
+        for (auto& client : pBackend->clients)
+        {
+            client.first->onSessionsChanged(deviceID);
+        }
+    }
+
+    static HRESULT readEndpointVolume(IAudioEndpointVolume* pVolume, TEndpointVolume& volume)
+    {
+        TraceSpan span("GetMasterVolumeLevelScalar");
+        float level = 0;
+        BOOL muted = FALSE;
+        HRESULT hr = pVolume->GetMasterVolumeLevelScalar(&level);
+        if (SUCCEEDED(hr))
+        {
+            hr = pVolume->GetMute(&muted);
+        }
+        if (SUCCEEDED(hr))
+        {
+            volume.level = level;
+            volume.muted = muted != FALSE;
+        }
+        return hr;
+    }
+
+    // Read the ID, state and names of a device into a table entry
+    HRESULT readDeviceEntry(IMMDevice* pDevice, TDeviceEntry& entry)
+    {
+        TraceSpan span("readDeviceEntry");
+        LPWSTR strID = NULL;
+        HRESULT hr = pDevice->GetId(&strID);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        entry.id = strID;
+        CoTaskMemFree(strID);
+        countEvent(eCounterCoTaskMemFree);
+
+        hr = pDevice->GetState(&entry.state);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        IPropertyStore* pStore = NULL;
+        {
+            TraceSpan storeSpan("OpenPropertyStore");
+            countEvent(eCounterPropertyStoreOpens);
+            hr = pDevice->OpenPropertyStore(STGM_READ, &pStore);
+        }
+        if (SUCCEEDED(hr))
+        {
+            entry.friendlyName = getDeviceProperty(pStore, PKEY_Device_FriendlyName);
+            entry.description = getDeviceProperty(pStore, PKEY_Device_DeviceDesc);
+            entry.interfaceName = getDeviceProperty(pStore, PKEY_DeviceInterface_FriendlyName);
+            entry.formFactor = getDeviceUIntProperty(pStore, PKEY_AudioEndpoint_FormFactor, UnknownFormFactor);
+            entry.containerID = getDeviceGuidProperty(pStore, PKEY_Device_ContainerId);
+            pStore->Release();
+        }
+        return hr;
+    }
+
+    bool comInitialized;
+    IMMDeviceEnumerator* pEnum;
+    IPolicyConfig* pPolicyConfig;               // At most one of these is created
+    IPolicyConfigVista* pPolicyConfigVista;
+    std::mutex clientsLock;
+    std::map<DeviceNotificationSink*, CNotificationClient*> clients;
+
+    std::mutex sessionLock;
+    std::condition_variable sessionSignal;
+    std::deque<TSessionWatchRequest*> sessionRequests;
+    std::thread sessionThread;          // Started by the first watchSessions
+    bool sessionStopping;
+};
+
+// Create the WASAPI backend, initializing COM on the calling thread
+HRESULT createWasapiBackend(AudioBackend** ppBackend)
+{
+    WasapiBackend* pBackend = new WasapiBackend();
+    HRESULT hr = pBackend->initialize();
+    if (FAILED(hr))
+    {
+        delete pBackend;
+        return hr;
+    }
+    *ppBackend = pBackend;
+    return S_OK;
+}
+
+// Retrieve a property from the device's property store
+std::wstring getDeviceProperty(IPropertyStore* pStore, const PROPERTYKEY key)
+{
+    TraceSpan span("GetValue");
+    countEvent(eCounterGetValue);
+    PROPVARIANT prop;
+    PropVariantInit(&prop);
+    HRESULT hr = pStore->GetValue(key, &prop);
+    if (SUCCEEDED(hr))
+    {
+        std::wstring result(prop.vt == VT_LPWSTR && prop.pwszVal != NULL ? prop.pwszVal : L"");
+        // Frees the string with CoTaskMemFree
+        countEvent(eCounterCoTaskMemFree, prop.vt == VT_LPWSTR ? 1 : 0);
+        PropVariantClear(&prop);
+        return result;
+    }
+    return std::wstring(L"");
+}
+
+// Retrieve a VT_UI4 property from the device's property store
+UINT getDeviceUIntProperty(IPropertyStore* pStore, const PROPERTYKEY key, UINT defaultValue)
+{
+    TraceSpan span("GetValue");
+    countEvent(eCounterGetValue);
+    PROPVARIANT prop;
+    PropVariantInit(&prop);
+    UINT result = defaultValue;
+    if (SUCCEEDED(pStore->GetValue(key, &prop)) && prop.vt == VT_UI4)
+    {
+        result = prop.ulVal;
+    }
+    PropVariantClear(&prop);
+    return result;
+}
+
+// Retrieve a VT_CLSID property from the device's property store as a braced GUID string
+std::wstring getDeviceGuidProperty(IPropertyStore* pStore, const PROPERTYKEY key)
+{
+    TraceSpan span("GetValue");
+    countEvent(eCounterGetValue);
+    PROPVARIANT prop;
+    PropVariantInit(&prop);
+    std::wstring result;
+    if (SUCCEEDED(pStore->GetValue(key, &prop)) && prop.vt == VT_CLSID && prop.puuid != NULL)
+    {
+        wchar_t buffer[64];
+        if (StringFromGUID2(*prop.puuid, buffer, 64) > 0)
+        {
+            result = buffer;
+        }
+    }
+    countEvent(eCounterCoTaskMemFree, prop.vt == VT_CLSID ? 1 : 0);
+    PropVariantClear(&prop);
+    return result;
+}
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "Interrupt.h"
+#include "Output.h"
+#include "ResidentBackend.h"
+#include "Watch.h"
+
+typedef std::chrono::steady_clock WatchClock;
+
+// How often the printing thread re-checks for Ctrl+C and the timeout while idle
+#define WATCH_POLL_MS 100
+
+static const wchar_t* roleNames[] = { L"console", L"multimedia", L"communications" };
+
+// Wakes the printing thread. The notification thread only sets a flag and signals the condition variable,
+// never taking the mutex, so it cannot be held up by the printer.
+class ChangeSignal
+{
+public:
+    ChangeSignal() : pending(false) {}
+
+    static void notify(void* pContext)
+    {
+        ChangeSignal* pSignal = (ChangeSignal*)pContext;
+        pSignal->pending = true;
+        pSignal->signal.notify_one();
+    }
+
+    // Wait for a change. A notify landing between the check and the wait is picked up when the wait times out.
+    bool wait(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        signal.wait_for(guard, timeout, [this] { return pending.load(); });
+        return pending.exchange(false);
+    }
+
+private:
+    std::atomic<bool> pending;
+    std::mutex lock;
+    std::condition_variable signal;
+};
+
+// What the watch has printed so far for its data flow
+typedef struct TWatchState
+{
+    EDataFlow dataFlow;
+    DeviceTable devices;                        // Every endpoint, regardless of state
+    std::wstring defaults[ERole_enum_count];
+} TWatchState;
+
+static const TDeviceEntry* findEntry(const DeviceTable& devices, const std::wstring& deviceID)
+{
+    for (const auto& device : devices)
+    {
+        if (device.id == deviceID)
+        {
+            return &device;
+        }
+    }
+    return NULL;
+}
+
+// The index a listing with the same options would show for the device, 0 if it would not list it
+static int listingIndex(const DeviceTable& devices, const std::wstring& deviceID, DWORD stateFilter)
+{
+    int index = 0;
+    for (const auto& device : devices)
+    {
+        if ((device.state & stateFilter) == 0)
+            continue;
+
+        index++;
+        if (device.id == deviceID)
+        {
+            return index;
+        }
+    }
+    return 0;
+}
+
+static bool sameDetails(const TDeviceEntry& a, const TDeviceEntry& b)
+{
+    return a.friendlyName == b.friendlyName && a.description == b.description && a.interfaceName == b.interfaceName &&
+           a.formFactor == b.formFactor && a.containerID == b.containerID;
+}
+
+static void printEvent(TGlobalState* state, const TWatchState* pWatch, LPCWSTR eventName, LPCWSTR roleName,
+    const TDeviceEntry& device, int index)
+{
+    const std::wstring& defaultID = pWatch->defaults[eConsole];
+    if (state->json)
+    {
+        std::wstring line;
+        appendFormat(line, L"{\"event\":\"%ls\",\"flow\":\"%ls\",", eventName, pWatch->dataFlow == eRender ? L"render" : L"capture");
+        if (roleName != NULL)
+        {
+            appendFormat(line, L"\"role\":\"%ls\",", roleName);
+        }
+        appendDeviceJson(line, device, index, device.id == defaultID);
+        outputf(L"%ls}\n", line.c_str());
+    }
+    else
+    {
+        if (roleName != NULL)
+            outputf(L"%ls %ls: ", eventName, roleName);
+        else
+            outputf(L"%ls: ", eventName);
+        printDeviceInfo(device, index, state->deviceFormatStr.c_str(), defaultID.c_str());
+    }
+}
+
+// Apply the queued changes and print their net effect: a device that changed several times in the
+// coalescing window is reported once, comparing its entry before the window with the one after it
+static void printChanges(TGlobalState* state, ResidentBackend* pResident, TWatchState* pWatch)
+{
+    std::vector<TDeviceUpdate> updates;
+    pResident->applyPendingChanges(updates);
+
+    std::vector<std::wstring> touched;
+    std::vector<TDeviceEntry> before;
+    std::vector<int> beforeIndex;
+    std::vector<bool> existed;
+    std::wstring previousDefaults[ERole_enum_count];
+    for (int role = eConsole; role < ERole_enum_count; role++)
+    {
+        previousDefaults[role] = pWatch->defaults[role];
+    }
+
+    for (const auto& update : updates)
+    {
+        if (update.dataFlow != pWatch->dataFlow)
+            continue;
+
+        if (update.event == eDeviceEventDefaultChanged)
+        {
+            pWatch->defaults[update.role] = update.device.id;
+            continue;
+        }
+
+        bool seen = false;
+        for (const auto& deviceID : touched)
+        {
+            seen = seen || deviceID == update.device.id;
+        }
+        if (!seen)
+        {
+            const TDeviceEntry* pEntry = findEntry(pWatch->devices, update.device.id);
+            touched.push_back(update.device.id);
+            before.push_back(pEntry != NULL ? *pEntry : update.device);
+            beforeIndex.push_back(listingIndex(pWatch->devices, update.device.id, state->deviceStateFilter));
+            existed.push_back(pEntry != NULL);
+        }
+        updateDeviceTable(pWatch->devices, update.device, update.event == eDeviceEventRemoved);
+    }
+
+    for (size_t i = 0; i < touched.size(); i++)
+    {
+        const TDeviceEntry* pAfter = findEntry(pWatch->devices, touched[i]);
+        DWORD stateFilter = state->deviceStateFilter;
+        if ((!existed[i] || (before[i].state & stateFilter) == 0) && (pAfter == NULL || (pAfter->state & stateFilter) == 0))
+            continue;   // Not listed before or after
+
+        // A device that drops out of the listing keeps the index it was listed under
+        int index = pAfter != NULL ? listingIndex(pWatch->devices, touched[i], stateFilter) : 0;
+        if (index == 0)
+            index = beforeIndex[i];
+        if (!existed[i])
+            printEvent(state, pWatch, L"added", NULL, *pAfter, index);
+        else if (pAfter == NULL)
+            printEvent(state, pWatch, L"removed", NULL, before[i], index);
+        else if (pAfter->state != before[i].state)
+            printEvent(state, pWatch, L"state", NULL, *pAfter, index);
+        else if (!sameDetails(*pAfter, before[i]))
+            printEvent(state, pWatch, L"changed", NULL, *pAfter, index);
+    }
+
+    for (int role = eConsole; role < ERole_enum_count; role++)
+    {
+        if (pWatch->defaults[role] == previousDefaults[role])
+            continue;
+
+        TDeviceEntry device = {};
+        const TDeviceEntry* pEntry = findEntry(pWatch->devices, pWatch->defaults[role]);
+        if (pEntry != NULL)
+        {
+            device = *pEntry;
+        }
+        device.id = pWatch->defaults[role];
+        printEvent(state, pWatch, L"default", roleNames[role], device,
+            listingIndex(pWatch->devices, device.id, state->deviceStateFilter));
+    }
+
+    fflush(stdout);
+}
+
+HRESULT runWatch(TGlobalState* state, bool isOutput)
+{
+    // The backend's notification threads only queue changes; this thread applies and prints them
+    ResidentBackend resident(state->pBackend);
+    ChangeSignal changeSignal;
+    resident.setChangeHandler(ChangeSignal::notify, &changeSignal);
+    HRESULT hr = resident.initialize();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    TWatchState watch;
+    watch.dataFlow = isOutput ? eRender : eCapture;
+    resident.enumerateDevices(watch.dataFlow, DEVICE_STATEMASK_ALL, watch.devices);
+    for (int role = eConsole; role < ERole_enum_count; role++)
+    {
+        resident.getDefaultDeviceID(watch.dataFlow, (ERole)role, watch.defaults[role]);
+    }
+
+    InterruptScope interrupt;
+
+    WatchClock::time_point deadline = state->timeoutMs >= 0
+        ? WatchClock::now() + std::chrono::milliseconds(state->timeoutMs) : WatchClock::time_point::max();
+    while (!interrupt.isRequested())
+    {
+        WatchClock::time_point now = WatchClock::now();
+        if (now >= deadline)
+            break;
+
+        auto timeout = std::chrono::milliseconds(WATCH_POLL_MS);
+        if (deadline - now < timeout)
+            timeout = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) + std::chrono::milliseconds(1);
+        if (!changeSignal.wait(timeout))
+            continue;
+
+        // Let the rest of a burst arrive so it prints as one diff
+        if (state->coalesceMs > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(state->coalesceMs));
+        }
+        printChanges(state, &resident, &watch);
+    }
+
+    // Report what arrived during the last window
+    printChanges(state, &resident, &watch);
+    return S_OK;
+}
@@ -0,0 +1,15 @@
+// ----------------------------------------------------------------------------
+// Watch.h
+// --watch: stream endpoint additions, removals, state, name and default
+// changes of one data flow as they happen, as format-string or JSON lines.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include "EndPointController.h"
+
+#define WATCH_DEFAULT_COALESCE_MS 100
+
+// Print changes until interrupted or state->timeoutMs passes
+HRESULT runWatch(TGlobalState* state, bool isOutput);
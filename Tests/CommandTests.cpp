@@ -0,0 +1,114 @@
+// ----------------------------------------------------------------------------
+// CommandTests.cpp
+// Listing and switching through the command-line front end, on the
+// simulated backend.
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include "EndPointTests.h"
+
+static std::wstring defaultDevice(AudioBackend* pBackend, EDataFlow dataFlow, ERole role)
+{
+    std::wstring deviceID;
+    EXPECT(SUCCEEDED(pBackend->getDefaultDeviceID(dataFlow, role, deviceID)));
+    return deviceID;
+}
+
+static std::wstring deviceAt(AudioBackend* pBackend, EDataFlow dataFlow, size_t index)
+{
+    DeviceTable devices;
+    EXPECT(SUCCEEDED(pBackend->enumerateDevices(dataFlow, DEVICE_STATE_ACTIVE, devices)));
+    return index < devices.size() ? devices[index].id : std::wstring();
+}
+
+TEST(Command, ListsActiveDevices)
+{
+    AudioBackend* pBackend = createTestBackend("render=3,capture=2");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, {}, output) == S_OK);
+    EXPECT(output ==
+        L"Audio Device 1: Speakers (Simulated Audio Device 1)\n"
+        L"Audio Device 2: Headphones (Simulated Audio Device 2)\n"
+        L"Audio Device 3: HDMI Output (Simulated Audio Device 3)\n");
+
+    EXPECT(runTestCommand(pBackend, { L"--input", L"--default" }, output) == S_OK);
+    EXPECT(output == L"Audio Device 1: Microphone (Simulated Audio Device 1)\n");
+    releaseAudioBackend(pBackend);
+}
+
+TEST(Command, ListsJsonWithFormatAndVolume)
+{
+    AudioBackend* pBackend = createTestBackend("render=2,capture=1");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, { L"--json" }, output) == S_OK);
+    EXPECT(contains(output, L"{\"index\":1,\"name\":\"Speakers (Simulated Audio Device 1)\",\"state\":1,\"default\":true,"));
+    EXPECT(contains(output, L"{\"index\":2,\"name\":\"Headphones (Simulated Audio Device 2)\",\"state\":1,\"default\":false,"));
+    EXPECT(contains(output, L"\"sampleRate\":48000,\"channels\":2,\"bitsPerSample\":24,"));
+    EXPECT(contains(output, L"\"minimumPeriod\":30000,"));
+    EXPECT(contains(output, L"\"volume\":"));
+    releaseAudioBackend(pBackend);
+}
+
+TEST(Command, SwitchesByIndex)
+{
+    AudioBackend* pBackend = createTestBackend("render=3,capture=2");
+    std::wstring output;
+
+    // Index switching goes through the cache the listing writes
+    EXPECT(runTestCommand(pBackend, {}, output) == S_OK);
+    EXPECT(runTestCommand(pBackend, { L"2" }, output) == S_OK);
+    EXPECT(defaultDevice(pBackend, eRender, eConsole) == deviceAt(pBackend, eRender, 1));
+    EXPECT(runTestCommand(pBackend, { L"4" }, output) == E_INVALIDARG);
+    EXPECT(defaultDevice(pBackend, eRender, eConsole) == deviceAt(pBackend, eRender, 1));
+
+    // A capture switch moves every role
+    EXPECT(runTestCommand(pBackend, { L"--input" }, output) == S_OK);
+    EXPECT(runTestCommand(pBackend, { L"--input", L"2" }, output) == S_OK);
+    for (int role = eConsole; role < ERole_enum_count; role++)
+    {
+        EXPECT(defaultDevice(pBackend, eCapture, (ERole)role) == deviceAt(pBackend, eCapture, 1));
+    }
+    releaseAudioBackend(pBackend);
+}
+
+TEST(Command, SwitchesByRules)
+{
+    FILE* rulesFile = fopen("test.rules", "w");
+    fputs("# prefer headphones, then HDMI\n10 formfactor=hdmi\n100 formfactor=headphones name=\"Simulated Audio\"\n", rulesFile);
+    fclose(rulesFile);
+
+    AudioBackend* pBackend = createTestBackend("render=3");
+    std::wstring output;
+
+    // No listing first: the rules enumerate the devices themselves when there is no cache
+    EXPECT(runTestCommand(pBackend, { L"--rules", L"test.rules" }, output) == S_OK);
+    EXPECT(output == L"Selected device 2: Headphones (Simulated Audio Device 2) (priority 100)\n");
+    EXPECT(defaultDevice(pBackend, eRender, eConsole) == deviceAt(pBackend, eRender, 1));
+
+    rulesFile = fopen("none.rules", "w");
+    fputs("10 formfactor=handset\n", rulesFile);
+    fclose(rulesFile);
+    EXPECT(runTestCommand(pBackend, { L"--rules", L"none.rules" }, output) == E_NOTFOUND);
+    EXPECT(output == L"No active device matches the rules\n");
+    releaseAudioBackend(pBackend);
+}
+
+TEST(Command, RulesOnlyMatchActive)
+{
+    FILE* rulesFile = fopen("state.rules", "w");
+    fputs("10 state=active formfactor=headphones\n20 state=unplugged\n", rulesFile);
+    fclose(rulesFile);
+
+    AudioBackend* pBackend = createTestBackend("render=3");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, { L"--rules", L"state.rules" }, output) == E_INVALIDARG);
+    EXPECT(output == L"Invalid rule on line 2, only state=active can match in a rules file: 20 state=unplugged\n");
+    EXPECT(defaultDevice(pBackend, eRender, eConsole) == deviceAt(pBackend, eRender, 0));
+
+    rulesFile = fopen("state.rules", "w");
+    fputs("10 state=active formfactor=headphones\n", rulesFile);
+    fclose(rulesFile);
+    EXPECT(runTestCommand(pBackend, { L"--rules", L"state.rules" }, output) == S_OK);
+    EXPECT(defaultDevice(pBackend, eRender, eConsole) == deviceAt(pBackend, eRender, 1));
+    releaseAudioBackend(pBackend);
+}
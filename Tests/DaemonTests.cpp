@@ -0,0 +1,136 @@
+// ----------------------------------------------------------------------------
+// DaemonTests.cpp
+// The resident process on a thread of its own, under a channel name no other
+// test or running daemon uses: listings from its shared snapshot, switches
+// sent by a client and their outcome, and the fallback once it has shut
+// down.
+// ----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "EndPointTests.h"
+#include "../EndPointController/Daemon.h"
+#include "../EndPointController/Output.h"
+#include "../EndPointController/SharedSnapshot.h"
+
+typedef std::chrono::steady_clock DaemonClock;
+
+// Set, or with NULL remove, a variable the daemon and the client read
+static void setEnvironment(const char* name, const char* value)
+{
+#ifdef _WIN32
+    _putenv_s(name, value != NULL ? value : "");
+#else
+    if (value != NULL)
+        setenv(name, value, 1);
+    else
+        unsetenv(name);
+#endif
+}
+
+// Run a client request with the given arguments, as if typed after --client
+static HRESULT runTestClient(std::vector<LPCWSTR> arguments, std::wstring& output, bool* pServed)
+{
+    arguments.insert(arguments.begin(), L"--client");
+    arguments.insert(arguments.begin(), L"EndPointController");
+
+    output.clear();
+    beginOutputCapture(&output);
+    HRESULT hr = runClient((int)arguments.size(), arguments.data(), pServed);
+    endOutputCapture();
+    return hr;
+}
+
+// The snapshot, once the daemon has published one; NULL if it does not within the timeout
+static AudioBackend* waitForSnapshot(int timeoutMs)
+{
+    DaemonClock::time_point deadline = DaemonClock::now() + std::chrono::milliseconds(timeoutMs);
+    AudioBackend* pSnapshot = NULL;
+    while (FAILED(openSnapshotBackend(&pSnapshot)) && DaemonClock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return pSnapshot;
+}
+
+static std::wstring snapshotDefault(EDataFlow dataFlow)
+{
+    std::wstring deviceID;
+    AudioBackend* pSnapshot = waitForSnapshot(0);
+    if (pSnapshot != NULL)
+    {
+        pSnapshot->getDefaultDeviceID(dataFlow, eConsole, deviceID);
+        releaseAudioBackend(pSnapshot);
+    }
+    return deviceID;
+}
+
+TEST(Daemon, ServesAndFallsBack)
+{
+    std::string channelName = "EndPointTests." + std::to_string((unsigned long long)DaemonClock::now().time_since_epoch().count());
+    setEnvironment("EPC_IPC_NAME", channelName.c_str());
+    setEnvironment("EPC_SIMULATE", "render=3,capture=1");
+
+    HRESULT daemonResult = E_FAIL;
+    std::wstring daemonOutput;
+    std::thread daemon([&]
+    {
+        LPCWSTR argv[] = { L"EndPointController", L"--daemon" };
+        TGlobalState state = TGlobalState();
+        bool isOutput = true;
+        beginOutputCapture(&daemonOutput);
+        daemonResult = parseArguments(&state, 2, argv, &isOutput);
+        if (daemonResult == S_OK)
+        {
+            daemonResult = runDaemon(&state);
+        }
+        endOutputCapture();
+    });
+
+    // A plain listing reads the published tables
+    AudioBackend* pSnapshot = waitForSnapshot(5000);
+    EXPECT(pSnapshot != NULL);
+    std::wstring output;
+    if (pSnapshot != NULL)
+    {
+        EXPECT(runTestCommand(pSnapshot, {}, output) == S_OK);
+        EXPECT(output ==
+            L"Audio Device 1: Speakers (Simulated Audio Device 1)\n"
+            L"Audio Device 2: Headphones (Simulated Audio Device 2)\n"
+            L"Audio Device 3: HDMI Output (Simulated Audio Device 3)\n");
+        releaseAudioBackend(pSnapshot);
+    }
+    std::wstring firstDefault = snapshotDefault(eRender);
+
+    // The daemon queues the switch, makes it when the switch window closes and republishes the new default
+    bool served = false;
+    EXPECT(runTestClient({ L"2" }, output, &served) == S_OK);
+    EXPECT(served);
+    DaemonClock::time_point deadline = DaemonClock::now() + std::chrono::seconds(2);
+    while (snapshotDefault(eRender) == firstDefault && DaemonClock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT(snapshotDefault(eRender) != firstDefault);
+    EXPECT(runTestClient({ L"--switch-status" }, output, &served) == S_OK);
+    EXPECT(served && output == L"Switches: 1 requests, 1 calls, 0 merged, 0 dropped, 0 failed\n");
+
+    EXPECT(runTestClient({ L"--json" }, output, &served) == S_OK);
+    EXPECT(served && contains(output, L"{\"index\":2,\"name\":\"Headphones (Simulated Audio Device 2)\",\"state\":1,\"default\":true,"));
+
+    EXPECT(runTestClient({ L"--shutdown" }, output, &served) == S_OK);
+    EXPECT(served && contains(output, L"Resident process stopped: 1 switch requests, 1 calls, 0 merged, 0 dropped, 0 failed\n"));
+    daemon.join();
+    EXPECT(daemonResult == S_OK);
+    EXPECT(contains(daemonOutput, L"Resident process listening on "));
+
+    // With the daemon gone the snapshot is withdrawn and clients run the request themselves
+    EXPECT(openSnapshotBackend(&pSnapshot) == E_NOTFOUND);
+    EXPECT(runTestClient({}, output, &served) == S_OK);
+    EXPECT(!served && output.empty());
+
+    setEnvironment("EPC_SIMULATE", NULL);
+    setEnvironment("EPC_IPC_NAME", NULL);
+}
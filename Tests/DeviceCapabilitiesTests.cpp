@@ -0,0 +1,78 @@
+// ----------------------------------------------------------------------------
+// DeviceCapabilitiesTests.cpp
+// --capabilities on the simulated backend: the probed matrix for shared and
+// exclusive use, and when the capabilities cache is used or bypassed.
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include "EndPointTests.h"
+#include "../EndPointController/DeviceCapabilities.h"
+
+TEST(DeviceCapabilities, ProbesMatrix)
+{
+    std::vector<TAudioFormat> formats;
+    buildCapabilityMatrix(formats);
+    EXPECT(formats.size() == 6 * 4 * 4);
+
+    // The speakers are 48 kHz, 24-bit stereo: shared mode takes that or float samples, exclusive mode any
+    // listed rate with 16- or 24-bit samples in the device's own layout
+    AudioBackend* pBackend = createTestBackend("render=3");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, { L"--capabilities", L"1" }, output) == S_OK);
+    EXPECT(contains(output, L"Device 1: Speakers (Simulated Audio Device 1): driver 10.0.1.1, share mode 1, probed in "));
+    EXPECT(contains(output, L"   48000/24      .     B     .     .\n"));
+    EXPECT(contains(output, L"   48000/32f     .     S     .     .\n"));
+    EXPECT(contains(output, L"   48000/16      .     E     .     .\n"));
+    EXPECT(contains(output, L"  192000/24      .     E     .     .\n"));
+    EXPECT(contains(output, L"   44100/32      .     .     .     .\n"));
+    EXPECT(contains(output, L"Probed 1 devices (0 cached) on 1 threads"));
+
+    // HDMI is 8 channels and left shared only
+    EXPECT(runTestCommand(pBackend, { L"--capabilities", L"3", L"--json" }, output) == S_OK);
+    EXPECT(contains(output, L"\"driverVersion\":\"10.0.1.3\",\"shareMode\":0,\"cached\":false,"));
+    EXPECT(contains(output, L"{\"sampleRate\":48000,\"bitsPerSample\":24,\"float\":false,\"channels\":8,\"shared\":true,\"exclusive\":true}"));
+    EXPECT(contains(output, L"{\"sampleRate\":96000,\"bitsPerSample\":16,\"float\":false,\"channels\":8,\"shared\":false,\"exclusive\":true}"));
+    EXPECT(!contains(output, L"\"channels\":2,"));
+    releaseAudioBackend(pBackend);
+}
+
+TEST(DeviceCapabilities, ReprobesOnChange)
+{
+    AudioBackend* pBackend = createTestBackend("render=2");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, { L"--capabilities" }, output) == S_OK);
+    EXPECT(contains(output, L"Probed 2 devices (0 cached)"));
+
+    EXPECT(runTestCommand(pBackend, { L"--capabilities" }, output) == S_OK);
+    EXPECT(contains(output, L"Device 1: Speakers (Simulated Audio Device 1): driver 10.0.1.1, share mode 1, cached\n"));
+    EXPECT(contains(output, L"   48000/24      .     B     .     .\n"));
+    EXPECT(contains(output, L"Probed 2 devices (2 cached)"));
+
+    // Entries recorded under another driver version are probed again, and rewritten with the current one
+    std::string content = readWholeFile(CAPABILITIES_CACHE_FILE);
+    size_t pos = content.find("|10.0.1.1|");
+    EXPECT(pos != std::string::npos);
+    if (pos != std::string::npos)
+    {
+        content.replace(pos, 10, "|10.0.1.0|");
+        FILE* cacheFile = fopen(CAPABILITIES_CACHE_FILE, "wb");
+        fwrite(content.data(), 1, content.size(), cacheFile);
+        fclose(cacheFile);
+    }
+    EXPECT(runTestCommand(pBackend, { L"--capabilities" }, output) == S_OK);
+    EXPECT(contains(output, L"Device 1: Speakers (Simulated Audio Device 1): driver 10.0.1.1, share mode 1, probed in "));
+    EXPECT(contains(output, L"Device 2: Headphones (Simulated Audio Device 2): driver 10.0.1.2, share mode 1, cached\n"));
+    EXPECT(contains(output, L"Probed 2 devices (1 cached)"));
+    EXPECT(readWholeFile(CAPABILITIES_CACHE_FILE).find("|10.0.1.1|") != std::string::npos);
+
+    // A new current format changes what shared mode takes, so the device is probed again
+    EXPECT(runTestCommand(pBackend, { L"--set-format", L"44100/16", L"1" }, output) == S_OK);
+    EXPECT(runTestCommand(pBackend, { L"--capabilities" }, output) == S_OK);
+    EXPECT(contains(output, L"Device 1: Speakers (Simulated Audio Device 1): driver 10.0.1.1, share mode 1, probed in "));
+    EXPECT(contains(output, L"   44100/16      .     B     .     .\n"));
+    EXPECT(contains(output, L"Probed 2 devices (1 cached)"));
+
+    EXPECT(runTestCommand(pBackend, { L"--capabilities" }, output) == S_OK);
+    EXPECT(contains(output, L"Probed 2 devices (2 cached)"));
+    releaseAudioBackend(pBackend);
+}
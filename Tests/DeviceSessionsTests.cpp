@@ -0,0 +1,86 @@
+// ----------------------------------------------------------------------------
+// DeviceSessionsTests.cpp
+// --sessions on the simulated backend, directly and through the resident
+// backend, which keeps each device's sessions once read and re-reads them
+// when a session notification arrives.
+// ----------------------------------------------------------------------------
+
+#include <chrono>
+#include <thread>
+#include "EndPointTests.h"
+#include "../EndPointController/ResidentBackend.h"
+
+typedef std::chrono::steady_clock SessionsTestClock;
+
+// The state of the speakers' application session as the backend reads it now
+static ESessionState speakersApplicationState(AudioBackend* pBackend)
+{
+    DeviceTable devices;
+    SessionTable sessions;
+    if (FAILED(pBackend->enumerateDevices(eRender, DEVICE_STATE_ACTIVE, devices)) || devices.empty() ||
+        FAILED(pBackend->getSessions(devices[0].id.c_str(), sessions)) || sessions.empty())
+    {
+        return eSessionExpired;
+    }
+    return sessions.back().state;
+}
+
+TEST(DeviceSessions, ListsSessions)
+{
+    AudioBackend* pBackend = createTestBackend("render=3,capture=1");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, { L"--sessions" }, output) == S_OK);
+    EXPECT(contains(output, L"Device 1: Speakers (Simulated Audio Device 1): 2 sessions in "));
+    EXPECT(contains(output, L" ms\n    System Sounds (pid 0): inactive, 100%\n    Media Player (pid 4100): active, 100%\n"));
+    EXPECT(contains(output, L"    Voice Chat (pid 4200): inactive, 50%\n"));
+    EXPECT(contains(output, L"    (unnamed) (pid 4300): inactive, 100%\n"));
+    EXPECT(contains(output, L"Found 6 sessions on 3 devices (0 cached) on "));
+
+    // Capture devices have no System Sounds session
+    EXPECT(runTestCommand(pBackend, { L"--sessions", L"--input", L"--json" }, output) == S_OK);
+    EXPECT(contains(output, L"{\"index\":1,\"name\":\"Microphone (Simulated Audio Device 1)\","));
+    EXPECT(contains(output, L"\"cached\":false,"));
+    EXPECT(contains(output, L"\"sessions\":[{\"pid\":4200,\"name\":\"Voice Chat\",\"state\":\"active\",\"volume\":50,\"muted\":false}]}\n"));
+    EXPECT(!contains(output, L"Found "));
+    releaseAudioBackend(pBackend);
+}
+
+TEST(DeviceSessions, ResidentKeepsSessions)
+{
+    // The speakers' application session starts or stops every 200 ms
+    AudioBackend* pInner = createTestBackend("render=2,session_toggle_ms=200");
+    ResidentBackend* pResident = new ResidentBackend(pInner);
+    EXPECT(SUCCEEDED(pResident->initialize()));
+    std::wstring output;
+    EXPECT(runTestCommand(pResident, { L"--sessions", L"1" }, output) == S_OK);
+    EXPECT(contains(output, L"Device 1: Speakers (Simulated Audio Device 1): 2 sessions in "));
+    EXPECT(contains(output, L"Found 2 sessions on 1 devices (0 cached)"));
+
+    // Read once, they come from the table
+    EXPECT(runTestCommand(pResident, { L"--sessions" }, output) == S_OK);
+    EXPECT(contains(output, L"Device 1: Speakers (Simulated Audio Device 1): 2 sessions, cached\n"));
+    EXPECT(contains(output, L"Device 2: Headphones (Simulated Audio Device 2): 2 sessions in "));
+    EXPECT(contains(output, L"Found 4 sessions on 2 devices (1 cached)"));
+
+    // Once the session has stopped, its notification re-reads the speakers' sessions, and the table says so
+    SessionsTestClock::time_point deadline = SessionsTestClock::now() + std::chrono::seconds(2);
+    while (speakersApplicationState(pInner) != eSessionInactive && SessionsTestClock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    bool reread = false;
+    deadline = SessionsTestClock::now() + std::chrono::milliseconds(150);
+    while (!reread && SessionsTestClock::now() < deadline)
+    {
+        std::vector<TDeviceUpdate> updates;
+        pResident->applyPendingChanges(updates);
+        EXPECT(runTestCommand(pResident, { L"--sessions", L"1" }, output) == S_OK);
+        reread = contains(output, L"    Media Player (pid 4100): inactive, 100%\n");
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT(reread);
+    EXPECT(contains(output, L"2 sessions, cached\n"));
+
+    delete pResident;
+    releaseAudioBackend(pInner);
+}
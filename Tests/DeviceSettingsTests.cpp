@@ -0,0 +1,80 @@
+// ----------------------------------------------------------------------------
+// DeviceSettingsTests.cpp
+// --set-period on the simulated backend, whose endpoints have a 3 ms or a
+// 10 ms minimum period and round periods to whole 16-frame multiples.
+// ----------------------------------------------------------------------------
+
+#include "EndPointTests.h"
+
+static INT64 currentPeriod(AudioBackend* pBackend, size_t index)
+{
+    DeviceTable devices;
+    EXPECT(SUCCEEDED(pBackend->enumerateDevices(eRender, DEVICE_STATE_ACTIVE, devices)));
+    TProcessingPeriod period;
+    EXPECT(index < devices.size() && SUCCEEDED(pBackend->getProcessingPeriod(devices[index].id.c_str(), period)));
+    return period.currentPeriod;
+}
+
+TEST(DeviceSettings, ResolvesNamedPeriods)
+{
+    // Speakers and headphones go down to 3 ms; HDMI and the headset only have the 10 ms default
+    AudioBackend* pBackend = createTestBackend("render=4");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, { L"--set-period", L"min" }, output) == S_OK);
+    EXPECT(contains(output, L"Device 1: Speakers (Simulated Audio Device 1): 3.00 ms: changed from 10.00 ms"));
+    EXPECT(contains(output, L"Device 3: HDMI Output (Simulated Audio Device 3): 10.00 ms: already set"));
+    EXPECT(contains(output, L"Changed 2, skipped 2, failed 0 of 4 devices"));
+    EXPECT(currentPeriod(pBackend, 0) == 30000);
+    EXPECT(currentPeriod(pBackend, 2) == 100000);
+
+    EXPECT(runTestCommand(pBackend, { L"--set-period", L"default" }, output) == S_OK);
+    EXPECT(contains(output, L"Device 1: Speakers (Simulated Audio Device 1): 10.00 ms: changed from 3.00 ms"));
+    EXPECT(contains(output, L"Changed 2, skipped 2, failed 0 of 4 devices"));
+    EXPECT(currentPeriod(pBackend, 0) == 100000);
+    releaseAudioBackend(pBackend);
+}
+
+TEST(DeviceSettings, SetsMilliseconds)
+{
+    AudioBackend* pBackend = createTestBackend("render=4");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, { L"--set-period", L"5" }, output) == E_INVALIDARG);
+    EXPECT(contains(output, L"Device 1: Speakers (Simulated Audio Device 1): 5.00 ms: changed from 10.00 ms"));
+    EXPECT(contains(output, L"Device 3: HDMI Output (Simulated Audio Device 3): 5.00 ms: failed (0x80070057)"));
+    EXPECT(contains(output, L"Changed 2, skipped 0, failed 2 of 4 devices"));
+    EXPECT(currentPeriod(pBackend, 0) == 50000);
+    EXPECT(currentPeriod(pBackend, 2) == 100000);
+    releaseAudioBackend(pBackend);
+}
+
+TEST(DeviceSettings, VerifyReportsRounding)
+{
+    // 3 ms is 144 frames at 48 kHz, but 132.3 at the headphones' 44.1 kHz, which rounds up to 144 frames
+    AudioBackend* pBackend = createTestBackend("render=2");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, { L"--set-period", L"3", L"--verify" }, output) == S_OK);
+    EXPECT(contains(output, L"Device 1: Speakers (Simulated Audio Device 1): 3.00 ms: changed from 10.00 ms, "
+        L"effective 3.00 ms (minimum 3.00 ms, default 10.00 ms)"));
+    EXPECT(contains(output, L"Device 2: Headphones (Simulated Audio Device 2): 3.00 ms: changed from 10.00 ms, "
+        L"effective 3.27 ms (minimum 3.00 ms, default 10.00 ms)"));
+    EXPECT(currentPeriod(pBackend, 1) == 144 * 10000000LL / 44100);
+
+    // Without --verify the effective period is not read back
+    EXPECT(runTestCommand(pBackend, { L"--set-period", L"4" }, output) == S_OK);
+    EXPECT(!contains(output, L"effective"));
+    releaseAudioBackend(pBackend);
+}
+
+TEST(DeviceSettings, SkipsDevicesAtTarget)
+{
+    AudioBackend* pBackend = createTestBackend("render=4");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, { L"--set-period", L"5", L"--match", L"formfactor=speakers" }, output) == S_OK);
+    EXPECT(contains(output, L"Changed 1, skipped 0, failed 0 of 1 devices"));
+
+    EXPECT(runTestCommand(pBackend, { L"--set-period", L"5", L"--match", L"formfactor=speakers" }, output) == S_OK);
+    EXPECT(contains(output, L"Device 1: Speakers (Simulated Audio Device 1): 5.00 ms: already set"));
+    EXPECT(contains(output, L"Changed 0, skipped 1, failed 0 of 1 devices"));
+    EXPECT(currentPeriod(pBackend, 0) == 50000);
+    releaseAudioBackend(pBackend);
+}
@@ -0,0 +1,104 @@
+// ----------------------------------------------------------------------------
+// DeviceVolumeTests.cpp
+// --volume, --set-volume, --mute and --unmute on the simulated backend,
+// whose playback devices start at 80% and capture devices at 60%, and the
+// listing fields that read the volume only when a format uses them.
+// ----------------------------------------------------------------------------
+
+#include "EndPointTests.h"
+
+TEST(DeviceVolume, ReportsVolume)
+{
+    AudioBackend* pBackend = createTestBackend("render=2,capture=1");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, { L"--volume" }, output) == S_OK);
+    EXPECT(output ==
+        L"Device 1: Speakers (Simulated Audio Device 1): 80%\n"
+        L"Device 2: Headphones (Simulated Audio Device 2): 80%\n");
+
+    EXPECT(runTestCommand(pBackend, { L"--volume", L"--input", L"--json" }, output) == S_OK);
+    EXPECT(contains(output, L"{\"index\":1,\"name\":\"Microphone (Simulated Audio Device 1)\","));
+    EXPECT(contains(output, L",\"volume\":60,\"muted\":false}\n"));
+    releaseAudioBackend(pBackend);
+}
+
+TEST(DeviceVolume, SetsVolumeAndSkipsSame)
+{
+    AudioBackend* pBackend = createTestBackend("render=3");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, { L"--set-volume", L"25", L"--match", L"formfactor=speakers" }, output) == S_OK);
+    EXPECT(contains(output, L"Device 1: Speakers (Simulated Audio Device 1): 25%: changed from 80% ("));
+    EXPECT(contains(output, L"Changed 1, skipped 0, failed 0 of 1 devices on 1 threads"));
+
+    // A device already at the requested volume is left alone and reported as such
+    EXPECT(runTestCommand(pBackend, { L"--set-volume", L"25" }, output) == S_OK);
+    EXPECT(contains(output, L"Device 1: Speakers (Simulated Audio Device 1): 25%: already set ("));
+    EXPECT(contains(output, L"Device 2: Headphones (Simulated Audio Device 2): 25%: changed from 80% ("));
+    EXPECT(contains(output, L"Changed 2, skipped 1, failed 0 of 3 devices"));
+
+    EXPECT(runTestCommand(pBackend, { L"--set-volume", L"101" }, output) == E_INVALIDARG);
+    EXPECT(output == L"Missing or invalid volume (0 to 100)");
+    releaseAudioBackend(pBackend);
+}
+
+TEST(DeviceVolume, MutesAndUnmutes)
+{
+    AudioBackend* pBackend = createTestBackend("render=2,capture=1");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, { L"--mute" }, output) == S_OK);
+    EXPECT(contains(output, L"Device 1: Speakers (Simulated Audio Device 1): 80%, muted: changed from 80% ("));
+    EXPECT(contains(output, L"Changed 2, skipped 0, failed 0 of 2 devices"));
+    EXPECT(runTestCommand(pBackend, { L"--mute" }, output) == S_OK);
+    EXPECT(contains(output, L"Device 2: Headphones (Simulated Audio Device 2): 80%, muted: already set ("));
+    EXPECT(contains(output, L"Changed 0, skipped 2, failed 0 of 2 devices"));
+
+    // The two combine into one update, and --json says which devices it changed
+    EXPECT(runTestCommand(pBackend, { L"--unmute", L"--set-volume", L"40", L"--json", L"1" }, output) == S_OK);
+    EXPECT(contains(output, L"\"volume\":40,\"muted\":false,\"previousVolume\":80,\"previouslyMuted\":true,\"changed\":true,"));
+    EXPECT(runTestCommand(pBackend, { L"--unmute", L"--set-volume", L"40", L"--json", L"1" }, output) == S_OK);
+    EXPECT(contains(output, L"\"volume\":40,\"muted\":false,\"previousVolume\":40,\"previouslyMuted\":false,\"changed\":false,"));
+
+    EXPECT(runTestCommand(pBackend, { L"--volume" }, output) == S_OK);
+    EXPECT(output ==
+        L"Device 1: Speakers (Simulated Audio Device 1): 40%\n"
+        L"Device 2: Headphones (Simulated Audio Device 2): 80%, muted\n");
+
+    // Capture devices are untouched by all of it
+    EXPECT(runTestCommand(pBackend, { L"--volume", L"--input" }, output) == S_OK);
+    EXPECT(output == L"Device 1: Microphone (Simulated Audio Device 1): 60%\n");
+    releaseAudioBackend(pBackend);
+}
+
+TEST(DeviceVolume, ListingReadsVolumeWhenUsed)
+{
+    // Only the last two fields of a format string, and --json, need the volume
+    const wchar_t* volumeFormat = L"%d %ls %d %d %.0ls%.0ls%.0ls%d %d %d %x %d %d %d %d %d";
+    const wchar_t* periodFormat = L"%d %ls %d %d %.0ls%.0ls%.0ls%d %d %d %x %d %d %d";
+    struct
+    {
+        std::vector<LPCWSTR> arguments;
+        bool needsVolume;
+    } listings[] = {
+        { {}, false },
+        { { L"-f", periodFormat }, false },
+        { { L"-f", volumeFormat }, true },
+        { { L"--json" }, true },
+    };
+    for (const auto& listing : listings)
+    {
+        std::vector<LPCWSTR> argv = listing.arguments;
+        argv.insert(argv.begin(), L"EndPointController");
+        TGlobalState state = TGlobalState();
+        bool isOutput = true;
+        EXPECT(parseArguments(&state, (int)argv.size(), argv.data(), &isOutput) == S_OK);
+        EXPECT(listingNeedsVolume(&state) == listing.needsVolume);
+    }
+
+    AudioBackend* pBackend = createTestBackend("render=2");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, { L"--mute", L"2" }, output) == S_OK);
+    EXPECT(runTestCommand(pBackend, { L"-f", volumeFormat }, output) == S_OK);
+    EXPECT(contains(output, L"1 Speakers (Simulated Audio Device 1) 1 1 48000 2 24 3 100000 30000 100000 80 0\n"));
+    EXPECT(contains(output, L"2 Headphones (Simulated Audio Device 2) 1 0 44100 2 16 3 100000 30000 100000 80 1\n"));
+    releaseAudioBackend(pBackend);
+}
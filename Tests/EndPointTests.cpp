@@ -0,0 +1,126 @@
+// ----------------------------------------------------------------------------
+// EndPointTests.cpp
+// Runs the registered tests, or those whose name contains the filter, and
+// prints one line per test. Exits non-zero if any test failed.
+//
+// Usage: EndPointTests [--filter text]
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "EndPointTests.h"
+#include "../Benchmarks/WorkDirectory.h"
+#include "../EndPointController/Output.h"
+
+typedef std::chrono::steady_clock TestClock;
+
+typedef struct TRegisteredTest
+{
+    const char* name;
+    TestFunction function;
+} TRegisteredTest;
+
+// Constructed on first use, since registrations run during static initialization of every file
+static std::vector<TRegisteredTest>& registeredTests()
+{
+    static std::vector<TRegisteredTest> tests;
+    return tests;
+}
+
+static int failedExpectations = 0;
+
+TestRegistration::TestRegistration(const char* name, TestFunction function)
+{
+    registeredTests().push_back({ name, function });
+}
+
+void expectTrue(bool condition, const char* text, const char* file, int line)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "%s:%d: expected %s\n", file, line, text);
+        failedExpectations++;
+    }
+}
+
+AudioBackend* createTestBackend(const char* spec)
+{
+    AudioBackend* pBackend = NULL;
+    HRESULT hr = createSimulatedBackend(spec, &pBackend);
+    EXPECT(SUCCEEDED(hr) && pBackend != NULL);
+    return pBackend;
+}
+
+HRESULT runTestCommand(AudioBackend* pBackend, std::vector<LPCWSTR> arguments, std::wstring& output)
+{
+    bool isOutput = true;
+    arguments.insert(arguments.begin(), L"EndPointController");
+    TGlobalState state = TGlobalState();
+
+    output.clear();
+    beginOutputCapture(&output);
+    HRESULT hr = parseArguments(&state, (int)arguments.size(), arguments.data(), &isOutput);
+    if (hr == S_OK)
+    {
+        state.pBackend = pBackend;
+        hr = runCommand(&state, isOutput);
+    }
+    endOutputCapture();
+    return hr;
+}
+
+bool contains(const std::wstring& text, LPCWSTR part)
+{
+    return text.find(part) != std::wstring::npos;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* filter = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: EndPointTests [--filter text]\n");
+            return 1;
+        }
+    }
+
+    WorkDirectory workDirectory("EndPointTests");
+    int run = 0;
+    int failed = 0;
+    for (const auto& test : registeredTests())
+    {
+        if (filter != NULL && strstr(test.name, filter) == NULL)
+        {
+            continue;
+        }
+
+        // A directory per test, so no test starts with another's device cache
+        std::filesystem::path testDirectory = workDirectory.getPath() / std::to_string(run);
+        std::filesystem::create_directory(testDirectory);
+        std::filesystem::current_path(testDirectory);
+
+        int failedBefore = failedExpectations;
+        TestClock::time_point start = TestClock::now();
+        test.function();
+        double elapsedMs = std::chrono::duration<double, std::milli>(TestClock::now() - start).count();
+
+        bool passed = failedExpectations == failedBefore;
+        printf("%-4s %-40s %8.1f ms\n", passed ? "ok" : "FAIL", test.name, elapsedMs);
+        fflush(stdout);
+        run++;
+        failed += passed ? 0 : 1;
+    }
+
+    printf("%d tests, %d failed\n", run, failed);
+    return failed != 0 || run == 0 ? 1 : 0;
+}
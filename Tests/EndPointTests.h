@@ -0,0 +1,43 @@
+// ----------------------------------------------------------------------------
+// EndPointTests.h
+// A minimal test harness for the portable build. Tests register themselves
+// under a "Group/Name" and run against the simulated backend, each in a
+// fresh working directory so the cache files of one test never reach the
+// next. A failed EXPECT is reported with its file and line and the test
+// carries on; the run fails if any expectation did.
+// ----------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "../EndPointController/EndPointController.h"
+
+typedef void (*TestFunction)();
+
+// Adds a test to the run at static initialization
+class TestRegistration
+{
+public:
+    TestRegistration(const char* name, TestFunction function);
+};
+
+#define TEST(group, name)                                                                       \
+    static void test_##group##_##name();                                                        \
+    static TestRegistration registration_##group##_##name(#group "/" #name, test_##group##_##name); \
+    static void test_##group##_##name()
+
+// Record a failure unless the condition holds
+#define EXPECT(condition) expectTrue((condition), #condition, __FILE__, __LINE__)
+
+void expectTrue(bool condition, const char* text, const char* file, int line);
+
+// Create the simulated backend for spec, failing the test if it cannot be
+AudioBackend* createTestBackend(const char* spec);
+
+// Parse a command line as the tool does and run it against pBackend, capturing everything it prints
+HRESULT runTestCommand(AudioBackend* pBackend, std::vector<LPCWSTR> arguments, std::wstring& output);
+
+// Whether text contains part
+bool contains(const std::wstring& text, LPCWSTR part);
@@ -0,0 +1,85 @@
+// ----------------------------------------------------------------------------
+// IdleSwitchTests.cpp
+// --when-idle on the simulated backend, where only the first endpoint's
+// application session plays at the start and each endpoint's meter shows a
+// signal for the first 70% of a cycle of 2 s plus 1 s per endpoint number.
+// ----------------------------------------------------------------------------
+
+#include <chrono>
+#include <thread>
+#include "EndPointTests.h"
+
+typedef std::chrono::steady_clock IdleTestClock;
+
+// The ID of the playback endpoint listed at index, counting from 1
+static std::wstring renderDeviceID(AudioBackend* pBackend, size_t index)
+{
+    DeviceTable devices;
+    if (FAILED(pBackend->enumerateDevices(eRender, DEVICE_STATE_ACTIVE, devices)) || devices.size() < index)
+    {
+        return std::wstring();
+    }
+    return devices[index - 1].id;
+}
+
+static std::wstring renderDefault(AudioBackend* pBackend)
+{
+    std::wstring deviceID;
+    pBackend->getDefaultDeviceID(eRender, eConsole, deviceID);
+    return deviceID;
+}
+
+TEST(IdleSwitch, SwitchesWhenIdle)
+{
+    AudioBackend* pBackend = createTestBackend("render=2");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, {}, output) == S_OK);
+    EXPECT(runTestCommand(pBackend, { L"2" }, output) == S_OK);
+
+    // The headphones play no session; wait for their meter to go quiet, 2.1 s into its 3 s cycle
+    PeakMeter* pMeter = NULL;
+    EXPECT(SUCCEEDED(pBackend->openPeakMeter(renderDeviceID(pBackend, 2).c_str(), &pMeter)));
+    IdleTestClock::time_point deadline = IdleTestClock::now() + std::chrono::milliseconds(3500);
+    float peak = 1;
+    while (pMeter != NULL && SUCCEEDED(pMeter->getPeakValue(&peak)) && peak > 0 && IdleTestClock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    delete pMeter;
+    EXPECT(peak == 0);
+
+    EXPECT(runTestCommand(pBackend, { L"--when-idle", L"100", L"1" }, output) == S_OK);
+    EXPECT(contains(output, L"Waiting for Headphones (Simulated Audio Device 2) to be idle for 100 ms\n"));
+    EXPECT(contains(output, L" ms (activity seen 0 times)\n"));
+    EXPECT(renderDefault(pBackend) == renderDeviceID(pBackend, 1));
+    releaseAudioBackend(pBackend);
+}
+
+TEST(IdleSwitch, TimeoutKeepsDefault)
+{
+    // The speakers' media player plays throughout
+    AudioBackend* pBackend = createTestBackend("render=2");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, {}, output) == S_OK);
+    EXPECT(runTestCommand(pBackend, { L"--when-idle", L"100", L"--timeout", L"200", L"2" }, output) ==
+        HRESULT_FROM_WIN32(ERROR_TIMEOUT));
+    EXPECT(contains(output, L"Not idle within 200 ms, default left unchanged; last activity: "
+        L"Media Player (pid 4100) active on Speakers (Simulated Audio Device 1)\n"));
+    EXPECT(!contains(output, L"Idle after"));
+    EXPECT(renderDefault(pBackend) == renderDeviceID(pBackend, 1));
+    releaseAudioBackend(pBackend);
+}
+
+TEST(IdleSwitch, ActiveSessionDelaysSwitch)
+{
+    // The speakers' session stops at 1 s and their meter goes quiet at 1.4 s, so the first idle window opens there
+    AudioBackend* pBackend = createTestBackend("render=2,session_toggle_ms=1000");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, {}, output) == S_OK);
+    IdleTestClock::time_point start = IdleTestClock::now();
+    EXPECT(runTestCommand(pBackend, { L"--when-idle", L"200", L"--timeout", L"3000", L"2" }, output) == S_OK);
+    EXPECT(IdleTestClock::now() - start >= std::chrono::milliseconds(1200));
+    EXPECT(contains(output, L" ms (activity seen 1 times)\n"));
+    EXPECT(renderDefault(pBackend) == renderDeviceID(pBackend, 2));
+    releaseAudioBackend(pBackend);
+}
@@ -0,0 +1,62 @@
+// ----------------------------------------------------------------------------
+// MannWhitneyTests.cpp
+// The U statistic, tie correction and p values BenchmarkBaseline compares
+// benchmark timings with, against values worked out by hand.
+// ----------------------------------------------------------------------------
+
+#include <math.h>
+#include "EndPointTests.h"
+#include "../Benchmarks/MannWhitney.h"
+
+static bool near(double value, double expected)
+{
+    return fabs(value - expected) < 1e-4;
+}
+
+TEST(MannWhitney, CountsPairs)
+{
+    double u = -1;
+    double tieTerm = -1;
+    mannWhitneyU({ 4, 5, 6 }, { 1, 2, 3 }, &u, &tieTerm);
+    EXPECT(u == 9 && tieTerm == 0);
+    mannWhitneyU({ 1, 2, 3 }, { 4, 5, 6 }, &u, &tieTerm);
+    EXPECT(u == 0 && tieTerm == 0);
+
+    // Interleaved: 3 beats 2, 5 beats 2 and 4
+    mannWhitneyU({ 3, 5 }, { 2, 4, 6 }, &u, &tieTerm);
+    EXPECT(u == 3 && tieTerm == 0);
+
+    // (2, 2) pairs count a half each, and the group of three 2s adds 3^3 - 3
+    mannWhitneyU({ 1, 2, 2 }, { 2, 3 }, &u, &tieTerm);
+    EXPECT(u == 1 && tieTerm == 24);
+}
+
+TEST(MannWhitney, CorrectsForTies)
+{
+    // U = 7, with one group of four tied 2s. The tie term shrinks the variance, so the same U is less likely.
+    double u = -1;
+    double tieTerm = -1;
+    mannWhitneyU({ 2, 2, 3 }, { 1, 2, 2 }, &u, &tieTerm);
+    EXPECT(u == 7 && tieTerm == 60);
+    EXPECT(near(mannWhitneyGreater({ 2, 2, 3 }, { 1, 2, 2 }), 0.15085));
+    EXPECT(near(mannWhitneyP(7, 0, 3, 3), 0.19137));
+
+    // Nothing but ties has no variance and never counts as a difference
+    EXPECT(mannWhitneyGreater({ 5, 5, 5 }, { 5, 5, 5 }) == 1.0);
+}
+
+TEST(MannWhitney, GreaterIsOneSided)
+{
+    EXPECT(near(mannWhitneyGreater({ 4, 5, 6 }, { 1, 2, 3 }), 0.04043));
+    EXPECT(near(mannWhitneyGreater({ 1, 2, 3 }, { 4, 5, 6 }), 0.98545));
+}
+
+TEST(MannWhitney, MinimumPBySampleCount)
+{
+    // Two samples a side cannot reach 0.05 however far apart they are; three can
+    EXPECT(near(mannWhitneyMinimumP(2, 2), 0.12264));
+    EXPECT(mannWhitneyMinimumP(2, 2) >= 0.05);
+    EXPECT(mannWhitneyMinimumP(3, 3) < 0.05);
+    EXPECT(mannWhitneyMinimumP(2, 10) < mannWhitneyMinimumP(2, 2));
+    EXPECT(mannWhitneyMinimumP(1, 0) == 1.0);
+}
@@ -0,0 +1,164 @@
+// ----------------------------------------------------------------------------
+// MeterTests.cpp
+// The single-producer, single-consumer ring the --meter sampler writes into,
+// and the binary log it produces on the simulated backend.
+// ----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <wchar.h>
+#include <thread>
+#include "EndPointTests.h"
+#include "../EndPointController/Output.h"
+#include "../EndPointController/SampleRing.h"
+
+TEST(Meter, RingDropsWhenFull)
+{
+    // Rounded up to 8
+    SampleRing<int> ring(5);
+    for (int i = 0; i < 8; i++)
+    {
+        EXPECT(ring.push(i));
+    }
+    EXPECT(!ring.push(8));
+    EXPECT(!ring.push(9));
+    EXPECT(ring.getDropped() == 2);
+
+    // The dropped items are the new ones; what was queued comes out in order
+    int item = -1;
+    for (int i = 0; i < 8; i++)
+    {
+        EXPECT(ring.pop(item) && item == i);
+    }
+    EXPECT(!ring.pop(item));
+
+    EXPECT(ring.push(10));
+    EXPECT(ring.pop(item) && item == 10);
+    EXPECT(ring.getDropped() == 2);
+}
+
+TEST(Meter, RingWrapsAround)
+{
+    // Uneven batches put the positions at every offset of the storage, many times over
+    SampleRing<int> ring(4);
+    int next = 0;
+    int expected = 0;
+    for (int round = 0; round < 1000; round++)
+    {
+        int batch = 1 + round % 4;
+        for (int i = 0; i < batch; i++)
+        {
+            EXPECT(ring.push(next++));
+        }
+        int item = -1;
+        for (int i = 0; i < batch; i++)
+        {
+            EXPECT(ring.pop(item) && item == expected++);
+        }
+        EXPECT(!ring.pop(item));
+    }
+    EXPECT(ring.getDropped() == 0);
+}
+
+TEST(Meter, RingAcrossThreads)
+{
+    // Every item is either received, in order, or counted as dropped
+    const uint32_t count = 1000000;
+    SampleRing<uint32_t> ring(64);
+    std::thread producer([&]
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            ring.push(i);
+        }
+    });
+
+    uint64_t received = 0;
+    uint32_t last = 0;
+    bool ordered = true;
+    for (;;)
+    {
+        uint32_t item;
+        if (ring.pop(item))
+        {
+            ordered &= received == 0 || item > last;
+            last = item;
+            received++;
+            if (item == count - 1)
+                break;
+        }
+        else if (received + ring.getDropped() >= count)
+        {
+            break;
+        }
+    }
+    producer.join();
+
+    uint32_t item;
+    while (ring.pop(item))
+    {
+        ordered &= item > last;
+        last = item;
+        received++;
+    }
+    EXPECT(ordered);
+    EXPECT(received + ring.getDropped() == count);
+}
+
+static uint32_t readLittleEndian(const std::string& buffer, size_t& pos, int bytes)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < bytes && pos < buffer.size(); i++, pos++)
+    {
+        value |= (uint32_t)(unsigned char)buffer[pos] << (8 * i);
+    }
+    return value;
+}
+
+TEST(Meter, LogRoundTrip)
+{
+    AudioBackend* pBackend = createTestBackend("render=2,capture=1");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, { L"--meter", L"--meter-rate", L"200", L"--meter-log", L"meter.bin", L"--timeout", L"300" },
+        output) == S_OK);
+    unsigned long long logged = 0;
+    size_t loggedPos = output.find(L"Logged ");
+    EXPECT(loggedPos != std::wstring::npos && swscanf(output.c_str() + loggedPos, L"Logged %llu samples", &logged) == 1);
+
+    std::string log = readWholeFile("meter.bin");
+    EXPECT(log.compare(0, 4, "EPCM") == 0);
+    size_t pos = 4;
+    EXPECT(readLittleEndian(log, pos, 4) == 1);
+    EXPECT(readLittleEndian(log, pos, 4) == 200);
+    uint32_t deviceCount = readLittleEndian(log, pos, 4);
+    EXPECT(deviceCount == 2);
+
+    DeviceTable devices;
+    EXPECT(SUCCEEDED(pBackend->enumerateDevices(eRender, DEVICE_STATE_ACTIVE, devices)));
+    for (uint32_t i = 0; i < deviceCount && i < devices.size(); i++)
+    {
+        size_t length = readLittleEndian(log, pos, 2);
+        std::wstring id;
+        appendFromUtf8(id, log.c_str() + pos, length < log.size() - pos ? length : log.size() - pos);
+        pos += length;
+        EXPECT(id == devices[i].id);
+    }
+
+    // 8-byte records: tick, device number, peak. The simulated tones stay between 0.1 and 0.4 of full scale for
+    // well over the run, and every tick samples each device once.
+    EXPECT(pos <= log.size() && (log.size() - pos) % 8 == 0);
+    EXPECT((log.size() - pos) / 8 == logged);
+    EXPECT(logged >= 2 * 20);
+    std::vector<long long> lastTicks(deviceCount > 0 ? deviceCount : 1, -1);
+    bool valid = true;
+    while (pos + 8 <= log.size())
+    {
+        uint32_t tick = readLittleEndian(log, pos, 4);
+        uint32_t device = readLittleEndian(log, pos, 2);
+        uint32_t peak = readLittleEndian(log, pos, 2);
+        valid &= device < deviceCount && (long long)tick > lastTicks[device < deviceCount ? device : 0];
+        valid &= peak >= 6553 && peak <= 26215;
+        lastTicks[device < deviceCount ? device : 0] = tick;
+    }
+    EXPECT(valid);
+    releaseAudioBackend(pBackend);
+}
@@ -0,0 +1,120 @@
+// ----------------------------------------------------------------------------
+// SwitchSchedulerTests.cpp
+// The resident process's switch rate limiting over the simulated backend:
+// merging within the window, dropping switches to the current default,
+// spacing calls by the interval, and keeping failures for --switch-status.
+// ----------------------------------------------------------------------------
+
+#include <chrono>
+#include <thread>
+#include "EndPointTests.h"
+#include "../EndPointController/Output.h"
+#include "../EndPointController/SwitchScheduler.h"
+
+static std::wstring renderDevice(AudioBackend* pBackend, size_t index)
+{
+    DeviceTable devices;
+    EXPECT(SUCCEEDED(pBackend->enumerateDevices(eRender, DEVICE_STATE_ACTIVE, devices)));
+    return index < devices.size() ? devices[index].id : std::wstring();
+}
+
+static std::wstring renderDefault(AudioBackend* pBackend)
+{
+    std::wstring deviceID;
+    EXPECT(SUCCEEDED(pBackend->getDefaultDeviceID(eRender, eConsole, deviceID)));
+    return deviceID;
+}
+
+static bool statsAre(const TSwitchStats& stats, unsigned long long requests, unsigned long long calls,
+    unsigned long long merged, unsigned long long dropped, unsigned long long failed)
+{
+    return stats.requests == requests && stats.calls == calls && stats.merged == merged && stats.dropped == dropped &&
+           stats.failed == failed;
+}
+
+TEST(SwitchScheduler, MergesWithinWindow)
+{
+    AudioBackend* pBackend = createTestBackend("render=3");
+    std::wstring first = renderDevice(pBackend, 0);
+    std::wstring second = renderDevice(pBackend, 1);
+    std::wstring third = renderDevice(pBackend, 2);
+    SwitchScheduler scheduler(pBackend, 50, 1000);
+    EXPECT(scheduler.getWaitMs() == -1);
+
+    // The second request replaces the first; the queued device already reads as the default
+    EXPECT(scheduler.setDefaultEndpoint(second.c_str(), eConsole) == S_OK);
+    EXPECT(scheduler.setDefaultEndpoint(third.c_str(), eConsole) == S_OK);
+    EXPECT(statsAre(scheduler.getStats(), 2, 0, 1, 0, 0));
+    EXPECT(renderDefault(&scheduler) == third);
+    EXPECT(renderDefault(pBackend) == first);
+    int waitMs = scheduler.getWaitMs();
+    EXPECT(waitMs > 0 && waitMs <= 50);
+
+    // Nothing is sent before the window closes, and one call after it
+    scheduler.flush(false);
+    EXPECT(scheduler.getStats().calls == 0);
+    while (scheduler.getWaitMs() > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(scheduler.getWaitMs()));
+    }
+    scheduler.flush(false);
+    EXPECT(statsAre(scheduler.getStats(), 2, 1, 1, 0, 0));
+    EXPECT(renderDefault(pBackend) == third);
+    EXPECT(scheduler.getWaitMs() == -1);
+    releaseAudioBackend(pBackend);
+}
+
+TEST(SwitchScheduler, DropsAndSpacesCalls)
+{
+    AudioBackend* pBackend = createTestBackend("render=3");
+    std::wstring first = renderDevice(pBackend, 0);
+    std::wstring second = renderDevice(pBackend, 1);
+    SwitchScheduler scheduler(pBackend, 10, 1000);
+
+    // A switch to the current default makes no call
+    EXPECT(scheduler.setDefaultEndpoint(first.c_str(), eConsole) == S_OK);
+    scheduler.flush(true);
+    EXPECT(statsAre(scheduler.getStats(), 1, 0, 0, 1, 0));
+
+    EXPECT(scheduler.setDefaultEndpoint(second.c_str(), eConsole) == S_OK);
+    scheduler.flush(true);
+    EXPECT(statsAre(scheduler.getStats(), 2, 1, 0, 1, 0));
+
+    // The next switch of the role waits out the interval since that call, not just the window; other roles
+    // and the other data flow have their own
+    EXPECT(scheduler.setDefaultEndpoint(first.c_str(), eConsole) == S_OK);
+    EXPECT(scheduler.getWaitMs() > 500);
+    scheduler.flush(false);
+    EXPECT(scheduler.getStats().calls == 1);
+    EXPECT(scheduler.setDefaultEndpoint(second.c_str(), eMultimedia) == S_OK);
+    EXPECT(scheduler.getWaitMs() <= 10);
+
+    scheduler.flush(true);
+    EXPECT(statsAre(scheduler.getStats(), 4, 3, 0, 1, 0));
+    EXPECT(renderDefault(pBackend) == first);
+    releaseAudioBackend(pBackend);
+}
+
+TEST(SwitchScheduler, KeepsLastFailure)
+{
+    AudioBackend* pBackend = createTestBackend("render=3");
+    std::wstring third = renderDevice(pBackend, 2);
+    SwitchScheduler scheduler(pBackend, 10, 100);
+    std::wstring description;
+    EXPECT(scheduler.takeLastFailure(description) == S_OK && description.empty());
+
+    // The device is disabled after the switch was queued, so the call itself fails
+    EXPECT(scheduler.setDefaultEndpoint(third.c_str(), eConsole) == S_OK);
+    EXPECT(SUCCEEDED(pBackend->setEndpointVisibility(third.c_str(), false)));
+    std::wstring output;
+    beginOutputCapture(&output);
+    scheduler.flush(true);
+    endOutputCapture();
+    EXPECT(statsAre(scheduler.getStats(), 1, 1, 0, 0, 1));
+
+    std::wstring expected = L"Switching the render console device to " + third + L" failed (0x80070057)";
+    EXPECT(output == expected + L"\n");
+    EXPECT(scheduler.takeLastFailure(description) == E_INVALIDARG && description == expected);
+    EXPECT(scheduler.takeLastFailure(description) == S_OK && description.empty());
+    releaseAudioBackend(pBackend);
+}
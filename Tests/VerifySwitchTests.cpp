@@ -0,0 +1,69 @@
+// ----------------------------------------------------------------------------
+// VerifySwitchTests.cpp
+// --verify against the simulated backend's injected notification latency.
+// ----------------------------------------------------------------------------
+
+#include <wchar.h>
+#include "EndPointTests.h"
+
+// The latencies --verify printed for each role, in the order printed
+static std::vector<double> reportedLatencies(const std::wstring& output)
+{
+    std::vector<double> latencies;
+    for (size_t pos = output.find(L"reported after "); pos != std::wstring::npos; pos = output.find(L"reported after ", pos + 1))
+    {
+        double latency = -1;
+        swscanf(output.c_str() + pos, L"reported after %lf ms", &latency);
+        latencies.push_back(latency);
+    }
+    return latencies;
+}
+
+TEST(VerifySwitch, ReportsInjectedLatency)
+{
+    AudioBackend* pBackend = createTestBackend("render=3,capture=2,notify_delay_ms=30");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, {}, output) == S_OK);
+    EXPECT(runTestCommand(pBackend, { L"2", L"--verify" }, output) == S_OK);
+    EXPECT(contains(output, L"Propagation latency: "));
+
+    std::vector<double> latencies = reportedLatencies(output);
+    EXPECT(latencies.size() == 1);
+    for (double latency : latencies)
+    {
+        EXPECT(latency >= 30);
+    }
+
+    // A capture switch waits for all three roles
+    EXPECT(runTestCommand(pBackend, { L"--input" }, output) == S_OK);
+    EXPECT(runTestCommand(pBackend, { L"--input", L"2", L"--verify" }, output) == S_OK);
+    latencies = reportedLatencies(output);
+    EXPECT(latencies.size() == 3);
+    for (double latency : latencies)
+    {
+        EXPECT(latency >= 30);
+    }
+    releaseAudioBackend(pBackend);
+}
+
+TEST(VerifySwitch, TimesOutWithoutNotification)
+{
+    // The notification comes long after --verify stops waiting for it
+    AudioBackend* pBackend = createTestBackend("render=3,notify_delay_ms=2000");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, {}, output) == S_OK);
+    EXPECT(runTestCommand(pBackend, { L"3", L"--verify", L"--timeout", L"50" }, output) == HRESULT_FROM_WIN32(ERROR_TIMEOUT));
+    EXPECT(contains(output, L"Default change (console) not reported within 50 ms\n"));
+    EXPECT(!contains(output, L"Propagation latency"));
+    releaseAudioBackend(pBackend);
+}
+
+TEST(VerifySwitch, SkipsCurrentDefault)
+{
+    AudioBackend* pBackend = createTestBackend("render=2,notify_delay_ms=2000");
+    std::wstring output;
+    EXPECT(runTestCommand(pBackend, {}, output) == S_OK);
+    EXPECT(runTestCommand(pBackend, { L"1", L"--verify", L"--timeout", L"50" }, output) == S_OK);
+    EXPECT(output == L"Device is already the default, no change to verify\n");
+    releaseAudioBackend(pBackend);
+}